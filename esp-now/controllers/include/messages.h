@@ -1,7 +1,10 @@
 #ifndef MESSAGES_H
 #define MESSAGES_H
 
-#include "Arduino.h"
+// Kept free of Arduino includes so the host tools share the same registry
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 const uint8_t BROADCAST_ADDR[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 
@@ -13,31 +16,362 @@ enum DevType : uint8_t
 
 enum class MessageType : uint8_t
 {
-  RearCam_MoveTo
+  RearCam_MoveTo,
+  RearCam_Telemetry,
+  Hub_TelemetryAck,
+  Rpc_Reply,
+  Time_Request,
+  Time_Reply,
+  Ota_Begin,
+  Ota_Chunk,
+  Ota_Poll,
+  Ota_Status,
+  Ota_End,
+  RearCam_Jog,
+  RearCam_Script,
+  RearCam_Preset,
+  RearCam_Recall,
 };
 
-inline String MessageTypeToString(MessageType t)
+inline const char *MessageTypeToString(MessageType t)
 {
   switch (t)
   {
   case MessageType::RearCam_MoveTo:
     return "RearCam_MoveTo";
+  case MessageType::RearCam_Telemetry:
+    return "RearCam_Telemetry";
+  case MessageType::Hub_TelemetryAck:
+    return "Hub_TelemetryAck";
+  case MessageType::Rpc_Reply:
+    return "Rpc_Reply";
+  case MessageType::Time_Request:
+    return "Time_Request";
+  case MessageType::Time_Reply:
+    return "Time_Reply";
+  case MessageType::Ota_Begin:
+    return "Ota_Begin";
+  case MessageType::Ota_Chunk:
+    return "Ota_Chunk";
+  case MessageType::Ota_Poll:
+    return "Ota_Poll";
+  case MessageType::Ota_Status:
+    return "Ota_Status";
+  case MessageType::Ota_End:
+    return "Ota_End";
+  case MessageType::RearCam_Jog:
+    return "RearCam_Jog";
+  case MessageType::RearCam_Script:
+    return "RearCam_Script";
+  case MessageType::RearCam_Preset:
+    return "RearCam_Preset";
+  case MessageType::RearCam_Recall:
+    return "RearCam_Recall";
   default:
     return "UNKNOWN";
   };
 }
 
+// Multicast addressing, see Header::to. Bits 0-15 are single nodes by their
+// DEVICE_INDEX, bits 16-31 are groups nodes join with DEVICE_GROUPS.
+#define ADDR_MAX_NODES 16
+#define ADDR_NODE(i) ((uint32_t)1 << (i))
+#define ADDR_GROUP(g) ((uint32_t)1 << (16 + (g)))
+
+enum Group : uint8_t
+{
+  GROUP_CAMERAS,
+};
+
+// Set on a call to also get an "accepted" reply, not just "completed"
+#define MSG_FLAG_WANT_ACCEPTED 0x01
+// The message carries an executeAtUs in hub time, see clockSync.h
+#define MSG_FLAG_TIMED 0x02
+
 struct Header
 {
   DevType src;
   DevType dest;
   MessageType msgType;
+  uint8_t flags = 0;
+  // Non zero makes the message a call, answered with Rpc_Reply. Calls from
+  // the hub's serial bridge host have the top bit set.
+  uint16_t corrId = 0;
+
+  // Filled in by radioSend(), relays key their duplicate cache on these.
+  // origin is the low two bytes of the sender's MAC.
+  uint16_t origin = 0;
+  uint16_t seq = 0;
+  // Hops left and hops taken, see relay.h
+  uint8_t ttl = 0;
+  uint8_t hops = 0;
+
+  // Non zero makes the frame multicast, for every node whose accept mask
+  // shares a bit with it, and dest is ignored. Zero addresses by dest.
+  uint32_t to = 0;
 };
 
+// Receive filter, cheap enough for the radio callback: reads only Header::to
+// out of the frame and ANDs it with the node's mask. False means the frame
+// is multicast and not for us.
+inline bool addressedTo(const uint8_t *frame, uint32_t acceptMask)
+{
+  uint32_t to;
+  memcpy(&to, frame + offsetof(Header, to), sizeof(to));
+  return to == 0 || (to & acceptMask) != 0;
+}
+
 struct RearCam_MoveTo : Header
 {
   uint8_t pos;
-  MessageType msgType = MessageType::RearCam_MoveTo;
+  // Low 32 bits of the hub's clock, only with MSG_FLAG_TIMED
+  uint32_t executeAtUs = 0;
+
+  RearCam_MoveTo() { msgType = MessageType::RearCam_MoveTo; }
+};
+
+// One sample of a streamed move for manual aiming, sent at 20-50 Hz. The
+// camera plays the stream back a little behind to ride out radio jitter,
+// see jitterBuffer.h.
+struct RearCam_Jog : Header
+{
+  // A new value starts a new stream
+  uint8_t stream;
+  // 1/256 degree
+  uint16_t pos;
+  // Sender's own clock when pos was sampled, low 32 bits of microseconds.
+  // Needs no clock sync, only the spacing of the samples matters.
+  uint32_t sampleUs;
+
+  RearCam_Jog() { msgType = MessageType::RearCam_Jog; }
+};
+
+// Motion scripts, see motionScript.h. A script of up to SCRIPT_MAX_CODE
+// bytes takes one or two frames, only the used part of code is sent.
+#define SCRIPT_MAX_CODE 256
+#define SCRIPT_PART_CODE 220
+// Stored scripts a camera keeps in flash
+#define SCRIPT_SLOTS 4
+
+enum ScriptAction : uint8_t
+{
+  // Runs the code sent
+  SCRIPT_RUN,
+  // Keeps the code sent in slot
+  SCRIPT_STORE,
+  // Runs what was stored in slot, no code
+  SCRIPT_RUN_STORED,
+  // Stops the running script, no code
+  SCRIPT_STOP,
+};
+
+// A call when corrId is set, answered once the script is taken on and when
+// it ends. Of a script in two parts only the last is the call and carries
+// the timing; every part shares the corrId.
+struct RearCam_Script : Header
+{
+  uint8_t action;
+  uint8_t slot;
+  // Length of the whole script, and where this part goes in it
+  uint16_t total;
+  uint16_t offset;
+  // Low 32 bits of the hub's clock, only with MSG_FLAG_TIMED
+  uint32_t executeAtUs = 0;
+  uint8_t code[SCRIPT_PART_CODE];
+
+  RearCam_Script() { msgType = MessageType::RearCam_Script; }
+};
+
+#define SCRIPT_HEADER_SIZE (sizeof(RearCam_Script) - SCRIPT_PART_CODE)
+
+// Positions a camera keeps in flash under a slot number, so the hub can move
+// it without knowing where "up" is on that camera
+#define PRESET_SLOTS 8
+// What the hub's toggle switch recalls, 0 and 90 degrees until set
+#define PRESET_UP 0
+#define PRESET_DOWN 1
+// Slowest a preset may move, a full sweep in 9 s
+#define PRESET_MAX_MS_PER_DEGREE 50
+
+enum PresetAction : uint8_t
+{
+  PRESET_SET,
+  // Stores where the servo is now, pos is ignored
+  PRESET_SET_HERE,
+  PRESET_CLEAR,
+};
+
+// A call when corrId is set, completed with the position stored
+struct RearCam_Preset : Header
+{
+  uint8_t action;
+  uint8_t slot;
+  uint8_t pos;
+  // ms per degree up to PRESET_MAX_MS_PER_DEGREE, 0 for the camera's usual
+  // rate
+  uint8_t speed;
+
+  RearCam_Preset() { msgType = MessageType::RearCam_Preset; }
+};
+
+// Moves to what is stored in slot, answered like RearCam_MoveTo. Rejected if
+// the slot is empty.
+struct RearCam_Recall : Header
+{
+  uint8_t slot;
+  // Low 32 bits of the hub's clock, only with MSG_FLAG_TIMED
+  uint32_t executeAtUs = 0;
+
+  RearCam_Recall() { msgType = MessageType::RearCam_Recall; }
+};
+
+#define TELEMETRY_MAX_DATA 48
+
+// State report, see telemetry.h. Only the used part of data is sent.
+struct RearCam_Telemetry : Header
+{
+  uint8_t fields;
+  // Random per boot, a new value tells the hub the node rebooted
+  uint16_t bootId;
+  // The reporter's own numbering, apart from Header::seq which the radio
+  // stamps on every frame
+  uint16_t telemetrySeq;
+  // Frame the data is a delta against, 0 for a full frame
+  uint16_t baseSeq;
+  uint8_t data[TELEMETRY_MAX_DATA];
+
+  RearCam_Telemetry() { msgType = MessageType::RearCam_Telemetry; }
+};
+
+#define TELEMETRY_HEADER_SIZE (sizeof(RearCam_Telemetry) - TELEMETRY_MAX_DATA)
+
+// The hub could not apply the frame, the next one has to be a full frame
+#define TELEMETRY_ACK_RESYNC 0x01
+
+struct Hub_TelemetryAck : Header
+{
+  // TELEMETRY_ACK_ bits, apart from Header::flags
+  uint8_t ackFlags;
+  uint16_t bootId;
+  // telemetrySeq of the frame acknowledged, apart from Header::seq
+  uint16_t ackSeq;
+
+  Hub_TelemetryAck() { msgType = MessageType::Hub_TelemetryAck; }
+};
+
+// Clock sync exchange, times are microseconds. The hub's clock is the reference.
+struct Time_Request : Header
+{
+  // Requester's clock when sent
+  int64_t t1;
+
+  Time_Request() { msgType = MessageType::Time_Request; }
+};
+
+struct Time_Reply : Header
+{
+  int64_t t1;
+  // Hub's clock on receiving the request and on answering it
+  int64_t t2;
+  int64_t t3;
+
+  Time_Reply() { msgType = MessageType::Time_Reply; }
+};
+
+enum RpcStage : uint8_t
+{
+  // The receiver took the request on, the work is still going
+  RPC_ACCEPTED = 1,
+  // Final reply, no more replies follow for this corrId
+  RPC_COMPLETED = 2,
+};
+
+enum RpcStatus : uint8_t
+{
+  RPC_OK,
+  RPC_REJECTED,
+  // A newer request took over before this one finished
+  RPC_SUPERSEDED,
+  RPC_UNSUPPORTED,
+  // Never on the wire, the caller gave up waiting
+  RPC_TIMEOUT,
+};
+
+struct Rpc_Reply : Header
+{
+  uint8_t stage;
+  uint8_t status;
+  // Message specific result, e.g. the final position of a move
+  int16_t value;
+
+  Rpc_Reply() { msgType = MessageType::Rpc_Reply; }
+};
+
+// Firmware distribution, see ota.h. Chunk frames are 248 bytes, as close to
+// ESP-NOW's 250 byte limit as the struct's alignment allows.
+#define OTA_CHUNK_DATA 226
+// Chunks the sender streams ahead of the slowest receiver
+#define OTA_WINDOW 64
+
+struct Ota_Begin : Header
+{
+  uint32_t sessionId;
+  uint32_t imageSize;
+  uint16_t chunkCount;
+  uint8_t sha256[32];
+
+  Ota_Begin() { msgType = MessageType::Ota_Begin; }
+};
+
+struct Ota_Chunk : Header
+{
+  uint32_t sessionId;
+  uint16_t index;
+  uint8_t data[OTA_CHUNK_DATA];
+
+  Ota_Chunk() { msgType = MessageType::Ota_Chunk; }
+};
+
+#define OTA_CHUNK_HEADER_SIZE (sizeof(Ota_Chunk) - OTA_CHUNK_DATA)
+
+// Asks every receiver for an Ota_Status
+struct Ota_Poll : Header
+{
+  uint32_t sessionId;
+
+  Ota_Poll() { msgType = MessageType::Ota_Poll; }
+};
+
+enum OtaState : uint8_t
+{
+  OTA_IDLE,
+  // Erasing the partition, chunks can't be taken yet
+  OTA_PREPARING,
+  OTA_RECEIVING,
+  OTA_VERIFYING,
+  // Image verified and set to boot
+  OTA_DONE,
+  OTA_FAILED,
+};
+
+struct Ota_Status : Header
+{
+  uint32_t sessionId;
+  uint8_t state;
+  // Every chunk before base has arrived, bit i of received is chunk base + i
+  uint16_t base;
+  uint8_t received[OTA_WINDOW / 8];
+
+  Ota_Status() { msgType = MessageType::Ota_Status; }
+};
+
+struct Ota_End : Header
+{
+  uint32_t sessionId;
+  // Restart into the new image, otherwise it boots on the next reset
+  uint8_t reboot;
+
+  Ota_End() { msgType = MessageType::Ota_End; }
 };
 
-#endif
\ No newline at end of file
+#endif
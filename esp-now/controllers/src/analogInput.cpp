@@ -0,0 +1,91 @@
+#include "analogInput.h"
+#include <driver/adc.h>
+#include <soc/soc_caps.h>
+
+bool AnalogInput::init(int pin, uint32_t rateHz)
+{
+  int ch = digitalPinToAnalogChannel(pin);
+  if (ch < 0 || ch >= SOC_ADC_CHANNEL_NUM(0))
+  {
+    Serial.printf("GPIO%d has no ADC1 channel\n", pin);
+    return false;
+  }
+  channel = (uint8_t)ch;
+
+  adc_digi_init_config_t initConfig = {};
+  initConfig.max_store_buf_size = FRAMES * FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES;
+  initConfig.conv_num_each_intr = FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES;
+  initConfig.adc1_chan_mask = BIT(channel);
+  initConfig.adc2_chan_mask = 0;
+  if (adc_digi_initialize(&initConfig) != ESP_OK)
+  {
+    Serial.println("ADC DMA init failed");
+    return false;
+  }
+
+  adc_digi_pattern_config_t pattern = {};
+  // The full 0 to 3.3 V of a pot across the supply
+  pattern.atten = ADC_ATTEN_DB_11;
+  pattern.channel = channel;
+  pattern.unit = 0;
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+  adc_digi_configuration_t config = {};
+  config.conv_limit_en = 1;
+  config.conv_limit_num = 250;
+  config.pattern_num = 1;
+  config.adc_pattern = &pattern;
+  config.sample_freq_hz = rateHz;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+  if (adc_digi_controller_configure(&config) != ESP_OK || adc_digi_start() != ESP_OK)
+  {
+    Serial.println("ADC DMA start failed");
+    adc_digi_deinitialize();
+    return false;
+  }
+
+  running = true;
+  return true;
+}
+
+size_t AnalogInput::read(uint16_t *out, size_t max)
+{
+  if (!running)
+  {
+    return 0;
+  }
+
+  uint8_t buf[FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES];
+  size_t n = 0;
+  while (n + FRAME_SAMPLES <= max)
+  {
+    uint32_t len = 0;
+    esp_err_t err = adc_digi_read_bytes(buf, sizeof(buf), &len, 0);
+    if (err == ESP_ERR_INVALID_STATE)
+    {
+      // The driver's buffer filled and dropped samples, what it has is fine
+      overruns++;
+    }
+    else if (err != ESP_OK)
+    {
+      break;
+    }
+    if (len == 0)
+    {
+      break;
+    }
+    frames++;
+
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len; i += SOC_ADC_DIGI_RESULT_BYTES)
+    {
+      const adc_digi_output_data_t *d = (const adc_digi_output_data_t *)&buf[i];
+      // ADC2 results can turn up on the C3 even with no ADC2 channel set
+      if (d->type2.unit == 0 && d->type2.channel == channel)
+      {
+        out[n++] = d->type2.data;
+      }
+    }
+  }
+  return n;
+}
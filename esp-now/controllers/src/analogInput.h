@@ -0,0 +1,38 @@
+#ifndef ANALOG_INPUT_H
+#define ANALOG_INPUT_H
+
+// One ADC1 pin sampled continuously by the ADC's DMA. The hardware converts
+// at a fixed rate into a ring of frames without the CPU, and read() takes
+// whatever frames have completed since the last call; the CPU only works
+// once per frame, not once per sample.
+//
+// Uses the ESP-IDF 4.4 adc_digi API that Arduino-ESP32 2.x is built on.
+// Only ADC1 (GPIO0 to GPIO4 on the C3), ADC2 has no working DMA there.
+
+#include <Arduino.h>
+
+class AnalogInput
+{
+public:
+  // Samples per DMA frame, one frame is FRAME_SAMPLES / rate seconds
+  static const size_t FRAME_SAMPLES = 8;
+  // Frames the driver buffers before it drops samples
+  static const size_t FRAMES = 16;
+
+  // Starts sampling pin at rateHz. False if the pin has no ADC1 channel or
+  // the driver refused.
+  bool init(int pin, uint32_t rateHz);
+  // Up to max 12 bit samples, oldest first, without waiting. 0 if none.
+  size_t read(uint16_t *out, size_t max);
+
+  // DMA frames taken, and times the driver's buffer had filled up because
+  // read() wasn't called often enough
+  uint32_t frames = 0;
+  uint32_t overruns = 0;
+
+private:
+  bool running = false;
+  uint8_t channel;
+};
+
+#endif
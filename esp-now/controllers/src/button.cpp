@@ -1,10 +1,11 @@
 #include "button.h"
 #include <Arduino.h>
 
-void Button::init(int pin, int debounceMs, std::function<void()> onPressCallback, std::function<void()> onReleaseCallback)
+void Button::init(int pin, int debounceMs, TimerWheel &timers, std::function<void()> onPressCallback, std::function<void()> onReleaseCallback)
 {
   this->pin = pin;
   this->debounceMs = debounceMs;
+  this->timers = &timers;
   this->onPressCallback = onPressCallback;
   this->onReleaseCallback = onReleaseCallback;
 
@@ -14,8 +15,8 @@ void Button::init(int pin, int debounceMs, std::function<void()> onPressCallback
   // Initialize state variables
   this->currentState = HIGH; // Pull-up means HIGH when not pressed
   this->lastState = HIGH;
-  this->lastDebounceTime = 0;
   this->buttonPressed = false;
+  this->debounceTimer = TimerWheel::NONE;
 }
 
 void Button::update()
@@ -26,39 +27,51 @@ void Button::update()
   // Check if the button state has changed
   if (reading != lastState)
   {
-    // Reset the debounce timer
-    lastDebounceTime = millis();
+    // Reset the debounce timer, it fires once the reading has held still
+    // for longer than debounceMs
+    timers->cancel(debounceTimer);
+    debounceTimer = timers->start(debounceMs + 1, onSettled, this);
   }
 
-  // Check if enough time has passed since the last state change
-  if ((millis() - lastDebounceTime) > debounceMs)
+  // Save the current reading for next iteration
+  lastState = reading;
+
+  // Without a timer the change would wait for the next edge, take it now
+  if (reading != currentState && debounceTimer == TimerWheel::NONE)
   {
-    // If the button state has changed after debounce period
-    if (reading != currentState)
-    {
-      currentState = reading;
+    undebounced++;
+    onSettled(this, 0);
+  }
+}
 
-      // Button is pressed when it goes from HIGH to LOW (pull-up configuration)
-      if (currentState == LOW && !buttonPressed)
-      {
-        buttonPressed = true;
-        if (onPressCallback)
-        {
-          onPressCallback();
-        }
-      }
-      // Button is released when it goes from LOW to HIGH
-      else if (currentState == HIGH && buttonPressed)
-      {
-        buttonPressed = false;
-        if (onReleaseCallback)
-        {
-          onReleaseCallback();
-        }
-      }
-    }
+void Button::onSettled(void *owner, uint32_t tag)
+{
+  Button &b = *(Button *)owner;
+  b.debounceTimer = TimerWheel::NONE;
+
+  // If the button state has changed after debounce period
+  if (b.lastState == b.currentState)
+  {
+    return;
   }
+  b.currentState = b.lastState;
 
-  // Save the current reading for next iteration
-  lastState = reading;
-}
\ No newline at end of file
+  // Button is pressed when it goes from HIGH to LOW (pull-up configuration)
+  if (b.currentState == LOW && !b.buttonPressed)
+  {
+    b.buttonPressed = true;
+    if (b.onPressCallback)
+    {
+      b.onPressCallback();
+    }
+  }
+  // Button is released when it goes from LOW to HIGH
+  else if (b.currentState == HIGH && b.buttonPressed)
+  {
+    b.buttonPressed = false;
+    if (b.onReleaseCallback)
+    {
+      b.onReleaseCallback();
+    }
+  }
+}
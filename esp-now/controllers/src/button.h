@@ -2,6 +2,7 @@
 #define BUTTON_H
 
 #include <functional>
+#include "timerWheel.h"
 
 class Button
 {
@@ -14,12 +15,21 @@ private:
   int debounceMs;
   int currentState;
   int lastState;
-  unsigned long lastDebounceTime;
   bool buttonPressed;
 
+  // Restarted on every change of the reading, the state is taken once it
+  // runs out
+  TimerWheel *timers;
+  uint32_t debounceTimer;
+
+  static void onSettled(void *owner, uint32_t tag);
+
 public:
-  void init(int pin, int debounceMs, std::function<void()> onPressCallback, std::function<void()> onReleaseCallback);
+  // Changes taken without debouncing because the wheel had no timer free
+  uint32_t undebounced = 0;
+
+  void init(int pin, int debounceMs, TimerWheel &timers, std::function<void()> onPressCallback, std::function<void()> onReleaseCallback);
   void update();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,49 +1,118 @@
 #include <cameraServo.h>
 #include <ESP32Servo.h>
 #include <Preferences.h>
+#include "allocStats.h"
 
 #define RW_MODE false
 #define RO_MODE true
 #define NVS_NAMESPACE "rearCamera"
 
+#define MIN_POS 0
+#define MAX_POS 180
+// ESP32Servo's defaults, spelled out to map 1/256 degree to pulse widths
+#define MIN_PULSE_US 544
+#define MAX_PULSE_US 2400
+
 void CameraServo::init(int pin)
 {
   s.setPeriodHertz(50); // Standard 50 Hz servo frequency
-  s.attach(pin);
+  s.attach(pin, MIN_PULSE_US, MAX_PULSE_US);
 
   // Load the last saved position from NVS
   loadPosition();
+  target = pos;
+  lastStepMs = 0;
 
   // Ensure we are at the correct position
   s.write(pos);
 }
 
-void CameraServo::moveSlowlyTo(int newPos)
+void CameraServo::moveTo(int newPos, unsigned long newStepMs)
+{
+  endJog();
+  target = constrain(newPos, MIN_POS, MAX_POS);
+  stepMs = newStepMs;
+}
+
+void CameraServo::jogTo(int32_t posQ8)
+{
+  if (!jogging)
+  {
+    jogging = true;
+    jogPos = pos * 256;
+    lastStepMs = millis();
+  }
+
+  // Never faster than a move would go, a burst of samples after a gap
+  // shouldn't slam the camera over
+  unsigned long now = millis();
+  int32_t maxStep = (int32_t)((now - lastStepMs) * 256 / STEP_INTERVAL_MS);
+  lastStepMs = now;
+  posQ8 = constrain(posQ8, MIN_POS * 256, MAX_POS * 256);
+  jogPos += constrain(posQ8 - jogPos, -maxStep, maxStep);
+
+  // The pulse width directly, write() only takes whole degrees
+  s.writeMicroseconds(MIN_PULSE_US + (int)((int64_t)jogPos * (MAX_PULSE_US - MIN_PULSE_US) / (MAX_POS * 256)));
+  pos = (jogPos + 128) / 256;
+  target = pos;
+}
+
+void CameraServo::endJog()
+{
+  if (!jogging)
+  {
+    return;
+  }
+  jogging = false;
+  target = pos;
+  s.write(pos);
+  savePosition();
+}
+
+void CameraServo::stop()
 {
-  // Only save if the position actually changes
-  if (pos != newPos)
+  endJog();
+  if (pos != target)
   {
-    while (pos != newPos)
-    {
-      if (pos < newPos)
-      {
-        pos += 1;
-      }
-      if (pos > newPos)
-      {
-        pos -= 1;
-      }
-      s.write(pos);
-      delay(10);
-    }
-
-    // Save the final position to NVS only once after movement is complete
+    target = pos;
     savePosition();
   }
 }
 
+bool CameraServo::update()
+{
+  if (jogging || pos == target)
+  {
+    return false;
+  }
+
+  unsigned long now = millis();
+  if (now - lastStepMs < stepMs)
+  {
+    return false;
+  }
+  lastStepMs = now;
+
+  pos += (pos < target) ? 1 : -1;
+  s.write(pos);
+
+  // Save the final position to NVS only once after movement is complete
+  if (pos == target)
+  {
+    savePosition();
+  }
+
+  return true;
+}
+
+bool CameraServo::isMoving()
+{
+  return jogging || pos != target;
+}
+
 void CameraServo::savePosition()
 {
+  AllocScope scope(allocNvs);
   Preferences preferences;
   preferences.begin(NVS_NAMESPACE, RW_MODE);
   preferences.putInt("servoPos", pos);
@@ -52,6 +121,7 @@ void CameraServo::savePosition()
 
 void CameraServo::loadPosition()
 {
+  AllocScope scope(allocNvs);
   Preferences preferences;
   preferences.begin(NVS_NAMESPACE, RO_MODE);
   pos = preferences.getInt("servoPos", 0);
@@ -61,4 +131,9 @@ void CameraServo::loadPosition()
 int CameraServo::getCurrentPosition()
 {
   return pos;
-}
\ No newline at end of file
+}
+
+int CameraServo::getTarget()
+{
+  return target;
+}
@@ -5,16 +5,41 @@
 
 class CameraServo
 {
+public:
+    // Time between 1 degree steps, sets the slew rate of the camera
+    static const unsigned long STEP_INTERVAL_MS = 10;
+
 private:
     Servo s;
     int pos;
+    int target;
+    unsigned long lastStepMs;
+    unsigned long stepMs = STEP_INTERVAL_MS;
+    // Following a jog stream, in 1/256 degree
+    bool jogging = false;
+    int32_t jogPos;
     void savePosition();
     void loadPosition();
 
 public:
     void init(int pin);
-    void moveSlowlyTo(int newPos);
+    // Sets a new target, the servo walks towards it from update() one
+    // degree every stepMs
+    void moveTo(int newPos, unsigned long stepMs = STEP_INTERVAL_MS);
+    // Holds the current position, abandoning the target
+    void stop();
+    // Steps the servo if one is due, returns true if the servo was written
+    bool update();
+    // Puts the servo straight at posQ8, 1/256 degree, for a streamed move.
+    // Steps are limited to the slew rate. Call every tick while the stream
+    // plays, then endJog().
+    void jogTo(int32_t posQ8);
+    // Stays where the jog left off and saves it
+    void endJog();
+    bool isJogging() { return jogging; }
+    bool isMoving();
     int getCurrentPosition();
+    int getTarget();
 };
 
-#endif // CAMERASERVO_H
\ No newline at end of file
+#endif // CAMERASERVO_H
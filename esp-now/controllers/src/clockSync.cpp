@@ -0,0 +1,139 @@
+#include "clockSync.h"
+
+bool ClockSync::requestDue(int64_t localUs) const
+{
+  if (!requested)
+  {
+    return true;
+  }
+  uint32_t interval = count < WINDOW / 2 ? FAST_INTERVAL_US : INTERVAL_US;
+  return localUs - lastRequestUs >= interval;
+}
+
+int64_t ClockSync::predictOffset(int64_t localUs) const
+{
+  return offset + (localUs - refUs) * drift / 1000000000;
+}
+
+int64_t ClockSync::toHub(int64_t localUs) const
+{
+  return localUs + predictOffset(localUs);
+}
+
+int64_t ClockSync::toLocal(int64_t hubUs) const
+{
+  // The drift term changes so slowly that evaluating it at the hub time
+  // instead of the local one is off by well under a microsecond
+  return hubUs - predictOffset(hubUs - offset);
+}
+
+void ClockSync::addSample(int64_t t1, int64_t t2, int64_t t3, int64_t t4)
+{
+  int64_t delay = (t4 - t1) - (t3 - t2);
+  if (delay < 0 || delay > MAX_DELAY_US)
+  {
+    rejected++;
+    return;
+  }
+
+  Sample s;
+  s.localUs = t1 + (t4 - t1) / 2;
+  s.offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+  s.delayUs = (uint32_t)delay;
+
+  // Score the current estimate against the sample before it's folded in
+  uint32_t minDelay = s.delayUs;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (samples[i].delayUs < minDelay)
+    {
+      minDelay = samples[i].delayUs;
+    }
+  }
+  if (synced() && s.delayUs <= minDelay + DELAY_SLACK_US)
+  {
+    int64_t diff = s.offsetUs - predictOffset(s.localUs);
+    uint32_t residual = (uint32_t)(diff < 0 ? -diff : diff);
+    error = (error * 3 + residual) / 4;
+  }
+
+  samples[next] = s;
+  next = (next + 1) % WINDOW;
+  if (count < WINDOW)
+  {
+    count++;
+  }
+  refit();
+}
+
+void ClockSync::refit()
+{
+  uint32_t minDelay = UINT32_MAX;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (samples[i].delayUs < minDelay)
+    {
+      minDelay = samples[i].delayUs;
+    }
+  }
+
+  // Fit relative to the newest trusted sample to keep the numbers small
+  const Sample *newest = nullptr;
+  good = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    const Sample &s = samples[i];
+    if (s.delayUs <= minDelay + DELAY_SLACK_US)
+    {
+      good++;
+      if (!newest || s.localUs > newest->localUs)
+      {
+        newest = &s;
+      }
+    }
+  }
+  if (!newest)
+  {
+    return;
+  }
+
+  // Least squares over the trusted samples. Doubles are soft float on the
+  // C3, but this only runs once per sample.
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    const Sample &s = samples[i];
+    if (s.delayUs > minDelay + DELAY_SLACK_US)
+    {
+      continue;
+    }
+    double x = (double)(s.localUs - newest->localUs);
+    double y = (double)(s.offsetUs - newest->offsetUs);
+    n++;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+
+  refUs = newest->localUs;
+  double varX = sxx - sx * sx / n;
+  // Need a couple of seconds of spread before the slope means anything,
+  // until then the old drift is kept
+  if (n >= 2 && varX > 1e12 / 4 * n)
+  {
+    double slope = (sxy - sx * sy / n) / varX;
+    double ppb = slope * 1e9;
+    if (ppb > MAX_DRIFT_PPB)
+      ppb = MAX_DRIFT_PPB;
+    if (ppb < -MAX_DRIFT_PPB)
+      ppb = -MAX_DRIFT_PPB;
+    drift = (int32_t)ppb;
+    // Line through the centroid, evaluated at refUs
+    offset = newest->offsetUs + (int64_t)(sy / n - slope * sx / n);
+  }
+  else
+  {
+    offset = newest->offsetUs + (int64_t)(sy / n);
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+// NTP style estimate of the hub's clock, shared with the host simulator.
+//
+// A node asks the hub for its time (t1 local send, t2 hub receive, t3 hub
+// send, t4 local receive). Every exchange gives an offset sample and a round
+// trip delay. Only samples close to the smallest delay seen recently are
+// trusted, and a line fitted through them gives both the offset and the
+// drift between the two crystals, so the estimate holds up between samples.
+//
+// All times are microseconds, local times from esp_timer_get_time().
+
+#include <stddef.h>
+#include <stdint.h>
+
+class ClockSync
+{
+public:
+  // Samples the fit looks at
+  static const size_t WINDOW = 32;
+  // Samples slower than the fastest recent one by more than this are
+  // assumed to have queued somewhere and are left out of the fit
+  static const uint32_t DELAY_SLACK_US = 300;
+  // Round trips over this are dropped outright
+  static const uint32_t MAX_DELAY_US = 50000;
+  // Requests go out quickly until the window has some samples, then slowly
+  static const uint32_t FAST_INTERVAL_US = 250000;
+  static const uint32_t INTERVAL_US = 2000000;
+  // Crystals are good for a few tens of ppm, anything past this is noise
+  static const int32_t MAX_DRIFT_PPB = 200000;
+
+  // True when the next time request should go out
+  bool requestDue(int64_t localUs) const;
+  void requestSent(int64_t localUs) { lastRequestUs = localUs; requested = true; }
+
+  void addSample(int64_t t1, int64_t t2, int64_t t3, int64_t t4);
+
+  bool synced() const { return good > 0; }
+  int64_t toHub(int64_t localUs) const;
+  int64_t toLocal(int64_t hubUs) const;
+
+  // Smoothed difference between what the estimate predicted and what the
+  // trusted samples measured, the achieved synchronization error
+  uint32_t errorUs() const { return error; }
+  int32_t driftPpb() const { return drift; }
+  uint32_t rejected = 0;
+
+private:
+  struct Sample
+  {
+    int64_t localUs;
+    int64_t offsetUs;
+    uint32_t delayUs;
+  };
+
+  Sample samples[WINDOW] = {};
+  size_t count = 0;
+  size_t next = 0;
+  size_t good = 0;
+
+  bool requested = false;
+  int64_t lastRequestUs = 0;
+
+  // Offset at refUs, plus drift in parts per billion
+  int64_t refUs = 0;
+  int64_t offset = 0;
+  int32_t drift = 0;
+  uint32_t error = 0;
+
+  int64_t predictOffset(int64_t localUs) const;
+  void refit();
+};
+
+#endif
@@ -1,8 +1,32 @@
 #ifndef DEV_BASE_H
 #define DEV_BASE_H
 
+#include <Arduino.h>
 #include <esp_now.h>
+#include <esp_timer.h>
+#include <esp_system.h>
 #include "messages.h"
+#include "clockSync.h"
+#include "ota.h"
+#include "otaFlash.h"
+#include "radio.h"
+#include "relay.h"
+#include "rpc.h"
+#include "timerWheel.h"
+
+// Set to 1 in a node's build_flags to have it relay frames for others
+#ifndef DEVICE_RELAY
+#define DEVICE_RELAY 0
+#endif
+
+// Node's bit in multicast addressing, unique per node, and the Group bits
+// it belongs to. See Header::to.
+#ifndef DEVICE_INDEX
+#define DEVICE_INDEX 0
+#endif
+#ifndef DEVICE_GROUPS
+#define DEVICE_GROUPS 0
+#endif
 
 namespace Dev
 {
@@ -11,7 +35,114 @@ namespace Dev
   protected:
     esp_now_peer_info_t broadcastPeerInfo;
 
+    // Deadlines and timeouts in ms, fired from service(). The pool covers
+    // every pending call and queued frame plus a few for the device's own use.
+    static const size_t TIMERS = RpcClient::MAX_PENDING + TxScheduler::POOL + 8;
+    TimerWheel::Node timerPool[TIMERS];
+    TimerWheel timers{timerPool, TIMERS, 0};
+
+    // Every node keeps an estimate of the hub's clock, the hub is the reference
+    ClockSync clock;
+
+    // When the frame onRecv() is handling came off the radio
+    int64_t frameRxUs = 0;
+
+    // The hub's clock now, as well as this node knows it
+    int64_t hubTimeUs() const
+    {
+      int64_t now = esp_timer_get_time();
+      return getDevType() == DevType::Hub ? now : clock.toHub(now);
+    }
+
+    // True once a timed message's executeAtUs has come
+    bool due(uint32_t executeAtUs) const
+    {
+      return (int32_t)((uint32_t)hubTimeUs() - executeAtUs) >= 0;
+    }
+
+    // Answers a call, does nothing if req wasn't one. ACCEPTED replies are
+    // only sent when the caller asked for them.
+    void reply(const Header &req, RpcStage stage, RpcStatus status, int16_t value = 0)
+    {
+      if (req.corrId == 0 || (stage == RPC_ACCEPTED && !(req.flags & MSG_FLAG_WANT_ACCEPTED)))
+      {
+        return;
+      }
+
+      Rpc_Reply msg;
+      msg.src = getDevType();
+      msg.dest = req.src;
+      msg.corrId = req.corrId;
+      msg.stage = stage;
+      msg.status = status;
+      msg.value = value;
+      radioSend(msg, sizeof(msg));
+    }
+
+  private:
+    int64_t lastTimeRequestUs = 0;
+
+    // Seen cache for every node, pending rebroadcasts for relays
+    Relay relay;
+    bool relayEnabled = DEVICE_RELAY;
+
+    // Firmware updates pushed over the radio, see ota.h
+    OtaFlash otaFlash;
+    OtaReceiver ota{otaFlash};
+
+    // True if the message was part of an update
+    bool handleOta(const Header &header, const uint8_t *data, int len, int64_t rxUs)
+    {
+      uint32_t jitter = esp_random() % OtaReceiver::STATUS_JITTER_US;
+      switch (header.msgType)
+      {
+      case MessageType::Ota_Begin:
+        if (len >= (int)sizeof(Ota_Begin))
+        {
+          Ota_Begin m;
+          memcpy(&m, data, sizeof(m));
+          ota.onBegin(m, rxUs, jitter);
+        }
+        return true;
+      case MessageType::Ota_Chunk:
+      {
+        // Only the used part of data is sent
+        Ota_Chunk m;
+        size_t n = min((size_t)len, sizeof(m));
+        memcpy(&m, data, n);
+        ota.onChunk(m, n, rxUs, jitter);
+        return true;
+      }
+      case MessageType::Ota_Poll:
+        if (len >= (int)sizeof(Ota_Poll))
+        {
+          Ota_Poll m;
+          memcpy(&m, data, sizeof(m));
+          ota.onPoll(m, rxUs, jitter);
+        }
+        return true;
+      case MessageType::Ota_End:
+        if (len >= (int)sizeof(Ota_End))
+        {
+          Ota_End m;
+          memcpy(&m, data, sizeof(m));
+          ota.onEnd(m);
+        }
+        return true;
+      default:
+        return false;
+      }
+    }
+
+    const uint32_t acceptMask = ADDR_NODE(DEVICE_INDEX) | ((uint32_t)DEVICE_GROUPS << 16);
+    // What the radio callback filters on, relays have to see everything
+    uint32_t rxMask = DEVICE_RELAY ? UINT32_MAX : acceptMask;
+
   public:
+    RpcClient rpc{timers};
+    // The radio's send scheduler runs on it too
+    TimerWheel &timerWheel() { return timers; }
+
     virtual ~Base() = default;
     virtual void init()
     {
@@ -25,8 +156,153 @@ namespace Dev
         return;
       }
     };
+    void setRelay(bool enabled)
+    {
+      relayEnabled = enabled;
+      rxMask = enabled ? UINT32_MAX : acceptMask;
+    }
+    // For addressedTo() in the radio callback
+    uint32_t receiveMask() const { return rxMask; }
+    const Relay &relayStats() const { return relay; }
+
+    // Called from loop() for every frame heard, rxUs is when it came off the
+    // radio, rssi 0 if unknown
+    void dispatch(const uint8_t *mac, const uint8_t *data, int len, int64_t rxUs, int8_t rssi)
+    {
+      Header header;
+      memcpy(&header, data, sizeof(header));
+
+      // Our own frames coming back through a relay
+      if (header.origin == radioOrigin())
+      {
+        return;
+      }
+
+      // Every copy counts for the link it came over, duplicates included
+      LinkTable &links = radioLinks();
+      links.onFrame(header.origin, header.src, header.seq, header.hops, rxUs);
+      if (rssi != 0)
+      {
+        links.onRssi(radioOriginOf(mac), rssi);
+      }
+
+      // Anything heard before, directly or through another relay
+      if (!relay.firstSighting(header.origin, header.seq))
+      {
+        return;
+      }
+
+      // dest is a device type, so frames for our own type are passed on too
+      // in case another node of the type is further out
+      if (relayEnabled && header.ttl > 1)
+      {
+        Header stepped = header;
+        stepped.ttl--;
+        stepped.hops++;
+        uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+        memcpy(frame, data, len);
+        memcpy(frame, &stepped, sizeof(stepped));
+        relay.schedule(frame, len, rxUs, esp_random() % Relay::MAX_BACKOFF_US);
+      }
+
+      if (header.to != 0 ? (header.to & acceptMask) == 0 : header.dest != getDevType())
+      {
+        return;
+      }
+
+      if (handleOta(header, data, len, rxUs))
+      {
+        return;
+      }
+
+      if (header.msgType == MessageType::Time_Request && len >= (int)sizeof(Time_Request))
+      {
+        Time_Request req;
+        memcpy(&req, data, sizeof(req));
+
+        Time_Reply r;
+        r.src = getDevType();
+        r.dest = req.src;
+        r.t1 = req.t1;
+        r.t2 = rxUs;
+        r.t3 = esp_timer_get_time();
+        radioSend(r, sizeof(r));
+        return;
+      }
+
+      if (header.msgType == MessageType::Time_Reply && len >= (int)sizeof(Time_Reply))
+      {
+        Time_Reply r;
+        memcpy(&r, data, sizeof(r));
+        // Replies are broadcast, only ours echoes our own t1
+        if (r.t1 == lastTimeRequestUs)
+        {
+          clock.addSample(r.t1, r.t2, r.t3, rxUs);
+          links.onRtt(header.origin, (uint32_t)((rxUs - r.t1) - (r.t3 - r.t2)));
+        }
+        return;
+      }
+
+      if (header.msgType == MessageType::Rpc_Reply && len >= (int)sizeof(Rpc_Reply))
+      {
+        Rpc_Reply r;
+        memcpy(&r, data, sizeof(r));
+        rpc.onReply(r);
+      }
+
+      frameRxUs = rxUs;
+      onRecv(header, mac, data, len);
+    }
+
+    // Called from loop()
+    void service()
+    {
+      int64_t now = esp_timer_get_time();
+      timers.advance((uint32_t)(now / 1000));
+
+      uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+      size_t n;
+      while ((n = relay.due(now, frame)) > 0)
+      {
+        radioQueue(BROADCAST_ADDR, frame, n);
+      }
+
+      if (getDevType() != DevType::Hub && clock.requestDue(now))
+      {
+        Time_Request req;
+        req.src = getDevType();
+        req.dest = DevType::Hub;
+        req.t1 = now;
+        lastTimeRequestUs = now;
+        clock.requestSent(now);
+        radioSend(req, sizeof(req));
+      }
+
+      // Status before update(), which blocks for the erase and the hash
+      Ota_Status status;
+      if (ota.statusDue(now, status))
+      {
+        status.src = getDevType();
+        status.dest = DevType::Hub;
+        radioSend(status, sizeof(status));
+      }
+      ota.update();
+      if (ota.rebootRequested())
+      {
+        Serial.println("Rebooting into the new firmware");
+        delay(100);
+        esp_restart();
+      }
+
+      update();
+
+      // Last, so whatever this pass queued goes out without waiting a pass
+      radioService();
+    }
+
     virtual void update() = 0;
     virtual void onRecv(Header header, const uint8_t *mac, const uint8_t *incomingData, int len) = 0;
+    // Called from loop() with the final outcome of every frame, see radio.h
     virtual void onSent(const uint8_t *mac_addr, esp_now_send_status_t status) = 0;
     virtual DevType getDevType() const = 0;
   };
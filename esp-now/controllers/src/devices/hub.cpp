@@ -1,6 +1,7 @@
 #include "hub.h"
 #include <Arduino.h>
 #include <esp_now.h>
+#include "radio.h"
 
 DevType Dev::Hub::getDevType() const
 {
@@ -10,84 +11,163 @@ DevType Dev::Hub::getDevType() const
 // callback function that will be executed when data is received
 void Dev::Hub::onRecv(Header header, const uint8_t *mac, const uint8_t *incomingData, int len)
 {
-  // Create a struct_message called myData
-  Serial.print("Bytes received: ");
-  Serial.println(len);
-  Serial.print("Source type: ");
-  Serial.println(header.src);
-  Serial.print("Dest type: ");
-  Serial.println(header.dest);
-  Serial.print("Msg type: ");
-  Serial.println(MessageTypeToString(header.msgType));
+  bridge.forwardRecv(mac, incomingData, len);
+
+  switch (header.msgType)
+  {
+  case MessageType::RearCam_Telemetry:
+  {
+    RearCam_Telemetry msg;
+    size_t n = min((size_t)len, sizeof(msg));
+    memcpy(&msg, incomingData, n);
+
+    Hub_TelemetryAck ack;
+    stateCache.onTelemetry(mac, msg, n, ack);
+    radioSend(ack, sizeof(ack));
+    break;
+  }
+  case MessageType::Rpc_Reply:
+    // Already handed to rpc by dispatch()
+    break;
+  case MessageType::Ota_Status:
+    // For the host driving the update, forwarded above
+    break;
+  default:
+    Serial.print("Bytes received: ");
+    Serial.println(len);
+    Serial.print("Source type: ");
+    Serial.println(header.src);
+    Serial.print("Dest type: ");
+    Serial.println(header.dest);
+    Serial.print("Msg type: ");
+    Serial.println(MessageTypeToString(header.msgType));
+    break;
+  }
 }
 
-// callback when data is sent
+// Outcome of every frame sent, once the radio is done retrying it
 void Dev::Hub::onSent(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
   Serial.print("\r\nLast Packet Send Status:\t");
   Serial.println(status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
+
+  bridge.forwardSent(mac_addr, status == ESP_NOW_SEND_SUCCESS);
 }
 
-void Dev::Hub::onButtonPressed()
+void Dev::Hub::recallRearCam(uint8_t slot)
 {
-  // Function called when button is pressed
-  Serial.println("Button pressed!");
-
-  // Create a struct_message called myData
-  RearCam_MoveTo msg;
+  RearCam_Recall msg;
   msg.src = this->getDevType();
   msg.dest = DevType::RearCam;
-  msg.pos = 0;
+  msg.slot = slot;
+  // Scheduled slightly ahead so every rear cam starts at the same moment
+  msg.flags = MSG_FLAG_TIMED;
+  msg.executeAtUs = (uint32_t)(hubTimeUs() + MOVE_LEAD_US);
 
-  // Send message via ESP-NOW
-  esp_err_t result = esp_now_send(BROADCAST_ADDR, (uint8_t *)&msg, sizeof(msg));
+  unsigned long start = millis();
+  uint16_t id = rpc.call(msg, sizeof(msg), RECALL_TIMEOUT_MS, [start](const Rpc_Reply &r)
+                         {
+    if (r.stage != RPC_COMPLETED)
+    {
+      return;
+    }
+    if (r.status == RPC_OK)
+    {
+      Serial.printf("Rear cam arrived at %d after %lums\n", r.value, millis() - start);
+    }
+    else
+    {
+      Serial.printf("Rear cam move failed, status %d\n", r.status);
+    } });
 
-  if (result == ESP_OK)
+  if (id == 0)
   {
-    Serial.println("Sent with success");
-  }
-  else
-  {
-    Serial.println("Error sending the data");
+    Serial.println("Move not sent, call slots or send queue full");
   }
 }
 
-void Dev::Hub::onButtonReleased()
+bool Dev::Hub::moveCameras(uint32_t to, uint8_t pos)
 {
-  // Function called when button is pressed
-  Serial.println("Button Released!");
-
-  // Create a struct_message called myData
   RearCam_MoveTo msg;
   msg.src = this->getDevType();
   msg.dest = DevType::RearCam;
-  msg.pos = 90;
+  msg.to = to;
+  msg.pos = pos;
+  msg.flags = MSG_FLAG_TIMED;
+  msg.executeAtUs = (uint32_t)(hubTimeUs() + MOVE_LEAD_US);
 
-  // Send message via ESP-NOW
-  esp_err_t result = esp_now_send(BROADCAST_ADDR, (uint8_t *)&msg, sizeof(msg));
-
-  if (result == ESP_OK)
-  {
-    Serial.println("Sent with success");
-  }
-  else
+  if (radioSend(msg, sizeof(msg)) != ESP_OK)
   {
-    Serial.println("Error sending the data");
+    Serial.println("Send queue full, move dropped");
+    return false;
   }
+  return true;
+}
+
+void Dev::Hub::onButtonPressed()
+{
+  // Function called when button is pressed
+  Serial.println("Button pressed!");
+  recallRearCam(PRESET_UP);
+}
+
+void Dev::Hub::onButtonReleased()
+{
+  // Function called when button is pressed
+  Serial.println("Button Released!");
+  recallRearCam(PRESET_DOWN);
 }
 
 void Dev::Hub::init()
 {
   Dev::Base::init();
 
-  toggleSwitch.init(TOGGLE_SWITCH_PIN, 200, [this]()
+  toggleSwitch.init(TOGGLE_SWITCH_PIN, 200, timers, [this]()
                     { onButtonPressed(); }, [this]()
                     { onButtonReleased(); });
 
   Serial.println("Toggle switch initialized.");
+
+  if (HUB_POT_PIN >= 0 && pot.init(HUB_POT_PIN, PotFilter::SAMPLE_HZ))
+  {
+    potEnabled = true;
+    potStreamBase = (uint8_t)esp_random();
+    Serial.println("Potentiometer initialized.");
+  }
+
+  bridge.init(&stateCache, [this](uint32_t to, uint8_t pos)
+              { return moveCameras(to, pos); });
+}
+
+void Dev::Hub::updatePot()
+{
+  uint16_t raw[AnalogInput::FRAMES * AnalogInput::FRAME_SAMPLES];
+  potFilter.addSamples(raw, pot.read(raw, sizeof(raw) / sizeof(raw[0])));
+
+  int64_t now = esp_timer_get_time();
+  uint16_t pos;
+  uint8_t stream;
+  if (!potFilter.setpoint(now, pos, stream))
+  {
+    return;
+  }
+
+  RearCam_Jog msg;
+  msg.src = this->getDevType();
+  msg.dest = DevType::RearCam;
+  msg.stream = potStreamBase + stream;
+  msg.pos = pos;
+  msg.sampleUs = (uint32_t)now;
+  // The next one is a better sample than a retry of this one would be
+  radioSend(msg, sizeof(msg));
 }
 
 void Dev::Hub::update()
 {
   toggleSwitch.update();
+  if (potEnabled)
+  {
+    updatePot();
+  }
+  bridge.update();
 }
@@ -5,8 +5,18 @@
 
 #include <esp_now.h>
 #include "messages.h"
+#include "analogInput.h"
 #include "base.h"
 #include "button.h"
+#include "potFilter.h"
+#include "serialBridge.h"
+#include "stateCache.h"
+
+// GPIO of a potentiometer that aims the rear cams, -1 for none. Set it in
+// the hub's build_flags, e.g. -D HUB_POT_PIN=3 for A1 on the XIAO.
+#ifndef HUB_POT_PIN
+#define HUB_POT_PIN -1
+#endif
 
 namespace Dev
 {
@@ -14,17 +24,42 @@ namespace Dev
   {
   private:
     const int TOGGLE_SWITCH_PIN = 2;
+    // A full 180 degree sweep at the slowest a preset may move, the hub
+    // doesn't know their speeds
+    const uint32_t RECALL_TIMEOUT_MS = 180 * PRESET_MAX_MS_PER_DEGREE + 1000;
+    // Covers delivery to every node, nodes start timed moves together
+    const uint32_t MOVE_LEAD_US = 20000;
     Button toggleSwitch;
+    // Streams RearCam_Jog while the pot is turned, see potFilter.h
+    AnalogInput pot;
+    PotFilter potFilter;
+    bool potEnabled = false;
+    // Added to the filter's stream ids, so a rebooted hub doesn't carry on
+    // a stream the cameras still have
+    uint8_t potStreamBase = 0;
+    SerialBridge bridge;
+    StateCache stateCache;
 
+    // Moves the rear cam to a preset it stores, see RearCam_Recall
+    void recallRearCam(uint8_t slot);
     void onButtonPressed();
     void onButtonReleased();
+    void updatePot();
 
   public:
+    // One timed frame to every node in to (ADDR_NODE / ADDR_GROUP bits), no
+    // replies are waited for. The bridge's BRIDGE_MOVE comes here. False if
+    // the send queue is full.
+    bool moveCameras(uint32_t to, uint8_t pos);
+
     void init();
     void update();
     void onRecv(Header header, const uint8_t *mac, const uint8_t *incomingData, int len);
     void onSent(const uint8_t *mac_addr, esp_now_send_status_t status);
     DevType getDevType() const;
+
+    // Last reported state of a node, no radio round trip
+    const StateCache::Device *deviceState(DevType type) const { return stateCache.find(type); }
   };
 }
 
@@ -2,8 +2,82 @@
 #include "esp_now.h"
 #include <WiFi.h>
 #include <nvs_flash.h>
+#include <esp_system.h>
+#include <Preferences.h>
 
 #include "messages.h"
+#include "allocStats.h"
+
+static_assert(SCRIPT_MAX_CODE == MotionScript::MAX_CODE, "script size differs from the interpreter's");
+
+#define NVS_NAMESPACE "rearCamera"
+
+// Servo, jog, scripts and telemetry, every pass of loop(), must not
+// allocate. Saving to NVS does and is counted apart.
+static AllocRegion allocMotion("motion", true);
+
+static bool saveScript(uint8_t slot, const uint8_t *code, size_t len)
+{
+  AllocScope scope(allocNvs);
+  char key[12];
+  snprintf(key, sizeof(key), "script%u", slot);
+  Preferences preferences;
+  preferences.begin(NVS_NAMESPACE, false);
+  bool ok = preferences.putBytes(key, code, len) == len;
+  preferences.end();
+  return ok;
+}
+
+// Returns the length, 0 if the slot is empty
+static size_t loadScript(uint8_t slot, uint8_t *code)
+{
+  AllocScope scope(allocNvs);
+  char key[12];
+  snprintf(key, sizeof(key), "script%u", slot);
+  Preferences preferences;
+  preferences.begin(NVS_NAMESPACE, true);
+  size_t len = preferences.getBytesLength(key);
+  if (len > SCRIPT_MAX_CODE)
+  {
+    len = 0;
+  }
+  if (len > 0)
+  {
+    preferences.getBytes(key, code, len);
+  }
+  preferences.end();
+  return len;
+}
+
+void Dev::RearCam::loadPresets()
+{
+  AllocScope scope(allocNvs);
+  Preferences preferences;
+  preferences.begin(NVS_NAMESPACE, true);
+  size_t len = preferences.getBytesLength("presets");
+  if (len == sizeof(presets))
+  {
+    preferences.getBytes("presets", presets, len);
+  }
+  else
+  {
+    // Where the hub's switch used to move the camera
+    memset(presets, 0, sizeof(presets));
+    presets[PRESET_UP] = {true, 0, 0};
+    presets[PRESET_DOWN] = {true, 90, 0};
+  }
+  preferences.end();
+}
+
+bool Dev::RearCam::savePresets()
+{
+  AllocScope scope(allocNvs);
+  Preferences preferences;
+  preferences.begin(NVS_NAMESPACE, false);
+  bool ok = preferences.putBytes("presets", presets, sizeof(presets)) == sizeof(presets);
+  preferences.end();
+  return ok;
+}
 
 DevType Dev::RearCam::getDevType() const
 {
@@ -22,37 +96,390 @@ void Dev::RearCam::init()
   ESP_ERROR_CHECK(ret);
 
   cameraServo.init(9); // D9
+  loadPresets();
+
+  resetReason = (uint8_t)esp_reset_reason();
+  telemetry.init(getDevType());
+}
+
+void Dev::RearCam::scheduleMove(const Header &call, uint8_t pos, uint8_t speed, uint32_t executeAtUs)
+{
+  reply(call, RPC_ACCEPTED, RPC_OK, pos);
+
+  if (!(call.flags & MSG_FLAG_TIMED))
+  {
+    startMove(call, pos, speed);
+    return;
+  }
+
+  // Without a synced clock the time means nothing, best effort is now
+  if (!clock.synced())
+  {
+    Serial.println("WARNING: Timed move before clock sync, moving now");
+    startMove(call, pos, speed);
+    return;
+  }
+
+  if (timedMovePending && timedMove.corrId != call.corrId)
+  {
+    reply(timedMove, RPC_COMPLETED, RPC_SUPERSEDED, cameraServo.getCurrentPosition());
+  }
+  timedMovePending = true;
+  timedMove = call;
+  timedMovePos = pos;
+  timedMoveSpeed = speed;
+  timedMoveAtUs = executeAtUs;
+}
+
+void Dev::RearCam::startMove(const Header &call, uint8_t pos, uint8_t speed)
+{
+  // Only one move can be in flight, the new target wins
+  if (moveCallPending && moveCall.corrId != call.corrId)
+  {
+    reply(moveCall, RPC_COMPLETED, RPC_SUPERSEDED, cameraServo.getCurrentPosition());
+  }
+  moveCallPending = call.corrId != 0;
+  moveCall = call;
+
+  endScript(RPC_SUPERSEDED);
+  jog.stop();
+  cameraServo.moveTo(pos, speed ? speed : CameraServo::STEP_INTERVAL_MS);
+  moves++;
+}
+
+void Dev::RearCam::supersedeMoves()
+{
+  if (moveCallPending)
+  {
+    moveCallPending = false;
+    reply(moveCall, RPC_COMPLETED, RPC_SUPERSEDED, cameraServo.getCurrentPosition());
+  }
+  if (timedMovePending)
+  {
+    timedMovePending = false;
+    reply(timedMove, RPC_COMPLETED, RPC_SUPERSEDED, cameraServo.getCurrentPosition());
+  }
+  endScript(RPC_SUPERSEDED);
+}
+
+void Dev::RearCam::endScript(RpcStatus status)
+{
+  script.stop();
+  if (scriptCallPending)
+  {
+    scriptCallPending = false;
+    reply(scriptCall, RPC_COMPLETED, status, cameraServo.getCurrentPosition());
+  }
+}
+
+void Dev::RearCam::startScript(const Header &call, const uint8_t *code, size_t len, bool timed, uint32_t executeAtUs)
+{
+  // A resend because the accept got lost, the script is already running
+  if (scriptCallPending && scriptCall.corrId == call.corrId && script.isRunning())
+  {
+    reply(call, RPC_ACCEPTED, RPC_OK, (int16_t)len);
+    return;
+  }
+
+  int64_t now = hubTimeUs();
+  int64_t start = now;
+  if (timed && clock.synced())
+  {
+    start = now + (int32_t)(executeAtUs - (uint32_t)now);
+  }
+  else if (timed)
+  {
+    Serial.println("WARNING: Timed script before clock sync, starting now");
+  }
+
+  supersedeMoves();
+  jog.stop();
+  if (!script.load(code, len, start, cameraServo.getCurrentPosition()))
+  {
+    reply(call, RPC_COMPLETED, RPC_REJECTED, cameraServo.getCurrentPosition());
+    return;
+  }
+  reply(call, RPC_ACCEPTED, RPC_OK, (int16_t)len);
+  scriptCallPending = call.corrId != 0;
+  scriptCall = call;
+}
+
+void Dev::RearCam::onScript(const Header &header, const RearCam_Script &msg, size_t codeLen)
+{
+  switch (msg.action)
+  {
+  case SCRIPT_STOP:
+    supersedeMoves();
+    cameraServo.stop();
+    reply(header, RPC_COMPLETED, RPC_OK, cameraServo.getCurrentPosition());
+    return;
+  case SCRIPT_RUN_STORED:
+  {
+    size_t len = msg.slot < SCRIPT_SLOTS ? loadScript(msg.slot, scriptCode) : 0;
+    if (len == 0)
+    {
+      reply(header, RPC_COMPLETED, RPC_REJECTED, cameraServo.getCurrentPosition());
+      return;
+    }
+    startScript(header, scriptCode, len, header.flags & MSG_FLAG_TIMED, msg.executeAtUs);
+    return;
+  }
+  case SCRIPT_RUN:
+  case SCRIPT_STORE:
+    break;
+  default:
+    reply(header, RPC_COMPLETED, RPC_UNSUPPORTED, 0);
+    return;
+  }
+
+  if (msg.total == 0 || msg.total > SCRIPT_MAX_CODE || msg.offset % SCRIPT_PART_CODE != 0 ||
+      msg.offset + codeLen > msg.total || (msg.action == SCRIPT_STORE && msg.slot >= SCRIPT_SLOTS))
+  {
+    reply(header, RPC_COMPLETED, RPC_REJECTED, 0);
+    return;
+  }
+
+  // Parts of another script start over, a part sent twice is just copied again
+  if (header.corrId != scriptCorrId || msg.total != scriptTotal)
+  {
+    scriptCorrId = header.corrId;
+    scriptTotal = msg.total;
+    scriptParts = 0;
+  }
+  memcpy(scriptCode + msg.offset, msg.code, codeLen);
+  scriptParts |= 1 << (msg.offset / SCRIPT_PART_CODE);
+  if (msg.offset + codeLen < msg.total)
+  {
+    return;
+  }
+
+  // The last part, the rest should be in by now
+  size_t parts = (msg.total + SCRIPT_PART_CODE - 1) / SCRIPT_PART_CODE;
+  bool complete = scriptParts == (1 << parts) - 1;
+  scriptTotal = 0;
+  if (!complete || !MotionScript::validate(scriptCode, msg.total))
+  {
+    reply(header, RPC_COMPLETED, RPC_REJECTED, 0);
+    return;
+  }
+
+  if (msg.action == SCRIPT_STORE)
+  {
+    bool saved = saveScript(msg.slot, scriptCode, msg.total);
+    reply(header, RPC_COMPLETED, saved ? RPC_OK : RPC_REJECTED, (int16_t)msg.total);
+    return;
+  }
+  startScript(header, scriptCode, msg.total, header.flags & MSG_FLAG_TIMED, msg.executeAtUs);
+}
+
+void Dev::RearCam::onPreset(const Header &header, const RearCam_Preset &msg)
+{
+  if (msg.slot >= PRESET_SLOTS || msg.action > PRESET_CLEAR || (msg.action == PRESET_SET && msg.pos > 180) ||
+      msg.speed > PRESET_MAX_MS_PER_DEGREE)
+  {
+    reply(header, RPC_COMPLETED, RPC_REJECTED, 0);
+    return;
+  }
+
+  Preset &p = presets[msg.slot];
+  p.set = msg.action != PRESET_CLEAR;
+  p.pos = msg.action == PRESET_SET_HERE ? cameraServo.getCurrentPosition() : msg.pos;
+  p.speed = msg.speed;
+  bool saved = savePresets();
+  reply(header, RPC_COMPLETED, saved ? RPC_OK : RPC_REJECTED, p.set ? p.pos : -1);
+}
+
+void Dev::RearCam::update()
+{
+  AllocScope scope(allocMotion);
+
+  if (timedMovePending && due(timedMoveAtUs))
+  {
+    timedMovePending = false;
+    lastTimedLateUs = (uint32_t)hubTimeUs() - timedMoveAtUs;
+    startMove(timedMove, timedMovePos, timedMoveSpeed);
+  }
+
+  int32_t jogPos;
+  if (jog.sample(esp_timer_get_time(), jogPos))
+  {
+    cameraServo.jogTo(jogPos);
+  }
+  else if (cameraServo.isJogging())
+  {
+    cameraServo.endJog();
+  }
+
+  switch (script.update(hubTimeUs(), cameraServo.isMoving()))
+  {
+  case MotionScript::STEP_MOVE:
+    cameraServo.moveTo(script.pos, script.speed ? script.speed : CameraServo::STEP_INTERVAL_MS);
+    break;
+  case MotionScript::STEP_DONE:
+    endScript(RPC_OK);
+    break;
+  default:
+    break;
+  }
+
+  cameraServo.update();
+
+  if (moveCallPending && !cameraServo.isMoving())
+  {
+    moveCallPending = false;
+    reply(moveCall, RPC_COMPLETED, RPC_OK, cameraServo.getCurrentPosition());
+  }
+
+  int64_t now = esp_timer_get_time();
+  const LinkTable &links = radioLinks();
+  const LinkTable::Peer *hub = links.findType(DevType::Hub, now);
+  bool relayed = links.ttlFor(DevType::Hub, RADIO_DEFAULT_TTL, now) > 1;
+
+  TelemetryState state = {};
+  state.pos = cameraServo.getCurrentPosition();
+  state.target = cameraServo.getTarget();
+  state.flags = cameraServo.isMoving() ? TELEMETRY_FLAG_MOVING : 0;
+  if (relayed)
+  {
+    state.flags |= TELEMETRY_FLAG_RELAYED;
+  }
+  if (cameraServo.isJogging())
+  {
+    state.flags |= TELEMETRY_FLAG_JOGGING;
+  }
+  if (script.isRunning())
+  {
+    state.flags |= TELEMETRY_FLAG_SCRIPT;
+  }
+  state.resetReason = resetReason;
+  state.uptimeS = millis() / 1000;
+  state.counters[TELEMETRY_MOVES] = moves;
+  state.counters[TELEMETRY_RX_FRAMES] = rxFrames;
+  state.counters[TELEMETRY_TX_FAILURES] = txFailures;
+  state.counters[TELEMETRY_RESYNCS] = telemetry.resyncs;
+  state.syncErrorUs = clock.synced() ? clock.errorUs() : UINT32_MAX;
+  state.timedLateUs = lastTimedLateUs;
+  if (hub)
+  {
+    state.linkDeliveryPct = hub->deliveryPct();
+    state.linkRssi = hub->rssi();
+    state.linkRttUs = hub->srttUs;
+  }
+
+  // A resend for the direct link alone that went unanswered as well is a
+  // loss on it. A single timeout isn't, the lost ack shows up as a gap in
+  // the hub's sequence numbers already.
+  bool resent = telemetry.update(state, links.rtoFor(DevType::Hub, now));
+  if (resent && telemetry.unacknowledged() > 2 && hub && !relayed)
+  {
+    radioLinks().onDelivery(hub->origin, false);
+  }
 }
 
 // callback function that will be executed when data is received
 void Dev::RearCam::onRecv(Header header, const uint8_t *mac, const uint8_t *incomingData, int len)
 {
-  // Create a struct_message called myData
-  Serial.print("Bytes received: ");
-  Serial.println(len);
-  Serial.print("Source type: ");
-  Serial.println(header.src);
-  Serial.print("Dest type: ");
-  Serial.println(header.dest);
-  Serial.print("Msg type: ");
-  Serial.println(MessageTypeToString(header.msgType));
+  rxFrames++;
 
   switch (header.msgType)
   {
   case MessageType::RearCam_MoveTo:
   {
+    if (len < (int)sizeof(RearCam_MoveTo))
+    {
+      break;
+    }
     RearCam_MoveTo msg;
     memcpy(&msg, incomingData, sizeof(msg));
     Serial.print("MoveTo Pos: ");
     Serial.println(msg.pos);
-    Serial.println();
-
-    cameraServo.moveSlowlyTo(msg.pos);
 
+    if (msg.pos > 180)
+    {
+      reply(header, RPC_COMPLETED, RPC_REJECTED, cameraServo.getCurrentPosition());
+      break;
+    }
+    scheduleMove(header, msg.pos, 0, msg.executeAtUs);
     break;
   }
+  case MessageType::RearCam_Recall:
+  {
+    if (len < (int)sizeof(RearCam_Recall))
+    {
+      break;
+    }
+    RearCam_Recall msg;
+    memcpy(&msg, incomingData, sizeof(msg));
+    if (msg.slot >= PRESET_SLOTS || !presets[msg.slot].set)
+    {
+      reply(header, RPC_COMPLETED, RPC_REJECTED, cameraServo.getCurrentPosition());
+      break;
+    }
+    const Preset &p = presets[msg.slot];
+    scheduleMove(header, p.pos, p.speed, msg.executeAtUs);
+    break;
+  }
+  case MessageType::RearCam_Preset:
+  {
+    if (len < (int)sizeof(RearCam_Preset))
+    {
+      break;
+    }
+    RearCam_Preset msg;
+    memcpy(&msg, incomingData, sizeof(msg));
+    onPreset(header, msg);
+    break;
+  }
+  case MessageType::RearCam_Jog:
+  {
+    if (len < (int)sizeof(RearCam_Jog))
+    {
+      break;
+    }
+    RearCam_Jog msg;
+    memcpy(&msg, incomingData, sizeof(msg));
+    // The stream takes over from any move, a move ends the stream
+    supersedeMoves();
+    jog.push(msg.stream, msg.sampleUs, msg.pos, frameRxUs);
+    break;
+  }
+  case MessageType::RearCam_Script:
+  {
+    if (len < (int)SCRIPT_HEADER_SIZE)
+    {
+      break;
+    }
+    // Only the used part of code is sent
+    RearCam_Script msg;
+    size_t n = min((size_t)len, sizeof(msg));
+    memcpy(&msg, incomingData, n);
+    onScript(header, msg, n - SCRIPT_HEADER_SIZE);
+    break;
+  }
+  case MessageType::Hub_TelemetryAck:
+  {
+    if (len < (int)sizeof(Hub_TelemetryAck))
+    {
+      break;
+    }
+    Hub_TelemetryAck ack;
+    memcpy(&ack, incomingData, sizeof(ack));
+    radioLinks().onRtt(header.origin, telemetry.onAck(ack));
+    break;
+  }
+  case MessageType::Rpc_Reply:
+    break;
   default:
-    Serial.println("WARNING: Unrecognized message type.");
+    Serial.print("WARNING: Unrecognized message type: ");
+    Serial.println(MessageTypeToString(header.msgType));
     break;
   }
 }
+
+void Dev::RearCam::onSent(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+  if (status != ESP_NOW_SEND_SUCCESS)
+  {
+    txFailures++;
+  }
+}
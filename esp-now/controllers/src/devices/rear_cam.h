@@ -6,6 +6,9 @@
 #include "messages.h"
 #include "base.h"
 #include "cameraServo.h"
+#include "jitterBuffer.h"
+#include "motionScript.h"
+#include "telemetryReporter.h"
 
 namespace Dev
 {
@@ -13,15 +16,71 @@ namespace Dev
   {
   private:
     CameraServo cameraServo;
+    TelemetryReporter telemetry;
+    uint8_t resetReason;
+
+    // The move call waiting for the servo to arrive
+    bool moveCallPending = false;
+    Header moveCall;
+
+    // A move waiting for its time to come
+    bool timedMovePending = false;
+    Header timedMove;
+    uint8_t timedMovePos;
+    uint8_t timedMoveSpeed;
+    uint32_t timedMoveAtUs;
+    // How late the last timed move started
+    uint32_t lastTimedLateUs = 0;
+
+    // Streamed setpoints from RearCam_Jog, played out a little behind
+    JitterBuffer jog;
+
+    // Script running, the call that started it, and the parts of the one
+    // being received
+    MotionScript script;
+    bool scriptCallPending = false;
+    Header scriptCall;
+    uint8_t scriptCode[SCRIPT_MAX_CODE];
+    uint16_t scriptCorrId = 0;
+    uint16_t scriptTotal = 0;
+    uint8_t scriptParts = 0;
+
+    // Positions stored by slot, kept in NVS
+    struct Preset
+    {
+      bool set;
+      uint8_t pos;
+      // ms per degree, 0 for the servo's usual rate
+      uint8_t speed;
+    };
+    Preset presets[PRESET_SLOTS];
+    void loadPresets();
+    bool savePresets();
+    void onPreset(const Header &header, const RearCam_Preset &msg);
+
+    // Moves now, or when executeAtUs comes for a timed call
+    void scheduleMove(const Header &call, uint8_t pos, uint8_t speed, uint32_t executeAtUs);
+    void startMove(const Header &call, uint8_t pos, uint8_t speed);
+    // Drops any move waiting on the servo or on its time, and the script
+    void supersedeMoves();
+    void onScript(const Header &header, const RearCam_Script &msg, size_t codeLen);
+    void startScript(const Header &call, const uint8_t *code, size_t len, bool timed, uint32_t executeAtUs);
+    // Ends the script's call with status
+    void endScript(RpcStatus status);
+
+    uint32_t moves = 0;
+    uint32_t rxFrames = 0;
+    // Frames the radio gave up on after its retries
+    uint32_t txFailures = 0;
 
   public:
     void init();
-    void update() {};
+    void update();
     void onRecv(Header header, const uint8_t *mac, const uint8_t *incomingData, int len);
-    void onSent(const uint8_t *mac_addr, esp_now_send_status_t status) {};
+    void onSent(const uint8_t *mac_addr, esp_now_send_status_t status);
     DevType getDevType() const;
   };
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,193 @@
+#include "jitterBuffer.h"
+
+void JitterBuffer::reset(uint8_t newStream, uint32_t sampleUs, int64_t nowUs)
+{
+  started = true;
+  stream = newStream;
+  count = 0;
+  haveBefore = false;
+  lastStamp = sampleUs;
+  lastTs = sampleUs;
+  baseCurrent = nowUs - lastTs;
+  basePrevious = baseCurrent;
+  windowStartUs = nowUs;
+  excessUs = 0;
+  excessVarUs = 0;
+  intervalUs = 0;
+  offset = baseCurrent + (fixedDelayUs ? fixedDelayUs : INITIAL_DELAY_US);
+  lastPlayUs = nowUs;
+  playedTs = INT64_MIN;
+  streams++;
+}
+
+uint32_t JitterBuffer::targetDelay() const
+{
+  if (fixedDelayUs)
+  {
+    return fixedDelayUs;
+  }
+  // The next sample has to be in before playback passes this one
+  uint32_t d = intervalUs + excessUs + DEVIATIONS * excessVarUs;
+  return d < MIN_DELAY_US ? MIN_DELAY_US : d > MAX_DELAY_US ? MAX_DELAY_US : d;
+}
+
+bool JitterBuffer::push(uint8_t newStream, uint32_t sampleUs, uint16_t posQ8, int64_t nowUs)
+{
+  if (!started || newStream != stream || !active(nowUs))
+  {
+    reset(newStream, sampleUs, nowUs);
+  }
+  received++;
+  lastArrivalUs = nowUs;
+
+  // 32 bit stamps wrap every 71 minutes, extend them from the newest one
+  int64_t ts = lastTs + (int32_t)(sampleUs - lastStamp);
+  if (ts > lastTs)
+  {
+    if (intervalUs == 0)
+    {
+      intervalUs = (uint32_t)(ts - lastTs);
+    }
+    else
+    {
+      intervalUs = intervalUs - intervalUs / 8 + (uint32_t)(ts - lastTs) / 8;
+    }
+    lastTs = ts;
+    lastStamp = sampleUs;
+  }
+
+  // Late samples still say how late the stream runs, count them first
+  if (nowUs - windowStartUs >= (int64_t)BASE_WINDOW_US)
+  {
+    basePrevious = baseCurrent;
+    baseCurrent = INT64_MAX;
+    windowStartUs = nowUs;
+  }
+  int64_t transit = nowUs - ts;
+  if (transit < baseCurrent)
+  {
+    baseCurrent = transit;
+  }
+  int64_t excess64 = transit - base();
+  uint32_t excess = excess64 > (int64_t)MAX_DELAY_US ? MAX_DELAY_US : (uint32_t)excess64;
+  uint32_t err = excess > excessUs ? excess - excessUs : excessUs - excess;
+  excessVarUs = excessVarUs - excessVarUs / 4 + err / 4;
+  excessUs = excessUs - excessUs / 8 + excess / 8;
+
+  if (ts <= playedTs)
+  {
+    late++;
+    return false;
+  }
+
+  // Kept in order of sender time, a radio relay can reorder them
+  size_t i = count;
+  while (i > 0 && samples[i - 1].ts > ts)
+  {
+    i--;
+  }
+  if (i > 0 && samples[i - 1].ts == ts)
+  {
+    duplicates++;
+    return false;
+  }
+  if (count == DEPTH)
+  {
+    if (i == 0)
+    {
+      overflows++;
+      return false;
+    }
+    // The oldest one is the least use
+    before = samples[0];
+    haveBefore = true;
+    for (size_t j = 1; j < count; j++)
+    {
+      samples[j - 1] = samples[j];
+    }
+    count--;
+    i--;
+    overflows++;
+  }
+  for (size_t j = count; j > i; j--)
+  {
+    samples[j] = samples[j - 1];
+  }
+  samples[i].ts = ts;
+  samples[i].pos = posQ8;
+  count++;
+  return true;
+}
+
+bool JitterBuffer::sample(int64_t nowUs, int32_t &posQ8)
+{
+  if (!active(nowUs) || count == 0)
+  {
+    return false;
+  }
+
+  // Move the offset towards where it should be, a little per ms
+  int64_t target = base() + targetDelay();
+  int64_t step = (nowUs - lastPlayUs) * SLEW_US_PER_MS / 1000;
+  lastPlayUs = nowUs;
+  if (offset < target)
+  {
+    offset = target - offset < step ? target : offset + step;
+  }
+  else
+  {
+    offset = offset - target < step ? target : offset - step;
+  }
+
+  int64_t t = nowUs - offset;
+  if (t > playedTs)
+  {
+    playedTs = t;
+  }
+
+  // Keep the last sample at or before t
+  while (count >= 2 && samples[1].ts <= t)
+  {
+    before = samples[0];
+    haveBefore = true;
+    for (size_t j = 1; j < count; j++)
+    {
+      samples[j - 1] = samples[j];
+    }
+    count--;
+  }
+
+  const Sample &a = samples[0];
+  if (t <= a.ts)
+  {
+    // Not started yet
+    posQ8 = a.pos;
+    return true;
+  }
+
+  if (count >= 2)
+  {
+    const Sample &b = samples[1];
+    posQ8 = a.pos + (int32_t)(((int64_t)(b.pos - a.pos) * (t - a.ts)) / (b.ts - a.ts));
+    return true;
+  }
+
+  // Ran out, carry on the way the last two samples were going
+  if (!haveBefore || t - a.ts > (int64_t)MAX_EXTRAPOLATE_US)
+  {
+    held++;
+  }
+  else
+  {
+    extrapolated++;
+  }
+  if (!haveBefore)
+  {
+    posQ8 = a.pos;
+    return true;
+  }
+  int64_t ahead = t - a.ts < (int64_t)MAX_EXTRAPOLATE_US ? t - a.ts : MAX_EXTRAPOLATE_US;
+  int64_t p = a.pos + ((int64_t)(a.pos - before.pos) * ahead) / (a.ts - before.ts);
+  posQ8 = p < 0 ? 0 : p > 180 * 256 ? 180 * 256 : (int32_t)p;
+  return true;
+}
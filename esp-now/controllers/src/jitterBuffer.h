@@ -0,0 +1,108 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+// Playout buffer for streamed jog setpoints, shared with the host simulator.
+//
+// The sender stamps every RearCam_Jog with its own clock when it sampled the
+// position. The receiver plays the stream back a little behind: the sender
+// time it shows is now minus a playout offset, and the position is
+// interpolated between the samples either side of it. Samples that went
+// missing in between don't matter; when the newest sample runs out the
+// motion is extrapolated along the last two for a while, then held.
+//
+// No clock sync is needed. The offset is the lowest transit time seen lately
+// (local arrival minus sender stamp, which includes the difference of the
+// clocks) plus a delay that covers the sample interval and the jitter,
+// estimated like an RTO (RFC 6298). The offset follows changes slowly, so
+// adapting only ever speeds playback up or slows it down by a few percent.
+//
+// Positions are in 1/256 degree. Local times are esp_timer_get_time()
+// microseconds.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class JitterBuffer
+{
+public:
+  static const size_t DEPTH = 8;
+  // Playout delay before the stream has told us anything, and its limits
+  static const uint32_t INITIAL_DELAY_US = 60000;
+  static const uint32_t MIN_DELAY_US = 5000;
+  static const uint32_t MAX_DELAY_US = 250000;
+  // Jitter margin in mean deviations of the transit time
+  static const uint8_t DEVIATIONS = 4;
+  // The base transit is the lowest of this window and the last, so it
+  // follows the drift between the two clocks
+  static const uint32_t BASE_WINDOW_US = 2000000;
+  // Most the playout offset moves per ms, 5% faster or slower playback
+  static const uint32_t SLEW_US_PER_MS = 50;
+  // Motion carries on along the last two samples for this long, then holds
+  static const uint32_t MAX_EXTRAPOLATE_US = 100000;
+  // No samples for this long and the stream is over
+  static const uint32_t IDLE_US = 1000000;
+
+  // Non zero fixes the playout delay instead of adapting it
+  uint32_t fixedDelayUs = 0;
+
+  // A received sample. A new stream id starts over. Returns false if the
+  // sample was dropped, a repeat or too late to be played.
+  bool push(uint8_t stream, uint32_t sampleUs, uint16_t posQ8, int64_t nowUs);
+  // Where the stream is at nowUs. False when no stream is playing.
+  bool sample(int64_t nowUs, int32_t &posQ8);
+  // Ends the stream, the next sample starts a new one
+  void stop() { started = false; }
+  bool active(int64_t nowUs) const { return started && nowUs - lastArrivalUs < (int64_t)IDLE_US; }
+  // Current playout delay over the fastest transit
+  uint32_t delayUs() const { return (uint32_t)(offset - base()); }
+  // Sender time last played, its 32 bit stamps extended to 64
+  int64_t playoutTs() const { return playedTs; }
+
+  uint32_t received = 0;
+  uint32_t late = 0;
+  uint32_t duplicates = 0;
+  uint32_t overflows = 0;
+  uint32_t streams = 0;
+  // sample() calls that had to extrapolate, and that held the last position
+  uint32_t extrapolated = 0;
+  uint32_t held = 0;
+
+private:
+  struct Sample
+  {
+    // Sender clock, unwrapped
+    int64_t ts;
+    int32_t pos;
+  };
+
+  Sample samples[DEPTH];
+  size_t count = 0;
+  // The sample played through last, for extrapolation
+  bool haveBefore = false;
+  Sample before;
+
+  bool started = false;
+  uint8_t stream = 0;
+  uint32_t lastStamp = 0;
+  int64_t lastTs = 0;
+  int64_t lastArrivalUs = 0;
+
+  // Transit times, local minus sender clock
+  int64_t baseCurrent = 0;
+  int64_t basePrevious = 0;
+  int64_t windowStartUs = 0;
+  uint32_t excessUs = 0;
+  uint32_t excessVarUs = 0;
+  uint32_t intervalUs = 0;
+
+  int64_t offset = 0;
+  int64_t lastPlayUs = 0;
+  // Sender time last shown, anything older is too late
+  int64_t playedTs = 0;
+
+  int64_t base() const { return baseCurrent < basePrevious ? baseCurrent : basePrevious; }
+  uint32_t targetDelay() const;
+  void reset(uint8_t newStream, uint32_t sampleUs, int64_t nowUs);
+};
+
+#endif
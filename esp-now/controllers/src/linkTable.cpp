@@ -0,0 +1,215 @@
+#include "linkTable.h"
+
+LinkTable::Peer *LinkTable::lookup(uint16_t origin)
+{
+  for (size_t i = 0; i < MAX_PEERS; i++)
+  {
+    if (peers[i].inUse && peers[i].origin == origin)
+    {
+      return &peers[i];
+    }
+  }
+  return nullptr;
+}
+
+const LinkTable::Peer *LinkTable::find(uint16_t origin) const
+{
+  return const_cast<LinkTable *>(this)->lookup(origin);
+}
+
+const LinkTable::Peer *LinkTable::findType(DevType type, int64_t nowUs) const
+{
+  for (size_t i = 0; i < MAX_PEERS; i++)
+  {
+    const Peer &p = peers[i];
+    if (p.inUse && p.type == type && nowUs - p.heardUs < FORGET_US)
+    {
+      return &p;
+    }
+  }
+  return nullptr;
+}
+
+void LinkTable::sample(Peer &p, bool delivered)
+{
+  if (delivered)
+  {
+    p.delivery += (65535 - p.delivery) >> DELIVERY_SHIFT;
+  }
+  else
+  {
+    p.delivery -= p.delivery >> DELIVERY_SHIFT;
+  }
+
+  // Hysteresis, so a link on the edge doesn't flip every frame
+  if (p.direct && p.delivery < DIRECT_LEAVE)
+  {
+    p.direct = false;
+  }
+  else if (!p.direct && p.delivery >= DIRECT_ENTER)
+  {
+    p.direct = true;
+  }
+}
+
+void LinkTable::onFrame(uint16_t origin, DevType type, uint16_t seq, uint8_t hops, int64_t nowUs)
+{
+  Peer *p = lookup(origin);
+  if (!p)
+  {
+    // A free slot, or the one quiet for longest
+    p = &peers[0];
+    for (size_t i = 0; i < MAX_PEERS; i++)
+    {
+      if (!peers[i].inUse)
+      {
+        p = &peers[i];
+        break;
+      }
+      if (peers[i].heardUs < p->heardUs)
+      {
+        p = &peers[i];
+      }
+    }
+    if (p->inUse)
+    {
+      evictions++;
+    }
+    *p = {};
+    p->inUse = true;
+    p->origin = origin;
+    // Heard at all, so give it the benefit of the doubt
+    p->delivery = DIRECT_ENTER;
+  }
+
+  p->type = type;
+  p->heardUs = nowUs;
+
+  // Anything further off either way is a reboot or a long silence
+  int16_t gap = (int16_t)(seq - p->lastSeq);
+  if (p->haveSeq && gap <= 0 && gap > -(int16_t)MAX_GAP)
+  {
+    // A repeat, or older than what we have
+    return;
+  }
+  bool counted = p->haveSeq && gap > 0 && gap <= (int16_t)MAX_GAP;
+
+  if (hops != 0)
+  {
+    // The direct copy would have come first, so a frame from a direct peer
+    // that only made it through a relay was lost on the link
+    for (int16_t i = 0; counted && i < gap; i++)
+    {
+      sample(*p, false);
+    }
+    if (p->haveSeq)
+    {
+      p->lastSeq = seq;
+    }
+    return;
+  }
+
+  for (int16_t i = 1; counted && i < gap; i++)
+  {
+    sample(*p, false);
+  }
+  sample(*p, true);
+  p->haveSeq = true;
+  p->lastSeq = seq;
+  p->directUs = nowUs;
+}
+
+void LinkTable::onRssi(uint16_t origin, int8_t rssi)
+{
+  Peer *p = lookup(origin);
+  if (!p)
+  {
+    return;
+  }
+  int16_t q = (int16_t)(rssi * 16);
+  if (p->rssiQ4 == 0)
+  {
+    p->rssiQ4 = q;
+    return;
+  }
+  p->rssiQ4 += (q - p->rssiQ4) / (1 << RSSI_SHIFT);
+}
+
+void LinkTable::onRtt(uint16_t origin, uint32_t rttUs)
+{
+  Peer *p = lookup(origin);
+  if (!p || rttUs == 0)
+  {
+    return;
+  }
+
+  if (p->srttUs == 0)
+  {
+    p->srttUs = rttUs;
+    p->rttVarUs = rttUs / 2;
+    return;
+  }
+
+  // RFC 6298: beta 1/4, alpha 1/8
+  uint32_t err = rttUs > p->srttUs ? rttUs - p->srttUs : p->srttUs - rttUs;
+  p->rttVarUs = p->rttVarUs - p->rttVarUs / 4 + err / 4;
+  p->srttUs = p->srttUs - p->srttUs / 8 + rttUs / 8;
+}
+
+void LinkTable::onDelivery(uint16_t origin, bool delivered)
+{
+  Peer *p = lookup(origin);
+  if (p)
+  {
+    sample(*p, delivered);
+  }
+}
+
+bool LinkTable::isDirect(const Peer &p, int64_t nowUs) const
+{
+  return p.direct && p.haveSeq && nowUs - p.directUs < STALE_US;
+}
+
+uint8_t LinkTable::ttlFor(DevType dest, uint8_t defaultTtl, int64_t nowUs) const
+{
+  bool any = false;
+  for (size_t i = 0; i < MAX_PEERS; i++)
+  {
+    const Peer &p = peers[i];
+    if (!p.inUse || p.type != dest || nowUs - p.heardUs >= FORGET_US)
+    {
+      continue;
+    }
+    if (!isDirect(p, nowUs))
+    {
+      return defaultTtl;
+    }
+    any = true;
+  }
+  return any ? 1 : defaultTtl;
+}
+
+uint32_t LinkTable::rto(const Peer &p)
+{
+  if (p.srttUs == 0)
+  {
+    return INITIAL_RTO_US;
+  }
+  uint32_t r = p.srttUs + 4 * p.rttVarUs;
+  return r < MIN_RTO_US ? MIN_RTO_US : r > MAX_RTO_US ? MAX_RTO_US : r;
+}
+
+uint32_t LinkTable::rtoFor(DevType dest, int64_t nowUs) const
+{
+  uint32_t worst = 0;
+  for (size_t i = 0; i < MAX_PEERS; i++)
+  {
+    const Peer &p = peers[i];
+    if (p.inUse && p.type == dest && nowUs - p.heardUs < FORGET_US)
+    {
+      uint32_t r = rto(p);
+      worst = r > worst ? r : worst;
+    }
+  }
+  return worst ? worst : INITIAL_RTO_US;
+}
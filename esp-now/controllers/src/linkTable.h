@@ -0,0 +1,102 @@
+#ifndef LINK_TABLE_H
+#define LINK_TABLE_H
+
+// Per peer link quality, shared with the host simulator.
+//
+// Peers are keyed on their origin (see Header). For every peer heard
+// directly the table keeps an exponentially weighted delivery ratio, taken
+// from gaps in the sequence numbers of its frames (a frame that only came
+// through a relay is a gap too) and from retransmit timeouts. Send
+// callbacks aren't used: frames go out as broadcasts, which are never
+// acknowledged. It also keeps the RSSI of its frames and a smoothed
+// round trip time with its variance (RFC 6298). Links are assumed to be
+// about as good both ways.
+//
+// From that it picks the TTL of outgoing frames, 1 when every peer of the
+// destination type is reached directly, so relays stay quiet, and the
+// retransmit timeout towards a device type.
+//
+// Frames multicast to other nodes are dropped before they are counted, so
+// they look like losses; the hub rarely sends them.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "messages.h"
+
+class LinkTable
+{
+public:
+  static const size_t MAX_PEERS = 8;
+  // EWMA gains as shifts, 1/16 for delivery and 1/8 for RSSI
+  static const uint8_t DELIVERY_SHIFT = 4;
+  static const uint8_t RSSI_SHIFT = 3;
+  // Sequence gaps larger than this either way are a reboot or a long
+  // silence, not losses
+  static const uint16_t MAX_GAP = 32;
+  // Delivery (of 65535) to become a direct link and to stop being one
+  static const uint16_t DIRECT_ENTER = 58982; // 90%
+  static const uint16_t DIRECT_LEAVE = 49151; // 75%
+  // Not heard directly for this long, the link is gone. Nodes send a time
+  // request every 2 s and the hub answers it.
+  static const uint32_t STALE_US = 6000000;
+  // Not heard at all for this long, the peer is left out of routing
+  static const uint32_t FORGET_US = 30000000;
+  // Retransmit timeouts: before any RTT sample, and the limits
+  static const uint32_t INITIAL_RTO_US = 500000;
+  static const uint32_t MIN_RTO_US = 50000;
+  static const uint32_t MAX_RTO_US = 4000000;
+
+  struct Peer
+  {
+    bool inUse;
+    uint16_t origin;
+    DevType type;
+    // Direct delivery ratio, 65535 is every frame
+    uint16_t delivery;
+    bool direct;
+    bool haveSeq;
+    uint16_t lastSeq;
+    // dBm * 16, 0 until a sample came in
+    int16_t rssiQ4;
+    // 0 until a sample came in
+    uint32_t srttUs;
+    uint32_t rttVarUs;
+    int64_t heardUs;
+    int64_t directUs;
+
+    uint8_t deliveryPct() const { return (uint8_t)((delivery * 100u + 32767) / 65535); }
+    int8_t rssi() const { return (int8_t)(rssiQ4 / 16); }
+  };
+
+  // A frame from origin, before duplicate suppression, hops as received
+  void onFrame(uint16_t origin, DevType type, uint16_t seq, uint8_t hops, int64_t nowUs);
+  // Signal strength of a frame from the neighbour with this origin
+  void onRssi(uint16_t origin, int8_t rssi);
+  void onRtt(uint16_t origin, uint32_t rttUs);
+  // A frame sent with TTL 1 that was never acknowledged, or one that was
+  void onDelivery(uint16_t origin, bool delivered);
+
+  // TTL for a frame to dest: 1 if every peer of that type heard lately is
+  // a direct link, otherwise defaultTtl
+  uint8_t ttlFor(DevType dest, uint8_t defaultTtl, int64_t nowUs) const;
+  // Retransmit timeout towards dest, the slowest of its peers
+  uint32_t rtoFor(DevType dest, int64_t nowUs) const;
+
+  const Peer *find(uint16_t origin) const;
+  // First peer of the type heard lately
+  const Peer *findType(DevType type, int64_t nowUs) const;
+  const Peer &peer(size_t i) const { return peers[i]; }
+
+  // Peers that had to make room for newer ones
+  uint32_t evictions = 0;
+
+private:
+  Peer peers[MAX_PEERS] = {};
+
+  Peer *lookup(uint16_t origin);
+  void sample(Peer &p, bool delivered);
+  bool isDirect(const Peer &p, int64_t nowUs) const;
+  static uint32_t rto(const Peer &p);
+};
+
+#endif
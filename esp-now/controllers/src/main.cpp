@@ -1,46 +1,125 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include "esp_now.h"
+#include <esp_timer.h>
+#include <esp_wifi.h>
 #include <memory>
 
 #include "messages.h"
 #include "devices/hub.h"
 #include "devices/rear_cam.h"
 #include "button.h"
+#include "radio.h"
+#include "allocStats.h"
 
 uint8_t devMacAddress[6];
 std::unique_ptr<Dev::Base> dev;
 
+// The receive path, from the radio callback to the device's handler, runs
+// for every frame and must not allocate. See allocStats.h.
+AllocRegion allocRx("rx", true);
+AllocRegion allocDispatch("dispatch", true);
+AllocRegion allocService("service");
+
+// Seconds between allocation reports on Serial, 0 for none
+#ifndef ALLOC_REPORT_S
+#define ALLOC_REPORT_S 60
+#endif
+
+// Tasks whose stacks the report covers
+const char *const REPORT_TASKS[] = {"loopTask", "wifi", "tiT", "esp_timer", "sys_evt", "IDLE"};
+unsigned long lastReportMs = 0;
+
+// Received messages wait here for loop(), the receive callback runs on the
+// WiFi task and must not touch device state or block
+struct RxPacket
+{
+  // Taken in the callback, clock sync needs the arrival time
+  int64_t rxUs;
+  // dBm, 0 if the sniffer didn't catch the frame
+  int8_t rssi;
+  uint8_t mac[6];
+  uint8_t len;
+  uint8_t data[ESP_NOW_MAX_DATA_LEN];
+};
+const size_t RX_QUEUE_DEPTH = 16;
+QueueHandle_t rxQueue;
+uint32_t rxDropped = 0;
+
+// Send callbacks, handed to the radio's scheduler from loop() for the same
+// reason. Never more than TxScheduler::POOL frames are in flight.
+struct TxDone
+{
+  uint8_t mac[6];
+  bool success;
+};
+QueueHandle_t txDoneQueue;
+
+// The receive callback of this IDF version carries no RSSI, so it comes from
+// promiscuous mode. Both callbacks run on the WiFi task, and the sniffer sees
+// a frame just before OnRecv does.
+volatile int8_t sniffedRssi = 0;
+uint8_t sniffedMac[6];
+
+void OnSniff(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+  const wifi_promiscuous_pkt_t *pkt = (const wifi_promiscuous_pkt_t *)buf;
+  // ESP-NOW rides on action frames, the sender is the 802.11 header's addr2
+  if (type != WIFI_PKT_MGMT || pkt->payload[0] != 0xd0)
+  {
+    return;
+  }
+  memcpy(sniffedMac, pkt->payload + 10, 6);
+  sniffedRssi = pkt->rx_ctrl.rssi;
+}
+
 void OnRecv(const uint8_t *mac, const uint8_t *incomingData, int len)
 {
+  AllocScope scope(allocRx);
+
   // Only process if device is initialized
   if (!dev)
     return;
 
-  // Ignore broadcasts from self
-  if (memcmp(mac, devMacAddress, 6) == 0)
+  if (len < (int)sizeof(Header) || len > ESP_NOW_MAX_DATA_LEN)
   {
     return;
   }
 
-  Header header;
-  memcpy(&header, incomingData, sizeof(header));
-
-  // Ignore messages directed at another device type
-  if (header.dest != dev->getDevType())
+  // Ignore broadcasts from self, and multicasts for other nodes before
+  // paying for the copy
+  if (memcmp(mac, devMacAddress, 6) == 0 || !addressedTo(incomingData, dev->receiveMask()))
   {
     return;
   }
 
-  dev->onRecv(header, mac, incomingData, len);
+  RxPacket pkt;
+  pkt.rxUs = esp_timer_get_time();
+  pkt.rssi = memcmp(sniffedMac, mac, 6) == 0 ? sniffedRssi : 0;
+  memcpy(pkt.mac, mac, 6);
+  pkt.len = len;
+  memcpy(pkt.data, incomingData, len);
+  if (xQueueSend(rxQueue, &pkt, 0) != pdTRUE)
+  {
+    rxDropped++;
+  }
 }
 
 void OnSent(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+  TxDone d;
+  memcpy(d.mac, mac_addr, 6);
+  d.success = status == ESP_NOW_SEND_SUCCESS;
+  xQueueSend(txDoneQueue, &d, 0);
+}
+
+// Final outcome of a frame, after the scheduler's retries
+void OnFrameDone(const uint8_t *mac, bool success)
 {
   // Only process if device is initialized
   if (dev)
   {
-    dev->onSent(mac_addr, status);
+    dev->onSent(mac, success ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL);
   }
 }
 
@@ -64,6 +143,9 @@ void setup()
   WiFi.mode(WIFI_STA);
   WiFi.macAddress(devMacAddress);
 
+  rxQueue = xQueueCreate(RX_QUEUE_DEPTH, sizeof(RxPacket));
+  txDoneQueue = xQueueCreate(TxScheduler::POOL, sizeof(TxDone));
+
   // Init ESP-NOW
   if (esp_now_init() != ESP_OK)
   {
@@ -74,9 +156,15 @@ void setup()
   // Initialize device if it was created
   if (dev)
   {
+    radioInit(devMacAddress, OnFrameDone, dev->timerWheel());
     dev->init();
     esp_now_register_recv_cb(OnRecv);
     esp_now_register_send_cb(OnSent);
+
+    wifi_promiscuous_filter_t filter = {WIFI_PROMIS_FILTER_MASK_MGMT};
+    esp_wifi_set_promiscuous_filter(&filter);
+    esp_wifi_set_promiscuous_rx_cb(OnSniff);
+    esp_wifi_set_promiscuous(true);
     Serial.println("Device initialized");
   }
 
@@ -88,6 +176,26 @@ void loop()
   // Only update dev if it's been assigned
   if (dev)
   {
-    dev->update();
+    TxDone d;
+    while (xQueueReceive(txDoneQueue, &d, 0) == pdTRUE)
+    {
+      radioSent(d.mac, d.success);
+    }
+
+    RxPacket pkt;
+    while (xQueueReceive(rxQueue, &pkt, 0) == pdTRUE)
+    {
+      AllocScope scope(allocDispatch);
+      dev->dispatch(pkt.mac, pkt.data, pkt.len, pkt.rxUs, pkt.rssi);
+    }
+
+    AllocScope scope(allocService);
+    dev->service();
+  }
+
+  if (ALLOC_REPORT_S > 0 && millis() - lastReportMs >= ALLOC_REPORT_S * 1000UL)
+  {
+    lastReportMs = millis();
+    allocReport(Serial, REPORT_TASKS, sizeof(REPORT_TASKS) / sizeof(REPORT_TASKS[0]));
   }
 }
\ No newline at end of file
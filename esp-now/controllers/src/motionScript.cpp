@@ -0,0 +1,176 @@
+#include "motionScript.h"
+
+#include <string.h>
+
+size_t MotionScript::length(uint8_t op)
+{
+  switch (op)
+  {
+  case OP_END:
+  case OP_WAIT_ARRIVED:
+  case OP_NEXT:
+    return 1;
+  case OP_LOOP:
+    return 2;
+  case OP_MOVE:
+  case OP_MOVE_BY:
+  case OP_WAIT:
+  case OP_SYNC:
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+bool MotionScript::validate(const uint8_t *code, size_t len)
+{
+  if (len == 0 || len > MAX_CODE)
+  {
+    return false;
+  }
+  size_t depth = 0;
+  for (size_t pc = 0; pc < len;)
+  {
+    uint8_t op = code[pc];
+    size_t n = length(op);
+    if (n == 0 || pc + n > len)
+    {
+      return false;
+    }
+    switch (op)
+    {
+    case OP_MOVE:
+      if (code[pc + 1] > MAX_POS)
+      {
+        return false;
+      }
+      break;
+    case OP_LOOP:
+      if (++depth > MAX_LOOPS)
+      {
+        return false;
+      }
+      break;
+    case OP_NEXT:
+      if (depth-- == 0)
+      {
+        return false;
+      }
+      break;
+    case OP_SYNC:
+      if ((code[pc + 1] | code[pc + 2]) == 0)
+      {
+        return false;
+      }
+      break;
+    }
+    pc += n;
+  }
+  return depth == 0;
+}
+
+bool MotionScript::load(const uint8_t *newCode, size_t newLen, int64_t start, uint8_t position)
+{
+  if (!validate(newCode, newLen))
+  {
+    return false;
+  }
+  memcpy(code, newCode, newLen);
+  len = newLen;
+  pc = 0;
+  depth = 0;
+  running = true;
+  startUs = start;
+  cursorUs = start;
+  waitArrived = false;
+  waitUntilUs = start;
+  lastTarget = position;
+  scripts++;
+  return true;
+}
+
+MotionScript::Step MotionScript::update(int64_t nowUs, bool servoMoving)
+{
+  if (!running || nowUs < startUs)
+  {
+    return STEP_NONE;
+  }
+
+  for (uint8_t steps = 0; steps < STEPS_PER_UPDATE; steps++)
+  {
+    if (waitArrived)
+    {
+      if (servoMoving)
+      {
+        return STEP_NONE;
+      }
+      waitArrived = false;
+      cursorUs = nowUs;
+    }
+    if (waitUntilUs > cursorUs)
+    {
+      if (nowUs < waitUntilUs)
+      {
+        return STEP_NONE;
+      }
+      cursorUs = waitUntilUs;
+    }
+
+    if (pc >= len || code[pc] == OP_END)
+    {
+      running = false;
+      return STEP_DONE;
+    }
+
+    uint8_t op = code[pc];
+    size_t at = pc;
+    pc += length(op);
+    switch (op)
+    {
+    case OP_MOVE:
+    case OP_MOVE_BY:
+    {
+      int target = op == OP_MOVE ? code[at + 1] : lastTarget + (int8_t)code[at + 1];
+      pos = target < 0 ? 0 : target > MAX_POS ? MAX_POS : (uint8_t)target;
+      speed = code[at + 2];
+      lastTarget = pos;
+      moves++;
+      return STEP_MOVE;
+    }
+    case OP_WAIT_ARRIVED:
+      // A move returns from update(), so servoMoving is never from before it
+      waitArrived = true;
+      break;
+    case OP_WAIT:
+      waitUntilUs = cursorUs + (int64_t)arg16(at + 1) * 1000;
+      break;
+    case OP_LOOP:
+      loops[depth].start = (uint16_t)pc;
+      loops[depth].left = code[at + 1];
+      depth++;
+      break;
+    case OP_NEXT:
+    {
+      Loop &l = loops[depth - 1];
+      if (l.left == 0 || --l.left > 0)
+      {
+        pc = l.start;
+      }
+      else
+      {
+        depth--;
+      }
+      break;
+    }
+    case OP_SYNC:
+    {
+      int64_t period = (int64_t)arg16(at + 1) * 1000;
+      // Strictly after, so a move on a boundary followed by SYNC waits a period
+      int64_t since = cursorUs - startUs;
+      waitUntilUs = startUs + (since / period + 1) * period;
+      break;
+    }
+    }
+  }
+  return STEP_NONE;
+}
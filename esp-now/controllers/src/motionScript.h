@@ -0,0 +1,114 @@
+#ifndef MOTION_SCRIPT_H
+#define MOTION_SCRIPT_H
+
+// Interpreter for short motion scripts run on the rear cam, shared with the
+// host simulator.
+//
+// A script is bytecode, one opcode byte followed by its arguments, 16 bit
+// ones little endian:
+//
+//   END                      stop, same as running off the end
+//   MOVE pos speed           start moving to pos, speed ms per degree
+//                            (0 for the camera's usual rate)
+//   MOVE_BY delta speed      the same, delta (signed) from the last target
+//   WAIT_ARRIVED             until the servo has arrived
+//   WAIT ms16                ms after the last wait or arrival ended
+//   LOOP count               repeat up to the matching NEXT count times,
+//                            0 for ever
+//   NEXT
+//   SYNC ms16                until the next multiple of ms since the start,
+//                            a full period if already on one
+//
+// A scan, out and back three times with a pause at each end, is 17 bytes.
+// Scripts run on the hub's clock, so cameras started on the same script at
+// the same time stay together, and SYNC pulls them back in step after moves
+// that took them different times. Waits run from when the last one should have
+// ended, not from when update() noticed, so timing errors don't add up.
+//
+// Memory is fixed: the code is copied in, with a small stack for loops.
+// update() runs at most STEPS_PER_UPDATE instructions, so a loop with no
+// wait in it can't hang the caller.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class MotionScript
+{
+public:
+  static const size_t MAX_CODE = 256;
+  static const size_t MAX_LOOPS = 4;
+  static const uint8_t STEPS_PER_UPDATE = 32;
+  static const uint8_t MAX_POS = 180;
+
+  enum Op : uint8_t
+  {
+    OP_END,
+    OP_MOVE,
+    OP_MOVE_BY,
+    OP_WAIT_ARRIVED,
+    OP_WAIT,
+    OP_LOOP,
+    OP_NEXT,
+    OP_SYNC,
+  };
+
+  // What update() wants done
+  enum Step : uint8_t
+  {
+    STEP_NONE,
+    // Start the move in pos and speed
+    STEP_MOVE,
+    // The script ended
+    STEP_DONE,
+  };
+
+  // True if code can be run: known opcodes with all their arguments,
+  // positions in range, loops matched and no deeper than MAX_LOOPS
+  static bool validate(const uint8_t *code, size_t len);
+  // Bytes an opcode takes with its arguments, 0 if unknown
+  static size_t length(uint8_t op);
+
+  // Copies code in and runs it from startUs, which may be in the future.
+  // position is where the servo is, for MOVE_BY. False if code is invalid,
+  // a running script carries on then.
+  bool load(const uint8_t *code, size_t len, int64_t startUs, uint8_t position);
+  void stop() { running = false; }
+  bool isRunning() const { return running; }
+
+  // Call every loop() pass with the hub's clock and whether the servo is
+  // still moving
+  Step update(int64_t nowUs, bool servoMoving);
+
+  // The move for STEP_MOVE
+  uint8_t pos = 0;
+  uint8_t speed = 0;
+
+  uint32_t scripts = 0;
+  uint32_t moves = 0;
+
+private:
+  struct Loop
+  {
+    uint16_t start;
+    // 0 for ever
+    uint8_t left;
+  };
+
+  uint8_t code[MAX_CODE];
+  size_t len = 0;
+  size_t pc = 0;
+  Loop loops[MAX_LOOPS];
+  size_t depth = 0;
+
+  bool running = false;
+  int64_t startUs = 0;
+  // When the current instruction was meant to start, waits count from here
+  int64_t cursorUs = 0;
+  bool waitArrived = false;
+  int64_t waitUntilUs = 0;
+  uint8_t lastTarget = 0;
+
+  uint16_t arg16(size_t at) const { return code[at] | (code[at + 1] << 8); }
+};
+
+#endif
@@ -0,0 +1,484 @@
+#include "ota.h"
+#include <string.h>
+#include "sha256.h"
+
+static uint16_t chunksFor(uint32_t size)
+{
+  return (uint16_t)((size + OTA_CHUNK_DATA - 1) / OTA_CHUNK_DATA);
+}
+
+static size_t chunkLen(uint32_t size, uint16_t index)
+{
+  uint32_t offset = (uint32_t)index * OTA_CHUNK_DATA;
+  return size - offset < OTA_CHUNK_DATA ? size - offset : OTA_CHUNK_DATA;
+}
+
+void OtaReceiver::statusAfter(int64_t nowUs, uint32_t jitterUs)
+{
+  statusAtUs = nowUs + jitterUs;
+  statusPending = true;
+}
+
+void OtaReceiver::onBegin(const Ota_Begin &m, int64_t nowUs, uint32_t jitterUs)
+{
+  // Repeated announcements of the session we're on just want a status
+  if (m.sessionId == sessionId && st != OTA_IDLE)
+  {
+    statusAfter(nowUs, jitterUs);
+    return;
+  }
+
+  if (st == OTA_PREPARING || st == OTA_RECEIVING || st == OTA_VERIFYING)
+  {
+    storage.abort();
+  }
+
+  sessionId = m.sessionId;
+  imageSize = m.imageSize;
+  chunkCount = m.chunkCount;
+  memcpy(sha256, m.sha256, sizeof(sha256));
+  memset(received, 0, sizeof(received));
+  base = 0;
+  receivedCount = 0;
+  reboot = false;
+
+  bool valid = imageSize > 0 && chunkCount == chunksFor(imageSize) && chunkCount <= MAX_CHUNKS;
+  st = valid ? OTA_PREPARING : OTA_FAILED;
+  statusAfter(nowUs, jitterUs);
+}
+
+void OtaReceiver::onChunk(const Ota_Chunk &m, size_t len, int64_t nowUs, uint32_t jitterUs)
+{
+  if (st != OTA_RECEIVING || m.sessionId != sessionId || m.index >= chunkCount || has(m.index))
+  {
+    return;
+  }
+
+  size_t n = chunkLen(imageSize, m.index);
+  if (len < OTA_CHUNK_HEADER_SIZE + n)
+  {
+    return;
+  }
+
+  if (!storage.write((uint32_t)m.index * OTA_CHUNK_DATA, m.data, n))
+  {
+    st = OTA_FAILED;
+    return;
+  }
+
+  received[m.index / 8] |= 1 << (m.index % 8);
+  receivedCount++;
+  while (base < chunkCount && has(base))
+  {
+    base++;
+  }
+  if (receivedCount == chunkCount)
+  {
+    st = OTA_VERIFYING;
+    statusAfter(nowUs, jitterUs);
+  }
+}
+
+void OtaReceiver::onPoll(const Ota_Poll &m, int64_t nowUs, uint32_t jitterUs)
+{
+  if (m.sessionId == sessionId && st != OTA_IDLE)
+  {
+    statusAfter(nowUs, jitterUs);
+  }
+}
+
+void OtaReceiver::onEnd(const Ota_End &m)
+{
+  if (m.sessionId == sessionId && st == OTA_DONE && m.reboot)
+  {
+    reboot = true;
+  }
+}
+
+void OtaReceiver::update()
+{
+  if (statusPending)
+  {
+    return;
+  }
+
+  if (st == OTA_PREPARING)
+  {
+    st = storage.begin(imageSize) ? OTA_RECEIVING : OTA_FAILED;
+    // Straight away, the sender is waiting on this one
+    statusPending = true;
+  }
+  else if (st == OTA_VERIFYING)
+  {
+    st = storage.finish(sha256) ? OTA_DONE : OTA_FAILED;
+    statusPending = true;
+  }
+}
+
+bool OtaReceiver::statusDue(int64_t nowUs, Ota_Status &out)
+{
+  if (!statusPending || nowUs < statusAtUs)
+  {
+    return false;
+  }
+  statusPending = false;
+
+  out.sessionId = sessionId;
+  out.state = st;
+  out.base = base;
+  memset(out.received, 0, sizeof(out.received));
+  for (uint16_t i = 0; i < OTA_WINDOW && base + i < chunkCount; i++)
+  {
+    if (has(base + i))
+    {
+      out.received[i / 8] |= 1 << (i % 8);
+    }
+  }
+  return true;
+}
+
+void OtaSender::start(const uint8_t *img, uint32_t size, uint32_t sessionId, DevType destType, uint32_t toMask,
+                      uint8_t expectedReceivers, bool rebootWhenDone, int64_t nowUs)
+{
+  image = img;
+  imageSize = size;
+  chunkCount = chunksFor(size);
+  session = sessionId;
+  dest = destType;
+  to = toMask;
+  expected = expectedReceivers;
+  reboot = rebootWhenDone;
+
+  Sha256 sha;
+  sha.update(image, size);
+  sha.finish(sha256);
+
+  memset(receivers, 0, sizeof(receivers));
+  chunksSent = 0;
+  retransmits = 0;
+  polls = 0;
+  highWater = 0;
+  endsSent = 0;
+  phase = BEGIN;
+  phaseUs = nowUs;
+  lastSendUs = nowUs - BEGIN_INTERVAL_US;
+}
+
+void OtaSender::address(Header &h) const
+{
+  h.src = DevType::Hub;
+  h.dest = dest;
+  h.to = to;
+}
+
+bool OtaSender::active(const Receiver &r) const
+{
+  return r.inUse && r.state != OTA_FAILED && r.state != OTA_IDLE;
+}
+
+bool OtaSender::needed(uint16_t index) const
+{
+  for (size_t i = 0; i < MAX_RECEIVERS; i++)
+  {
+    const Receiver &r = receivers[i];
+    if (!active(r) || r.state != OTA_RECEIVING || index < r.base)
+    {
+      continue;
+    }
+    uint16_t bit = index - r.base;
+    if (bit >= OTA_WINDOW || !(r.received[bit / 8] & (1 << (bit % 8))))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Starts the next pass over the window, which begins at the slowest
+// receiver's first missing chunk
+void OtaSender::newPass(int64_t nowUs)
+{
+  bool receiving = false;
+  bool anyActive = false;
+  windowBase = chunkCount;
+  for (size_t i = 0; i < MAX_RECEIVERS; i++)
+  {
+    const Receiver &r = receivers[i];
+    if (!active(r))
+    {
+      continue;
+    }
+    anyActive = true;
+    if (r.state == OTA_RECEIVING)
+    {
+      receiving = true;
+      if (r.base < windowBase)
+      {
+        windowBase = r.base;
+      }
+    }
+  }
+
+  phaseUs = nowUs;
+  if (!anyActive)
+  {
+    phase = FINISHED;
+    return;
+  }
+  if (!receiving)
+  {
+    phase = VERIFY;
+    lastSendUs = nowUs;
+    return;
+  }
+
+  phase = STREAM;
+  cursor = windowBase;
+  windowEnd = windowBase + OTA_WINDOW < chunkCount ? windowBase + OTA_WINDOW : chunkCount;
+}
+
+size_t OtaSender::poll(int64_t nowUs, uint8_t *out, bool everyone)
+{
+  // A repeated poll is only answered by those who missed the first one
+  for (size_t i = 0; i < MAX_RECEIVERS && everyone; i++)
+  {
+    receivers[i].answered = false;
+  }
+
+  Ota_Poll p;
+  address(p);
+  p.sessionId = session;
+  memcpy(out, &p, sizeof(p));
+  polls++;
+  lastSendUs = nowUs;
+  return sizeof(p);
+}
+
+size_t OtaSender::next(int64_t nowUs, uint8_t *out)
+{
+  switch (phase)
+  {
+  case BEGIN:
+  {
+    size_t ready = 0;
+    size_t preparing = 0;
+    for (size_t i = 0; i < MAX_RECEIVERS; i++)
+    {
+      if (receivers[i].inUse && receivers[i].state == OTA_RECEIVING)
+        ready++;
+      else if (receivers[i].inUse && receivers[i].state == OTA_PREPARING)
+        preparing++;
+    }
+
+    bool timedOut = nowUs - phaseUs >= BEGIN_TIMEOUT_US;
+    if ((expected > 0 && ready >= expected) || (expected == 0 && ready > 0 && preparing == 0 && nowUs - phaseUs >= 2 * BEGIN_INTERVAL_US) || timedOut)
+    {
+      // Whoever isn't ready by now is left out
+      for (size_t i = 0; i < MAX_RECEIVERS; i++)
+      {
+        if (receivers[i].inUse && receivers[i].state != OTA_RECEIVING)
+        {
+          receivers[i].state = OTA_FAILED;
+        }
+      }
+      newPass(nowUs);
+      return next(nowUs, out);
+    }
+
+    if (nowUs - lastSendUs < BEGIN_INTERVAL_US)
+    {
+      return 0;
+    }
+    Ota_Begin b;
+    address(b);
+    b.sessionId = session;
+    b.imageSize = imageSize;
+    b.chunkCount = chunkCount;
+    memcpy(b.sha256, sha256, sizeof(sha256));
+    memcpy(out, &b, sizeof(b));
+    lastSendUs = nowUs;
+    return sizeof(b);
+  }
+
+  case STREAM:
+    while (cursor < windowEnd)
+    {
+      uint16_t index = cursor++;
+      if (!needed(index))
+      {
+        continue;
+      }
+
+      Ota_Chunk c;
+      address(c);
+      c.sessionId = session;
+      c.index = index;
+      size_t n = chunkLen(imageSize, index);
+      memcpy(c.data, image + (uint32_t)index * OTA_CHUNK_DATA, n);
+      memcpy(out, &c, OTA_CHUNK_HEADER_SIZE + n);
+
+      chunksSent++;
+      if (index < highWater)
+      {
+        retransmits++;
+      }
+      else
+      {
+        highWater = index + 1;
+      }
+      return OTA_CHUNK_HEADER_SIZE + n;
+    }
+
+    phase = WAIT;
+    phaseUs = nowUs;
+    pollRetries = 0;
+    return poll(nowUs, out);
+
+  case WAIT:
+  {
+    bool all = true;
+    for (size_t i = 0; i < MAX_RECEIVERS; i++)
+    {
+      if (active(receivers[i]) && !receivers[i].answered)
+      {
+        all = false;
+      }
+    }
+    if (!all && nowUs - phaseUs < POLL_TIMEOUT_US)
+    {
+      return 0;
+    }
+    if (!all && pollRetries < POLL_RETRIES)
+    {
+      pollRetries++;
+      phaseUs = nowUs;
+      return poll(nowUs, out, false);
+    }
+
+    for (size_t i = 0; i < MAX_RECEIVERS; i++)
+    {
+      Receiver &r = receivers[i];
+      if (active(r) && nowUs - r.heardUs > SILENCE_TIMEOUT_US)
+      {
+        r.state = OTA_FAILED;
+      }
+    }
+    newPass(nowUs);
+    return next(nowUs, out);
+  }
+
+  case VERIFY:
+  {
+    // Receivers hash the whole partition, which keeps them quiet for a while
+    bool settled = true;
+    for (size_t i = 0; i < MAX_RECEIVERS; i++)
+    {
+      if (active(receivers[i]) && receivers[i].state != OTA_DONE)
+      {
+        settled = false;
+      }
+    }
+    if (!settled && nowUs - phaseUs >= VERIFY_TIMEOUT_US)
+    {
+      for (size_t i = 0; i < MAX_RECEIVERS; i++)
+      {
+        if (active(receivers[i]) && receivers[i].state != OTA_DONE)
+        {
+          receivers[i].state = OTA_FAILED;
+        }
+      }
+      settled = true;
+    }
+    if (settled)
+    {
+      phase = END;
+      phaseUs = nowUs;
+      lastSendUs = nowUs - END_INTERVAL_US;
+      return next(nowUs, out);
+    }
+
+    if (nowUs - lastSendUs < VERIFY_POLL_US)
+    {
+      return 0;
+    }
+    return poll(nowUs, out);
+  }
+
+  case END:
+  {
+    if (endsSent >= END_REPEATS)
+    {
+      phase = FINISHED;
+      return 0;
+    }
+    if (nowUs - lastSendUs < END_INTERVAL_US)
+    {
+      return 0;
+    }
+    // Not acknowledged, a node that misses all of these still boots the
+    // new image on its next reset
+    Ota_End e;
+    address(e);
+    e.sessionId = session;
+    e.reboot = reboot ? 1 : 0;
+    memcpy(out, &e, sizeof(e));
+    endsSent++;
+    lastSendUs = nowUs;
+    return sizeof(e);
+  }
+
+  case FINISHED:
+    break;
+  }
+  return 0;
+}
+
+void OtaSender::onStatus(const Ota_Status &s, int64_t nowUs)
+{
+  if (phase == FINISHED || s.sessionId != session)
+  {
+    return;
+  }
+
+  Receiver *r = nullptr;
+  Receiver *empty = nullptr;
+  for (size_t i = 0; i < MAX_RECEIVERS; i++)
+  {
+    if (receivers[i].inUse && receivers[i].origin == s.origin)
+    {
+      r = &receivers[i];
+      break;
+    }
+    if (!receivers[i].inUse && !empty)
+    {
+      empty = &receivers[i];
+    }
+  }
+
+  // Receivers can only join while the image is announced
+  if (!r)
+  {
+    if (phase != BEGIN || !empty)
+    {
+      return;
+    }
+    r = empty;
+    *r = {};
+    r->inUse = true;
+    r->origin = s.origin;
+  }
+  else if (r->state == OTA_FAILED)
+  {
+    return;
+  }
+
+  r->state = s.state;
+  r->base = s.base;
+  memcpy(r->received, s.received, sizeof(r->received));
+  r->answered = true;
+  r->heardUs = nowUs;
+  if (s.state == OTA_DONE && r->doneUs == 0)
+  {
+    r->doneUs = nowUs;
+  }
+}
@@ -0,0 +1,177 @@
+#ifndef OTA_H
+#define OTA_H
+
+// Firmware distribution over ESP-NOW, shared with the host tools and the
+// simulator.
+//
+// The sender announces the image (size, chunk count, SHA-256) with Ota_Begin
+// until the receivers report that their update partition is erased, then
+// broadcasts chunks. It streams at most OTA_WINDOW chunks ahead of the
+// slowest receiver and then polls; every receiver answers with the first
+// chunk it is missing and a bitmap of the window after it. The next pass
+// resends only what somebody is missing, plus whatever is new in the
+// window. One stream serves any number of receivers.
+//
+// Receivers write every chunk straight to its place in flash, in whatever
+// order it arrives, and hash the partition once it is complete.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "messages.h"
+
+// Where a receiver keeps the image: the inactive OTA partition on a node,
+// memory in the simulator
+class OtaStorage
+{
+public:
+  virtual ~OtaStorage() = default;
+  // Makes room for size bytes, may take seconds (erasing flash)
+  virtual bool begin(uint32_t size) = 0;
+  virtual bool write(uint32_t offset, const uint8_t *data, size_t len) = 0;
+  // True if what was written hashes to sha256, and it will boot next
+  virtual bool finish(const uint8_t *sha256) = 0;
+  virtual void abort() = 0;
+};
+
+class OtaReceiver
+{
+public:
+  // 1.8 MB, more than an app partition of the 4 MB layouts
+  static const uint16_t MAX_CHUNKS = 8192;
+  // Status replies are spread over this so receivers don't collide
+  static const uint32_t STATUS_JITTER_US = 6000;
+
+  explicit OtaReceiver(OtaStorage &storage) : storage(storage) {}
+
+  // Called on receipt, jitterUs is a random delay up to STATUS_JITTER_US
+  void onBegin(const Ota_Begin &m, int64_t nowUs, uint32_t jitterUs);
+  void onChunk(const Ota_Chunk &m, size_t len, int64_t nowUs, uint32_t jitterUs);
+  void onPoll(const Ota_Poll &m, int64_t nowUs, uint32_t jitterUs);
+  void onEnd(const Ota_End &m);
+
+  // Called from loop(), does the slow parts: erasing and verifying. They
+  // wait for the status announcing them to go out, so the sender knows why
+  // the node went quiet.
+  void update();
+
+  // Fills in out when a status should go out now
+  bool statusDue(int64_t nowUs, Ota_Status &out);
+
+  OtaState state() const { return st; }
+  bool rebootRequested() const { return reboot; }
+  uint16_t chunksReceived() const { return receivedCount; }
+
+private:
+  OtaStorage &storage;
+  OtaState st = OTA_IDLE;
+  uint32_t sessionId = 0;
+  uint32_t imageSize = 0;
+  uint16_t chunkCount = 0;
+  uint8_t sha256[32];
+
+  // First missing chunk
+  uint16_t base = 0;
+  uint16_t receivedCount = 0;
+  uint8_t received[MAX_CHUNKS / 8];
+
+  bool statusPending = false;
+  int64_t statusAtUs = 0;
+  bool reboot = false;
+
+  bool has(uint16_t i) const { return received[i / 8] & (1 << (i % 8)); }
+  void statusAfter(int64_t nowUs, uint32_t jitterUs);
+};
+
+class OtaSender
+{
+public:
+  static const size_t MAX_RECEIVERS = 8;
+  static const uint32_t BEGIN_INTERVAL_US = 250000;
+  // Erasing a 1.25 MB partition takes several seconds
+  static const uint32_t BEGIN_TIMEOUT_US = 20000000;
+  // Receivers' status jitter plus the air time of their replies
+  static const uint32_t POLL_TIMEOUT_US = 15000;
+  // Polls repeated for receivers that didn't answer, cheaper than resending
+  // a window's worth of chunks on stale bitmaps
+  static const uint8_t POLL_RETRIES = 2;
+  // A receiver not heard from for this long is dropped
+  static const uint32_t SILENCE_TIMEOUT_US = 5000000;
+  static const uint32_t VERIFY_POLL_US = 250000;
+  static const uint32_t VERIFY_TIMEOUT_US = 15000000;
+  static const uint8_t END_REPEATS = 3;
+  static const uint32_t END_INTERVAL_US = 50000;
+
+  struct Receiver
+  {
+    bool inUse;
+    uint16_t origin;
+    uint8_t state;
+    uint16_t base;
+    uint8_t received[OTA_WINDOW / 8];
+    bool answered;
+    int64_t heardUs;
+    // When it reported OTA_DONE, 0 until then
+    int64_t doneUs;
+  };
+
+  // Starts a session for image (kept by the caller). Frames are addressed
+  // with dest and to as in Header; expected is how many receivers to wait
+  // for before streaming, 0 to take whoever answers in BEGIN_TIMEOUT_US.
+  void start(const uint8_t *image, uint32_t size, uint32_t sessionId, DevType dest, uint32_t to,
+             uint8_t expected, bool reboot, int64_t nowUs);
+
+  // Copies the next frame to broadcast into out (250 bytes) and returns its
+  // length, 0 if nothing is to be sent yet
+  size_t next(int64_t nowUs, uint8_t *out);
+  void onStatus(const Ota_Status &s, int64_t nowUs);
+
+  bool finished() const { return phase == FINISHED; }
+  const Receiver &receiver(size_t i) const { return receivers[i]; }
+  uint16_t chunks() const { return chunkCount; }
+
+  uint32_t chunksSent = 0;
+  uint32_t retransmits = 0;
+  uint32_t polls = 0;
+
+private:
+  enum Phase
+  {
+    BEGIN,
+    STREAM,
+    WAIT,
+    VERIFY,
+    END,
+    FINISHED,
+  };
+
+  const uint8_t *image = nullptr;
+  uint32_t imageSize = 0;
+  uint16_t chunkCount = 0;
+  uint32_t session = 0;
+  DevType dest = DevType::RearCam;
+  uint32_t to = 0;
+  uint8_t expected = 0;
+  bool reboot = false;
+  uint8_t sha256[32];
+
+  Phase phase = FINISHED;
+  int64_t phaseUs = 0;
+  int64_t lastSendUs = 0;
+  uint16_t windowBase = 0;
+  uint16_t windowEnd = 0;
+  uint16_t cursor = 0;
+  // Chunks below this have been sent at least once
+  uint16_t highWater = 0;
+  uint8_t endsSent = 0;
+  uint8_t pollRetries = 0;
+
+  Receiver receivers[MAX_RECEIVERS] = {};
+
+  bool active(const Receiver &r) const;
+  bool needed(uint16_t index) const;
+  void newPass(int64_t nowUs);
+  void address(Header &h) const;
+  size_t poll(int64_t nowUs, uint8_t *out, bool everyone = true);
+};
+
+#endif
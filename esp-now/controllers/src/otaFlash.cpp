@@ -0,0 +1,115 @@
+#include "otaFlash.h"
+#include <Arduino.h>
+#include <esp_image_format.h>
+#include <string.h>
+#include "sha256.h"
+#include "allocStats.h"
+
+// esp_ota_begin() and friends allocate, and they run from the receive path
+static AllocRegion allocOta("ota");
+
+bool OtaFlash::begin(uint32_t size)
+{
+  AllocScope scope(allocOta);
+  abort();
+
+  partition = esp_ota_get_next_update_partition(nullptr);
+  if (!partition || size > partition->size)
+  {
+    Serial.println("OTA: no update partition big enough");
+    return false;
+  }
+
+  // Erases size bytes worth of sectors, a second or more per megabyte
+  unsigned long start = millis();
+  if (esp_ota_begin(partition, size, &handle) != ESP_OK)
+  {
+    handle = 0;
+    return false;
+  }
+  imageSize = size;
+  firstLen = 0;
+  Serial.printf("OTA: erased %s for %u bytes in %lums\n", partition->label, (unsigned)size, millis() - start);
+  return true;
+}
+
+bool OtaFlash::write(uint32_t offset, const uint8_t *data, size_t len)
+{
+  AllocScope scope(allocOta);
+  if (!handle)
+  {
+    return false;
+  }
+  // esp_ota_write() writes at the handle's running total, not at offset 0,
+  // so a chunk 0 resent after later chunks would land on top of them.
+  // Everything goes through esp_ota_write_with_offset() instead, and chunk
+  // 0 waits for finish(): a partition with a valid header is then always
+  // complete.
+  if (offset == 0)
+  {
+    if (len == 0 || len > sizeof(first) || data[0] != ESP_IMAGE_HEADER_MAGIC)
+    {
+      return false;
+    }
+    memcpy(first, data, len);
+    firstLen = len;
+    return true;
+  }
+  return esp_ota_write_with_offset(handle, data, len, offset) == ESP_OK;
+}
+
+bool OtaFlash::finish(const uint8_t *sha256)
+{
+  AllocScope scope(allocOta);
+  if (!handle)
+  {
+    return false;
+  }
+  if (!firstLen || esp_ota_write_with_offset(handle, first, firstLen, 0) != ESP_OK)
+  {
+    abort();
+    return false;
+  }
+
+  Sha256 sha;
+  uint8_t buf[1024];
+  for (uint32_t offset = 0; offset < imageSize; offset += sizeof(buf))
+  {
+    size_t n = imageSize - offset < sizeof(buf) ? imageSize - offset : sizeof(buf);
+    if (esp_partition_read(partition, offset, buf, n) != ESP_OK)
+    {
+      abort();
+      return false;
+    }
+    sha.update(buf, n);
+  }
+  uint8_t digest[32];
+  sha.finish(digest);
+  if (memcmp(digest, sha256, sizeof(digest)) != 0)
+  {
+    Serial.println("OTA: image hash mismatch");
+    abort();
+    return false;
+  }
+
+  // Also validates the image header and segments
+  esp_err_t err = esp_ota_end(handle);
+  handle = 0;
+  if (err != ESP_OK || esp_ota_set_boot_partition(partition) != ESP_OK)
+  {
+    Serial.printf("OTA: image rejected, %d\n", err);
+    return false;
+  }
+  Serial.printf("OTA: %s verified, boots next\n", partition->label);
+  return true;
+}
+
+void OtaFlash::abort()
+{
+  AllocScope scope(allocOta);
+  if (handle)
+  {
+    esp_ota_abort(handle);
+    handle = 0;
+  }
+}
@@ -0,0 +1,26 @@
+#ifndef OTA_FLASH_H
+#define OTA_FLASH_H
+
+#include <esp_ota_ops.h>
+#include "ota.h"
+
+// OtaStorage on the inactive app partition. Chunks land at their offset as
+// they arrive; the partition is erased up front so that's a plain write.
+// Chunk 0 is kept back and written last, once the rest is in flash.
+class OtaFlash : public OtaStorage
+{
+public:
+  bool begin(uint32_t size) override;
+  bool write(uint32_t offset, const uint8_t *data, size_t len) override;
+  bool finish(const uint8_t *sha256) override;
+  void abort() override;
+
+private:
+  const esp_partition_t *partition = nullptr;
+  esp_ota_handle_t handle = 0;
+  uint32_t imageSize = 0;
+  uint8_t first[OTA_CHUNK_DATA];
+  size_t firstLen = 0;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "potFilter.h"
+
+#define MAX_POS_Q8 (180 * 256)
+
+void PotFilter::setRange(uint16_t rawAt0, uint16_t rawAt180)
+{
+  if (rawAt0 == rawAt180)
+  {
+    return;
+  }
+  raw0 = rawAt0;
+  raw180 = rawAt180;
+}
+
+int32_t PotFilter::toDegreesQ8(int32_t readingQ8) const
+{
+  int64_t x = (int64_t)readingQ8 - (int64_t)raw0 * 256 * OVERSAMPLE;
+  int64_t d = x * 180 / (((int32_t)raw180 - (int32_t)raw0) * OVERSAMPLE);
+  return d < 0 ? 0 : d > MAX_POS_Q8 ? MAX_POS_Q8 : (int32_t)d;
+}
+
+void PotFilter::addSamples(const uint16_t *raw, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    sum += raw[i] & 0xfff;
+    if (++summed < OVERSAMPLE)
+    {
+      continue;
+    }
+    int32_t reading = (int32_t)(sum << 8);
+    sum = 0;
+    summed = 0;
+
+    if (!primed)
+    {
+      // Wherever the pot is at boot isn't a move, nothing goes out for it
+      primed = true;
+      filtered = reading;
+      output = toDegreesQ8(filtered);
+      lastSent = output;
+      continue;
+    }
+    filtered += (reading - filtered) >> IIR_SHIFT;
+
+    int32_t pos = toDegreesQ8(filtered);
+    if (pos == 0 || pos == MAX_POS_Q8)
+    {
+      // The band would keep the ends out of reach
+      output = pos;
+    }
+    else if (pos > output + DEADBAND_Q8)
+    {
+      output = pos - DEADBAND_Q8;
+    }
+    else if (pos < output - DEADBAND_Q8)
+    {
+      output = pos + DEADBAND_Q8;
+    }
+  }
+  samples += n;
+}
+
+bool PotFilter::setpoint(int64_t nowUs, uint16_t &posQ8, uint8_t &streamId)
+{
+  if (!primed || (sending && nowUs - lastSentUs < (int64_t)PERIOD_US))
+  {
+    return false;
+  }
+
+  int32_t change = output > lastSent ? output - lastSent : lastSent - output;
+  if (change >= THRESHOLD_Q8)
+  {
+    if (!sending)
+    {
+      sending = true;
+      stream++;
+      streams++;
+    }
+    settleLeft = SETTLE_SETPOINTS;
+    lastSent = output;
+  }
+  else if (sending && settleLeft > 0)
+  {
+    // Still, say so so the receiver stops rather than carrying on
+    if (--settleLeft == 0)
+    {
+      sending = false;
+    }
+  }
+  else
+  {
+    return false;
+  }
+
+  lastSentUs = nowUs;
+  posQ8 = (uint16_t)lastSent;
+  streamId = stream;
+  setpoints++;
+  return true;
+}
@@ -0,0 +1,86 @@
+#ifndef POT_FILTER_H
+#define POT_FILTER_H
+
+// Turns raw ADC samples of a potentiometer into camera setpoints, shared
+// with the host benchmark.
+//
+// Samples come in batches from the ADC's DMA (see analogInput.h). Every
+// OVERSAMPLE of them are summed into one 14 bit reading, which drives a
+// first order IIR filter in fixed point. A deadband of DEADBAND_Q8 around
+// the output keeps ADC noise from moving it: the output only follows the
+// filter once that leaves the band, and then trails it by the band's width.
+//
+// Setpoints are only produced while the output moves. Each is at least
+// THRESHOLD_Q8 from the last one and PERIOD_US after it; once the output
+// stops, SETTLE_SETPOINTS more at the final position tell the receiver the
+// motion is over, then nothing is sent until it moves again. Every burst of
+// motion is a stream of its own, see RearCam_Jog.
+//
+// Positions are in 1/256 degree, 0 to 180 over the ADC's range.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class PotFilter
+{
+public:
+  // ADC conversions per second, the DMA hands them over in frames
+  static const uint32_t SAMPLE_HZ = 1000;
+  // Raw samples summed into one filter input
+  static const uint8_t OVERSAMPLE = 4;
+  // IIR weight of a new input, 1/2^IIR_SHIFT. With 4 ms inputs the time
+  // constant is about 6 ms; 1/4 halves the noise again but doubles the
+  // time to settle, see host/pot_bench.
+  static const uint8_t IIR_SHIFT = 1;
+  // Half width of the deadband, 0.5 degree. ADC noise on the C3 is around
+  // 8 LSB of 4096, 0.35 degree, before oversampling and filtering.
+  static const int32_t DEADBAND_Q8 = 128;
+  // Smallest change worth a setpoint, 0.25 degree
+  static const int32_t THRESHOLD_Q8 = 64;
+  // Setpoints go out at most this often, 50 per second
+  static const uint32_t PERIOD_US = 20000;
+  // Repeats of the final position once the output stops
+  static const uint8_t SETTLE_SETPOINTS = 3;
+
+  // The raw readings at 0 and 180 degrees, 12 bit. Either way round.
+  void setRange(uint16_t rawAt0, uint16_t rawAt180);
+
+  // A batch of 12 bit samples, oldest first
+  void addSamples(const uint16_t *raw, size_t n);
+
+  // True if a setpoint should go out at nowUs, with its position and the
+  // stream it belongs to. Call at least every PERIOD_US.
+  bool setpoint(int64_t nowUs, uint16_t &posQ8, uint8_t &streamId);
+
+  // Deadbanded output, valid once the first reading is in
+  bool ready() const { return primed; }
+  int32_t position() const { return output; }
+
+  uint32_t samples = 0;
+  uint32_t setpoints = 0;
+  uint32_t streams = 0;
+
+private:
+  uint16_t raw0 = 0;
+  uint16_t raw180 = 4095;
+
+  // Oversampling accumulator
+  uint32_t sum = 0;
+  uint8_t summed = 0;
+
+  bool primed = false;
+  // Filter state, the 14 bit reading in Q8
+  int32_t filtered = 0;
+  int32_t output = 0;
+
+  // Motion on the way out
+  bool sending = false;
+  uint8_t settleLeft = 0;
+  uint8_t stream = 0;
+  int32_t lastSent = 0;
+  int64_t lastSentUs = 0;
+
+  int32_t toDegreesQ8(int32_t readingQ8) const;
+};
+
+#endif
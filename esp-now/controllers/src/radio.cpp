@@ -0,0 +1,83 @@
+#include "radio.h"
+#include <esp_system.h>
+#include <esp_timer.h>
+
+static uint16_t origin = 0;
+static uint16_t nextSeq = 0;
+static TxScheduler *tx = nullptr;
+static LinkTable links;
+static RadioSentCallback done = nullptr;
+
+void radioInit(const uint8_t *mac, RadioSentCallback onDone, TimerWheel &timers)
+{
+  static TxScheduler scheduler(timers);
+  tx = &scheduler;
+  origin = radioOriginOf(mac);
+  // A random start keeps frames after a reboot from looking like repeats
+  nextSeq = (uint16_t)esp_random();
+  done = onDone;
+}
+
+uint16_t radioOrigin()
+{
+  return origin;
+}
+
+void radioStamp(Header &msg)
+{
+  msg.origin = origin;
+  msg.seq = nextSeq++;
+  msg.ttl = links.ttlFor(msg.dest, RADIO_DEFAULT_TTL, esp_timer_get_time());
+  msg.hops = 0;
+}
+
+esp_err_t radioQueue(const uint8_t *mac, const uint8_t *frame, size_t len)
+{
+  return tx->enqueue(mac, frame, len) ? ESP_OK : ESP_ERR_ESPNOW_NO_MEM;
+}
+
+esp_err_t radioSend(Header &msg, size_t len)
+{
+  radioStamp(msg);
+  return radioQueue(BROADCAST_ADDR, (const uint8_t *)&msg, len);
+}
+
+void radioService()
+{
+  uint8_t mac[6];
+  uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+  size_t len;
+  while ((len = tx->next(mac, frame)) > 0)
+  {
+    esp_err_t err = esp_now_send(mac, frame, len);
+    if (err == ESP_ERR_ESPNOW_NO_MEM)
+    {
+      // The driver is full, the rest can wait for the next pass
+      tx->handedOff(TxScheduler::BUSY);
+      return;
+    }
+
+    if (!tx->handedOff(err == ESP_OK ? TxScheduler::ACCEPTED : TxScheduler::REFUSED) && done)
+    {
+      done(mac, false);
+    }
+  }
+}
+
+void radioSent(const uint8_t *mac, bool success)
+{
+  if (tx->onSent(mac, success) && done)
+  {
+    done(mac, success);
+  }
+}
+
+const TxScheduler &radioTxStats()
+{
+  return *tx;
+}
+
+LinkTable &radioLinks()
+{
+  return links;
+}
@@ -0,0 +1,47 @@
+#ifndef RADIO_H
+#define RADIO_H
+
+#include <Arduino.h>
+#include <esp_now.h>
+#include "linkTable.h"
+#include "messages.h"
+#include "timerWheel.h"
+#include "txScheduler.h"
+
+// Hops a frame may take by default, enough for a hub, two relays and the
+// far end of a trailer
+#define RADIO_DEFAULT_TTL 3
+
+// A node's origin is the low two bytes of its MAC
+inline uint16_t radioOriginOf(const uint8_t *mac)
+{
+  return (mac[4] << 8) | mac[5];
+}
+
+// Told the final outcome of every frame queued, after any retries
+typedef void (*RadioSentCallback)(const uint8_t *mac, bool success);
+
+// Every frame a node originates goes through here, so it carries an origin
+// and sequence number that relays and receivers deduplicate on. Frames wait
+// in a TxScheduler until the driver has room for them, with their backoffs
+// and callback timeouts on timers, the device's wheel in ms.
+void radioInit(const uint8_t *mac, RadioSentCallback onDone, TimerWheel &timers);
+uint16_t radioOrigin();
+// Fills in origin, seq, ttl and hops. The TTL is 1 when the link table says
+// every node of msg.dest is in direct reach, so relays leave the frame be.
+void radioStamp(Header &msg);
+// Queues len bytes of frame for mac as they are. ESP_ERR_ESPNOW_NO_MEM if
+// the send pool is full, the frame is not reported to onDone then.
+esp_err_t radioQueue(const uint8_t *mac, const uint8_t *frame, size_t len);
+// Stamps msg and queues len bytes of it for broadcast. Broadcasts aren't
+// acknowledged, so they are never retried and onDone always hears success.
+esp_err_t radioSend(Header &msg, size_t len);
+// Call from loop(), hands queued frames to the driver
+void radioService();
+// Call from loop() for every send callback
+void radioSent(const uint8_t *mac, bool success);
+const TxScheduler &radioTxStats();
+// Fed by Base::dispatch() and telemetry resends, see linkTable.h
+LinkTable &radioLinks();
+
+#endif
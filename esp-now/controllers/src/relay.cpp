@@ -0,0 +1,89 @@
+#include "relay.h"
+#include <string.h>
+
+Relay::Seen *Relay::find(uint16_t origin, uint16_t seq)
+{
+  for (size_t i = 0; i < SEEN; i++)
+  {
+    if (seen[i].inUse && seen[i].origin == origin && seen[i].seq == seq)
+    {
+      return &seen[i];
+    }
+  }
+  return nullptr;
+}
+
+bool Relay::firstSighting(uint16_t origin, uint16_t seq)
+{
+  Seen *s = find(origin, seq);
+  if (s)
+  {
+    if (s->copies < 255)
+    {
+      s->copies++;
+    }
+    duplicates++;
+    return false;
+  }
+
+  // Oldest entry makes room
+  seen[seenNext] = {origin, seq, 0, true};
+  seenNext = (seenNext + 1) % SEEN;
+  return true;
+}
+
+bool Relay::schedule(const uint8_t *frame, size_t len, int64_t nowUs, uint32_t backoffUs)
+{
+  if (len < sizeof(Header) || len > sizeof(pending[0].frame))
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < PENDING; i++)
+  {
+    Pending &p = pending[i];
+    if (p.inUse)
+    {
+      continue;
+    }
+
+    Header h;
+    memcpy(&h, frame, sizeof(h));
+    p.inUse = true;
+    p.atUs = nowUs + backoffUs;
+    p.origin = h.origin;
+    p.seq = h.seq;
+    p.len = (uint8_t)len;
+    memcpy(p.frame, frame, len);
+    return true;
+  }
+
+  overflows++;
+  return false;
+}
+
+size_t Relay::due(int64_t nowUs, uint8_t *out)
+{
+  for (size_t i = 0; i < PENDING; i++)
+  {
+    Pending &p = pending[i];
+    if (!p.inUse || nowUs < p.atUs)
+    {
+      continue;
+    }
+    p.inUse = false;
+
+    // Fell out of the cache means a lot went by since, send it anyway
+    Seen *s = find(p.origin, p.seq);
+    if (s && s->copies >= suppressCopies)
+    {
+      suppressed++;
+      continue;
+    }
+
+    relayed++;
+    memcpy(out, p.frame, p.len);
+    return p.len;
+  }
+  return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+// Multi-hop forwarding for ESP-NOW, shared with the host simulator.
+//
+// Every frame carries its origin and a per-origin sequence number (see
+// Header), which is what the recently-seen cache is keyed on. A node that
+// relays waits a random backoff before rebroadcasting with ttl - 1, and
+// gives up if it hears enough copies from neighbours in the meantime: they
+// already covered the area it would.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "messages.h"
+
+class Relay
+{
+public:
+  // Frames remembered for duplicate suppression
+  static const size_t SEEN = 32;
+  // Frames waiting out their backoff
+  static const size_t PENDING = 4;
+  static const uint32_t MAX_BACKOFF_US = 8000;
+  // Copies heard during the backoff that cancel our own rebroadcast. One
+  // cost ~10% delivery in host/relay_sim, where a single copy often came from
+  // a relay behind us; two keeps delivery within ~1% of flooding.
+  static const uint8_t SUPPRESS_COPIES = 2;
+
+  // Records a sighting. Returns false for a frame seen before, which also
+  // counts towards suppressing a pending rebroadcast of it.
+  bool firstSighting(uint16_t origin, uint16_t seq);
+
+  // Queues frame (len bytes, starting with a Header) for rebroadcast after
+  // backoffUs, ttl and hops already stepped. False if the pool is full.
+  bool schedule(const uint8_t *frame, size_t len, int64_t nowUs, uint32_t backoffUs);
+
+  // Copies the next frame whose backoff is over into out (250 bytes) and
+  // returns its length, 0 if none is due. Suppressed frames are skipped.
+  size_t due(int64_t nowUs, uint8_t *out);
+
+  // SUPPRESS_COPIES unless tuned, 255 turns suppression off
+  uint8_t suppressCopies = SUPPRESS_COPIES;
+
+  uint32_t relayed = 0;
+  uint32_t suppressed = 0;
+  uint32_t duplicates = 0;
+  // Frames that found the pending pool full
+  uint32_t overflows = 0;
+
+private:
+  struct Seen
+  {
+    uint16_t origin;
+    uint16_t seq;
+    uint8_t copies;
+    bool inUse;
+  };
+
+  struct Pending
+  {
+    bool inUse;
+    int64_t atUs;
+    uint16_t origin;
+    uint16_t seq;
+    uint8_t len;
+    uint8_t frame[250];
+  };
+
+  Seen seen[SEEN] = {};
+  size_t seenNext = 0;
+  Pending pending[PENDING] = {};
+
+  Seen *find(uint16_t origin, uint16_t seq);
+};
+
+#endif
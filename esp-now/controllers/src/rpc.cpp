@@ -0,0 +1,104 @@
+#include "rpc.h"
+#include "radio.h"
+
+uint16_t RpcClient::call(Header &msg, size_t len, uint32_t timeoutMs, RpcCallback cb, bool wantAccepted)
+{
+  size_t index = MAX_PENDING;
+  for (size_t i = 0; i < MAX_PENDING; i++)
+  {
+    if (!slots[i].inUse)
+    {
+      index = i;
+      break;
+    }
+  }
+  if (index == MAX_PENDING)
+  {
+    return 0;
+  }
+  Slot *slot = &slots[index];
+
+  // Ids from the serial bridge host live in the top half
+  nextId = (nextId + 1) & 0x7FFF;
+  if (nextId == 0)
+  {
+    nextId = 1;
+  }
+
+  msg.corrId = nextId;
+  if (wantAccepted)
+  {
+    msg.flags |= MSG_FLAG_WANT_ACCEPTED;
+  }
+  uint32_t timer = timers.start(timeoutMs, onTimeout, this, index);
+  if (timer == TimerWheel::NONE)
+  {
+    return 0;
+  }
+  if (radioSend(msg, len) != ESP_OK)
+  {
+    timers.cancel(timer);
+    return 0;
+  }
+
+  slot->inUse = true;
+  slot->corrId = nextId;
+  slot->dest = msg.dest;
+  slot->timer = timer;
+  slot->cb = cb;
+  return nextId;
+}
+
+void RpcClient::onReply(const Rpc_Reply &reply)
+{
+  for (size_t i = 0; i < MAX_PENDING; i++)
+  {
+    Slot &slot = slots[i];
+    if (!slot.inUse || slot.corrId != reply.corrId || slot.dest != reply.src)
+    {
+      continue;
+    }
+
+    if (reply.stage != RPC_COMPLETED)
+    {
+      slot.cb(reply);
+      return;
+    }
+
+    // Free the slot first, the callback may well issue the next call
+    RpcCallback cb = std::move(slot.cb);
+    slot.inUse = false;
+    timers.cancel(slot.timer);
+    cb(reply);
+    return;
+  }
+  orphanReplies++;
+}
+
+void RpcClient::onTimeout(void *owner, uint32_t tag)
+{
+  RpcClient &client = *(RpcClient *)owner;
+  Slot &slot = client.slots[tag];
+
+  Rpc_Reply timeout;
+  timeout.src = slot.dest;
+  timeout.corrId = slot.corrId;
+  timeout.stage = RPC_COMPLETED;
+  timeout.status = RPC_TIMEOUT;
+  timeout.value = 0;
+
+  RpcCallback cb = std::move(slot.cb);
+  slot.inUse = false;
+  client.timeouts++;
+  cb(timeout);
+}
+
+size_t RpcClient::pending() const
+{
+  size_t n = 0;
+  for (size_t i = 0; i < MAX_PENDING; i++)
+  {
+    n += slots[i].inUse ? 1 : 0;
+  }
+  return n;
+}
@@ -0,0 +1,54 @@
+#ifndef RPC_H
+#define RPC_H
+
+#include <Arduino.h>
+#include <functional>
+#include "messages.h"
+#include "timerWheel.h"
+
+// Gets every reply for a call: RPC_ACCEPTED if it was asked for, then exactly
+// one RPC_COMPLETED (status RPC_TIMEOUT if nothing came back in time).
+typedef std::function<void(const Rpc_Reply &reply)> RpcCallback;
+
+// Caller side of the request/response layer. Calls wait in a fixed pool of
+// slots until their completion arrives or their timer on the node's wheel
+// fires.
+class RpcClient
+{
+public:
+  static const size_t MAX_PENDING = 8;
+
+  // Every pending call holds one of its timers, in ms
+  explicit RpcClient(TimerWheel &timers) : timers(timers) {}
+
+  // Stamps msg with a fresh corrId and sends it. len is the full message
+  // size. Returns the corrId, or 0 if every slot or timer is taken or the
+  // send failed.
+  uint16_t call(Header &msg, size_t len, uint32_t timeoutMs, RpcCallback cb, bool wantAccepted = false);
+  void onReply(const Rpc_Reply &reply);
+
+  size_t pending() const;
+
+  uint32_t timeouts = 0;
+  // Replies that matched no pending call, e.g. after a timeout
+  uint32_t orphanReplies = 0;
+
+private:
+  struct Slot
+  {
+    bool inUse;
+    uint16_t corrId;
+    DevType dest;
+    uint32_t timer;
+    RpcCallback cb;
+  };
+
+  TimerWheel &timers;
+  Slot slots[MAX_PENDING] = {};
+  uint16_t nextId = 0;
+
+  // Completes slot tag with RPC_TIMEOUT
+  static void onTimeout(void *owner, uint32_t tag);
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "serialBridge.h"
+#include <esp_now.h>
+#include "radio.h"
+
+void SerialBridge::init(const StateCache *cache, BridgeMoveHandler moveHandler)
+{
+  stateCache = cache;
+  onMove = moveHandler;
+
+#if ARDUINO_USB_CDC_ON_BOOT
+  // Don't stall when no host is attached to the USB port
+  Serial.setTxTimeoutMs(0);
+#endif
+}
+
+void SerialBridge::update()
+{
+  uint8_t chunk[READ_CHUNK];
+  int available = Serial.available();
+  if (available <= 0)
+  {
+    return;
+  }
+
+  size_t n = Serial.read(chunk, min((size_t)available, sizeof(chunk)));
+  for (size_t i = 0; i < n; i++)
+  {
+    if (decoder.push(chunk[i]))
+    {
+      handleFrame();
+    }
+  }
+}
+
+void SerialBridge::handleFrame()
+{
+  const BridgeHeader &h = decoder.header();
+  switch (h.kind)
+  {
+  case BRIDGE_RADIO_TX:
+  {
+    addPeer(h.mac);
+
+    // The host builds whole messages, the hub only stamps them as its own
+    uint8_t frame[BRIDGE_MAX_PAYLOAD];
+    size_t len = decoder.payloadLen();
+    memcpy(frame, decoder.payload(), len);
+    if (len >= sizeof(Header))
+    {
+      Header msg;
+      memcpy(&msg, frame, sizeof(msg));
+      radioStamp(msg);
+      memcpy(frame, &msg, sizeof(msg));
+    }
+
+    // The host paces itself on the TX_STATUS every frame gets
+    if (radioQueue(h.mac, frame, len) != ESP_OK)
+    {
+      forwardSent(h.mac, false);
+    }
+    break;
+  }
+  case BRIDGE_PING:
+    write(BRIDGE_PONG, h.mac, decoder.payload(), decoder.payloadLen());
+    break;
+  case BRIDGE_STATE_QUERY:
+    sendStates();
+    break;
+  case BRIDGE_MOVE:
+  {
+    BridgeMove move;
+    if (decoder.payloadLen() != sizeof(move))
+    {
+      break;
+    }
+    memcpy(&move, decoder.payload(), sizeof(move));
+    // Otherwise the hub's onSent() reports the broadcast's outcome
+    if (!onMove || !onMove(move.to, move.pos))
+    {
+      forwardSent(BROADCAST_ADDR, false);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// Keeps the last MAX_PEERS unicast destinations registered, evicting the
+// least recently used. A frame still queued for an evicted peer is refused
+// by the driver and reported to the host as failed.
+void SerialBridge::addPeer(const uint8_t *mac)
+{
+  if (memcmp(mac, BROADCAST_ADDR, 6) == 0)
+  {
+    return;
+  }
+
+  Peer *slot = nullptr;
+  for (size_t i = 0; i < MAX_PEERS; i++)
+  {
+    Peer &p = peers[i];
+    if (p.inUse && memcmp(p.mac, mac, 6) == 0)
+    {
+      p.used = ++peerUses;
+      return;
+    }
+    if (!slot || (slot->inUse && (!p.inUse || p.used < slot->used)))
+    {
+      slot = &p;
+    }
+  }
+
+  if (slot->inUse)
+  {
+    esp_now_del_peer(slot->mac);
+  }
+  slot->inUse = true;
+  memcpy(slot->mac, mac, 6);
+  slot->used = ++peerUses;
+
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, mac, 6);
+  esp_now_add_peer(&peer);
+}
+
+void SerialBridge::sendStates()
+{
+  if (!stateCache)
+  {
+    return;
+  }
+
+  unsigned long now = millis();
+  for (size_t i = 0; i < StateCache::MAX_DEVICES; i++)
+  {
+    const StateCache::Device *d = stateCache->device(i);
+    if (!d)
+    {
+      continue;
+    }
+
+    BridgeDeviceState out;
+    out.devType = d->type;
+    out.bootId = d->bootId;
+    out.seq = d->seq;
+    out.reboots = d->reboots;
+    out.ageMs = now - d->lastHeardMs;
+    out.state = d->state;
+
+    const LinkTable::Peer *link = radioLinks().find(d->origin);
+    out.linkDeliveryPct = link ? link->deliveryPct() : 0;
+    out.linkRssi = link ? link->rssi() : 0;
+    out.linkDirect = link && link->direct;
+    write(BRIDGE_STATE, d->mac, (const uint8_t *)&out, sizeof(out));
+  }
+}
+
+void SerialBridge::write(uint8_t kind, const uint8_t *mac, const uint8_t *payload, size_t len)
+{
+  uint8_t out[BRIDGE_MAX_ENCODED];
+  size_t n = bridgeEncode(kind, mac, payload, len, out);
+
+  // One write per frame, so a frame is never left half written when the
+  // port's buffer fills up
+  if (n == 0 || Serial.availableForWrite() < (int)n)
+  {
+    droppedFrames++;
+    return;
+  }
+  Serial.write(out, n);
+}
+
+void SerialBridge::forwardRecv(const uint8_t *mac, const uint8_t *data, int len)
+{
+  write(BRIDGE_RADIO_RX, mac, data, len);
+}
+
+void SerialBridge::forwardSent(const uint8_t *mac, bool success)
+{
+  uint8_t status = success ? 1 : 0;
+  write(BRIDGE_TX_STATUS, mac, &status, 1);
+}
@@ -0,0 +1,56 @@
+#ifndef SERIAL_BRIDGE_H
+#define SERIAL_BRIDGE_H
+
+#include <Arduino.h>
+#include <functional>
+#include "serialLink.h"
+#include "stateCache.h"
+
+// Forwards frames between the hub's USB serial port and ESP-NOW, so a Linux
+// host can drive the network. Frames are handled as soon as they complete;
+// radio frames then wait in the radio's send pool like the hub's own.
+
+// Sends a BRIDGE_MOVE, false if it couldn't be queued
+typedef std::function<bool(uint32_t to, uint8_t pos)> BridgeMoveHandler;
+
+class SerialBridge
+{
+private:
+  // Max bytes pulled off the serial port per update()
+  static const size_t READ_CHUNK = 64;
+  // Unicast peers registered for the host, well under ESP-NOW's 20
+  static const size_t MAX_PEERS = 4;
+
+  struct Peer
+  {
+    bool inUse;
+    uint8_t mac[6];
+    // Higher is more recently used
+    uint32_t used;
+  };
+
+  BridgeDecoder decoder;
+  const StateCache *stateCache = nullptr;
+  BridgeMoveHandler onMove;
+  Peer peers[MAX_PEERS] = {};
+  uint32_t peerUses = 0;
+
+  void handleFrame();
+  void addPeer(const uint8_t *mac);
+  void sendStates();
+  void write(uint8_t kind, const uint8_t *mac, const uint8_t *payload, size_t len);
+
+public:
+  // Frames dropped because the serial port had no room for them
+  uint32_t droppedFrames = 0;
+
+  void init(const StateCache *cache, BridgeMoveHandler moveHandler);
+  // Call from loop(), reads the serial port and sends radio frames
+  void update();
+  // Hand a received ESP-NOW message to the host
+  void forwardRecv(const uint8_t *mac, const uint8_t *data, int len);
+  // Hand an ESP-NOW send result to the host
+  void forwardSent(const uint8_t *mac, bool success);
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "serialLink.h"
+#include <string.h>
+
+uint16_t crc16(const uint8_t *data, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out)
+{
+  size_t codeAt = 0;
+  size_t o = 1;
+  uint8_t code = 1;
+
+  for (size_t i = 0; i < len; i++)
+  {
+    if (in[i] != 0)
+    {
+      out[o++] = in[i];
+      code++;
+    }
+    if (in[i] == 0 || code == 0xFF)
+    {
+      out[codeAt] = code;
+      codeAt = o++;
+      code = 1;
+    }
+  }
+  out[codeAt] = code;
+  return o;
+}
+
+size_t cobsDecode(const uint8_t *in, size_t len, uint8_t *out)
+{
+  size_t i = 0;
+  size_t o = 0;
+
+  while (i < len)
+  {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > len)
+    {
+      return 0;
+    }
+    for (uint8_t j = 1; j < code; j++)
+    {
+      out[o++] = in[i++];
+    }
+    if (code != 0xFF && i < len)
+    {
+      out[o++] = 0;
+    }
+  }
+  return o;
+}
+
+size_t bridgeEncode(uint8_t kind, const uint8_t *mac, const uint8_t *payload, size_t len, uint8_t *out)
+{
+  uint8_t frame[BRIDGE_MAX_FRAME];
+  if (len > BRIDGE_MAX_PAYLOAD)
+  {
+    return 0;
+  }
+
+  BridgeHeader *h = (BridgeHeader *)frame;
+  h->kind = kind;
+  memcpy(h->mac, mac, sizeof(h->mac));
+  memcpy(frame + sizeof(BridgeHeader), payload, len);
+
+  size_t n = sizeof(BridgeHeader) + len;
+  uint16_t crc = crc16(frame, n);
+  frame[n++] = crc & 0xFF;
+  frame[n++] = crc >> 8;
+
+  out[0] = 0;
+  size_t encoded = cobsEncode(frame, n, out + 1);
+  out[1 + encoded] = 0;
+  return encoded + 2;
+}
+
+bool BridgeDecoder::push(uint8_t byte)
+{
+  if (byte != 0)
+  {
+    if (used < sizeof(buf))
+    {
+      buf[used++] = byte;
+    }
+    else
+    {
+      overflow = true;
+    }
+    return false;
+  }
+
+  // Delimiter, back to back delimiters are just empty frames
+  size_t n = used;
+  bool tooLong = overflow;
+  used = 0;
+  overflow = false;
+  if (n == 0)
+  {
+    return false;
+  }
+
+  // Decoding never grows the data, so it can run in place
+  frameLen = tooLong ? 0 : cobsDecode(buf, n, buf);
+  // The encoded buffer has room for COBS overhead, so a frame of only
+  // literal bytes decodes to a payload longer than BRIDGE_MAX_PAYLOAD
+  if (frameLen < sizeof(BridgeHeader) + 2 || frameLen > BRIDGE_MAX_FRAME)
+  {
+    badFrames++;
+    return false;
+  }
+
+  uint16_t crc = buf[frameLen - 2] | (buf[frameLen - 1] << 8);
+  if (crc16(buf, frameLen - 2) != crc)
+  {
+    badFrames++;
+    return false;
+  }
+  return true;
+}
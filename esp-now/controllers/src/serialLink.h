@@ -0,0 +1,103 @@
+#ifndef SERIAL_LINK_H
+#define SERIAL_LINK_H
+
+// Binary framing for the hub's USB serial port, shared with the host library.
+//
+// A frame on the wire is COBS(BridgeHeader + payload + CRC16) between 0x00
+// delimiters. The leading delimiter means any log text printed between
+// frames only ever costs a dropped junk frame, never a real one.
+//
+// Payloads are ESP-NOW messages from messages.h, unchanged.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "telemetry.h"
+
+#define BRIDGE_MAX_PAYLOAD 250 // ESP_NOW_MAX_DATA_LEN
+
+enum BridgeKind : uint8_t
+{
+  // host -> hub, send the payload over ESP-NOW to mac
+  BRIDGE_RADIO_TX = 1,
+  // hub -> host, payload received over ESP-NOW from mac
+  BRIDGE_RADIO_RX = 2,
+  // hub -> host, payload[0] is 1 if the send to mac succeeded
+  BRIDGE_TX_STATUS = 3,
+  // host -> hub, answered with a PONG carrying the same payload
+  BRIDGE_PING = 4,
+  BRIDGE_PONG = 5,
+  // host -> hub, answered with one STATE per node in the hub's state cache
+  BRIDGE_STATE_QUERY = 6,
+  // hub -> host, payload is a BridgeDeviceState for the node at mac
+  BRIDGE_STATE = 7,
+  // host -> hub, payload is a BridgeMove. The hub sends one RearCam_MoveTo
+  // timed on its own clock, which the host can't read, and answers with the
+  // TX_STATUS of that broadcast.
+  BRIDGE_MOVE = 8,
+};
+
+struct __attribute__((packed)) BridgeHeader
+{
+  uint8_t kind;
+  uint8_t mac[6];
+};
+
+struct __attribute__((packed)) BridgeMove
+{
+  // ADDR_NODE / ADDR_GROUP bits, 0 for every rear cam
+  uint32_t to;
+  uint8_t pos;
+};
+
+struct __attribute__((packed)) BridgeDeviceState
+{
+  uint8_t devType;
+  uint16_t bootId;
+  uint16_t seq;
+  uint32_t reboots;
+  // Time since the node was last heard from
+  uint32_t ageMs;
+  TelemetryState state;
+  // The hub's side of the link, see linkTable.h. Delivery in percent, RSSI
+  // in dBm (0 unknown), direct is 0 while frames to the node go relayed.
+  uint8_t linkDeliveryPct;
+  int8_t linkRssi;
+  uint8_t linkDirect;
+};
+
+#define BRIDGE_MAX_FRAME (sizeof(BridgeHeader) + BRIDGE_MAX_PAYLOAD + 2)
+// Worst case COBS overhead plus both delimiters
+#define BRIDGE_MAX_ENCODED (BRIDGE_MAX_FRAME + BRIDGE_MAX_FRAME / 254 + 1 + 2)
+
+// CRC-16/CCITT-FALSE
+uint16_t crc16(const uint8_t *data, size_t len);
+
+size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out);
+// Returns the decoded length, 0 if the input isn't valid COBS
+size_t cobsDecode(const uint8_t *in, size_t len, uint8_t *out);
+
+// Builds a complete wire frame in out (BRIDGE_MAX_ENCODED bytes), returns its length
+size_t bridgeEncode(uint8_t kind, const uint8_t *mac, const uint8_t *payload, size_t len, uint8_t *out);
+
+// Collects bytes until a delimiter, then decodes and checks the frame in place
+class BridgeDecoder
+{
+private:
+  uint8_t buf[BRIDGE_MAX_ENCODED];
+  size_t used = 0;
+  bool overflow = false;
+  size_t frameLen = 0;
+
+public:
+  uint32_t badFrames = 0;
+
+  // Returns true when byte completed a valid frame
+  bool push(uint8_t byte);
+
+  const BridgeHeader &header() const { return *(const BridgeHeader *)buf; }
+  const uint8_t *payload() const { return buf + sizeof(BridgeHeader); }
+  size_t payloadLen() const { return frameLen - sizeof(BridgeHeader) - 2; }
+};
+
+#endif
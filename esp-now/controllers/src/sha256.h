@@ -0,0 +1,28 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+// Plain SHA-256, so the firmware and the host tools hash OTA images the same
+// way without pulling in mbedtls on the host.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Sha256
+{
+public:
+  Sha256() { reset(); }
+
+  void reset();
+  void update(const uint8_t *data, size_t len);
+  void finish(uint8_t digest[32]);
+
+private:
+  uint32_t h[8];
+  uint8_t block[64];
+  size_t blockLen;
+  uint64_t totalLen;
+
+  void compress(const uint8_t *p);
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "stateCache.h"
+
+StateCache::Device *StateCache::lookup(uint16_t origin, DevType type)
+{
+  Device *empty = nullptr;
+  for (size_t i = 0; i < MAX_DEVICES; i++)
+  {
+    Device &d = devices[i];
+    if (d.inUse && d.origin == origin)
+    {
+      return &d;
+    }
+    if (!d.inUse && !empty)
+    {
+      empty = &d;
+    }
+  }
+
+  if (empty)
+  {
+    *empty = {};
+    empty->inUse = true;
+    empty->origin = origin;
+    empty->mac[4] = origin >> 8;
+    empty->mac[5] = origin & 0xff;
+    empty->type = type;
+  }
+  return empty;
+}
+
+const TelemetryState *StateCache::stateAt(const Device &d, uint16_t seq) const
+{
+  for (size_t i = 0; i < HISTORY; i++)
+  {
+    if (d.history[i].seq == seq)
+    {
+      return &d.history[i].state;
+    }
+  }
+  return nullptr;
+}
+
+void StateCache::onTelemetry(const uint8_t *mac, const RearCam_Telemetry &msg, size_t len, Hub_TelemetryAck &ack)
+{
+  ack.src = DevType::Hub;
+  ack.dest = msg.src;
+  ack.ackFlags = 0;
+  ack.bootId = msg.bootId;
+  ack.ackSeq = msg.telemetrySeq;
+
+  Device *d = lookup(msg.origin, msg.src);
+  if (!d || len < TELEMETRY_HEADER_SIZE || msg.telemetrySeq == 0)
+  {
+    ack.ackFlags = TELEMETRY_ACK_RESYNC;
+    return;
+  }
+  if (msg.hops == 0)
+  {
+    memcpy(d->mac, mac, 6);
+  }
+
+  // A new boot starts over with a full frame
+  if (d->bootId != msg.bootId)
+  {
+    if (msg.baseSeq != 0)
+    {
+      resyncs++;
+      ack.ackFlags = TELEMETRY_ACK_RESYNC;
+      return;
+    }
+    if (d->bootId != 0)
+    {
+      d->reboots++;
+    }
+    d->bootId = msg.bootId;
+    d->seq = 0;
+    memset(d->history, 0, sizeof(d->history));
+  }
+  d->lastHeardMs = millis();
+
+  // Already have it, the earlier acknowledgement got lost
+  if (stateAt(*d, msg.telemetrySeq))
+  {
+    return;
+  }
+
+  static const TelemetryState zero = {};
+  const TelemetryState *base = msg.baseSeq == 0 ? &zero : stateAt(*d, msg.baseSeq);
+  TelemetryState next;
+  if (base)
+  {
+    next = *base;
+  }
+  if (!base || !telemetryApply(msg.data, len - TELEMETRY_HEADER_SIZE, msg.fields, next))
+  {
+    resyncs++;
+    ack.ackFlags = TELEMETRY_ACK_RESYNC;
+    return;
+  }
+
+  d->history[d->historyNext].seq = msg.telemetrySeq;
+  d->history[d->historyNext].state = next;
+  d->historyNext = (d->historyNext + 1) % HISTORY;
+
+  if (d->seq == 0 || telemetrySeqNewer(msg.telemetrySeq, d->seq))
+  {
+    d->seq = msg.telemetrySeq;
+    d->state = next;
+  }
+}
+
+const StateCache::Device *StateCache::find(DevType type) const
+{
+  for (size_t i = 0; i < MAX_DEVICES; i++)
+  {
+    if (devices[i].inUse && devices[i].type == type)
+    {
+      return &devices[i];
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,61 @@
+#ifndef STATE_CACHE_H
+#define STATE_CACHE_H
+
+#include <Arduino.h>
+#include "messages.h"
+#include "telemetry.h"
+
+// Latest known state of every node that reports telemetry, kept on the hub so
+// it can be read without asking the node. Nodes are keyed on their origin
+// (see Header), so one heard both directly and through a relay is one
+// device.
+class StateCache
+{
+public:
+  static const size_t MAX_DEVICES = 4;
+  // Reconstructed states kept per device, frames can be deltas against any
+  // of them since acknowledgements get lost
+  static const size_t HISTORY = 4;
+
+  struct Device
+  {
+    bool inUse;
+    uint16_t origin;
+    // Taken from frames heard directly, until then only the origin bytes
+    uint8_t mac[6];
+    DevType type;
+    uint16_t bootId;
+    // Reboots seen since the hub started
+    uint32_t reboots;
+    unsigned long lastHeardMs;
+
+    uint16_t seq;
+    TelemetryState state;
+
+    struct
+    {
+      uint16_t seq;
+      TelemetryState state;
+    } history[HISTORY];
+    size_t historyNext;
+  };
+
+  // Frames that couldn't be applied and made the node resend in full
+  uint32_t resyncs = 0;
+
+  // Applies a telemetry frame and fills in the acknowledgement to send back,
+  // mac is the last hop's
+  void onTelemetry(const uint8_t *mac, const RearCam_Telemetry &msg, size_t len, Hub_TelemetryAck &ack);
+
+  // nullptr if the device has never reported
+  const Device *find(DevType type) const;
+  const Device *device(size_t i) const { return devices[i].inUse ? &devices[i] : nullptr; }
+
+private:
+  Device devices[MAX_DEVICES] = {};
+
+  Device *lookup(uint16_t origin, DevType type);
+  const TelemetryState *stateAt(const Device &d, uint16_t seq) const;
+};
+
+#endif
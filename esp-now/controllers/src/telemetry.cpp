@@ -0,0 +1,201 @@
+#include "telemetry.h"
+#include "messages.h"
+
+static size_t putVarint(uint32_t v, uint8_t *out)
+{
+  size_t n = 0;
+  while (v >= 0x80)
+  {
+    out[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+static bool getVarint(const uint8_t *data, size_t len, size_t &i, uint32_t &v)
+{
+  v = 0;
+  for (int shift = 0; shift < 35; shift += 7)
+  {
+    if (i >= len)
+    {
+      return false;
+    }
+    uint8_t b = data[i++];
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t telemetryEncode(const TelemetryState &cur, const TelemetryState &base, bool withSlow, uint8_t *out, uint8_t &fields)
+{
+  size_t n = 0;
+  fields = 0;
+
+  if (cur.pos != base.pos)
+  {
+    fields |= TELEMETRY_POS;
+    out[n++] = cur.pos;
+  }
+  if (cur.target != base.target)
+  {
+    fields |= TELEMETRY_TARGET;
+    out[n++] = cur.target;
+  }
+  if (cur.flags != base.flags)
+  {
+    fields |= TELEMETRY_FLAGS;
+    out[n++] = cur.flags;
+  }
+  if (cur.resetReason != base.resetReason)
+  {
+    fields |= TELEMETRY_RESET_REASON;
+    out[n++] = cur.resetReason;
+  }
+  if (withSlow && cur.uptimeS != base.uptimeS)
+  {
+    fields |= TELEMETRY_UPTIME;
+    n += putVarint(cur.uptimeS - base.uptimeS, out + n);
+  }
+
+  uint8_t mask = 0;
+  size_t maskAt = n + 1;
+  size_t m = maskAt;
+  for (uint8_t c = 0; c < TELEMETRY_COUNTER_COUNT; c++)
+  {
+    if (cur.counters[c] != base.counters[c])
+    {
+      mask |= 1 << c;
+      m += putVarint(cur.counters[c] - base.counters[c], out + m);
+    }
+  }
+  if (mask)
+  {
+    fields |= TELEMETRY_COUNTERS;
+    out[n] = mask;
+    n = m;
+  }
+
+  // Absolute values, a delta would be as large whenever they go down
+  if (withSlow && (cur.syncErrorUs != base.syncErrorUs || cur.timedLateUs != base.timedLateUs))
+  {
+    fields |= TELEMETRY_SYNC;
+    n += putVarint(cur.syncErrorUs, out + n);
+    n += putVarint(cur.timedLateUs, out + n);
+  }
+
+  if (withSlow && (cur.linkDeliveryPct != base.linkDeliveryPct || cur.linkRssi != base.linkRssi ||
+                   cur.linkRttUs != base.linkRttUs))
+  {
+    fields |= TELEMETRY_LINK;
+    out[n++] = cur.linkDeliveryPct;
+    out[n++] = (uint8_t)cur.linkRssi;
+    n += putVarint(cur.linkRttUs, out + n);
+  }
+
+  // Worst case is 4 + 5 + 1 + 4 * 5 + 2 * 5 + 2 + 5 = 47 bytes
+  static_assert(47 <= TELEMETRY_MAX_DATA, "telemetry data doesn't fit the frame");
+  return n;
+}
+
+bool telemetryApply(const uint8_t *data, size_t len, uint8_t fields, TelemetryState &state)
+{
+  size_t i = 0;
+  uint8_t *plain[] = {&state.pos, &state.target, &state.flags, &state.resetReason};
+  for (int f = 0; f < 4; f++)
+  {
+    if (fields & (1 << f))
+    {
+      if (i >= len)
+      {
+        return false;
+      }
+      *plain[f] = data[i++];
+    }
+  }
+
+  uint32_t v;
+  if (fields & TELEMETRY_UPTIME)
+  {
+    if (!getVarint(data, len, i, v))
+    {
+      return false;
+    }
+    state.uptimeS += v;
+  }
+
+  if (fields & TELEMETRY_COUNTERS)
+  {
+    if (i >= len)
+    {
+      return false;
+    }
+    uint8_t mask = data[i++];
+    for (uint8_t c = 0; c < TELEMETRY_COUNTER_COUNT; c++)
+    {
+      if (mask & (1 << c))
+      {
+        if (!getVarint(data, len, i, v))
+        {
+          return false;
+        }
+        state.counters[c] += v;
+      }
+    }
+  }
+
+  if (fields & TELEMETRY_SYNC)
+  {
+    if (!getVarint(data, len, i, state.syncErrorUs) || !getVarint(data, len, i, state.timedLateUs))
+    {
+      return false;
+    }
+  }
+
+  if (fields & TELEMETRY_LINK)
+  {
+    if (i + 2 > len)
+    {
+      return false;
+    }
+    state.linkDeliveryPct = data[i++];
+    state.linkRssi = (int8_t)data[i++];
+    if (!getVarint(data, len, i, state.linkRttUs))
+    {
+      return false;
+    }
+  }
+
+  return i == len;
+}
+
+void telemetryCopySlow(const TelemetryState &from, TelemetryState &to)
+{
+  to.uptimeS = from.uptimeS;
+  to.syncErrorUs = from.syncErrorUs;
+  to.timedLateUs = from.timedLateUs;
+  to.linkDeliveryPct = from.linkDeliveryPct;
+  to.linkRssi = from.linkRssi;
+  to.linkRttUs = from.linkRttUs;
+}
+
+bool telemetryChanged(const TelemetryState &a, const TelemetryState &b)
+{
+  if (a.pos != b.pos || a.target != b.target || a.flags != b.flags || a.resetReason != b.resetReason)
+  {
+    return true;
+  }
+  for (uint8_t c = 0; c < TELEMETRY_COUNTER_COUNT; c++)
+  {
+    if (a.counters[c] != b.counters[c])
+    {
+      return true;
+    }
+  }
+  return false;
+}
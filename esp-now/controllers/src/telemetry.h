@@ -0,0 +1,88 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+// Delta encoding of RearCam_Telemetry frames, shared by both ends.
+//
+// A frame only carries the fields that differ from a base state both sides
+// already have: the last frame the hub acknowledged. Positions and flags are
+// sent as new values, uptime and counters as varint increments over the
+// base. A full frame is simply a delta against the all zero state.
+//
+// Uptime, the clock sync and the link figures change all the time, so they
+// only ride along with keepalives and full frames.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_FLAG_MOVING 0x01
+// The node's frames to the hub go out with room for relays, see linkTable.h
+#define TELEMETRY_FLAG_RELAYED 0x02
+// Following a RearCam_Jog stream
+#define TELEMETRY_FLAG_JOGGING 0x04
+// Running a motion script, see motionScript.h
+#define TELEMETRY_FLAG_SCRIPT 0x08
+
+enum TelemetryField : uint8_t
+{
+  TELEMETRY_POS = 0x01,
+  TELEMETRY_TARGET = 0x02,
+  TELEMETRY_FLAGS = 0x04,
+  TELEMETRY_RESET_REASON = 0x08,
+  TELEMETRY_UPTIME = 0x10,
+  // Followed by a mask byte of the counters present
+  TELEMETRY_COUNTERS = 0x20,
+  TELEMETRY_SYNC = 0x40,
+  TELEMETRY_LINK = 0x80,
+};
+
+enum TelemetryCounter : uint8_t
+{
+  TELEMETRY_MOVES,
+  TELEMETRY_RX_FRAMES,
+  TELEMETRY_TX_FAILURES,
+  TELEMETRY_RESYNCS,
+  TELEMETRY_COUNTER_COUNT,
+};
+
+struct TelemetryState
+{
+  uint8_t pos;
+  uint8_t target;
+  uint8_t flags;
+  // esp_reset_reason() of the current boot
+  uint8_t resetReason;
+  uint32_t uptimeS;
+  uint32_t counters[TELEMETRY_COUNTER_COUNT];
+  // ClockSync::errorUs(), UINT32_MAX while not synced
+  uint32_t syncErrorUs;
+  // How late the last timed command started
+  uint32_t timedLateUs;
+  // The node's link to the hub: delivery ratio in percent, RSSI in dBm (0
+  // unknown) and smoothed round trip time (0 unknown)
+  uint8_t linkDeliveryPct;
+  int8_t linkRssi;
+  uint32_t linkRttUs;
+};
+
+// Newer in 16 bit sequence space
+inline bool telemetrySeqNewer(uint16_t a, uint16_t b)
+{
+  return (int16_t)(a - b) > 0;
+}
+
+// Encodes cur against base into out (TELEMETRY_MAX_DATA bytes). Uptime and
+// sync figures are only included when withSlow is set. Returns the data
+// length and sets fields.
+size_t telemetryEncode(const TelemetryState &cur, const TelemetryState &base, bool withSlow, uint8_t *out, uint8_t &fields);
+
+// Copies the fields only sent with withSlow from one state to another
+void telemetryCopySlow(const TelemetryState &from, TelemetryState &to);
+
+// Applies data onto state, which has to hold the frame's base state. Returns
+// false on malformed data, state is undefined then.
+bool telemetryApply(const uint8_t *data, size_t len, uint8_t fields, TelemetryState &state);
+
+// True if anything but the slow fields differs
+bool telemetryChanged(const TelemetryState &a, const TelemetryState &b);
+
+#endif
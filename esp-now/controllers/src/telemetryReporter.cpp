@@ -0,0 +1,106 @@
+#include "telemetryReporter.h"
+#include "radio.h"
+#include <esp_system.h>
+
+void TelemetryReporter::init(DevType src)
+{
+  this->src = src;
+  // Never 0, so the hub can't mistake a fresh cache for this boot
+  do
+  {
+    bootId = (uint16_t)esp_random();
+  } while (bootId == 0);
+}
+
+bool TelemetryReporter::update(const TelemetryState &cur, uint32_t rtoUs)
+{
+  unsigned long now = millis();
+  unsigned long since = now - lastSendMs;
+
+  bool changed = telemetryChanged(cur, lastSent);
+  bool unacked = !hasBase || baseSeq != seq;
+  bool keepalive = since >= KEEPALIVE_MS;
+  // Backed off while the hub stays silent
+  unsigned long retryMs = ((rtoUs + 999) / 1000) << min(unackedSends, MAX_BACKOFF);
+  bool timedOut = sentAny && unacked && since >= retryMs;
+
+  bool due = !sentAny || keepalive || timedOut || (changed && since >= MIN_INTERVAL_MS);
+  if (!due)
+  {
+    return false;
+  }
+
+  // 0 is reserved for "no base"
+  if (++seq == 0)
+  {
+    seq = 1;
+  }
+
+  RearCam_Telemetry msg;
+  msg.src = src;
+  msg.dest = DevType::Hub;
+  msg.bootId = bootId;
+  msg.telemetrySeq = seq;
+
+  static const TelemetryState zero = {};
+  const TelemetryState &from = hasBase ? base : zero;
+  bool withSlow = !hasBase || keepalive;
+  msg.baseSeq = hasBase ? baseSeq : 0;
+  size_t len = telemetryEncode(cur, from, withSlow, msg.data, msg.fields);
+
+  // Remember the state the way the hub will reconstruct it
+  TelemetryState sent = cur;
+  if (!withSlow)
+  {
+    telemetryCopySlow(from, sent);
+  }
+  history[historyNext] = {seq, micros(), sent};
+  historyNext = (historyNext + 1) % HISTORY;
+  lastSent = sent;
+  lastSendMs = now;
+  sentAny = true;
+  if (unackedSends < 255)
+  {
+    unackedSends++;
+  }
+
+  radioSend(msg, TELEMETRY_HEADER_SIZE + len);
+  return timedOut;
+}
+
+uint32_t TelemetryReporter::onAck(const Hub_TelemetryAck &ack)
+{
+  if (ack.bootId != bootId)
+  {
+    return 0;
+  }
+
+  // Every frame has its own seq, so the round trip is never ambiguous
+  uint32_t rttUs = 0;
+  const Sent *acked = nullptr;
+  for (size_t i = 0; i < HISTORY; i++)
+  {
+    if (history[i].seq == ack.ackSeq)
+    {
+      acked = &history[i];
+      rttUs = micros() - acked->sentUs;
+      unackedSends = 0;
+    }
+  }
+
+  if (ack.ackFlags & TELEMETRY_ACK_RESYNC)
+  {
+    hasBase = false;
+    resyncs++;
+    return rttUs;
+  }
+
+  // Only ever move the base forward
+  if (acked && (!hasBase || telemetrySeqNewer(ack.ackSeq, baseSeq)))
+  {
+    hasBase = true;
+    baseSeq = ack.ackSeq;
+    base = acked->state;
+  }
+  return rttUs;
+}
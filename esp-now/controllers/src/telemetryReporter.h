@@ -0,0 +1,63 @@
+#ifndef TELEMETRY_REPORTER_H
+#define TELEMETRY_REPORTER_H
+
+#include <Arduino.h>
+#include "messages.h"
+#include "telemetry.h"
+
+// Sends a node's TelemetryState to the hub, on change and as a keepalive.
+// Frames are deltas against the last state the hub acknowledged.
+class TelemetryReporter
+{
+private:
+  // Changes are batched up to this interval, so a moving servo isn't a flood
+  static const unsigned long MIN_INTERVAL_MS = 100;
+  static const unsigned long KEEPALIVE_MS = 5000;
+  // Resends double the retransmit timeout up to this many times
+  static const uint8_t MAX_BACKOFF = 4;
+  // Sent frames kept around to become the base once acknowledged
+  static const size_t HISTORY = 4;
+
+  struct Sent
+  {
+    uint16_t seq;
+    // micros() when sent, for the round trip to the ack
+    unsigned long sentUs;
+    TelemetryState state;
+  };
+
+  DevType src;
+  uint16_t bootId = 0;
+  uint16_t seq = 0;
+
+  Sent history[HISTORY] = {};
+  size_t historyNext = 0;
+
+  bool hasBase = false;
+  uint16_t baseSeq = 0;
+  TelemetryState base = {};
+
+  TelemetryState lastSent = {};
+  unsigned long lastSendMs = 0;
+  bool sentAny = false;
+  // Frames sent since the last ack
+  uint8_t unackedSends = 0;
+
+public:
+  uint32_t resyncs = 0;
+
+  void init(DevType src);
+  // Call from loop() with the current state and the retransmit timeout
+  // towards the hub, sends a frame when one is due. True if it was a resend
+  // because the last frame went unacknowledged. The resend deadline stays
+  // off the timer wheel: update() compares the state every pass regardless,
+  // and the deadline is one subtraction in it, with the timeout recomputed
+  // from the link's RTT each time.
+  bool update(const TelemetryState &cur, uint32_t rtoUs);
+  // Returns the round trip of the acknowledged frame, 0 if it matched none
+  uint32_t onAck(const Hub_TelemetryAck &ack);
+  // Frames sent since the hub last acknowledged one
+  uint8_t unacknowledged() const { return unackedSends; }
+};
+
+#endif
@@ -0,0 +1,197 @@
+#include "timerWheel.h"
+
+TimerWheel::TimerWheel(Node *pool, size_t count, uint32_t nowTick)
+    : nodes(pool), count(count < END ? count : END), current(nowTick)
+{
+  for (size_t i = 0; i <= FREE_LIST; i++)
+  {
+    heads[i] = END;
+  }
+  for (size_t i = 0; i < this->count; i++)
+  {
+    nodes[i] = {};
+    nodes[i].generation = 1;
+    push(FREE_LIST, (uint16_t)i);
+  }
+  freeCount = this->count;
+}
+
+void TimerWheel::push(uint16_t list, uint16_t i)
+{
+  Node &n = nodes[i];
+  n.list = list;
+  n.prev = END;
+  n.next = heads[list];
+  if (n.next != END)
+  {
+    nodes[n.next].prev = i;
+  }
+  heads[list] = i;
+  if (list < FIRING_LIST)
+  {
+    occupied[list / SLOTS] |= 1ull << (list % SLOTS);
+  }
+}
+
+void TimerWheel::unlink(uint16_t i)
+{
+  Node &n = nodes[i];
+  if (n.prev != END)
+  {
+    nodes[n.prev].next = n.next;
+  }
+  else
+  {
+    heads[n.list] = n.next;
+  }
+  if (n.next != END)
+  {
+    nodes[n.next].prev = n.prev;
+  }
+  if (n.list < FIRING_LIST && heads[n.list] == END)
+  {
+    occupied[n.list / SLOTS] &= ~(1ull << (n.list % SLOTS));
+  }
+}
+
+void TimerWheel::place(uint16_t i)
+{
+  uint32_t due = nodes[i].due;
+  for (uint8_t level = 0; level < LEVELS; level++)
+  {
+    // Slots of this level from the one current is in, modulo the bits the
+    // shift leaves so that wrapped ticks still compare
+    uint8_t shift = level * LEVEL_BITS;
+    uint32_t ahead = (due >> shift) - (current >> shift);
+    if (shift)
+    {
+      ahead &= (1u << (32 - shift)) - 1;
+    }
+    // current's own slot at this level comes round again after SLOTS more
+    if (ahead <= SLOTS || level == LEVELS - 1)
+    {
+      push(level * SLOTS + ((due >> shift) & (SLOTS - 1)), i);
+      return;
+    }
+  }
+}
+
+void TimerWheel::release(uint16_t i)
+{
+  Node &n = nodes[i];
+  n.generation = n.generation == 0xFFFF ? 1 : n.generation + 1;
+  n.cb = nullptr;
+  push(FREE_LIST, i);
+  freeCount++;
+}
+
+uint32_t TimerWheel::start(uint32_t delay, Callback cb, void *owner, uint32_t tag)
+{
+  uint16_t i = heads[FREE_LIST];
+  if (i == END)
+  {
+    exhausted++;
+    return NONE;
+  }
+  unlink(i);
+  freeCount--;
+
+  Node &n = nodes[i];
+  delay = delay < 1 ? 1 : delay > MAX_DELAY ? MAX_DELAY : delay;
+  n.due = current + delay;
+  n.cb = cb;
+  n.owner = owner;
+  n.tag = tag;
+  place(i);
+  return makeId(i, n.generation);
+}
+
+bool TimerWheel::running(uint32_t id) const
+{
+  uint16_t i = id & 0xFFFF;
+  return id != NONE && i < count && nodes[i].generation == id >> 16 && nodes[i].list != FREE_LIST;
+}
+
+bool TimerWheel::cancel(uint32_t id)
+{
+  if (!running(id))
+  {
+    return false;
+  }
+  uint16_t i = id & 0xFFFF;
+  unlink(i);
+  release(i);
+  return true;
+}
+
+void TimerWheel::cascade(uint8_t level, uint8_t slot)
+{
+  uint16_t list = level * SLOTS + slot;
+  uint16_t i = heads[list];
+  heads[list] = END;
+  occupied[level] &= ~(1ull << slot);
+  while (i != END)
+  {
+    uint16_t next = nodes[i].next;
+    place(i);
+    cascaded++;
+    i = next;
+  }
+}
+
+void TimerWheel::advance(uint32_t nowTick)
+{
+  while ((int32_t)(nowTick - current) > 0)
+  {
+    // Skip empty level 0 slots, but not past the end of level 0 where the
+    // levels above have to cascade
+    uint32_t index = (current + 1) & (SLOTS - 1);
+    if (index != 0)
+    {
+      uint64_t ahead = occupied[0] >> index;
+      uint32_t gap = ahead ? __builtin_ctzll(ahead) : SLOTS - index;
+      if ((int32_t)(nowTick - (current + 1 + gap)) < 0)
+      {
+        current = nowTick;
+        return;
+      }
+      current += gap;
+    }
+
+    // current + 1 is the tick to fire. Cascade while current is still the
+    // tick before, so timers land in the slots that tick reaches, top level
+    // first as it may refill the slots below.
+    uint32_t tick = current + 1;
+    uint8_t top = 0;
+    while (top + 1 < LEVELS && (tick & ((1u << ((top + 1) * LEVEL_BITS)) - 1)) == 0)
+    {
+      top++;
+    }
+    for (uint8_t level = top; level >= 1; level--)
+    {
+      cascade(level, (tick >> (level * LEVEL_BITS)) & (SLOTS - 1));
+    }
+
+    // Move the slot aside so callbacks starting timers for 64 ticks ahead
+    // don't land on it
+    uint16_t list = tick & (SLOTS - 1);
+    uint16_t i;
+    while ((i = heads[list]) != END)
+    {
+      unlink(i);
+      push(FIRING_LIST, i);
+    }
+    current = tick;
+
+    while ((i = heads[FIRING_LIST]) != END)
+    {
+      Node &n = nodes[i];
+      Callback cb = n.cb;
+      void *owner = n.owner;
+      uint32_t tag = n.tag;
+      unlink(i);
+      release(i);
+      cb(owner, tag);
+    }
+  }
+}
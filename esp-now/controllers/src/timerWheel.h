@@ -0,0 +1,103 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// Hierarchical timer wheel for deadlines and timeouts, shared with the host
+// benchmark.
+//
+// Five levels of 64 slots, each slot a doubly linked list of timers. A timer
+// goes into the lowest level whose slots still reach its expiry: level 0
+// holds the next 64 ticks one per slot, level 1 the next 4096 in slots of
+// 64 ticks, and so on. Whenever level 0 wraps, the level 1 slot that is now
+// due is emptied into level 0, and likewise up the levels. Starting and
+// cancelling a timer are O(1), and so is expiring one, plus at most one move
+// per level on the way down.
+//
+// A tick is whatever the caller counts in, millis() on the nodes. Ticks are
+// 32 bits and compared by difference, so they may wrap; delays are limited to
+// MAX_DELAY (12 days in ms). advance() skips runs of empty level 0 slots, a
+// loop() that stalled for seconds costs one step per 64 ticks.
+//
+// Timers live in a pool of nodes the caller provides, nothing is allocated.
+// Ids carry a generation, so cancelling a timer that already fired or whose
+// node has been reused is a harmless no-op.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class TimerWheel
+{
+public:
+  static const uint8_t LEVEL_BITS = 6;
+  static const uint8_t SLOTS = 1 << LEVEL_BITS;
+  static const uint8_t LEVELS = 5;
+  // Longest delay, the top level reaches 64 slots of 2^24 ticks ahead
+  static const uint32_t MAX_DELAY = 63u << 24;
+  // Never a valid id
+  static const uint32_t NONE = 0;
+
+  // owner and tag as passed to start()
+  typedef void (*Callback)(void *owner, uint32_t tag);
+
+  struct Node
+  {
+    uint32_t due;
+    uint16_t prev;
+    uint16_t next;
+    // List the node is on, FREE_LIST when not running
+    uint16_t list;
+    uint16_t generation;
+    Callback cb;
+    void *owner;
+    uint32_t tag;
+  };
+
+  // pool must outlive the wheel, at most 65535 nodes. nowTick is the tick
+  // the wheel starts at.
+  TimerWheel(Node *pool, size_t count, uint32_t nowTick);
+
+  // Calls cb(owner, tag) from advance() delay ticks after now(), at least 1
+  // and at most MAX_DELAY, so advance() first. Returns the timer's id, NONE
+  // if the pool is empty.
+  uint32_t start(uint32_t delay, Callback cb, void *owner, uint32_t tag = 0);
+  // True if the timer was still running
+  bool cancel(uint32_t id);
+  bool running(uint32_t id) const;
+
+  // Fires every timer due up to and including nowTick, tick by tick.
+  // Callbacks may start and cancel timers, delays count from the tick
+  // being fired.
+  void advance(uint32_t nowTick);
+
+  uint32_t now() const { return current; }
+  size_t active() const { return count - freeCount; }
+
+  // Timers that found the pool empty
+  uint32_t exhausted = 0;
+  // Moves from a level to the one below, for the benchmark
+  uint32_t cascaded = 0;
+
+private:
+  static const uint16_t END = 0xFFFF;
+  // Lists: the slots level by level, then timers being fired, then free nodes
+  static const uint16_t FIRING_LIST = LEVELS * SLOTS;
+  static const uint16_t FREE_LIST = FIRING_LIST + 1;
+
+  Node *nodes;
+  size_t count;
+  size_t freeCount = 0;
+  uint32_t current;
+  uint16_t heads[FREE_LIST + 1];
+  // Bit per non-empty slot, one word per level
+  uint64_t occupied[LEVELS] = {};
+
+  void push(uint16_t list, uint16_t i);
+  void unlink(uint16_t i);
+  // Puts a running timer on the slot that reaches its expiry from current
+  void place(uint16_t i);
+  // Empties a slot of level into the levels below
+  void cascade(uint8_t level, uint8_t slot);
+  void release(uint16_t i);
+  static uint32_t makeId(uint16_t i, uint16_t generation) { return ((uint32_t)generation << 16) | i; }
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include "txScheduler.h"
+#include <string.h>
+
+bool TxScheduler::enqueue(const uint8_t *mac, const uint8_t *data, size_t len)
+{
+  if (len == 0 || len > sizeof(slots[0].frame))
+  {
+    return false;
+  }
+
+  for (size_t i = 0; i < POOL; i++)
+  {
+    Slot &s = slots[i];
+    if (s.state != FREE)
+    {
+      continue;
+    }
+
+    s.state = QUEUED;
+    s.attempts = 0;
+    s.len = (uint8_t)len;
+    memcpy(s.mac, mac, 6);
+    s.order = nextOrder++;
+    s.timer = TimerWheel::NONE;
+    memcpy(s.frame, data, len);
+    ready++;
+
+    size_t used = queued() + inFlight();
+    if (used > highWater)
+    {
+      highWater = (uint8_t)used;
+    }
+    return true;
+  }
+
+  overflows++;
+  return false;
+}
+
+void TxScheduler::wait(Slot &s, State state, uint32_t us)
+{
+  uint32_t ticks = (us + usPerTick - 1) / usPerTick;
+  s.timer = timers.start(ticks ? ticks : 1, onTimer, this, (uint32_t)(&s - slots));
+  if (s.timer == TimerWheel::NONE && state == BACKOFF)
+  {
+    s.state = QUEUED;
+    ready++;
+    return;
+  }
+  s.state = state;
+}
+
+void TxScheduler::release(Slot &s)
+{
+  timers.cancel(s.timer);
+  s.timer = TimerWheel::NONE;
+  s.state = FREE;
+}
+
+void TxScheduler::onTimer(void *owner, uint32_t tag)
+{
+  TxScheduler &tx = *(TxScheduler *)owner;
+  Slot &s = tx.slots[tag];
+  s.timer = TimerWheel::NONE;
+  if (s.state == BACKOFF)
+  {
+    s.state = QUEUED;
+    tx.ready++;
+  }
+  else if (s.state == IN_FLIGHT)
+  {
+    s.state = FREE;
+    tx.lostCallbacks++;
+  }
+}
+
+uint8_t TxScheduler::inFlightTo(const uint8_t *mac) const
+{
+  uint8_t n = 0;
+  for (size_t i = 0; i < POOL; i++)
+  {
+    if (slots[i].state == IN_FLIGHT && memcmp(slots[i].mac, mac, 6) == 0)
+    {
+      n++;
+    }
+  }
+  return n;
+}
+
+size_t TxScheduler::next(uint8_t *mac, uint8_t *out)
+{
+  if (ready == 0)
+  {
+    return 0;
+  }
+
+  Slot *best = nullptr;
+  for (size_t i = 0; i < POOL; i++)
+  {
+    Slot &s = slots[i];
+    // Wrap safe comparison of enqueue order
+    if (s.state == QUEUED && (!best || (int32_t)(s.order - best->order) < 0))
+    {
+      if (inFlightTo(s.mac) < window)
+      {
+        best = &s;
+      }
+    }
+  }
+
+  if (!best)
+  {
+    return 0;
+  }
+
+  best->state = HANDING;
+  ready--;
+  handing = best;
+  memcpy(mac, best->mac, 6);
+  memcpy(out, best->frame, best->len);
+  return best->len;
+}
+
+bool TxScheduler::handedOff(Handoff result)
+{
+  Slot *s = handing;
+  handing = nullptr;
+  if (!s)
+  {
+    return true;
+  }
+
+  switch (result)
+  {
+  case ACCEPTED:
+    s->attempts++;
+    s->sendOrder = nextSendOrder++;
+    wait(*s, IN_FLIGHT, CALLBACK_TIMEOUT_US);
+    return true;
+  case BUSY:
+    // Not the frame's fault, doesn't use up an attempt
+    wait(*s, BACKOFF, BUSY_US);
+    busy++;
+    return true;
+  default:
+    s->state = FREE;
+    failed++;
+    return false;
+  }
+}
+
+bool TxScheduler::onSent(const uint8_t *mac, bool success)
+{
+  // The one handed to the driver first, which after a retry need not be
+  // the one queued first
+  Slot *oldest = nullptr;
+  for (size_t i = 0; i < POOL; i++)
+  {
+    Slot &s = slots[i];
+    if (s.state == IN_FLIGHT && memcmp(s.mac, mac, 6) == 0 &&
+        (!oldest || (int32_t)(s.sendOrder - oldest->sendOrder) < 0))
+    {
+      oldest = &s;
+    }
+  }
+
+  if (!oldest)
+  {
+    return true;
+  }
+
+  if (success)
+  {
+    release(*oldest);
+    sent++;
+    return true;
+  }
+
+  if (oldest->attempts >= MAX_ATTEMPTS)
+  {
+    release(*oldest);
+    failed++;
+    return true;
+  }
+
+  timers.cancel(oldest->timer);
+  wait(*oldest, BACKOFF, RETRY_US << (oldest->attempts - 1));
+  retries++;
+  return false;
+}
+
+size_t TxScheduler::queued() const
+{
+  size_t n = 0;
+  for (size_t i = 0; i < POOL; i++)
+  {
+    if (slots[i].state == QUEUED || slots[i].state == BACKOFF || slots[i].state == HANDING)
+    {
+      n++;
+    }
+  }
+  return n;
+}
+
+size_t TxScheduler::inFlight() const
+{
+  size_t n = 0;
+  for (size_t i = 0; i < POOL; i++)
+  {
+    if (slots[i].state == IN_FLIGHT)
+    {
+      n++;
+    }
+  }
+  return n;
+}
@@ -0,0 +1,146 @@
+#ifndef TX_SCHEDULER_H
+#define TX_SCHEDULER_H
+
+// Send side flow control for ESP-NOW, shared with the host simulator.
+//
+// esp_now_send() only queues a frame in the WiFi driver, which answers
+// ESP_ERR_ESPNOW_NO_MEM once its buffers are full; the send callback fires
+// when the frame has been on air (and, for unicast, acknowledged). Frames
+// wait here in a fixed pool and are handed to the driver while fewer than
+// WINDOW of them per peer are waiting for their callback. A frame the
+// driver refuses goes back into the pool, one whose callback reports a
+// failure is retried with exponential backoff, up to MAX_ATTEMPTS sends.
+//
+// Callbacks carry only the peer's MAC, so they complete that peer's oldest
+// frame in flight; the driver sends a peer's frames in order. Retries may
+// let later frames to the same peer overtake the one being retried.
+//
+// On the nodes every frame radioSend() originates goes to the broadcast
+// address, so they share one peer and one window, and their callbacks
+// always report success: retries and their backoff only ever apply to the
+// unicasts the hub's serial bridge sends. WINDOW and POOL are sized for
+// that one broadcast queue.
+//
+// Backoffs and callback timeouts are timers on the node's wheel, one per
+// frame at most, so the scheduler never looks at the clock and next() has
+// nothing to do until a frame is ready. If the wheel runs out of timers a
+// backoff is skipped, and a frame in flight waits for its callback without a
+// timeout.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "timerWheel.h"
+
+class TxScheduler
+{
+public:
+  // Frames queued or in flight: a window in the driver and about 40 ms of
+  // air time waiting behind it
+  static const size_t POOL = 16;
+  // Frames per peer handed to the driver and not yet called back. The
+  // driver's depth of 4 keeps the broadcast queue at the air's rate where 2
+  // leaves it idle about 3% of the time, see host/tx_sim --broadcast.
+  static const uint8_t WINDOW = 4;
+  static const uint8_t MAX_ATTEMPTS = 4;
+  // Backoff before the first retry, doubled for every one after
+  static const uint32_t RETRY_US = 2000;
+  // Backoff after the driver refused a frame for lack of buffers
+  static const uint32_t BUSY_US = 1000;
+  // A callback that never came, the frame counts as sent
+  static const uint32_t CALLBACK_TIMEOUT_US = 100000;
+
+  // The wheel's ticks are usPerTick long, ms on the nodes
+  explicit TxScheduler(TimerWheel &timers, uint32_t usPerTick = 1000) : timers(timers), usPerTick(usPerTick) {}
+
+  // What esp_now_send() made of a frame
+  enum Handoff : uint8_t
+  {
+    ACCEPTED,
+    // ESP_ERR_ESPNOW_NO_MEM, tried again after BUSY_US
+    BUSY,
+    // Any other error, the frame is dropped
+    REFUSED,
+  };
+
+  // Copies the frame into the pool. False if the pool is full.
+  bool enqueue(const uint8_t *mac, const uint8_t *data, size_t len);
+
+  // Copies the next frame the driver may take now into out (250 bytes) and
+  // its peer into mac, and returns its length; 0 if nothing can go yet.
+  // Every frame returned must be answered with handedOff().
+  size_t next(uint8_t *mac, uint8_t *out);
+
+  // Returns false if that finished the frame from next(), as a failure
+  bool handedOff(Handoff result);
+
+  // From the send callback. Returns true if a frame is finished, with
+  // success as its outcome, false if it will be retried. Callbacks for
+  // frames sent around the scheduler are passed through as finished.
+  bool onSent(const uint8_t *mac, bool success);
+
+  size_t queued() const;
+  size_t inFlight() const;
+
+  // WINDOW unless tuned
+  uint8_t window = WINDOW;
+
+  uint32_t sent = 0;
+  // Sends after the first, for failed callbacks
+  uint32_t retries = 0;
+  // Frames given up on after MAX_ATTEMPTS or refused by the driver
+  uint32_t failed = 0;
+  // ESP_ERR_ESPNOW_NO_MEM from the driver
+  uint32_t busy = 0;
+  // Frames that found the pool full
+  uint32_t overflows = 0;
+  uint32_t lostCallbacks = 0;
+  // Most frames ever in the pool
+  uint8_t highWater = 0;
+
+private:
+  enum State : uint8_t
+  {
+    FREE,
+    // Ready for next()
+    QUEUED,
+    // Waiting out a backoff on its timer
+    BACKOFF,
+    // Given to next(), waiting for handedOff()
+    HANDING,
+    // Waiting for its callback, or its timer
+    IN_FLIGHT,
+  };
+
+  struct Slot
+  {
+    State state;
+    uint8_t attempts;
+    uint8_t len;
+    uint8_t mac[6];
+    // Enqueue order, oldest goes first
+    uint32_t order;
+    // Order handed to the driver, callbacks come back in it
+    uint32_t sendOrder;
+    // BACKOFF and IN_FLIGHT
+    uint32_t timer;
+    uint8_t frame[250];
+  };
+
+  TimerWheel &timers;
+  const uint32_t usPerTick;
+  Slot slots[POOL] = {};
+  uint32_t nextOrder = 0;
+  uint32_t nextSendOrder = 0;
+  Slot *handing = nullptr;
+  // Slots in QUEUED
+  uint8_t ready = 0;
+
+  uint8_t inFlightTo(const uint8_t *mac) const;
+  // Moves s to state, with a timer of us for BACKOFF and IN_FLIGHT
+  void wait(Slot &s, State state, uint32_t us);
+  void release(Slot &s);
+  // A backoff is over or a callback never came, tag is the slot
+  static void onTimer(void *owner, uint32_t tag);
+};
+
+#endif
@@ -0,0 +1,177 @@
+// Simulates the ESP-NOW clock synchronization with several nodes whose
+// crystals are off by tens of ppm and wander, over a lossy, jittery radio.
+//
+//   clock_sync_sim [--nodes n] [--seconds s] [--loss p] [--seed n]
+//
+// Runs the firmware's ClockSync unchanged. Reports, after a warm up:
+// - the true synchronization error (node's idea of hub time minus hub time)
+//   next to the error the nodes themselves report as their metric
+// - how far apart the nodes fire a command scheduled for one hub timestamp,
+//   the way the rear cam executes timed moves from loop()
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "common/sim.h"
+#include "common/stats.h"
+#include "../esp-now/controllers/src/clockSync.h"
+
+struct Node
+{
+  std::unique_ptr<SimClock> clock;
+  ClockSync sync;
+};
+
+static const uint64_t SEC = 1000000;
+
+int main(int argc, char **argv)
+{
+  int nodeCount = 4;
+  int seconds = 600;
+  LinkModel link;
+  uint64_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    std::string opt = argv[i];
+    if (opt == "--nodes")
+      nodeCount = atoi(argv[i + 1]);
+    else if (opt == "--seconds")
+      seconds = atoi(argv[i + 1]);
+    else if (opt == "--loss")
+      link.loss = atof(argv[i + 1]);
+    else if (opt == "--seed")
+      seed = strtoull(argv[i + 1], nullptr, 10);
+  }
+
+  Sim sim(seed);
+  // The hub is the reference, but its crystal is no better than anyone's
+  SimClock hub((int64_t)sim.uniform(0, 1e9), sim.uniform(-40, 40));
+  std::vector<Node> nodes(nodeCount);
+  for (Node &n : nodes)
+  {
+    n.clock.reset(new SimClock((int64_t)sim.uniform(0, 1e9), sim.uniform(-40, 40)));
+  }
+
+  // Temperature wander, a few hundredths of a ppm per second
+  std::function<void()> wander = [&]()
+  {
+    hub.wander(sim.now, sim.normal(0, 0.02));
+    for (Node &n : nodes)
+    {
+      n.clock->wander(sim.now, sim.normal(0, 0.02));
+    }
+    sim.after(SEC, wander);
+  };
+  sim.after(SEC, wander);
+
+  // Each node's loop() checks for a due time request every pass. The hub
+  // timestamps t2 in the receive callback, then answers from its own loop().
+  std::vector<std::function<void()>> loops(nodes.size());
+  for (size_t i = 0; i < nodes.size(); i++)
+  {
+    loops[i] = [&, i]()
+    {
+      Node &n = nodes[i];
+      int64_t t1 = n.clock->read(sim.now);
+      if (n.sync.requestDue(t1))
+      {
+        n.sync.requestSent(t1);
+        uint64_t up;
+        if (link.deliver(sim, up))
+        {
+          sim.after(up, [&, i, t1]()
+                    {
+            int64_t t2 = hub.read(sim.now + (uint64_t)sim.uniform(0, 50));
+            // Waiting in the rx queue for the hub's loop()
+            sim.after((uint64_t)sim.uniform(50, 2000), [&, i, t1, t2]()
+                      {
+              int64_t t3 = hub.read(sim.now);
+              uint64_t down;
+              if (!link.deliver(sim, down))
+                return;
+              sim.after(down, [&, i, t1, t2, t3]()
+                        {
+                Node &n = nodes[i];
+                int64_t t4 = n.clock->read(sim.now + (uint64_t)sim.uniform(0, 50));
+                n.sync.addSample(t1, t2, t3, t4); }); }); });
+        }
+      }
+      sim.after(10000, loops[i]);
+    };
+    sim.after((uint64_t)sim.uniform(0, 10000), loops[i]);
+  }
+
+  // Sample the true error once a second after warm up
+  const uint64_t warmup = 30 * SEC;
+  Stats trueError, reportedError, drift;
+  std::function<void()> probe = [&]()
+  {
+    int64_t hubNow = hub.read(sim.now);
+    for (Node &n : nodes)
+    {
+      if (!n.sync.synced())
+        continue;
+      trueError.add((double)std::llabs(n.sync.toHub(n.clock->read(sim.now)) - hubNow));
+      reportedError.add(n.sync.errorUs());
+      double truePpm = (1 + hub.currentPpm() / 1e6) / (1 + n.clock->currentPpm() / 1e6) - 1;
+      drift.add(std::fabs(n.sync.driftPpb() / 1000.0 - truePpm * 1e6));
+    }
+    sim.after(SEC, probe);
+  };
+  sim.at(warmup, probe);
+
+  // Every 10 s the hub schedules a command 100 ms ahead. Each node converts
+  // the hub timestamp to its own clock and fires on the first loop() pass
+  // after it, loop() passes being 50 to 300 us apart.
+  Stats spread, lateness;
+  int missed = 0;
+  std::function<void()> command = [&]()
+  {
+    int64_t executeAt = hub.read(sim.now) + 100000;
+    uint64_t ideal = hub.trueTimeOf(executeAt);
+    auto fired = std::make_shared<std::vector<double>>();
+
+    for (Node &n : nodes)
+    {
+      uint64_t delay;
+      if (!link.deliver(sim, delay))
+      {
+        missed++;
+        continue;
+      }
+      sim.after(delay, [&, executeAt, ideal, fired, np = &n]()
+                {
+        int64_t localAt = np->sync.toLocal(executeAt);
+        uint64_t due = np->clock->trueTimeOf(localAt);
+        uint64_t t = std::max(sim.now, due) + (uint64_t)sim.uniform(0, 300);
+        fired->push_back((double)t - (double)ideal);
+        lateness.add((double)t - (double)ideal); });
+    }
+
+    sim.after(SEC, [&, fired]()
+              {
+      if (fired->size() >= 2)
+      {
+        auto mm = std::minmax_element(fired->begin(), fired->end());
+        spread.add(*mm.second - *mm.first);
+      } });
+    sim.after(10 * SEC, command);
+  };
+  sim.at(warmup, command);
+
+  sim.runUntil((uint64_t)seconds * SEC);
+
+  uint32_t rejected = 0;
+  for (Node &n : nodes)
+    rejected += n.sync.rejected;
+
+  printf("%d nodes, %d s, %.0f%% loss, %u samples rejected\n", nodeCount, seconds, link.loss * 100, rejected);
+  trueError.print("true sync error", "us");
+  reportedError.print("reported sync error", "us");
+  drift.print("drift estimate error", "ppm");
+  lateness.print("timed command vs ideal", "us");
+  spread.print("spread across nodes", "us");
+  printf("%d command deliveries lost\n", missed);
+  return 0;
+}
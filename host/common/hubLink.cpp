@@ -0,0 +1,122 @@
+#include "hubLink.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+HubLink::~HubLink()
+{
+  close();
+}
+
+bool HubLink::open(const char *path)
+{
+  fd = ::open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0)
+  {
+    fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  termios tty;
+  if (tcgetattr(fd, &tty) != 0)
+  {
+    fprintf(stderr, "%s is not a serial port\n", path);
+    close();
+    return false;
+  }
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, B115200);
+  cfsetospeed(&tty, B115200);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+  tcsetattr(fd, TCSANOW, &tty);
+  tcflush(fd, TCIOFLUSH);
+  return true;
+}
+
+void HubLink::close()
+{
+  if (fd >= 0)
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+bool HubLink::send(uint8_t kind, const uint8_t *mac, const void *payload, size_t len)
+{
+  if (len > BRIDGE_MAX_PAYLOAD)
+  {
+    return false;
+  }
+
+  uint8_t out[BRIDGE_MAX_ENCODED];
+  size_t n = bridgeEncode(kind, mac, (const uint8_t *)payload, len, out);
+  size_t sent = 0;
+  while (sent < n)
+  {
+    ssize_t w = write(fd, out + sent, n - sent);
+    if (w < 0 && errno != EINTR)
+    {
+      return false;
+    }
+    sent += w > 0 ? w : 0;
+  }
+  return true;
+}
+
+bool HubLink::receive(Frame &frame, int timeoutMs)
+{
+  uint64_t deadline = nowUs() + (uint64_t)timeoutMs * 1000;
+  for (;;)
+  {
+    while (rxHead < rxLen)
+    {
+      if (decoder.push(rx[rxHead++]))
+      {
+        frame.header = decoder.header();
+        frame.len = decoder.payloadLen();
+        memcpy(frame.payload, decoder.payload(), frame.len);
+        return true;
+      }
+    }
+
+    uint64_t now = nowUs();
+    if (now >= deadline)
+    {
+      return false;
+    }
+
+    pollfd p = {fd, POLLIN, 0};
+    int ready = poll(&p, 1, (int)((deadline - now + 999) / 1000));
+    if (ready < 0 && errno != EINTR)
+    {
+      return false;
+    }
+    if (ready <= 0)
+    {
+      continue;
+    }
+
+    ssize_t r = read(fd, rx, sizeof(rx));
+    if (r < 0 && errno != EINTR && errno != EAGAIN)
+    {
+      return false;
+    }
+    if (r == 0 && (p.revents & POLLHUP))
+    {
+      // The other end went away
+      return false;
+    }
+    rxHead = 0;
+    rxLen = r > 0 ? r : 0;
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef HOST_HUB_LINK_H
+#define HOST_HUB_LINK_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../../esp-now/controllers/src/serialLink.h"
+
+// Host end of the hub's binary serial bridge, see serialLink.h for the wire
+// format. Works on a real USB serial port or on a pseudo-terminal.
+class HubLink
+{
+public:
+  struct Frame
+  {
+    BridgeHeader header;
+    uint8_t payload[BRIDGE_MAX_PAYLOAD];
+    size_t len;
+  };
+
+  ~HubLink();
+
+  // Opens the port raw at 115200 baud, returns false on failure
+  bool open(const char *path);
+  void close();
+
+  bool send(uint8_t kind, const uint8_t *mac, const void *payload, size_t len);
+  // Waits up to timeoutMs for the next valid frame
+  bool receive(Frame &frame, int timeoutMs);
+
+  // Junk between frames (hub log lines) and corrupt frames
+  uint32_t badFrames() const { return decoder.badFrames; }
+
+private:
+  int fd = -1;
+  BridgeDecoder decoder;
+  // Bytes read but not yet pushed through the decoder
+  uint8_t rx[512];
+  size_t rxHead = 0;
+  size_t rxLen = 0;
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef HOST_MOTION_ASM_H
+#define HOST_MOTION_ASM_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../../esp-now/controllers/src/motionScript.h"
+
+// Assembles motion script source into the rear cam's bytecode, see
+// motionScript.h. One instruction per line or between semicolons,
+// # starts a comment:
+//
+//   loop 3; move 30 20; arrived; wait 500; move 150 20; arrived; wait 500; next
+//
+// Mnemonics are the opcodes without OP_, with arrived for WAIT_ARRIVED.
+// Returns false with a message in error if the source is bad or the result
+// doesn't validate.
+inline bool assembleMotion(const std::string &source, std::vector<uint8_t> &code, std::string &error)
+{
+  code.clear();
+  std::string text = source;
+  for (char &c : text)
+  {
+    if (c == ';')
+      c = '\n';
+  }
+
+  std::istringstream lines(text);
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(lines, line))
+  {
+    lineNo++;
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    std::string op;
+    if (!(words >> op))
+      continue;
+    std::vector<long> args;
+    std::string word;
+    while (words >> word)
+    {
+      char *end;
+      long v = strtol(word.c_str(), &end, 0);
+      if (*end != '\0')
+      {
+        error = "bad number " + word + " in statement " + std::to_string(lineNo);
+        return false;
+      }
+      args.push_back(v);
+    }
+
+    struct Mnemonic
+    {
+      const char *name;
+      uint8_t op;
+      // Argument sizes in bytes, the second may be left out for moves
+      int args[2];
+    };
+    static const Mnemonic mnemonics[] = {
+        {"end", MotionScript::OP_END, {0, 0}},        {"move", MotionScript::OP_MOVE, {1, 1}},
+        {"move_by", MotionScript::OP_MOVE_BY, {1, 1}}, {"arrived", MotionScript::OP_WAIT_ARRIVED, {0, 0}},
+        {"wait", MotionScript::OP_WAIT, {2, 0}},      {"loop", MotionScript::OP_LOOP, {1, 0}},
+        {"next", MotionScript::OP_NEXT, {0, 0}},      {"sync", MotionScript::OP_SYNC, {2, 0}},
+    };
+    const Mnemonic *m = nullptr;
+    for (const Mnemonic &c : mnemonics)
+    {
+      if (op == c.name)
+        m = &c;
+    }
+    if (!m)
+    {
+      error = "unknown instruction " + op + " in statement " + std::to_string(lineNo);
+      return false;
+    }
+
+    size_t wanted = (m->args[0] != 0) + (m->args[1] != 0);
+    bool speedOptional = m->op == MotionScript::OP_MOVE || m->op == MotionScript::OP_MOVE_BY;
+    if (args.size() == 1 && speedOptional)
+      args.push_back(0);
+    if (args.size() != wanted)
+    {
+      error = op + " takes " + std::to_string(wanted) + " arguments, statement " + std::to_string(lineNo);
+      return false;
+    }
+
+    code.push_back(m->op);
+    for (size_t i = 0; i < wanted; i++)
+    {
+      long lo = m->args[i] == 2 ? 0 : -128, hi = m->args[i] == 2 ? 65535 : 255;
+      if (args[i] < lo || args[i] > hi)
+      {
+        error = std::to_string(args[i]) + " out of range in statement " + std::to_string(lineNo);
+        return false;
+      }
+      code.push_back((uint8_t)(args[i] & 0xff));
+      if (m->args[i] == 2)
+        code.push_back((uint8_t)((args[i] >> 8) & 0xff));
+    }
+  }
+
+  if (!MotionScript::validate(code.data(), code.size()))
+  {
+    error = "script does not validate: a position over 180, a sync of 0, unmatched or too deeply nested loops, or "
+            "too long (" + std::to_string(code.size()) + " bytes)";
+    return false;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef HOST_NET_H
+#define HOST_NET_H
+
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Opens a TCP connection with Nagle off, returns -1 on failure
+inline int tcpConnect(const char *host, const char *port)
+{
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo *res;
+  if (getaddrinfo(host, port, &hints, &res) != 0)
+  {
+    fprintf(stderr, "Could not resolve %s\n", host);
+    return -1;
+  }
+
+  int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0)
+  {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+
+  if (fd >= 0)
+  {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+inline bool sendAll(int fd, const void *data, size_t len)
+{
+  const char *p = (const char *)data;
+  while (len > 0)
+  {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n <= 0)
+    {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <random>
+#include <vector>
+
+// Discrete event loop for the network simulators. Time is true time in
+// microseconds; every node keeps its own clock on top of it.
+class Sim
+{
+public:
+  uint64_t now = 0;
+  std::mt19937_64 rng;
+
+  explicit Sim(uint64_t seed = 1) : rng(seed) {}
+
+  void at(uint64_t t, std::function<void()> fn)
+  {
+    events.push({t, order++, std::move(fn)});
+  }
+  void after(uint64_t dt, std::function<void()> fn) { at(now + dt, std::move(fn)); }
+
+  void runUntil(uint64_t t)
+  {
+    while (!events.empty() && events.top().t <= t)
+    {
+      // Copy out before popping, the handler may schedule more events
+      Event e = events.top();
+      events.pop();
+      now = e.t;
+      e.fn();
+    }
+    now = t;
+  }
+
+  double uniform(double lo, double hi) { return std::uniform_real_distribution<double>(lo, hi)(rng); }
+  double normal(double mean, double sd) { return std::normal_distribution<double>(mean, sd)(rng); }
+  double exponential(double mean) { return std::exponential_distribution<double>(1.0 / mean)(rng); }
+  bool chance(double p) { return uniform(0, 1) < p; }
+
+private:
+  struct Event
+  {
+    uint64_t t;
+    uint64_t order;
+    std::function<void()> fn;
+    bool operator<(const Event &o) const { return t != o.t ? t > o.t : order > o.order; }
+  };
+
+  std::priority_queue<Event> events;
+  uint64_t order = 0;
+};
+
+// One way radio delay: air time plus channel access jitter, with the odd
+// long stall when the channel is busy
+struct LinkModel
+{
+  double baseUs = 600;
+  double jitterMeanUs = 300;
+  double loss = 0.05;
+  double stallChance = 0.05;
+  double stallMaxUs = 15000;
+
+  // Returns false if the frame is lost
+  bool deliver(Sim &sim, uint64_t &delayUs) const
+  {
+    if (sim.chance(loss))
+    {
+      return false;
+    }
+    double d = baseUs + sim.exponential(jitterMeanUs);
+    if (sim.chance(stallChance))
+    {
+      d += sim.uniform(0, stallMaxUs);
+    }
+    delayUs = (uint64_t)d;
+    return true;
+  }
+};
+
+// A crystal that is off by some ppm, wandering slowly with temperature
+class SimClock
+{
+public:
+  SimClock(int64_t offsetUs, double ppm) : base((double)offsetUs), ppm(ppm) {}
+
+  int64_t read(uint64_t t) const { return (int64_t)(base + (double)(t - lastT) * (1 + ppm / 1e6)); }
+
+  // True time at which this clock reads local, assuming no wander in between
+  uint64_t trueTimeOf(int64_t local) const
+  {
+    return lastT + (uint64_t)std::llround(((double)local - base) / (1 + ppm / 1e6));
+  }
+
+  void wander(uint64_t t, double ppmStep)
+  {
+    base = (double)read(t);
+    lastT = t;
+    ppm += ppmStep;
+  }
+
+  double currentPpm() const { return ppm; }
+
+private:
+  uint64_t lastT = 0;
+  double base;
+  double ppm;
+};
+
+#endif
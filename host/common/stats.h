@@ -0,0 +1,55 @@
+#ifndef HOST_STATS_H
+#define HOST_STATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Monotonic time in microseconds
+inline uint64_t nowUs()
+{
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Collects samples and prints percentiles
+class Stats
+{
+private:
+  std::vector<double> samples;
+
+public:
+  void add(double v) { samples.push_back(v); }
+  size_t count() const { return samples.size(); }
+
+  double percentile(double p)
+  {
+    if (samples.empty())
+    {
+      return 0;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t idx = (size_t)(p / 100.0 * (samples.size() - 1) + 0.5);
+    return samples[idx];
+  }
+
+  double mean() const
+  {
+    double sum = 0;
+    for (double v : samples)
+    {
+      sum += v;
+    }
+    return samples.empty() ? 0 : sum / samples.size();
+  }
+
+  void print(const char *name, const char *unit)
+  {
+    printf("%-24s n=%-6zu mean=%-9.1f p50=%-9.1f p95=%-9.1f p99=%-9.1f max=%.1f %s\n",
+           name, count(), mean(), percentile(50), percentile(95), percentile(99), percentile(100), unit);
+  }
+};
+
+#endif
@@ -0,0 +1,153 @@
+// HTTP load generator for the camera web servers. Runs a set of concurrent
+// clients, each doing one request per connection back to back, and reports
+// throughput and latency percentiles for every concurrency level.
+//
+//   http_loadgen <host> [--port p] [--path /api/v1/action/move] [--body 45]
+//                [--method POST] [--clients 1,4,16] [--seconds 10]
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/net.h"
+#include "common/stats.h"
+
+struct Options
+{
+  const char *host;
+  const char *port = "8080";
+  std::string path = "/api/v1/action/move";
+  std::string method = "POST";
+  std::string body = "45";
+  double seconds = 10;
+  std::vector<int> clients = {1, 4, 16};
+};
+
+// Returns the latency in microseconds, or -1 if the request failed
+static long request(const Options &o, const std::string &raw)
+{
+  uint64_t start = nowUs();
+  int fd = tcpConnect(o.host, o.port);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  bool ok = sendAll(fd, raw.data(), raw.size());
+  std::string resp;
+  char buf[512];
+  while (ok)
+  {
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, 5000) <= 0)
+    {
+      ok = false;
+      break;
+    }
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0)
+    {
+      break;
+    }
+    resp.append(buf, n);
+  }
+  close(fd);
+
+  if (!ok || resp.compare(0, 12, "HTTP/1.1 200") != 0)
+  {
+    return -1;
+  }
+  return (long)(nowUs() - start);
+}
+
+static void runLevel(const Options &o, int clients)
+{
+  std::string raw = o.method + " " + o.path + " HTTP/1.1\r\nHost: " + o.host +
+                    "\r\nContent-Length: " + std::to_string(o.body.size()) +
+                    "\r\nConnection: close\r\n\r\n" + o.body;
+
+  std::mutex lock;
+  Stats latency;
+  std::atomic<long> failed(0);
+  uint64_t end = nowUs() + (uint64_t)(o.seconds * 1e6);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; i++)
+  {
+    threads.emplace_back([&]()
+                         {
+                           std::vector<double> mine;
+                           while (nowUs() < end)
+                           {
+                             long us = request(o, raw);
+                             if (us < 0)
+                             {
+                               failed++;
+                               continue;
+                             }
+                             mine.push_back(us / 1000.0);
+                           }
+                           std::lock_guard<std::mutex> g(lock);
+                           for (double v : mine)
+                           {
+                             latency.add(v);
+                           }
+                         });
+  }
+  for (auto &t : threads)
+  {
+    t.join();
+  }
+
+  printf("clients=%-3d ok=%-6zu failed=%-5ld throughput=%.1f req/s\n", clients, latency.count(), failed.load(),
+         latency.count() / o.seconds);
+  latency.print("  latency", "ms");
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <host> [--port p] [--path p] [--method m] [--body b] [--clients 1,4,16] [--seconds n]\n", argv[0]);
+    return 1;
+  }
+
+  Options o;
+  o.host = argv[1];
+  for (int i = 2; i + 1 < argc; i++)
+  {
+    std::string a = argv[i];
+    if (a == "--port")
+      o.port = argv[++i];
+    else if (a == "--path")
+      o.path = argv[++i];
+    else if (a == "--method")
+      o.method = argv[++i];
+    else if (a == "--body")
+      o.body = argv[++i];
+    else if (a == "--seconds")
+      o.seconds = atof(argv[++i]);
+    else if (a == "--clients")
+    {
+      o.clients.clear();
+      std::string list = argv[++i];
+      size_t at = 0;
+      while (at < list.size())
+      {
+        o.clients.push_back(atoi(list.c_str() + at));
+        size_t comma = list.find(',', at);
+        at = comma == std::string::npos ? list.size() : comma + 1;
+      }
+    }
+  }
+
+  for (int c : o.clients)
+  {
+    runLevel(o, c);
+  }
+  return 0;
+}
@@ -0,0 +1,277 @@
+// Compares the rear-camera.ino request handling before and after the switch
+// to HttpParser, per request CPU time and heap churn.
+//
+//   http_parser_bench [iterations]
+//
+// The old handler is reproduced with a String that grows the way
+// arduino-esp32's WString does: 11 bytes inline, then a realloc to the exact
+// new size on every append. The socket and Serial are stand-ins with the same
+// call pattern as on the device (one call per byte for the old code).
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "common/stats.h"
+#include "../rear-camera/httpParser.h"
+
+static size_t allocCount = 0;
+static size_t allocBytes = 0;
+
+void *operator new(size_t n)
+{
+  allocCount++;
+  allocBytes += n;
+  void *p = malloc(n);
+  if (!p)
+  {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Minimal stand-in for Arduino's String, same growth policy
+class LegacyString
+{
+private:
+  static const size_t SSO = 11;
+  char sso[SSO + 1] = {};
+  char *heap = nullptr;
+  size_t len = 0;
+  size_t cap = SSO;
+
+public:
+  ~LegacyString() { free(heap); }
+  const char *c_str() const { return heap ? heap : sso; }
+  size_t length() const { return len; }
+
+  __attribute__((noinline)) LegacyString &operator+=(char c)
+  {
+    if (len + 1 > cap)
+    {
+      char *grown = (char *)realloc(heap, len + 2);
+      allocCount++;
+      allocBytes += len + 2;
+      if (!heap)
+      {
+        memcpy(grown, sso, len + 1);
+      }
+      heap = grown;
+      cap = len + 1;
+    }
+    char *b = heap ? heap : sso;
+    b[len++] = c;
+    b[len] = '\0';
+    return *this;
+  }
+
+  LegacyString &operator=(const char *s)
+  {
+    len = 0;
+    char *b = heap ? heap : sso;
+    b[0] = '\0';
+    while (*s)
+    {
+      *this += *s++;
+    }
+    return *this;
+  }
+
+  int indexOf(const char *s) const
+  {
+    const char *at = strstr(c_str(), s);
+    return at ? (int)(at - c_str()) : -1;
+  }
+};
+
+// Socket stand-in, the whole request is already in the receive buffer
+class FakeClient
+{
+public:
+  const char *data;
+  size_t len;
+  size_t at;
+  size_t written;
+
+  __attribute__((noinline)) int available() { return (int)(len - at); }
+  __attribute__((noinline)) int read() { return at < len ? (uint8_t)data[at++] : -1; }
+  __attribute__((noinline)) size_t read(uint8_t *buf, size_t n)
+  {
+    n = std::min(n, len - at);
+    memcpy(buf, data + at, n);
+    at += n;
+    return n;
+  }
+  __attribute__((noinline)) size_t write(const char *s, size_t n)
+  {
+    written += n;
+    asm volatile("" ::"r"(s) : "memory");
+    return n;
+  }
+  size_t println(const char *s) { return write(s, strlen(s)) + write("\r\n", 2); }
+};
+
+static volatile uint32_t serialSink;
+__attribute__((noinline)) static void serialWrite(char c) { serialSink += c; }
+
+static volatile int movedTo;
+
+// The handler as it was, minus the timeout and the servo
+static void legacyHandle(FakeClient &client)
+{
+  LegacyString currentLine;
+  LegacyString header;
+
+  while (true)
+  {
+    if (client.available())
+    {
+      char c = client.read();
+      serialWrite(c);
+      header += c;
+      if (c == '\n')
+      {
+        if (currentLine.length() == 0)
+        {
+          LegacyString body;
+          while (client.available())
+          {
+            body += (char)client.read();
+          }
+          int position = atoi(body.c_str());
+
+          if (header.indexOf("POST /api/v1/action/move") >= 0)
+          {
+            movedTo = position;
+          }
+
+          client.println("HTTP/1.1 200 OK");
+          client.println("Content-type:application/json");
+          client.println("Connection: close");
+          client.println("");
+          client.println("{\"status\": \"ok\"}");
+          break;
+        }
+        else
+        {
+          currentLine = "";
+        }
+      }
+      else if (c != '\r')
+      {
+        currentLine += c;
+      }
+    }
+    else
+    {
+      break;
+    }
+  }
+}
+
+static HttpParser parser;
+
+// The handler as it is now, minus the timeout and the servo
+static void parserHandle(FakeClient &client)
+{
+  parser.reset();
+  while (int available = client.available())
+  {
+    size_t n = client.read(parser.writePtr(), std::min((size_t)available, parser.writeSpace()));
+    HttpParser::Result result = parser.commit(n);
+    if (result == HttpParser::NeedMore)
+    {
+      continue;
+    }
+
+    char response[192];
+    int len;
+    if (result == HttpParser::Complete && strcmp(parser.method(), "POST") == 0 &&
+        strcmp(parser.path(), "/api/v1/action/move") == 0)
+    {
+      movedTo = atoi(parser.body());
+    }
+    len = snprintf(response, sizeof(response),
+                   "HTTP/1.1 %d %s\r\nContent-type:application/json\r\nConnection: close\r\n\r\n%s\n",
+                   200, "OK", "{\"status\": \"ok\"}");
+    client.write(response, len);
+    break;
+  }
+}
+
+struct Sample
+{
+  const char *name;
+  const char *request;
+};
+
+static const Sample SAMPLES[] = {
+    {"curl POST",
+     "POST /api/v1/action/move HTTP/1.1\r\n"
+     "Host: 192.168.4.20:8080\r\n"
+     "User-Agent: curl/8.4.0\r\n"
+     "Accept: */*\r\n"
+     "Content-Length: 2\r\n"
+     "Content-Type: application/x-www-form-urlencoded\r\n"
+     "\r\n"
+     "45"},
+    {"python-requests POST",
+     "POST /api/v1/action/move HTTP/1.1\r\n"
+     "Host: 192.168.4.20:8080\r\n"
+     "User-Agent: python-requests/2.31.0\r\n"
+     "Accept-Encoding: gzip, deflate\r\n"
+     "Accept: */*\r\n"
+     "Connection: keep-alive\r\n"
+     "Content-Type: application/json\r\n"
+     "Content-Length: 2\r\n"
+     "\r\n"
+     "90"},
+    {"browser GET",
+     "GET /api/v1/status HTTP/1.1\r\n"
+     "Host: 192.168.4.20:8080\r\n"
+     "Connection: keep-alive\r\n"
+     "Cache-Control: max-age=0\r\n"
+     "Upgrade-Insecure-Requests: 1\r\n"
+     "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+     "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+     "Accept-Encoding: gzip, deflate\r\n"
+     "Accept-Language: en-US,en;q=0.9\r\n"
+     "\r\n"},
+};
+
+template <typename F>
+static void run(const char *name, const Sample &sample, F handle, int iterations)
+{
+  FakeClient client = {sample.request, strlen(sample.request), 0, 0};
+
+  size_t allocsBefore = allocCount;
+  size_t bytesBefore = allocBytes;
+  uint64_t start = nowUs();
+  for (int i = 0; i < iterations; i++)
+  {
+    client.at = 0;
+    handle(client);
+  }
+  uint64_t elapsed = nowUs() - start;
+
+  printf("  %-8s %8.1f ns/req %8.1f allocs/req %8.1f bytes/req\n", name,
+         elapsed * 1000.0 / iterations,
+         (double)(allocCount - allocsBefore) / iterations,
+         (double)(allocBytes - bytesBefore) / iterations);
+}
+
+int main(int argc, char **argv)
+{
+  int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+
+  for (const Sample &s : SAMPLES)
+  {
+    printf("%s (%zu bytes)\n", s.name, strlen(s.request));
+    run("legacy", s, legacyHandle, iterations);
+    run("parser", s, parserHandle, iterations);
+  }
+  return 0;
+}
@@ -0,0 +1,755 @@
+// Drives the ESP-NOW network through the hub's binary serial bridge.
+//
+//   hub_cli <port> ping [--count n] [--size bytes]
+//   hub_cli <port> move <pos> [--mac aa:bb:cc:dd:ee:ff] [--to mask] [--wait]
+//   hub_cli <port> sequence <pos> <pos> ...
+//   hub_cli <port> listen [--seconds s]
+//   hub_cli <port> state
+//   hub_cli <port> ota <firmware.bin> [--to mask] [--nodes n] [--no-reboot]
+//   hub_cli <port> jog [--rate hz] [--seconds s] [--mac m] [--to mask]
+//   hub_cli <port> script <source> [--store slot] [--to mask] [--seconds s]
+//   hub_cli <port> script --run slot | --stop [--to mask]
+//   hub_cli <port> preset <slot> <pos> | --here | --clear [--speed ms] [--mac m] [--to mask]
+//   hub_cli <port> recall <slot> [--mac m] [--to mask]
+//
+// ping measures the serial round trip to the hub itself. move sends a
+// RearCam_MoveTo (broadcast unless --mac is given) and waits for the hub to
+// report the ESP-NOW send result, or with --wait makes it a call and waits
+// for the camera to report it arrived. --to makes it one multicast frame for
+// the nodes and groups in mask (see ADDR_NODE / ADDR_GROUP in messages.h),
+// e.g. 0x10000 for every camera. sequence chains such calls, each move
+// starting as soon as the previous one completed. listen prints everything
+// the hub forwards.
+// state dumps the hub's cache of node telemetry, without touching the radio.
+// ota streams a firmware image to every rear cam (or the nodes in --to) at
+// once, waiting for --nodes of them to get ready if given, and reboots them
+// into it once verified.
+// jog streams RearCam_Jog samples of a slow sweep between 30 and 150 degrees
+// at --rate per second (50 by default) for --seconds (10), the way a
+// joystick would drive the camera, and counts the send results.
+// script assembles a motion script (see common/motionAsm.h; source is the
+// text or a file holding it) and runs it on the cameras, waiting up to
+// --seconds (30) for it to end, or stores it in a slot to be run later with
+// --run. --stop ends whatever script is running.
+// preset stores a position in one of the camera's preset slots, with the
+// speed to move there at in ms per degree (0 for the usual), or where the
+// camera is now with --here. recall moves to a slot and waits for the
+// camera to arrive. Slots 0 and 1 are what the hub's switch recalls.
+//
+// <port> is the hub's USB serial device, e.g. /dev/ttyACM0, or the path that
+// hub_stub prints when testing without hardware.
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <vector>
+
+#include "common/hubLink.h"
+#include "common/motionAsm.h"
+#include "common/stats.h"
+#include "../esp-now/controllers/include/messages.h"
+#include "../esp-now/controllers/src/ota.h"
+
+static bool parseMac(const char *s, uint8_t *mac)
+{
+  unsigned int b[6];
+  if (sscanf(s, "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6)
+  {
+    return false;
+  }
+  for (int i = 0; i < 6; i++)
+  {
+    mac[i] = (uint8_t)b[i];
+  }
+  return true;
+}
+
+static void printMac(const uint8_t *mac)
+{
+  printf("%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+static int ping(HubLink &link, int count, size_t size)
+{
+  uint8_t payload[BRIDGE_MAX_PAYLOAD] = {};
+  size = std::max(size, sizeof(uint32_t));
+  size = std::min(size, sizeof(payload));
+
+  Stats rtt;
+  int lost = 0;
+  for (uint32_t seq = 0; seq < (uint32_t)count; seq++)
+  {
+    memcpy(payload, &seq, sizeof(seq));
+    uint64_t start = nowUs();
+    link.send(BRIDGE_PING, BROADCAST_ADDR, payload, size);
+
+    HubLink::Frame f;
+    bool answered = false;
+    while (link.receive(f, 500))
+    {
+      uint32_t got;
+      memcpy(&got, f.payload, sizeof(got));
+      if (f.header.kind == BRIDGE_PONG && f.len == size && got == seq)
+      {
+        answered = true;
+        break;
+      }
+    }
+
+    if (answered)
+    {
+      rtt.add((double)(nowUs() - start));
+    }
+    else
+    {
+      lost++;
+    }
+  }
+
+  printf("%d pings, %zu byte payload, %d lost, %u junk frames\n", count, size, lost, link.badFrames());
+  if (rtt.count() > 0)
+  {
+    rtt.print("rtt", "us");
+  }
+  return lost == count ? 1 : 0;
+}
+
+static int move(HubLink &link, int pos, const uint8_t *mac, uint32_t to)
+{
+  RearCam_MoveTo msg;
+  msg.src = DevType::Hub;
+  msg.dest = DevType::RearCam;
+  msg.to = to;
+  msg.pos = (uint8_t)pos;
+
+  uint64_t start = nowUs();
+  link.send(BRIDGE_RADIO_TX, mac, &msg, sizeof(msg));
+
+  HubLink::Frame f;
+  while (link.receive(f, 1000))
+  {
+    if (f.header.kind == BRIDGE_TX_STATUS && memcmp(f.header.mac, mac, 6) == 0 && f.len >= 1)
+    {
+      printf("%s after %.2fms\n", f.payload[0] ? "delivered" : "send failed", (nowUs() - start) / 1000.0);
+      return f.payload[0] ? 0 : 1;
+    }
+  }
+  fprintf(stderr, "No send status from the hub\n");
+  return 1;
+}
+
+// Has the hub send the move, timed on its clock so every camera in to
+// starts it together, see BRIDGE_MOVE
+static int moveTimed(HubLink &link, int pos, uint32_t to)
+{
+  BridgeMove m;
+  m.to = to;
+  m.pos = (uint8_t)pos;
+
+  uint64_t start = nowUs();
+  link.send(BRIDGE_MOVE, BROADCAST_ADDR, &m, sizeof(m));
+
+  HubLink::Frame f;
+  while (link.receive(f, 1000))
+  {
+    if (f.header.kind == BRIDGE_TX_STATUS && memcmp(f.header.mac, BROADCAST_ADDR, 6) == 0 && f.len >= 1)
+    {
+      printf("%s after %.2fms\n", f.payload[0] ? "sent" : "send failed", (nowUs() - start) / 1000.0);
+      return f.payload[0] ? 0 : 1;
+    }
+  }
+  fprintf(stderr, "No send status from the hub\n");
+  return 1;
+}
+
+// Worst case for a move, a full sweep at 10 ms per degree plus slack
+static const int MOVE_TIMEOUT_MS = 3000;
+
+// Sends msg as a call and waits for its completion. Returns the final
+// status, RPC_TIMEOUT if the camera never answered.
+static RpcStatus call(HubLink &link, Header &msg, size_t len, const uint8_t *mac, uint16_t corrId, int timeoutMs,
+                      bool verbose)
+{
+  msg.src = DevType::Hub;
+  msg.dest = DevType::RearCam;
+  msg.flags |= MSG_FLAG_WANT_ACCEPTED;
+  // Calls from the host keep the top bit set so they never collide with the hub's own
+  msg.corrId = 0x8000 | corrId;
+
+  uint64_t start = nowUs();
+  link.send(BRIDGE_RADIO_TX, mac, &msg, len);
+
+  HubLink::Frame f;
+  while (nowUs() - start < (uint64_t)timeoutMs * 1000 && link.receive(f, timeoutMs))
+  {
+    if (f.header.kind != BRIDGE_RADIO_RX || f.len < sizeof(Rpc_Reply))
+    {
+      continue;
+    }
+    Rpc_Reply r;
+    memcpy(&r, f.payload, sizeof(r));
+    if (r.msgType != MessageType::Rpc_Reply || r.corrId != msg.corrId)
+    {
+      continue;
+    }
+
+    double ms = (nowUs() - start) / 1000.0;
+    if (r.stage == RPC_ACCEPTED)
+    {
+      if (verbose)
+        printf("accepted after %.2fms\n", ms);
+      continue;
+    }
+    if (verbose)
+      printf("completed after %.2fms, status %d, at %d\n", ms, r.status, r.value);
+    return (RpcStatus)r.status;
+  }
+
+  if (verbose)
+    printf("no completion within %dms\n", timeoutMs);
+  return RPC_TIMEOUT;
+}
+
+static RpcStatus moveCall(HubLink &link, int pos, const uint8_t *mac, uint32_t to, uint16_t corrId, bool verbose)
+{
+  RearCam_MoveTo msg;
+  msg.to = to;
+  msg.pos = (uint8_t)pos;
+  return call(link, msg, sizeof(msg), mac, corrId, MOVE_TIMEOUT_MS, verbose);
+}
+
+// Stores pos in slot, or where the camera is if pos is negative, or clears
+// the slot
+static int preset(HubLink &link, int slot, int pos, int speed, bool clear, const uint8_t *mac, uint32_t to)
+{
+  RearCam_Preset msg;
+  msg.to = to;
+  msg.action = clear ? PRESET_CLEAR : pos < 0 ? PRESET_SET_HERE : PRESET_SET;
+  msg.slot = (uint8_t)slot;
+  msg.pos = (uint8_t)(pos < 0 ? 0 : pos);
+  msg.speed = (uint8_t)speed;
+  return call(link, msg, sizeof(msg), mac, (uint16_t)nowUs(), 1000, true) == RPC_OK ? 0 : 1;
+}
+
+static int recall(HubLink &link, int slot, const uint8_t *mac, uint32_t to)
+{
+  RearCam_Recall msg;
+  msg.to = to;
+  msg.slot = (uint8_t)slot;
+  int timeoutMs = 180 * PRESET_MAX_MS_PER_DEGREE + 1000;
+  return call(link, msg, sizeof(msg), mac, (uint16_t)nowUs(), timeoutMs, true) == RPC_OK ? 0 : 1;
+}
+
+static int sequence(HubLink &link, int count, char **positions, const uint8_t *mac, uint32_t to)
+{
+  uint64_t start = nowUs();
+  for (int i = 0; i < count; i++)
+  {
+    int pos = atoi(positions[i]);
+    uint64_t stepStart = nowUs();
+    RpcStatus status = moveCall(link, pos, mac, to, (uint16_t)(nowUs() + i), false);
+    printf("%-4d %8.2fms status %d\n", pos, (nowUs() - stepStart) / 1000.0, status);
+    if (status != RPC_OK)
+    {
+      return 1;
+    }
+  }
+
+  // What the same sequence costs when every step sleeps for a full sweep
+  printf("total %.2fms, %.0fms with worst case delays\n", (nowUs() - start) / 1000.0, count * 1800.0);
+  return 0;
+}
+
+static int state(HubLink &link)
+{
+  link.send(BRIDGE_STATE_QUERY, BROADCAST_ADDR, nullptr, 0);
+
+  // One frame per known node, the hub sends them back to back
+  HubLink::Frame f;
+  int nodes = 0;
+  while (link.receive(f, 200))
+  {
+    if (f.header.kind != BRIDGE_STATE || f.len != sizeof(BridgeDeviceState))
+    {
+      continue;
+    }
+    BridgeDeviceState d;
+    memcpy(&d, f.payload, sizeof(d));
+    const TelemetryState &s = d.state;
+
+    printMac(f.header.mac);
+    printf(" type=%d boot=%04x seq=%u reboots=%u age=%ums\n", d.devType, d.bootId, d.seq, d.reboots, d.ageMs);
+    printf("  pos=%u target=%u moving=%d jogging=%d script=%d reset=%u uptime=%us\n", s.pos, s.target,
+           (s.flags & TELEMETRY_FLAG_MOVING) ? 1 : 0, (s.flags & TELEMETRY_FLAG_JOGGING) ? 1 : 0,
+           (s.flags & TELEMETRY_FLAG_SCRIPT) ? 1 : 0, s.resetReason, s.uptimeS);
+    printf("  moves=%u rx=%u txFailures=%u resyncs=%u\n", s.counters[TELEMETRY_MOVES], s.counters[TELEMETRY_RX_FRAMES],
+           s.counters[TELEMETRY_TX_FAILURES], s.counters[TELEMETRY_RESYNCS]);
+    if (s.syncErrorUs == UINT32_MAX)
+      printf("  clock not synced\n");
+    else
+      printf("  syncError=%uus lastTimedLate=%uus\n", s.syncErrorUs, s.timedLateUs);
+    printf("  link to hub: delivery=%u%% rssi=%ddBm rtt=%.1fms %s\n", s.linkDeliveryPct, s.linkRssi,
+           s.linkRttUs / 1000.0, (s.flags & TELEMETRY_FLAG_RELAYED) ? "relayed" : "direct");
+    printf("  link from hub: delivery=%u%% rssi=%ddBm %s\n", d.linkDeliveryPct, d.linkRssi,
+           d.linkDirect ? "direct" : "relayed");
+    nodes++;
+  }
+  if (nodes == 0)
+  {
+    printf("No nodes have reported yet\n");
+  }
+  return 0;
+}
+
+static const char *otaStateName(uint8_t s)
+{
+  switch (s)
+  {
+  case OTA_PREPARING:
+    return "preparing";
+  case OTA_RECEIVING:
+    return "receiving";
+  case OTA_VERIFYING:
+    return "verifying";
+  case OTA_DONE:
+    return "done";
+  case OTA_FAILED:
+    return "failed";
+  default:
+    return "idle";
+  }
+}
+
+static int ota(HubLink &link, const char *path, uint32_t to, int nodes, bool reboot)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+  {
+    perror(path);
+    return 1;
+  }
+  std::vector<uint8_t> image;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+  {
+    image.insert(image.end(), buf, buf + n);
+  }
+  fclose(f);
+  if (image.empty() || image.size() > (size_t)OtaReceiver::MAX_CHUNKS * OTA_CHUNK_DATA)
+  {
+    fprintf(stderr, "%s: %zu bytes won't fit an update\n", path, image.size());
+    return 1;
+  }
+
+  uint64_t start = nowUs();
+  OtaSender sender;
+  sender.start(image.data(), (uint32_t)image.size(), (uint32_t)start, DevType::RearCam, to, (uint8_t)nodes, reboot,
+               (int64_t)start);
+  printf("%s: %zu bytes, %u chunks\n", path, image.size(), sender.chunks());
+
+  uint64_t lastReport = start;
+  HubLink::Frame fr;
+  while (!sender.finished())
+  {
+    uint8_t frame[BRIDGE_MAX_PAYLOAD];
+    size_t len = sender.next((int64_t)nowUs(), frame);
+    bool waitForSend = len > 0;
+    if (waitForSend)
+    {
+      link.send(BRIDGE_RADIO_TX, BROADCAST_ADDR, frame, len);
+    }
+
+    // The hub reports every send, which paces us to what the radio takes
+    while (link.receive(fr, waitForSend ? 100 : 2))
+    {
+      if (fr.header.kind == BRIDGE_TX_STATUS)
+      {
+        break;
+      }
+      Ota_Status s;
+      if (fr.header.kind == BRIDGE_RADIO_RX && fr.len >= sizeof(s))
+      {
+        memcpy(&s, fr.payload, sizeof(s));
+        if (s.msgType == MessageType::Ota_Status)
+        {
+          sender.onStatus(s, (int64_t)nowUs());
+        }
+      }
+      if (!waitForSend)
+      {
+        break;
+      }
+    }
+
+    if (nowUs() - lastReport >= 1000000)
+    {
+      lastReport = nowUs();
+      printf("%5.1fs sent %u chunks, %u resent, %u polls\n", (lastReport - start) / 1e6, sender.chunksSent,
+             sender.retransmits, sender.polls);
+      fflush(stdout);
+    }
+  }
+
+  double seconds = (nowUs() - start) / 1e6;
+  int done = 0;
+  int seen = 0;
+  for (size_t i = 0; i < OtaSender::MAX_RECEIVERS; i++)
+  {
+    const OtaSender::Receiver &r = sender.receiver(i);
+    if (!r.inUse)
+    {
+      continue;
+    }
+    seen++;
+    printf("node %04x %s", r.origin, otaStateName(r.state));
+    if (r.state == OTA_DONE)
+    {
+      done++;
+      printf(" after %.1fs", (r.doneUs - (int64_t)start) / 1e6);
+    }
+    printf("\n");
+  }
+  printf("%d of %d nodes updated in %.1fs, %.1f KB/s, %u of %u chunks resent\n", done, seen, seconds,
+         image.size() / 1024.0 / seconds, sender.retransmits, sender.chunksSent);
+  return done > 0 && done == seen ? 0 : 1;
+}
+
+static int jog(HubLink &link, int rate, int seconds, const uint8_t *mac, uint32_t to)
+{
+  RearCam_Jog msg;
+  msg.src = DevType::Hub;
+  msg.dest = DevType::RearCam;
+  msg.to = to;
+  // A fresh id so the camera doesn't take this for the end of the last run
+  msg.stream = (uint8_t)(nowUs() >> 10);
+
+  uint64_t periodUs = 1000000 / std::max(rate, 1);
+  uint64_t start = nowUs();
+  uint64_t end = start + (uint64_t)seconds * 1000000;
+  int sent = 0, ok = 0, failed = 0;
+  for (uint64_t next = start; next < end; next += periodUs)
+  {
+    // Out and back every 8 s
+    uint64_t now = nowUs();
+    double phase = (now - start) / 8e6 * 2 * M_PI;
+    msg.pos = (uint16_t)std::lround((90 - 60 * std::cos(phase)) * 256);
+    msg.sampleUs = (uint32_t)now;
+    link.send(BRIDGE_RADIO_TX, mac, &msg, sizeof(msg));
+    sent++;
+
+    // Send results come back while waiting for the next sample
+    HubLink::Frame f;
+    while ((now = nowUs()) < next + periodUs && link.receive(f, (int)((next + periodUs - now) / 1000)))
+    {
+      if (f.header.kind == BRIDGE_TX_STATUS && f.len >= 1)
+      {
+        (f.payload[0] ? ok : failed)++;
+      }
+    }
+  }
+
+  printf("%d samples at %d Hz, %d sent ok, %d failed, %d unreported\n", sent, rate, ok, failed, sent - ok - failed);
+  return failed == 0 ? 0 : 1;
+}
+
+// Sends a script call in as many parts as it takes and waits for the
+// camera(s) to report it ended, or just for it to be taken on if !toEnd
+static int scriptCall(HubLink &link, RearCam_Script &msg, const std::vector<uint8_t> &code, const uint8_t *mac,
+                      int seconds, bool toEnd)
+{
+  msg.src = DevType::Hub;
+  msg.dest = DevType::RearCam;
+  msg.flags = MSG_FLAG_WANT_ACCEPTED;
+  msg.corrId = 0x8000 | (uint16_t)nowUs();
+  msg.total = (uint16_t)code.size();
+
+  uint64_t start = nowUs();
+  size_t offset = 0;
+  do
+  {
+    size_t n = std::min(code.size() - offset, (size_t)SCRIPT_PART_CODE);
+    msg.offset = (uint16_t)offset;
+    memcpy(msg.code, code.data() + offset, n);
+    link.send(BRIDGE_RADIO_TX, mac, &msg, SCRIPT_HEADER_SIZE + n);
+    offset += n;
+  } while (offset < code.size());
+  if (!code.empty())
+  {
+    printf("%zu bytes in %zu frame(s)\n", code.size(), (code.size() + SCRIPT_PART_CODE - 1) / SCRIPT_PART_CODE);
+  }
+
+  int accepted = 0, ok = 0, failed = 0;
+  HubLink::Frame f;
+  uint64_t end = start + (uint64_t)seconds * 1000000;
+  while (nowUs() < end)
+  {
+    Rpc_Reply r;
+    if (!link.receive(f, 100) || f.header.kind != BRIDGE_RADIO_RX || f.len < sizeof(r))
+    {
+      continue;
+    }
+    memcpy(&r, f.payload, sizeof(r));
+    if (r.msgType != MessageType::Rpc_Reply || r.corrId != msg.corrId)
+    {
+      continue;
+    }
+    double ms = (nowUs() - start) / 1000.0;
+    printMac(f.header.mac);
+    if (r.stage == RPC_ACCEPTED)
+    {
+      printf(" accepted after %.2fms\n", ms);
+      accepted++;
+      if (!toEnd && msg.to == 0)
+      {
+        break;
+      }
+      continue;
+    }
+    printf(" completed after %.2fms, status %d, value %d\n", ms, r.status, r.value);
+    (r.status == RPC_OK ? ok : failed)++;
+    // Without --to there is no telling how many cameras will answer
+    if (msg.to == 0)
+    {
+      break;
+    }
+  }
+  if (accepted + ok + failed == 0)
+  {
+    printf("no reply\n");
+  }
+  return failed == 0 && accepted + ok > 0 ? 0 : 1;
+}
+
+static int script(HubLink &link, const char *source, int store, int run, bool stop, const uint8_t *mac, uint32_t to,
+                  int seconds)
+{
+  RearCam_Script msg;
+  msg.to = to;
+  std::vector<uint8_t> code;
+
+  if (stop || run >= 0)
+  {
+    msg.action = stop ? SCRIPT_STOP : SCRIPT_RUN_STORED;
+    msg.slot = run < 0 ? 0 : (uint8_t)run;
+    return scriptCall(link, msg, code, mac, seconds, !stop);
+  }
+
+  // A file if there is one by that name, the source itself otherwise
+  std::string text = source;
+  FILE *f = fopen(source, "r");
+  if (f)
+  {
+    text.clear();
+    char buf[256];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+      text.append(buf, n);
+    }
+    fclose(f);
+  }
+  std::string error;
+  if (!assembleMotion(text, code, error))
+  {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  msg.action = store >= 0 ? SCRIPT_STORE : SCRIPT_RUN;
+  msg.slot = store >= 0 ? (uint8_t)store : 0;
+  return scriptCall(link, msg, code, mac, seconds, true);
+}
+
+static int listen(HubLink &link, int seconds)
+{
+  uint64_t end = nowUs() + (uint64_t)seconds * 1000000;
+  HubLink::Frame f;
+  while (seconds == 0 || nowUs() < end)
+  {
+    if (!link.receive(f, 1000))
+    {
+      continue;
+    }
+
+    printMac(f.header.mac);
+    if (f.header.kind == BRIDGE_RADIO_RX && f.len >= sizeof(Header))
+    {
+      Header h;
+      memcpy(&h, f.payload, sizeof(h));
+      printf(" rx %s src=%d dest=%d len=%zu\n", MessageTypeToString(h.msgType), h.src, h.dest, f.len);
+    }
+    else if (f.header.kind == BRIDGE_TX_STATUS && f.len >= 1)
+    {
+      printf(" tx %s\n", f.payload[0] ? "ok" : "failed");
+    }
+    else
+    {
+      printf(" kind=%d len=%zu\n", f.header.kind, f.len);
+    }
+    fflush(stdout);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "usage: %s <port> ping [--count n] [--size bytes] | move <pos> [--mac m] [--to mask] [--wait | --timed] | sequence <pos>... | listen [--seconds s] | state | ota <file> [--to mask] [--nodes n] [--no-reboot] | jog [--rate hz] [--seconds s] [--mac m] [--to mask] | script <source> [--store slot] | script --run slot | script --stop | preset <slot> <pos>|--here|--clear [--speed ms] | recall <slot>\n", argv[0]);
+    return 1;
+  }
+
+  std::string verb = argv[2];
+  int count = 100;
+  size_t size = 16;
+  int seconds = 0;
+  bool wait = false;
+  bool timed = false;
+  uint32_t to = 0;
+  int nodes = 0;
+  int rate = 50;
+  int store = -1;
+  int run = -1;
+  bool stop = false;
+  bool here = false;
+  bool clear = false;
+  int speed = 0;
+  bool reboot = true;
+  uint8_t mac[6];
+  memcpy(mac, BROADCAST_ADDR, 6);
+
+  bool sourceGiven = verb == "script" && argc > 3 && strncmp(argv[3], "--", 2) != 0;
+  int first = verb == "move" || verb == "ota" || verb == "preset" || verb == "recall" || sourceGiven ? 4 : 3;
+  for (int i = first; i < argc; i++)
+  {
+    std::string opt = argv[i];
+    if (opt == "--wait")
+    {
+      wait = true;
+      continue;
+    }
+    if (opt == "--timed")
+    {
+      timed = true;
+      continue;
+    }
+    if (opt == "--no-reboot")
+    {
+      reboot = false;
+      continue;
+    }
+    if (opt == "--stop")
+    {
+      stop = true;
+      continue;
+    }
+    if (opt == "--here")
+    {
+      here = true;
+      continue;
+    }
+    if (opt == "--clear")
+    {
+      clear = true;
+      continue;
+    }
+    // Anything else that isn't an option is a position for sequence
+    if (i + 1 >= argc || opt.compare(0, 2, "--") != 0)
+      continue;
+    if (opt == "--count")
+      count = atoi(argv[i + 1]);
+    else if (opt == "--size")
+      size = atoi(argv[i + 1]);
+    else if (opt == "--seconds")
+      seconds = atoi(argv[i + 1]);
+    else if (opt == "--to")
+      to = (uint32_t)strtoul(argv[i + 1], nullptr, 0);
+    else if (opt == "--nodes")
+      nodes = atoi(argv[i + 1]);
+    else if (opt == "--rate")
+      rate = atoi(argv[i + 1]);
+    else if (opt == "--store")
+      store = atoi(argv[i + 1]);
+    else if (opt == "--run")
+      run = atoi(argv[i + 1]);
+    else if (opt == "--speed")
+      speed = atoi(argv[i + 1]);
+    else if (opt == "--mac" && !parseMac(argv[i + 1], mac))
+    {
+      fprintf(stderr, "Bad MAC %s\n", argv[i + 1]);
+      return 1;
+    }
+    i++;
+  }
+
+  HubLink link;
+  if (!link.open(argv[1]))
+  {
+    return 1;
+  }
+
+  if (verb == "ping")
+  {
+    return ping(link, count, size);
+  }
+  if (verb == "move" && argc > 3)
+  {
+    if (wait)
+    {
+      return moveCall(link, atoi(argv[3]), mac, to, (uint16_t)nowUs(), true) == RPC_OK ? 0 : 1;
+    }
+    if (timed)
+    {
+      return moveTimed(link, atoi(argv[3]), to);
+    }
+    return move(link, atoi(argv[3]), mac, to);
+  }
+  if (verb == "sequence" && argc > 3)
+  {
+    int steps = 0;
+    while (3 + steps < argc && strncmp(argv[3 + steps], "--", 2) != 0)
+    {
+      steps++;
+    }
+    return sequence(link, steps, argv + 3, mac, to);
+  }
+  if (verb == "listen")
+  {
+    return listen(link, seconds);
+  }
+  if (verb == "state")
+  {
+    return state(link);
+  }
+  if (verb == "ota" && argc > 3)
+  {
+    return ota(link, argv[3], to, nodes, reboot);
+  }
+  if (verb == "script" && (sourceGiven || run >= 0 || stop))
+  {
+    return script(link, sourceGiven ? argv[3] : "", store, run, stop, mac, to, seconds ? seconds : 30);
+  }
+  if (verb == "preset" && argc > 3)
+  {
+    bool posGiven = argc > 4 && strncmp(argv[4], "--", 2) != 0;
+    if (!posGiven && !here && !clear)
+    {
+      fprintf(stderr, "preset needs a position, --here or --clear\n");
+      return 1;
+    }
+    return preset(link, atoi(argv[3]), posGiven ? atoi(argv[4]) : -1, speed, clear, mac, to);
+  }
+  if (verb == "recall" && argc > 3)
+  {
+    return recall(link, atoi(argv[3]), mac, to);
+  }
+  if (verb == "jog")
+  {
+    return jog(link, rate, seconds ? seconds : 10, mac, to);
+  }
+  fprintf(stderr, "Unknown command %s\n", verb.c_str());
+  return 1;
+}
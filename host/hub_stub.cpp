@@ -0,0 +1,588 @@
+// Pretends to be a hub on a pseudo-terminal, so hub_cli and HubLink can be
+// tested without hardware.
+//
+//   hub_stub [--noise] [--delay-us n] [--loss p]
+//
+// Prints the path of the pty to open. PINGs are answered with PONGs and every
+// RADIO_TX is acknowledged with a successful TX_STATUS followed by the same
+// message looped back as a RADIO_RX, except RearCam_MoveTo calls, which are
+// answered like a rear cam would: accepted, then completed once a servo
+// moving at 1 degree per 10 ms would have arrived, RearCam_Recall and
+// RearCam_Preset calls, against presets kept in memory, and RearCam_Script,
+// which the camera runs through the firmware's MotionScript, answering as
+// the rear cam does. OTA messages are taken
+// by the same camera's OtaReceiver, storing the image in memory, and its
+// statuses come back as RADIO_RX. STATE_QUERY gets one made up node, and a
+// MOVE moves the camera if it is addressed, with a TX_STATUS either way.
+// --noise interleaves log lines between
+// frames like the real hub's Serial.print output, --delay-us simulates the
+// time the hub takes to get round to a frame. --loss drops that fraction of
+// radio frames after their TX_STATUS, as if lost on air.
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+
+#include <random>
+#include <vector>
+
+#include "common/stats.h"
+#include "../esp-now/controllers/include/messages.h"
+#include "../esp-now/controllers/src/motionScript.h"
+#include "../esp-now/controllers/src/ota.h"
+#include "../esp-now/controllers/src/serialLink.h"
+#include "../esp-now/controllers/src/sha256.h"
+
+static int master = -1;
+static bool noise = false;
+
+static void writeAll(const void *data, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  while (len > 0)
+  {
+    ssize_t w = write(master, p, len);
+    if (w < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+      return;
+    }
+    p += w;
+    len -= w;
+  }
+}
+
+static void reply(uint8_t kind, const uint8_t *mac, const uint8_t *payload, size_t len)
+{
+  if (noise)
+  {
+    const char *log = "Bytes received: 4\r\nLast Packet Send Status:\tDelivery Success\r\n";
+    writeAll(log, strlen(log));
+  }
+  uint8_t out[BRIDGE_MAX_ENCODED];
+  writeAll(out, bridgeEncode(kind, mac, payload, len, out));
+}
+
+static const uint8_t camMac[6] = {0x02, 0, 0, 0, 0, 0x01};
+// Built like the rear_cam env, node 1 in GROUP_CAMERAS
+static const uint32_t camAcceptMask = ADDR_NODE(1) | ADDR_GROUP(GROUP_CAMERAS);
+
+// The simulated rear cam. Its servo moves 1 degree per stepUs from where it
+// was when it started towards target.
+static int servoFrom = 90;
+static int servoTarget = 90;
+static uint64_t servoStartUs = 0;
+static uint64_t servoStepUs = 10000;
+static bool callPending = false;
+static Header call;
+
+// Scripts, run by the firmware's own interpreter
+static MotionScript camScript;
+static bool scriptCallPending = false;
+static Header scriptCall;
+static std::vector<uint8_t> scriptSlots[SCRIPT_SLOTS];
+static uint8_t scriptCode[SCRIPT_MAX_CODE];
+static uint16_t scriptCorrId = 0;
+static uint16_t scriptTotal = 0;
+static uint8_t scriptParts = 0;
+
+static int camPos(uint64_t now)
+{
+  int travelled = (int)((now - servoStartUs) / servoStepUs);
+  int distance = abs(servoTarget - servoFrom);
+  travelled = std::min(travelled, distance);
+  return servoFrom + (servoTarget > servoFrom ? travelled : -travelled);
+}
+
+static void servoMove(int target, uint64_t stepUs)
+{
+  uint64_t now = nowUs();
+  servoFrom = camPos(now);
+  servoTarget = target;
+  servoStartUs = now;
+  servoStepUs = stepUs;
+}
+
+static uint64_t servoArrivalUs()
+{
+  return servoStartUs + (uint64_t)abs(servoTarget - servoFrom) * servoStepUs;
+}
+
+static void camReply(const Header &req, RpcStage stage, RpcStatus status, int16_t value)
+{
+  Rpc_Reply r;
+  r.src = DevType::RearCam;
+  r.dest = req.src;
+  r.corrId = req.corrId;
+  r.stage = stage;
+  r.status = status;
+  r.value = value;
+  reply(BRIDGE_RADIO_RX, camMac, (const uint8_t *)&r, sizeof(r));
+}
+
+static void endScript(RpcStatus status)
+{
+  camScript.stop();
+  if (scriptCallPending)
+  {
+    scriptCallPending = false;
+    camReply(scriptCall, RPC_COMPLETED, status, camPos(nowUs()));
+  }
+}
+
+static void camMove(const Header &msg, int pos, uint64_t stepUs)
+{
+  // Where the servo got to on the way to the previous target
+  if (callPending)
+  {
+    camReply(call, RPC_COMPLETED, RPC_SUPERSEDED, camPos(nowUs()));
+  }
+  endScript(RPC_SUPERSEDED);
+
+  if (msg.flags & MSG_FLAG_WANT_ACCEPTED)
+  {
+    camReply(msg, RPC_ACCEPTED, RPC_OK, pos);
+  }
+  callPending = true;
+  call = msg;
+  servoMove(pos, stepUs);
+}
+
+// Presets, kept in memory, as the rear cam sets them up on first boot
+struct Preset
+{
+  bool set;
+  uint8_t pos;
+  uint8_t speed;
+};
+static Preset presets[PRESET_SLOTS] = {{true, 0, 0}, {true, 90, 0}};
+
+static void camPresetRecv(const RearCam_Preset &msg)
+{
+  if (msg.slot >= PRESET_SLOTS || msg.action > PRESET_CLEAR || (msg.action == PRESET_SET && msg.pos > 180) ||
+      msg.speed > PRESET_MAX_MS_PER_DEGREE)
+  {
+    camReply(msg, RPC_COMPLETED, RPC_REJECTED, 0);
+    return;
+  }
+  Preset &p = presets[msg.slot];
+  p.set = msg.action != PRESET_CLEAR;
+  p.pos = msg.action == PRESET_SET_HERE ? (uint8_t)camPos(nowUs()) : msg.pos;
+  p.speed = msg.speed;
+  camReply(msg, RPC_COMPLETED, RPC_OK, p.set ? p.pos : -1);
+}
+
+static void camRecall(const RearCam_Recall &msg)
+{
+  if (msg.slot >= PRESET_SLOTS || !presets[msg.slot].set)
+  {
+    camReply(msg, RPC_COMPLETED, RPC_REJECTED, camPos(nowUs()));
+    return;
+  }
+  const Preset &p = presets[msg.slot];
+  camMove(msg, p.pos, (p.speed ? p.speed : 10) * 1000);
+}
+
+static void camStartScript(const Header &req, const uint8_t *code, size_t len)
+{
+  if (scriptCallPending && scriptCall.corrId == req.corrId && camScript.isRunning())
+  {
+    if (req.flags & MSG_FLAG_WANT_ACCEPTED)
+    {
+      camReply(req, RPC_ACCEPTED, RPC_OK, (int16_t)len);
+    }
+    return;
+  }
+  if (callPending)
+  {
+    callPending = false;
+    camReply(call, RPC_COMPLETED, RPC_SUPERSEDED, camPos(nowUs()));
+  }
+  endScript(RPC_SUPERSEDED);
+  uint64_t now = nowUs();
+  if (!camScript.load(code, len, (int64_t)now, (uint8_t)camPos(now)))
+  {
+    camReply(req, RPC_COMPLETED, RPC_REJECTED, 0);
+    return;
+  }
+  if (req.flags & MSG_FLAG_WANT_ACCEPTED)
+  {
+    camReply(req, RPC_ACCEPTED, RPC_OK, (int16_t)len);
+  }
+  scriptCallPending = req.corrId != 0;
+  scriptCall = req;
+}
+
+// As the rear cam's onScript(), timing aside: scripts start when they arrive
+static void camScriptRecv(const uint8_t *frame, size_t len)
+{
+  RearCam_Script msg;
+  size_t n = std::min(len, sizeof(msg));
+  memcpy(&msg, frame, n);
+  size_t codeLen = n - SCRIPT_HEADER_SIZE;
+
+  switch (msg.action)
+  {
+  case SCRIPT_STOP:
+    if (callPending)
+    {
+      callPending = false;
+      camReply(call, RPC_COMPLETED, RPC_SUPERSEDED, camPos(nowUs()));
+    }
+    endScript(RPC_SUPERSEDED);
+    servoMove(camPos(nowUs()), 10000);
+    camReply(msg, RPC_COMPLETED, RPC_OK, camPos(nowUs()));
+    return;
+  case SCRIPT_RUN_STORED:
+    if (msg.slot >= SCRIPT_SLOTS || scriptSlots[msg.slot].empty())
+    {
+      camReply(msg, RPC_COMPLETED, RPC_REJECTED, 0);
+      return;
+    }
+    camStartScript(msg, scriptSlots[msg.slot].data(), scriptSlots[msg.slot].size());
+    return;
+  case SCRIPT_RUN:
+  case SCRIPT_STORE:
+    break;
+  default:
+    camReply(msg, RPC_COMPLETED, RPC_UNSUPPORTED, 0);
+    return;
+  }
+
+  if (msg.total == 0 || msg.total > SCRIPT_MAX_CODE || msg.offset % SCRIPT_PART_CODE != 0 ||
+      msg.offset + codeLen > msg.total || (msg.action == SCRIPT_STORE && msg.slot >= SCRIPT_SLOTS))
+  {
+    camReply(msg, RPC_COMPLETED, RPC_REJECTED, 0);
+    return;
+  }
+  if (msg.corrId != scriptCorrId || msg.total != scriptTotal)
+  {
+    scriptCorrId = msg.corrId;
+    scriptTotal = msg.total;
+    scriptParts = 0;
+  }
+  memcpy(scriptCode + msg.offset, msg.code, codeLen);
+  scriptParts |= 1 << (msg.offset / SCRIPT_PART_CODE);
+  if (msg.offset + codeLen < msg.total)
+  {
+    return;
+  }
+  size_t parts = (msg.total + SCRIPT_PART_CODE - 1) / SCRIPT_PART_CODE;
+  bool complete = scriptParts == (1 << parts) - 1;
+  scriptTotal = 0;
+  if (!complete || !MotionScript::validate(scriptCode, msg.total))
+  {
+    camReply(msg, RPC_COMPLETED, RPC_REJECTED, 0);
+    return;
+  }
+  if (msg.action == SCRIPT_STORE)
+  {
+    scriptSlots[msg.slot].assign(scriptCode, scriptCode + msg.total);
+    camReply(msg, RPC_COMPLETED, RPC_OK, (int16_t)msg.total);
+    return;
+  }
+  camStartScript(msg, scriptCode, msg.total);
+}
+
+class MemStorage : public OtaStorage
+{
+public:
+  std::vector<uint8_t> data;
+
+  bool begin(uint32_t size) override
+  {
+    data.assign(size, 0xff);
+    return true;
+  }
+  bool write(uint32_t offset, const uint8_t *p, size_t len) override
+  {
+    memcpy(data.data() + offset, p, len);
+    return true;
+  }
+  bool finish(const uint8_t *sha256) override
+  {
+    Sha256 sha;
+    sha.update(data.data(), data.size());
+    uint8_t digest[32];
+    sha.finish(digest);
+    return memcmp(digest, sha256, 32) == 0;
+  }
+  void abort() override {}
+};
+
+static MemStorage camImage;
+static OtaReceiver camOta(camImage);
+static std::mt19937 rng(1);
+
+// What Base::dispatch() does with update messages, false for anything else
+static bool camOtaRecv(const uint8_t *msg, size_t len)
+{
+  Header hdr;
+  memcpy(&hdr, msg, sizeof(hdr));
+  int64_t now = (int64_t)nowUs();
+  uint32_t jitter = rng() % OtaReceiver::STATUS_JITTER_US;
+  switch (hdr.msgType)
+  {
+  case MessageType::Ota_Begin:
+  {
+    Ota_Begin m;
+    memcpy(&m, msg, std::min(len, sizeof(m)));
+    camOta.onBegin(m, now, jitter);
+    return true;
+  }
+  case MessageType::Ota_Chunk:
+  {
+    Ota_Chunk m;
+    memcpy(&m, msg, std::min(len, sizeof(m)));
+    camOta.onChunk(m, len, now, jitter);
+    return true;
+  }
+  case MessageType::Ota_Poll:
+  {
+    Ota_Poll m;
+    memcpy(&m, msg, std::min(len, sizeof(m)));
+    camOta.onPoll(m, now, jitter);
+    return true;
+  }
+  case MessageType::Ota_End:
+  {
+    Ota_End m;
+    memcpy(&m, msg, std::min(len, sizeof(m)));
+    // Ota_End is repeated, report the first
+    bool wasRequested = camOta.rebootRequested();
+    camOta.onEnd(m);
+    if (camOta.rebootRequested() && !wasRequested)
+    {
+      fprintf(stderr, "camera would reboot into the new %zu byte image\n", camImage.data.size());
+    }
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+static void camUpdate()
+{
+  Ota_Status s;
+  if (camOta.statusDue((int64_t)nowUs(), s))
+  {
+    s.src = DevType::RearCam;
+    s.dest = DevType::Hub;
+    s.origin = 0x0001;
+    reply(BRIDGE_RADIO_RX, camMac, (const uint8_t *)&s, sizeof(s));
+  }
+  camOta.update();
+
+  uint64_t now = nowUs();
+  if (callPending && now >= servoArrivalUs())
+  {
+    callPending = false;
+    camReply(call, RPC_COMPLETED, RPC_OK, camPos(now));
+  }
+
+  switch (camScript.update((int64_t)now, now < servoArrivalUs()))
+  {
+  case MotionScript::STEP_MOVE:
+    servoMove(camScript.pos, (camScript.speed ? camScript.speed : 10) * 1000);
+    break;
+  case MotionScript::STEP_DONE:
+    endScript(RPC_OK);
+    break;
+  default:
+    break;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  long delayUs = 0;
+  double loss = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string opt = argv[i];
+    if (opt == "--noise")
+      noise = true;
+    else if (opt == "--delay-us" && i + 1 < argc)
+      delayUs = atol(argv[++i]);
+    else if (opt == "--loss" && i + 1 < argc)
+      loss = atof(argv[++i]);
+  }
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+  {
+    perror("posix_openpt");
+    return 1;
+  }
+
+  // Raw on our side too, otherwise the line discipline eats 0x00 and friends
+  termios tty;
+  tcgetattr(master, &tty);
+  cfmakeraw(&tty);
+  tcsetattr(master, TCSANOW, &tty);
+
+  printf("%s\n", ptsname(master));
+  fflush(stdout);
+
+  BridgeDecoder decoder;
+  uint8_t buf[256];
+  for (;;)
+  {
+    camUpdate();
+
+    int timeoutMs = callPending ? (int)((servoArrivalUs() - std::min(servoArrivalUs(), nowUs()) + 999) / 1000) : -1;
+    // Scripts are stepped every ms, as often as loop() would
+    if (camScript.isRunning())
+    {
+      timeoutMs = 1;
+    }
+    // Statuses go out after their jitter
+    if (camOta.state() != OTA_IDLE && (timeoutMs < 0 || timeoutMs > 2))
+    {
+      timeoutMs = 2;
+    }
+    pollfd p = {master, POLLIN, 0};
+    int ready = poll(&p, 1, timeoutMs);
+    if (ready < 0 && errno != EINTR)
+    {
+      return 1;
+    }
+    if (ready <= 0)
+    {
+      continue;
+    }
+
+    ssize_t n = read(master, buf, sizeof(buf));
+    if (n < 0)
+    {
+      // EIO just means nobody has the slave open right now
+      usleep(10000);
+      continue;
+    }
+
+    for (ssize_t i = 0; i < n; i++)
+    {
+      if (!decoder.push(buf[i]))
+      {
+        continue;
+      }
+      if (delayUs > 0)
+      {
+        usleep(delayUs);
+      }
+
+      const BridgeHeader &h = decoder.header();
+      if (h.kind == BRIDGE_PING)
+      {
+        reply(BRIDGE_PONG, h.mac, decoder.payload(), decoder.payloadLen());
+      }
+      else if (h.kind == BRIDGE_STATE_QUERY)
+      {
+        BridgeDeviceState d = {};
+        d.devType = 1;
+        d.bootId = 0xbeef;
+        d.seq = 42;
+        d.state.pos = camPos(nowUs());
+        d.state.target = servoTarget;
+        d.state.flags = (nowUs() < servoArrivalUs() ? TELEMETRY_FLAG_MOVING : 0) |
+                        (camScript.isRunning() ? TELEMETRY_FLAG_SCRIPT : 0);
+        d.state.resetReason = 1;
+        d.state.uptimeS = 3600;
+        d.state.syncErrorUs = 40;
+        d.state.linkDeliveryPct = 97;
+        d.state.linkRssi = -61;
+        d.state.linkRttUs = 4200;
+        d.linkDeliveryPct = 98;
+        d.linkRssi = -59;
+        d.linkDirect = 1;
+        reply(BRIDGE_STATE, camMac, (const uint8_t *)&d, sizeof(d));
+      }
+      else if (h.kind == BRIDGE_MOVE && decoder.payloadLen() == sizeof(BridgeMove))
+      {
+        BridgeMove m;
+        memcpy(&m, decoder.payload(), sizeof(m));
+        uint8_t ok = 1;
+        reply(BRIDGE_TX_STATUS, BROADCAST_ADDR, &ok, 1);
+        if (m.to == 0 || (m.to & camAcceptMask) != 0)
+        {
+          // A plain move supersedes whatever the camera was doing
+          if (callPending)
+          {
+            callPending = false;
+            camReply(call, RPC_COMPLETED, RPC_SUPERSEDED, camPos(nowUs()));
+          }
+          endScript(RPC_SUPERSEDED);
+          servoMove(m.pos, 10000);
+        }
+      }
+      else if (h.kind == BRIDGE_RADIO_TX)
+      {
+        uint8_t mac[6];
+        memcpy(mac, h.mac, 6);
+        uint8_t ok = 1;
+        uint8_t msg[BRIDGE_MAX_PAYLOAD];
+        size_t len = decoder.payloadLen();
+        memcpy(msg, decoder.payload(), len);
+        reply(BRIDGE_TX_STATUS, mac, &ok, 1);
+
+        Header hdr;
+        memcpy(&hdr, msg, std::min(len, sizeof(hdr)));
+        // Lost on air, nothing answers or loops back
+        if (std::uniform_real_distribution<double>(0, 1)(rng) < loss)
+        {
+          continue;
+        }
+        if (len >= sizeof(Header) && addressedTo(msg, camAcceptMask) && camOtaRecv(msg, len))
+        {
+          continue;
+        }
+        if (len >= SCRIPT_HEADER_SIZE && hdr.msgType == MessageType::RearCam_Script)
+        {
+          if (addressedTo(msg, camAcceptMask))
+          {
+            camScriptRecv(msg, len);
+          }
+        }
+        else if (len >= sizeof(RearCam_MoveTo) && hdr.msgType == MessageType::RearCam_MoveTo && hdr.corrId != 0)
+        {
+          // Multicast calls for other nodes go unanswered
+          if (addressedTo(msg, camAcceptMask))
+          {
+            RearCam_MoveTo move;
+            memcpy(&move, msg, sizeof(move));
+            camMove(move, move.pos, 10000);
+          }
+        }
+        else if (len >= sizeof(RearCam_Recall) && hdr.msgType == MessageType::RearCam_Recall && hdr.corrId != 0)
+        {
+          if (addressedTo(msg, camAcceptMask))
+          {
+            RearCam_Recall recall;
+            memcpy(&recall, msg, sizeof(recall));
+            camRecall(recall);
+          }
+        }
+        else if (len >= sizeof(RearCam_Preset) && hdr.msgType == MessageType::RearCam_Preset && hdr.corrId != 0)
+        {
+          if (addressedTo(msg, camAcceptMask))
+          {
+            RearCam_Preset preset;
+            memcpy(&preset, msg, sizeof(preset));
+            camPresetRecv(preset);
+          }
+        }
+        else
+        {
+          reply(BRIDGE_RADIO_RX, mac, msg, len);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,250 @@
+// Simulates a jog stream from the host through the hub to a rear cam, and
+// what the camera makes of it.
+//
+//   jog_sim [--seconds n] [--seed n]
+//
+// Runs the firmware's JitterBuffer unchanged. A joystick sweeps the camera
+// back and forth at up to 60 degrees/s, changing speed every 0.3-1.5 s. The
+// host samples it at 20 or 50 Hz with 1 ms of timer jitter, stamping each
+// sample with its own clock, and the frame takes 0.2-2 ms over USB before
+// the hub sends it. The radio delays and loses frames like LinkModel, once
+// for a quiet channel and once for a busy one. The camera's clock is off by
+// 20 ppm and its servo tick runs every 10 ms.
+//
+// Compared are playing the newest sample as it arrives, which is what
+// sending a RearCam_MoveTo per sample amounts to, fixed playout delays, and
+// the adaptive delay. For each it prints the latency from a stick position to
+// the camera showing it, the RMS error against the stick at that point,
+// the roughness of the motion (RMS change of speed between ticks, the stick
+// alone gives ~0.03), the largest step in one tick, and how often the
+// buffer had to extrapolate or hold.
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+#include "common/sim.h"
+#include "common/stats.h"
+#include "../esp-now/controllers/src/jitterBuffer.h"
+
+static const uint64_t MS = 1000;
+static const uint64_t TICK_US = 10 * MS;
+// Settling time left out of the figures
+static const uint64_t WARMUP_US = 2000 * MS;
+
+// The stick, precomputed per ms so every policy sees the same motion
+class Stick
+{
+public:
+  Stick(uint64_t seed, uint64_t durationUs)
+  {
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> speed(-60, 60), hold(300, 1500);
+    size_t n = durationUs / MS + 1;
+    pos.resize(n);
+    double p = 90, v = 0, target = 0, nextChange = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+      if (i >= nextChange)
+      {
+        target = speed(rng);
+        nextChange = i + hold(rng);
+      }
+      // Hands don't change speed instantly, 300 degrees/s^2 at most
+      double dv = target - v;
+      v += std::max(-0.3, std::min(0.3, dv));
+      p += v / 1000;
+      if (p < 10 || p > 170)
+      {
+        p = std::max(10.0, std::min(170.0, p));
+        v = -v;
+        target = -target;
+      }
+      pos[i] = p;
+    }
+  }
+
+  double at(uint64_t us) const
+  {
+    size_t i = std::min(us / MS, (uint64_t)pos.size() - 2);
+    double f = (double)(us - i * MS) / MS;
+    return pos[i] + (pos[i + 1] - pos[i]) * std::min(1.0, f);
+  }
+
+private:
+  std::vector<double> pos;
+};
+
+struct Result
+{
+  Stats latencyMs;
+  double sqError = 0;
+  double sqAccel = 0;
+  double maxStep = 0;
+  int ticks = 0;
+  uint32_t extrapolated = 0;
+  uint32_t held = 0;
+  uint32_t late = 0;
+};
+
+// delayUs 0 is the adaptive buffer, UINT32_MAX plays the newest sample
+static Result run(const Stick &stick, uint64_t seconds, double rateHz, const LinkModel &link, uint32_t delayUs,
+                  uint64_t seed)
+{
+  Sim sim(seed);
+  SimClock hostClock(123456789, -8);
+  SimClock camClock(-5000000, 20);
+  JitterBuffer jitter;
+  jitter.fixedDelayUs = delayUs == UINT32_MAX ? 0 : delayUs;
+  bool newest = delayUs == UINT32_MAX;
+
+  Result r;
+  uint64_t endUs = seconds * 1000000;
+  uint64_t periodUs = (uint64_t)(1e6 / rateHz);
+
+  // Newest sample by stamp, for playing it straight away
+  bool haveNewest = false;
+  uint32_t newestStamp = 0;
+  uint16_t newestPos = 0;
+
+  std::function<void(uint64_t)> hostSample = [&](uint64_t dueUs)
+  {
+    uint32_t stamp = (uint32_t)hostClock.read(sim.now);
+    uint16_t pos = (uint16_t)std::lround(stick.at(sim.now) * 256);
+    uint64_t delay;
+    if (link.deliver(sim, delay))
+    {
+      delay += (uint64_t)sim.uniform(200, 2000);
+      sim.after(delay, [&, stamp, pos]()
+                {
+        int64_t local = camClock.read(sim.now);
+        jitter.push(1, stamp, pos, local);
+        if (!haveNewest || (int32_t)(stamp - newestStamp) > 0)
+        {
+          haveNewest = true;
+          newestStamp = stamp;
+          newestPos = pos;
+        } });
+    }
+    uint64_t next = dueUs + periodUs;
+    if (next < endUs)
+    {
+      sim.at(next + (uint64_t)sim.uniform(0, 1000), [&, next]()
+             { hostSample(next); });
+    }
+  };
+  sim.at(0, [&]()
+         { hostSample(0); });
+
+  double last = NAN, lastVelocity = NAN;
+  std::function<void()> tick = [&]()
+  {
+    int64_t local = camClock.read(sim.now);
+    bool shown = false;
+    double out = 0;
+    uint64_t shownUs = 0;
+    if (newest && haveNewest)
+    {
+      out = newestPos / 256.0;
+      shownUs = hostClock.trueTimeOf(newestStamp);
+      shown = true;
+    }
+    int32_t q8;
+    if (!newest && jitter.sample(local, q8))
+    {
+      out = q8 / 256.0;
+      shownUs = hostClock.trueTimeOf(jitter.playoutTs());
+      shown = true;
+    }
+
+    if (shown && sim.now >= WARMUP_US)
+    {
+      r.latencyMs.add((sim.now - shownUs) / 1000.0);
+      double err = out - stick.at(shownUs);
+      r.sqError += err * err;
+      double v = out - last;
+      r.maxStep = std::max(r.maxStep, std::fabs(v));
+      if (!std::isnan(lastVelocity))
+      {
+        r.sqAccel += (v - lastVelocity) * (v - lastVelocity);
+      }
+      lastVelocity = v;
+      r.ticks++;
+    }
+    if (shown)
+    {
+      last = out;
+    }
+    sim.after(TICK_US + (uint64_t)sim.uniform(0, 1000), tick);
+  };
+  sim.at(TICK_US, tick);
+
+  sim.runUntil(endUs);
+  r.extrapolated = jitter.extrapolated;
+  r.held = jitter.held;
+  r.late = jitter.late;
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t seconds = 60;
+  uint64_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    std::string opt = argv[i];
+    if (opt == "--seconds")
+      seconds = strtoull(argv[i + 1], nullptr, 10);
+    else if (opt == "--seed")
+      seed = strtoull(argv[i + 1], nullptr, 10);
+  }
+  Stick stick(seed, seconds * 1000000 + MS);
+
+  // How rough the stick itself is at the servo's tick
+  double sq = 0, lastV = 0;
+  int n = 0;
+  for (uint64_t t = WARMUP_US + 2 * TICK_US; t < seconds * 1000000; t += TICK_US, n++)
+  {
+    double v = stick.at(t) - stick.at(t - TICK_US);
+    sq += (v - lastV) * (v - lastV);
+    lastV = v;
+  }
+  printf("%llu s of joystick per run, stick roughness %.3f\n", (unsigned long long)seconds, std::sqrt(sq / n));
+
+  LinkModel quiet;
+  quiet.loss = 0.01;
+  quiet.stallChance = 0.01;
+  LinkModel busy;
+  busy.jitterMeanUs = 3000;
+  busy.loss = 0.1;
+  busy.stallChance = 0.05;
+  busy.stallMaxUs = 60000;
+
+  struct Scenario
+  {
+    const char *name;
+    const LinkModel *link;
+  };
+  const Scenario scenarios[] = {{"quiet channel", &quiet}, {"busy channel", &busy}};
+  const uint32_t delays[] = {UINT32_MAX, 10000, 25000, 50000, 100000, 0};
+
+  for (const Scenario &sc : scenarios)
+  {
+    for (double rate : {20.0, 50.0})
+    {
+      printf("\n%s, %.0f Hz\n", sc.name, rate);
+      printf("  %-16s %8s %8s %8s %10s %9s %8s %8s %6s\n", "playout", "p50 ms", "p99 ms", "rms deg", "roughness",
+             "max step", "extrap", "held", "late");
+      for (uint32_t d : delays)
+      {
+        Result r = run(stick, seconds, rate, *sc.link, d, seed);
+        std::string name = d == UINT32_MAX ? "newest sample" : d == 0 ? "adaptive" : "fixed " + std::to_string(d / 1000) + " ms";
+        double ticks = std::max(1, r.ticks);
+        printf("  %-16s %8.1f %8.1f %8.2f %10.3f %9.2f %7.1f%% %7.1f%% %6u\n", name.c_str(), r.latencyMs.percentile(50),
+               r.latencyMs.percentile(99), std::sqrt(r.sqError / ticks), std::sqrt(r.sqAccel / ticks), r.maxStep,
+               100.0 * r.extrapolated / ticks, 100.0 * r.held / ticks, r.late);
+      }
+    }
+  }
+  return 0;
+}
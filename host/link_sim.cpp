@@ -0,0 +1,277 @@
+// Simulates a rear cam whose direct link to the hub degrades, drops out and
+// comes back, with a relay in between that stays good.
+//
+//   link_sim [--period-ms n] [--relay-loss p] [--seed n]
+//
+// Runs the firmware's LinkTable and Relay unchanged. The cam sends a frame
+// that the hub acknowledges every --period-ms, like telemetry, resending
+// until it is acknowledged. The hub-cam link loses 5% of frames for a
+// minute, then 40%, then everything, then 5% again; both links through the
+// relay lose --relay-loss.
+//
+// Three policies are compared:
+//   relayed:  TTL 3 and a 500 ms resend, what the firmware did before
+//   direct:   TTL 1 and a 500 ms resend
+//   adaptive: TTL and resend timeout from the link table, with backoff
+// For every phase it prints the latency from a frame's creation to its
+// acknowledgement, the share acknowledged within a second, the
+// transmissions (relays included) per acknowledged frame and the share of
+// the cam's frames sent with room for the relay.
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "common/sim.h"
+#include "common/stats.h"
+#include "../esp-now/controllers/src/linkTable.h"
+#include "../esp-now/controllers/src/relay.h"
+
+static const uint64_t MS = 1000;
+static const uint64_t PHASE_US = 60000 * MS;
+static const int PHASES = 4;
+static const double DIRECT_LOSS[PHASES] = {0.05, 0.4, 1.0, 0.05};
+// Air time of a ~60 byte frame at 1 Mbps plus preamble
+static const uint64_t AIR_US = 600;
+static const uint8_t DEFAULT_TTL = 3;
+
+enum Node
+{
+  HUB,
+  RELAY,
+  CAM,
+  NODES,
+};
+
+enum Policy
+{
+  RELAYED,
+  DIRECT,
+  ADAPTIVE,
+};
+
+struct Frame
+{
+  Header h;
+  // Cam's frame number, or the acknowledged seq in the hub's frames
+  uint16_t value;
+};
+
+struct PhaseResult
+{
+  Stats latencyMs;
+  int created = 0;
+  int inTime = 0;
+  uint64_t transmissions = 0;
+  int relayedFrames = 0;
+  int camFrames = 0;
+};
+
+static void run(const char *name, Policy policy, uint64_t periodUs, double relayLoss, uint64_t seed)
+{
+  Sim sim(seed);
+  LinkTable links[NODES];
+  std::unique_ptr<Relay> relays[NODES];
+  for (auto &r : relays)
+  {
+    r.reset(new Relay());
+  }
+  uint16_t seq[NODES] = {0, 0, 0};
+  PhaseResult result[PHASES];
+
+  auto phase = [&]()
+  { return std::min((int)(sim.now / PHASE_US), PHASES - 1); };
+  auto loss = [&](int a, int b)
+  {
+    if ((a == HUB && b == CAM) || (a == CAM && b == HUB))
+      return DIRECT_LOSS[phase()];
+    return relayLoss;
+  };
+
+  std::function<void(int, Frame)> transmit;
+  std::function<void(int, Frame)> receive;
+
+  transmit = [&](int from, Frame f)
+  {
+    result[phase()].transmissions++;
+    for (int to = 0; to < NODES; to++)
+    {
+      if (to == from || sim.chance(loss(from, to)))
+        continue;
+      // Air time plus the receiver's loop() getting to it
+      sim.after(AIR_US + (uint64_t)sim.uniform(100, 400), [&, to, f]()
+                { receive(to, f); });
+    }
+  };
+
+  auto ttlFor = [&](int node, DevType dest)
+  {
+    if (policy == RELAYED)
+      return DEFAULT_TTL;
+    if (policy == DIRECT)
+      return (uint8_t)1;
+    return links[node].ttlFor(dest, DEFAULT_TTL, (int64_t)sim.now);
+  };
+
+  auto send = [&](int from, DevType src, DevType dest, uint16_t value)
+  {
+    Frame f = {};
+    f.h.src = src;
+    f.h.dest = dest;
+    f.h.origin = (uint16_t)from;
+    f.h.seq = seq[from]++;
+    f.h.ttl = ttlFor(from, dest);
+    f.value = value;
+    relays[from]->firstSighting(f.h.origin, f.h.seq);
+    transmit(from, f);
+    return f.h;
+  };
+
+  // The cam's outstanding frame, resent with a fresh seq until acknowledged
+  struct Pending
+  {
+    bool active = false;
+    uint64_t createdUs;
+    int phase;
+    uint16_t lastSeq;
+    uint64_t lastSentUs;
+    uint8_t resends;
+  } pending;
+  uint64_t nextCreateUs = 0;
+
+  auto camSend = [&]()
+  {
+    Header h = send(CAM, DevType::RearCam, DevType::Hub, 0);
+    pending.lastSeq = h.seq;
+    pending.lastSentUs = sim.now;
+    result[phase()].camFrames++;
+    if (h.ttl > 1)
+      result[phase()].relayedFrames++;
+  };
+
+  // What Base::dispatch() and the devices do with a frame
+  receive = [&](int node, Frame f)
+  {
+    const Header &h = f.h;
+    if (h.origin == node)
+      return;
+    if (node != RELAY)
+      links[node].onFrame(h.origin, h.src, h.seq, h.hops, (int64_t)sim.now);
+    if (!relays[node]->firstSighting(h.origin, h.seq))
+      return;
+
+    if (node == RELAY)
+    {
+      if (h.ttl > 1)
+      {
+        Frame stepped = f;
+        stepped.h.ttl--;
+        stepped.h.hops++;
+        uint32_t backoff = (uint32_t)sim.uniform(0, Relay::MAX_BACKOFF_US);
+        relays[RELAY]->schedule((const uint8_t *)&stepped, sizeof(stepped), (int64_t)sim.now, backoff);
+        sim.after(backoff, [&]()
+                  {
+          Frame out;
+          while (relays[RELAY]->due((int64_t)sim.now, (uint8_t *)&out) > 0)
+            transmit(RELAY, out); });
+      }
+      return;
+    }
+
+    if (node == HUB && h.src == DevType::RearCam)
+    {
+      send(HUB, DevType::Hub, DevType::RearCam, h.seq);
+      return;
+    }
+
+    if (node == CAM && h.src == DevType::Hub && pending.active && f.value == pending.lastSeq)
+    {
+      links[CAM].onRtt(h.origin, (uint32_t)(sim.now - pending.lastSentUs));
+      PhaseResult &r = result[pending.phase];
+      double ms = (sim.now - pending.createdUs) / 1000.0;
+      r.latencyMs.add(ms);
+      if (ms <= 1000)
+        r.inTime++;
+      pending.active = false;
+    }
+  };
+
+  // The cam's loop(): a new frame every period once the last one is
+  // through, resends when the timeout runs out
+  std::function<void()> camLoop = [&]()
+  {
+    int64_t now = (int64_t)sim.now;
+    if (!pending.active && sim.now >= nextCreateUs)
+    {
+      pending.active = true;
+      pending.createdUs = sim.now;
+      pending.phase = phase();
+      pending.resends = 0;
+      result[phase()].created++;
+      nextCreateUs = sim.now + periodUs;
+      camSend();
+    }
+    else if (pending.active)
+    {
+      uint64_t timeout = 500 * MS;
+      if (policy == ADAPTIVE)
+        timeout = (uint64_t)links[CAM].rtoFor(DevType::Hub, now) << std::min<uint8_t>(pending.resends, 4);
+      if (sim.now - pending.lastSentUs >= timeout)
+      {
+        const LinkTable::Peer *hub = links[CAM].findType(DevType::Hub, now);
+        // As the rear cam does: a resend for the direct link alone went
+        // unanswered too
+        if (hub && pending.resends > 0 && links[CAM].ttlFor(DevType::Hub, DEFAULT_TTL, now) == 1)
+          links[CAM].onDelivery(hub->origin, false);
+        pending.resends++;
+        camSend();
+      }
+    }
+    sim.after((uint64_t)sim.uniform(200, 1000), camLoop);
+  };
+  sim.at(0, camLoop);
+
+  sim.runUntil(PHASES * PHASE_US);
+
+  printf("\n%s\n", name);
+  printf("  %-14s %8s %8s %8s %9s %10s %8s\n", "direct loss", "p50 ms", "p90 ms", "p99 ms", "in 1 s", "tx/frame", "relayed");
+  for (int p = 0; p < PHASES; p++)
+  {
+    PhaseResult &r = result[p];
+    int acked = (int)r.latencyMs.count();
+    printf("  %-14.0f %8.1f %8.1f %8.1f %8.1f%% %10.2f %7.0f%%\n", DIRECT_LOSS[p] * 100,
+           acked ? r.latencyMs.percentile(50) : 0.0, acked ? r.latencyMs.percentile(90) : 0.0,
+           acked ? r.latencyMs.percentile(99) : 0.0, r.created ? 100.0 * r.inTime / r.created : 0.0,
+           acked ? (double)r.transmissions / acked : 0.0, r.camFrames ? 100.0 * r.relayedFrames / r.camFrames : 0.0);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t periodUs = 200 * MS;
+  double relayLoss = 0.05;
+  uint64_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    std::string opt = argv[i];
+    if (opt == "--period-ms")
+      periodUs = strtoull(argv[i + 1], nullptr, 10) * MS;
+    else if (opt == "--relay-loss")
+      relayLoss = atof(argv[i + 1]);
+    else if (opt == "--seed")
+      seed = strtoull(argv[i + 1], nullptr, 10);
+  }
+
+  printf("cam frame every %llu ms, relay links lose %.0f%%, direct link per minute:", (unsigned long long)(periodUs / MS),
+         relayLoss * 100);
+  for (double l : DIRECT_LOSS)
+  {
+    printf(" %.0f%%", l * 100);
+  }
+  printf("\n");
+  run("relayed, 500 ms resend", RELAYED, periodUs, relayLoss, seed);
+  run("direct, 500 ms resend", DIRECT, periodUs, relayLoss, seed);
+  run("adaptive", ADAPTIVE, periodUs, relayLoss, seed);
+  return 0;
+}
@@ -0,0 +1,349 @@
+// Simulates firmware distribution over ESP-NOW to several nodes at once.
+//
+//   ota_sim [--size bytes] [--baud n] [--seed n]
+//
+// Runs the firmware's OtaSender and OtaReceiver unchanged over one shared
+// channel: every frame occupies the air for its 1 Mbps air time, and each
+// receiver loses frames independently. Nodes are busy (and queue up to 16
+// frames, like main.cpp's rx queue) while erasing the partition, writing a
+// chunk and hashing the image at the end.
+//
+// --baud limits the sender to what the hub's serial bridge can carry, for
+// updates driven from the host; 0 models a sender that already has the
+// image.
+
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <string>
+
+#include "common/sim.h"
+#include "common/stats.h"
+#include "../esp-now/controllers/src/ota.h"
+#include "../esp-now/controllers/src/sha256.h"
+
+// 802.11b at 1 Mbps: DIFS, average backoff, long preamble, ESP-NOW framing
+static uint64_t airtimeUs(size_t len)
+{
+  return 50 + 310 + 192 + (43 + len) * 8;
+}
+
+// Flash timings for the ESP32-C3's external flash
+static const double ERASE_US_PER_KB = 2500;
+static const uint64_t WRITE_US = 400;
+static const double HASH_US_PER_KB = 400;
+static const size_t RX_QUEUE_DEPTH = 16;
+// ESP_IMAGE_HEADER_MAGIC, the first byte of every app image
+static const uint8_t IMAGE_MAGIC = 0xe9;
+
+// Behaves like OtaFlash: chunk 0 is kept back until finish() and must
+// carry the image magic. Writes can only clear bits, as in erased NOR
+// flash, so a chunk written over another corrupts the image.
+class MemStorage : public OtaStorage
+{
+public:
+  std::vector<uint8_t> data;
+  std::vector<uint8_t> first;
+
+  bool begin(uint32_t size) override
+  {
+    data.assign(size, 0xff);
+    first.clear();
+    return true;
+  }
+  bool write(uint32_t offset, const uint8_t *p, size_t len) override
+  {
+    if (offset == 0)
+    {
+      if (p[0] != IMAGE_MAGIC)
+        return false;
+      first.assign(p, p + len);
+      return true;
+    }
+    for (size_t i = 0; i < len; i++)
+      data[offset + i] &= p[i];
+    return true;
+  }
+  bool finish(const uint8_t *sha256) override
+  {
+    if (first.empty())
+      return false;
+    for (size_t i = 0; i < first.size(); i++)
+      data[i] &= first[i];
+    Sha256 sha;
+    sha.update(data.data(), data.size());
+    uint8_t digest[32];
+    sha.finish(digest);
+    return memcmp(digest, sha256, 32) == 0;
+  }
+  void abort() override {}
+};
+
+struct Node
+{
+  MemStorage storage;
+  OtaReceiver ota{storage};
+  uint16_t origin;
+  uint64_t busyUntil = 0;
+  std::deque<std::vector<uint8_t>> queue;
+  uint32_t queueDrops = 0;
+  // Misses chunk 0 until it has every other chunk
+  bool firstLast = false;
+};
+
+struct Run
+{
+  double seconds;
+  int done;
+  uint32_t chunksSent;
+  uint32_t retransmits;
+  uint32_t polls;
+  Stats perNode;
+  uint32_t drops;
+};
+
+static Run simulate(const std::vector<uint8_t> &image, int receivers, double loss, int baud, uint64_t seed,
+                    bool firstLast = false)
+{
+  Sim sim(seed);
+  std::vector<std::unique_ptr<Node>> nodes;
+  for (int i = 0; i < receivers; i++)
+  {
+    nodes.emplace_back(new Node());
+    nodes.back()->origin = (uint16_t)(0x100 + i);
+    nodes.back()->firstLast = firstLast;
+  }
+
+  OtaSender sender;
+  sender.start(image.data(), (uint32_t)image.size(), 0x5eed, DevType::RearCam, 0, (uint8_t)receivers, true, 0);
+
+  uint64_t channelFree = 0;
+  std::function<void(Node &, std::vector<uint8_t>)> arrive;
+  std::function<void(Node &)> drain;
+  std::function<void(Node &)> tryStatus;
+  std::function<void(Node &)> service;
+
+  // Everything shares one channel, frames wait until it is free
+  auto transmit = [&](size_t len) -> uint64_t
+  {
+    uint64_t start = std::max(sim.now, channelFree);
+    channelFree = start + airtimeUs(len);
+    return channelFree;
+  };
+
+  tryStatus = [&](Node &n)
+  {
+    Ota_Status s;
+    if (!n.ota.statusDue((int64_t)sim.now, s))
+      return;
+    s.origin = n.origin;
+    uint64_t end = transmit(sizeof(s));
+    if (!sim.chance(loss))
+    {
+      sim.at(end, [&, s]()
+             { sender.onStatus(s, (int64_t)sim.now); });
+    }
+  };
+
+  // What Base::dispatch() does with each OTA message
+  auto process = [&](Node &n, const std::vector<uint8_t> &frame)
+  {
+    Header h;
+    memcpy(&h, frame.data(), sizeof(h));
+    uint32_t jitter = (uint32_t)sim.uniform(0, OtaReceiver::STATUS_JITTER_US);
+    uint16_t before = n.ota.chunksReceived();
+
+    switch (h.msgType)
+    {
+    case MessageType::Ota_Begin:
+    {
+      Ota_Begin m;
+      memcpy(&m, frame.data(), sizeof(m));
+      n.ota.onBegin(m, (int64_t)sim.now, jitter);
+      break;
+    }
+    case MessageType::Ota_Chunk:
+    {
+      Ota_Chunk m;
+      memcpy(&m, frame.data(), frame.size());
+      if (n.firstLast && m.index == 0 && n.ota.chunksReceived() + 1 < sender.chunks())
+        break;
+      n.ota.onChunk(m, frame.size(), (int64_t)sim.now, jitter);
+      break;
+    }
+    case MessageType::Ota_Poll:
+    {
+      Ota_Poll m;
+      memcpy(&m, frame.data(), sizeof(m));
+      n.ota.onPoll(m, (int64_t)sim.now, jitter);
+      break;
+    }
+    default:
+      break;
+    }
+
+    Node *node = &n;
+    if (n.ota.chunksReceived() != before)
+    {
+      n.busyUntil = sim.now + WRITE_US;
+      sim.at(n.busyUntil, [&, node]()
+             { drain(*node); });
+    }
+    sim.after(jitter + 1, [&, node]()
+              { service(*node); });
+  };
+
+  // Base::service(): status out first, then update(), which blocks loop()
+  // for as long as the erase or hash takes
+  service = [&](Node &n)
+  {
+    if (sim.now < n.busyUntil)
+      return;
+    tryStatus(n);
+
+    OtaState before = n.ota.state();
+    n.ota.update();
+    uint64_t cost = 0;
+    if (before == OTA_PREPARING && n.ota.state() != before)
+      cost = (uint64_t)(image.size() / 1024.0 * ERASE_US_PER_KB);
+    if (before == OTA_VERIFYING && n.ota.state() != before)
+      cost = (uint64_t)(image.size() / 1024.0 * HASH_US_PER_KB);
+    if (cost > 0)
+    {
+      Node *node = &n;
+      n.busyUntil = sim.now + cost;
+      sim.at(n.busyUntil, [&, node]()
+             {
+        service(*node);
+        drain(*node); });
+    }
+  };
+
+  drain = [&](Node &n)
+  {
+    while (!n.queue.empty() && sim.now >= n.busyUntil)
+    {
+      std::vector<uint8_t> f = std::move(n.queue.front());
+      n.queue.pop_front();
+      process(n, f);
+    }
+  };
+
+  arrive = [&](Node &n, std::vector<uint8_t> frame)
+  {
+    if (sim.now < n.busyUntil || !n.queue.empty())
+    {
+      if (n.queue.size() >= RX_QUEUE_DEPTH)
+      {
+        n.queueDrops++;
+        return;
+      }
+      n.queue.push_back(std::move(frame));
+      return;
+    }
+    process(n, frame);
+  };
+
+  // The sender puts a frame on air whenever the channel is free and the
+  // serial link has delivered the next one
+  std::function<void()> senderTick = [&]()
+  {
+    uint8_t out[250];
+    size_t len = sender.next((int64_t)sim.now, out);
+    if (sender.finished())
+      return;
+    if (len == 0)
+    {
+      sim.after(1000, senderTick);
+      return;
+    }
+
+    uint64_t end = transmit(len);
+    std::vector<uint8_t> frame(out, out + len);
+    for (auto &n : nodes)
+    {
+      if (!sim.chance(loss))
+      {
+        Node *node = n.get();
+        sim.at(end, [&, node, frame]()
+               { arrive(*node, frame); });
+      }
+    }
+
+    // COBS framed with the bridge header and CRC, 10 bits per byte
+    uint64_t serialUs = baud > 0 ? (uint64_t)((len + 12) * 10 * 1e6 / baud) : 0;
+    sim.at(std::max(end, sim.now + serialUs), senderTick);
+  };
+  sim.at(0, senderTick);
+
+  uint64_t limit = 3600ull * 1000000;
+  while (!sender.finished() && sim.now < limit)
+  {
+    sim.runUntil(sim.now + 10000);
+  }
+
+  Run r = {};
+  r.seconds = sim.now / 1e6;
+  r.chunksSent = sender.chunksSent;
+  r.retransmits = sender.retransmits;
+  r.polls = sender.polls;
+  for (int i = 0; i < receivers; i++)
+  {
+    const OtaSender::Receiver &rx = sender.receiver(i);
+    if (rx.inUse && rx.state == OTA_DONE)
+    {
+      r.done++;
+      r.perNode.add(rx.doneUs / 1e6);
+    }
+    r.drops += nodes[i]->queueDrops;
+  }
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  size_t size = 1024 * 1024;
+  int baud = 0;
+  uint64_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    std::string opt = argv[i];
+    if (opt == "--size")
+      size = strtoul(argv[i + 1], nullptr, 10);
+    else if (opt == "--baud")
+      baud = atoi(argv[i + 1]);
+    else if (opt == "--seed")
+      seed = strtoull(argv[i + 1], nullptr, 10);
+  }
+
+  std::vector<uint8_t> image(size);
+  std::mt19937 rng(7);
+  for (auto &b : image)
+  {
+    b = (uint8_t)rng();
+  }
+  image[0] = IMAGE_MAGIC;
+
+  printf("%zu byte image, %u chunks, %s\n", size, (unsigned)((size + OTA_CHUNK_DATA - 1) / OTA_CHUNK_DATA),
+         baud > 0 ? "paced by the serial bridge" : "radio limited");
+  printf("%-5s %-5s %8s %9s %10s %8s %7s %7s %6s\n", "nodes", "loss", "done", "total s", "per node s", "KB/s", "resent", "polls", "drops");
+  const int counts[] = {1, 2, 4, 8};
+  const double losses[] = {0.0, 0.05, 0.2};
+  for (int n : counts)
+  {
+    for (double loss : losses)
+    {
+      Run r = simulate(image, n, loss, baud, seed);
+      printf("%-5d %-5.2f %5d/%-2d %9.1f %10.1f %8.1f %6.1f%% %7u %6u\n", n, loss, r.done, n, r.seconds,
+             r.perNode.count() ? r.perNode.mean() : 0.0, size / 1024.0 / r.seconds,
+             100.0 * r.retransmits / r.chunksSent, r.polls, r.drops);
+    }
+  }
+
+  // Receivers miss chunk 0 until they have the rest. The sender stays
+  // within a window of the first missing chunk, so the image is one window.
+  std::vector<uint8_t> window(image.begin(), image.begin() + std::min(image.size(), (size_t)OTA_WINDOW * OTA_CHUNK_DATA));
+  Run r = simulate(window, 4, 0.05, baud, seed, true);
+  printf("chunk 0 last, %zu bytes: %d/4 done in %.1f s at 5%% loss\n", window.size(), r.done, r.seconds);
+  return 0;
+}
@@ -0,0 +1,273 @@
+// Cost and behaviour of the hub's potentiometer pipeline at 1 kHz.
+//
+//   pot_bench [--noise lsb] [--seconds n] [--seed n]
+//
+// Runs esp-now/controllers/src/potFilter.cpp unchanged. The ADC is modelled
+// as 12 bit samples of the pot's true position plus gaussian noise (8 LSB
+// by default, what the C3 gives at 11 dB), handed over by the DMA in frames
+// of 8 samples (AnalogInput::FRAME_SAMPLES), and the hub's loop polls for a
+// setpoint every ms.
+//
+// The baseline is what reading the pot from loop() would be: one
+// analogRead() every 20 ms, sent when it moved by the threshold, once with
+// PotFilter's 0.25 degree and once with a full degree.
+//
+// For a pot left alone it prints the setpoints noise alone causes. For
+// steps between 45 and 135 degrees, the time to the first setpoint and
+// until one is within 1 degree of the new position. For steady turns, the
+// lag of the setpoints behind the pot and how many go out. Last the CPU
+// cost of the filter per sample.
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include "common/stats.h"
+#include "../esp-now/controllers/src/potFilter.h"
+
+static const size_t FRAME = 8;
+
+// A pot position over time, in degrees
+typedef double (*Motion)(double ms);
+
+static double still(double)
+{
+  return 90;
+}
+
+// Steps between 45 and 135 every 2 s, at varying points of the ADC frames
+// and the 20 ms reads
+static double stepAt(int k)
+{
+  return 2000.0 * k + (k * 13) % 80;
+}
+
+static double steps(double ms)
+{
+  int k = (int)(ms / 2000);
+  int count = ms >= stepAt(k) ? k + 1 : k;
+  return count % 2 ? 45 : 135;
+}
+
+static double turnSpeed;
+// Back and forth between 30 and 150 degrees at turnSpeed
+static double sweep(double ms)
+{
+  double span = 120;
+  double d = std::fmod(ms / 1000 * turnSpeed, 2 * span);
+  return 30 + (d < span ? d : 2 * span - d);
+}
+
+struct Result
+{
+  double setpointsPerMin = 0;
+  Stats firstMs;
+  Stats settledMs;
+  Stats lagMs;
+};
+
+struct Sent
+{
+  double ms;
+  double pos;
+};
+
+class Adc
+{
+public:
+  Adc(double noiseLsb, uint64_t seed) : noise(0, noiseLsb), rng(seed) {}
+
+  uint16_t sample(double degrees)
+  {
+    double raw = degrees / 180 * 4095 + noise(rng);
+    return (uint16_t)std::max(0.0, std::min(4095.0, std::round(raw)));
+  }
+
+private:
+  std::normal_distribution<double> noise;
+  std::mt19937_64 rng;
+};
+
+// threshold 0 runs PotFilter, anything else the analogRead() baseline
+static std::vector<Sent> run(Motion motion, double seconds, double noiseLsb, uint64_t seed, double threshold)
+{
+  Adc adc(noiseLsb, seed);
+  PotFilter filter;
+  std::vector<Sent> sent;
+  uint16_t frame[FRAME];
+  size_t inFrame = 0;
+  double lastSent = motion(0);
+  bool primed = false;
+
+  for (int ms = 0; ms < seconds * 1000; ms++)
+  {
+    uint16_t raw = adc.sample(motion(ms));
+    if (threshold > 0)
+    {
+      if (ms % 20 == 0)
+      {
+        double pos = raw * 180.0 / 4095;
+        if (!primed)
+        {
+          primed = true;
+          lastSent = pos;
+        }
+        else if (std::fabs(pos - lastSent) >= threshold)
+        {
+          lastSent = pos;
+          sent.push_back({(double)ms, pos});
+        }
+      }
+      continue;
+    }
+
+    frame[inFrame++] = raw;
+    if (inFrame == FRAME)
+    {
+      filter.addSamples(frame, FRAME);
+      inFrame = 0;
+    }
+    uint16_t posQ8;
+    uint8_t stream;
+    if (filter.setpoint((int64_t)ms * 1000, posQ8, stream))
+    {
+      sent.push_back({(double)ms, posQ8 / 256.0});
+    }
+  }
+  return sent;
+}
+
+static Result measure(Motion motion, double seconds, double noiseLsb, uint64_t seed, double threshold)
+{
+  std::vector<Sent> sent = run(motion, seconds, noiseLsb, seed, threshold);
+  Result r;
+  // The first second settles the filter and isn't counted
+  size_t counted = 0;
+  for (const Sent &s : sent)
+  {
+    counted += s.ms >= 1000;
+  }
+  r.setpointsPerMin = counted * 60 / (seconds - 1);
+
+  if (motion == steps)
+  {
+    for (int k = 1; stepAt(k + 1) <= seconds * 1000; k++)
+    {
+      double t = stepAt(k);
+      double target = steps(t);
+      bool first = false, settled = false;
+      for (const Sent &s : sent)
+      {
+        if (s.ms < t || s.ms >= stepAt(k + 1))
+          continue;
+        if (!first)
+        {
+          r.firstMs.add(s.ms - t);
+          first = true;
+        }
+        if (!settled && std::fabs(s.pos - target) <= 1)
+        {
+          r.settledMs.add(s.ms - t);
+          settled = true;
+        }
+      }
+    }
+  }
+
+  if (motion == sweep)
+  {
+    for (const Sent &s : sent)
+    {
+      // Away from the turning points the lag is the error over the speed
+      double d = std::fmod(s.ms / 1000 * turnSpeed, 240);
+      if (s.ms >= 1000 && std::fabs(d - 120) > 20 && d > 20 && d < 220)
+      {
+        r.lagMs.add(std::fabs(sweep(s.ms) - s.pos) / turnSpeed * 1000);
+      }
+    }
+  }
+  return r;
+}
+
+static volatile uint32_t sink;
+
+int main(int argc, char **argv)
+{
+  double noise = 8;
+  double seconds = 60;
+  uint64_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    std::string opt = argv[i];
+    if (opt == "--noise")
+      noise = atof(argv[i + 1]);
+    else if (opt == "--seconds")
+      seconds = atof(argv[i + 1]);
+    else if (opt == "--seed")
+      seed = strtoull(argv[i + 1], nullptr, 10);
+  }
+
+  struct Pipeline
+  {
+    const char *name;
+    double threshold;
+  };
+  const Pipeline pipelines[] = {{"analogRead 0.25", 0.25}, {"analogRead 1.0", 1.0}, {"PotFilter", 0}};
+
+  printf("%.0f s per run, 1 kHz, noise %.1f LSB (%.2f degrees)\n", seconds, noise, noise * 180 / 4095);
+
+  printf("\npot left alone\n  %-16s %14s\n", "pipeline", "setpoints/min");
+  for (const Pipeline &p : pipelines)
+  {
+    Result r = measure(still, seconds, noise, seed, p.threshold);
+    printf("  %-16s %14.1f\n", p.name, r.setpointsPerMin);
+  }
+
+  printf("\nsteps of 90 degrees every 2 s\n  %-16s %12s %12s %14s %14s\n", "pipeline", "first ms", "first p99",
+         "within 1 deg", "within 1 p99");
+  for (const Pipeline &p : pipelines)
+  {
+    Result r = measure(steps, seconds, noise, seed, p.threshold);
+    printf("  %-16s %12.1f %12.1f %14.1f %14.1f\n", p.name, r.firstMs.mean(), r.firstMs.percentile(99),
+           r.settledMs.mean(), r.settledMs.percentile(99));
+  }
+
+  for (double speed : {30.0, 120.0})
+  {
+    turnSpeed = speed;
+    printf("\nturning at %.0f degrees/s\n  %-16s %12s %12s %14s\n", speed, "pipeline", "lag ms", "lag p99",
+           "setpoints/s");
+    for (const Pipeline &p : pipelines)
+    {
+      Result r = measure(sweep, seconds, noise, seed, p.threshold);
+      printf("  %-16s %12.1f %12.1f %14.1f\n", p.name, r.lagMs.mean(), r.lagMs.percentile(99),
+             r.setpointsPerMin / 60);
+    }
+  }
+
+  // CPU: a frame of samples and a poll, as the hub's loop does
+  Adc adc(noise, seed);
+  std::vector<uint16_t> raw(FRAME * 4096);
+  for (size_t i = 0; i < raw.size(); i++)
+  {
+    raw[i] = adc.sample(sweep(i));
+  }
+  PotFilter filter;
+  const int rounds = 200;
+  uint64_t t0 = nowUs();
+  for (int round = 0; round < rounds; round++)
+  {
+    for (size_t i = 0; i < raw.size(); i += FRAME)
+    {
+      filter.addSamples(&raw[i], FRAME);
+      uint16_t pos;
+      uint8_t stream;
+      sink += filter.setpoint((int64_t)(round * raw.size() + i) * 1000, pos, stream) ? pos : 0;
+    }
+  }
+  double ns = (nowUs() - t0) * 1000.0 / ((double)rounds * raw.size());
+  printf("\nfilter %.2f ns per sample, %.2f us per %zu sample frame, %.4f%% of a core at 1 kHz\n", ns, ns * FRAME / 1000,
+         FRAME, ns * 1000 / 1e9 * 100);
+  return 0;
+}
@@ -0,0 +1,248 @@
+// Simulates multi-hop relaying over ESP-NOW on a line of nodes, e.g. the hub
+// in the cab, relays along the trailer and the rear cam at the far end.
+//
+//   relay_sim [--nodes n] [--width n] [--seconds s] [--ttl n] [--seed n]
+//
+// Runs the firmware's Relay unchanged. Positions along the line are one unit
+// apart; a frame reaches the next position most of the time, the one after
+// that rarely and nothing further. --width puts that many relays side by
+// side at every position between the ends, 2 by default, since suppression
+// only pays where relays overlap. Nodes defer to transmissions they can
+// hear, but two nodes that can't hear each other still collide at a node
+// between them.
+//
+// The hub and the far node send each other a frame every 100 ms. For every
+// relay policy it reports delivery ratio, latency per hop and how many
+// transmissions each delivered frame cost.
+
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "common/sim.h"
+#include "common/stats.h"
+#include "../esp-now/controllers/src/relay.h"
+
+static const uint64_t MS = 1000;
+// Air time of a ~60 byte frame at 1 Mbps plus preamble
+static const uint64_t AIR_US = 600;
+
+static double lossAt(int distance)
+{
+  switch (distance)
+  {
+  case 0:
+    return 0.02;
+  case 1:
+    return 0.1;
+  case 2:
+    return 0.75;
+  default:
+    return 1.0;
+  }
+}
+
+struct Tx
+{
+  int node;
+  uint64_t start;
+  uint64_t end;
+};
+
+struct Result
+{
+  int sent = 0;
+  int delivered = 0;
+  uint64_t transmissions = 0;
+  Stats latency;
+  Stats perHop;
+};
+
+static void runPolicy(const char *name, int length, int width, int seconds, uint8_t ttl, bool relays, uint8_t suppress, uint64_t seed)
+{
+  Sim sim(seed);
+
+  // Hub first, far end last, width relays at every position in between
+  std::vector<int> position = {0};
+  for (int p = 1; p < length - 1; p++)
+  {
+    for (int w = 0; w < width; w++)
+      position.push_back(p);
+  }
+  position.push_back(length - 1);
+  const int nodeCount = (int)position.size();
+  const int last = nodeCount - 1;
+
+  std::vector<std::unique_ptr<Relay>> relay;
+  for (int i = 0; i < nodeCount; i++)
+  {
+    relay.emplace_back(new Relay());
+    relay.back()->suppressCopies = suppress;
+  }
+  std::vector<Tx> air;
+  Result result[2];
+  // When each (origin, seq) was first sent, to time its delivery
+  std::map<uint32_t, uint64_t> sentAt;
+
+  auto distance = [&](int a, int b)
+  { return std::abs(position[a] - position[b]); };
+  auto inRange = [&](int a, int b)
+  { return distance(a, b) <= 2; };
+
+  std::function<void(int, std::vector<uint8_t>)> transmit;
+  std::function<void(int, std::vector<uint8_t>)> receive;
+
+  // Carrier sense, then on air; collisions and loss are decided per receiver
+  transmit = [&](int node, std::vector<uint8_t> frame)
+  {
+    for (const Tx &t : air)
+    {
+      if (t.end > sim.now && inRange(t.node, node))
+      {
+        sim.at(t.end + (uint64_t)sim.uniform(0, 200), [&, node, frame]()
+               { transmit(node, frame); });
+        return;
+      }
+    }
+
+    Tx tx = {node, sim.now, sim.now + AIR_US};
+    air.push_back(tx);
+    for (int rx = 0; rx < nodeCount; rx++)
+    {
+      if (rx == node || !inRange(rx, node))
+        continue;
+      sim.at(tx.end, [&, rx, tx, frame]()
+             {
+        for (const Tx &o : air)
+        {
+          if (o.node != tx.node && o.node != rx && inRange(o.node, rx) && o.start < tx.end && o.end > tx.start)
+            return;
+        }
+        if (!sim.chance(lossAt(distance(rx, tx.node))))
+          receive(rx, frame); });
+    }
+
+    Header h;
+    memcpy(&h, frame.data(), sizeof(h));
+    result[h.origin == 0 ? 0 : 1].transmissions++;
+
+    // Old transmissions can't collide with anything any more
+    while (!air.empty() && air.front().end + 10 * MS < sim.now)
+      air.erase(air.begin());
+  };
+
+  // What Dev::Base::dispatch() does with a frame
+  receive = [&](int node, std::vector<uint8_t> frame)
+  {
+    Header h;
+    memcpy(&h, frame.data(), sizeof(h));
+    if (h.origin == node || !relay[node]->firstSighting(h.origin, h.seq))
+      return;
+
+    int dest = h.dest == DevType::Hub ? 0 : last;
+    if (node == dest)
+    {
+      Result &r = result[h.origin == 0 ? 0 : 1];
+      r.delivered++;
+      double us = (double)(sim.now - sentAt[(uint32_t)h.origin << 16 | h.seq]);
+      r.latency.add(us);
+      r.perHop.add(us / (h.hops + 1));
+      return;
+    }
+
+    if (relays && node != 0 && node != last && h.ttl > 1)
+    {
+      h.ttl--;
+      h.hops++;
+      memcpy(frame.data(), &h, sizeof(h));
+      uint32_t backoff = (uint32_t)sim.uniform(0, Relay::MAX_BACKOFF_US);
+      relay[node]->schedule(frame.data(), frame.size(), (int64_t)sim.now, backoff);
+      sim.after(backoff, [&, node]()
+                {
+        uint8_t out[250];
+        size_t n;
+        while ((n = relay[node]->due((int64_t)sim.now, out)) > 0)
+          transmit(node, std::vector<uint8_t>(out, out + n)); });
+    }
+  };
+
+  // Both ends originate a frame every 100 ms or so; strictly periodic senders
+  // would collide forever once their phases lined up
+  uint16_t seq[2] = {0, 0};
+  for (int end = 0; end < 2; end++)
+  {
+    auto fn = std::make_shared<std::function<void()>>();
+    *fn = [&, end, fn]()
+    {
+      int node = end == 0 ? 0 : last;
+      Header h;
+      h.src = end == 0 ? DevType::Hub : DevType::RearCam;
+      h.dest = end == 0 ? DevType::RearCam : DevType::Hub;
+      h.origin = (uint16_t)node;
+      h.seq = seq[end]++;
+      h.ttl = ttl;
+      h.hops = 0;
+      relay[node]->firstSighting(h.origin, h.seq);
+      std::vector<uint8_t> frame(sizeof(Header) + 40);
+      memcpy(frame.data(), &h, sizeof(h));
+      sentAt[(uint32_t)h.origin << 16 | h.seq] = sim.now;
+      result[end].sent++;
+      transmit(node, frame);
+      sim.after(100 * MS + (uint64_t)sim.uniform(0, 10 * MS), *fn);
+    };
+    sim.at((uint64_t)sim.uniform(0, 100 * MS), *fn);
+  }
+
+  sim.runUntil((uint64_t)seconds * 1000 * MS);
+
+  uint32_t suppressed = 0, relayed = 0;
+  for (auto &r : relay)
+  {
+    suppressed += r->suppressed;
+    relayed += r->relayed;
+  }
+  printf("\n%s: %u relayed, %u suppressed\n", name, relayed, suppressed);
+  const char *dir[2] = {"hub -> far end", "far end -> hub"};
+  for (int i = 0; i < 2; i++)
+  {
+    Result &r = result[i];
+    printf("  %s: delivered %.1f%%, %.2f transmissions per delivery\n", dir[i],
+           100.0 * r.delivered / r.sent, r.delivered ? (double)r.transmissions / r.delivered : 0.0);
+    if (r.latency.count())
+    {
+      r.latency.print("    latency", "us");
+      r.perHop.print("    per hop", "us");
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int nodes = 4;
+  int width = 2;
+  int seconds = 300;
+  int ttl = 3;
+  uint64_t seed = 1;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    std::string opt = argv[i];
+    if (opt == "--nodes")
+      nodes = atoi(argv[i + 1]);
+    else if (opt == "--width")
+      width = atoi(argv[i + 1]);
+    else if (opt == "--seconds")
+      seconds = atoi(argv[i + 1]);
+    else if (opt == "--ttl")
+      ttl = atoi(argv[i + 1]);
+    else if (opt == "--seed")
+      seed = strtoull(argv[i + 1], nullptr, 10);
+  }
+
+  printf("line of %d positions, %d relays wide, ttl %d, %d s\n", nodes, width, ttl, seconds);
+  runPolicy("no relays", nodes, width, seconds, (uint8_t)ttl, false, 255, seed);
+  runPolicy("flooding", nodes, width, seconds, (uint8_t)ttl, true, 255, seed);
+  runPolicy("suppress after 1 copy", nodes, width, seconds, (uint8_t)ttl, true, 1, seed);
+  runPolicy("suppress after 2 copies", nodes, width, seconds, (uint8_t)ttl, true, 2, seed);
+  return 0;
+}
@@ -0,0 +1,361 @@
+// Compares driving a scan on two rear cams from the hub, one move at a time,
+// with sending it to them once as a motion script.
+//
+//   script_sim [--runs n] [--seed n] [--loss p]
+//
+// The scan is out to 30 degrees and back to 150 three times, pausing 500 ms
+// at each end, on two cameras that start at 90 and 120 degrees. Frames go
+// over LinkModel's radio, 5% loss and stalls of up to 15 ms. Each camera's
+// idea of the hub's clock is off by 100 us RMS and its loop runs every 1 ms.
+//
+//   hub-driven  the hub sends each move as one timed multicast call, 20 ms
+//               ahead as Hub::moveCameras does, waits for both cameras to
+//               report they arrived, resending to the ones that don't in
+//               time, then waits the pause and sends the next
+//   script      one RearCam_Script to both, started 100 ms ahead, resent to
+//               a camera that doesn't accept it within 30 ms. Runs
+//               "loop 3; move 30; arrived; wait 500; move 150; arrived;
+//               wait 500; next" in esp-now/controllers/src/motionScript.cpp,
+//               unchanged.
+//   script+sync the same, pausing with sync instead: every move starts on a
+//               2 s boundary of the script's start
+//
+// Printed are the frames on air, how far the pauses are from 500 ms (or the
+// moves from their 2 s boundary with sync) after the first move, the skew
+// between the cameras starting the same move, and how long the scan took.
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+#include "common/motionAsm.h"
+#include "common/sim.h"
+#include "common/stats.h"
+
+static const uint64_t MS = 1000;
+static const uint64_t STEP_US = 10 * MS;
+static const uint64_t PAUSE_US = 500 * MS;
+static const int LOOPS = 3;
+static const int TARGETS[2] = {30, 150};
+
+enum Mode
+{
+  HUB_DRIVEN,
+  SCRIPT,
+  SCRIPT_SYNC,
+};
+
+struct Cam
+{
+  // Hub time as the camera knows it, minus true time
+  int64_t clockErrorUs;
+
+  // Servo, true time
+  int from = 90;
+  int target = 90;
+  uint64_t moveStartUs = 0;
+
+  // Hub-driven: a move waiting for its time, and the call to answer
+  bool movePending = false;
+  int moveTarget = 0;
+  uint64_t moveAtUs = 0;
+  bool callPending = false;
+  uint16_t call = 0;
+
+  MotionScript script;
+
+  std::vector<uint64_t> starts;
+  std::vector<uint64_t> arrivals;
+
+  uint64_t arrivalUs() const { return moveStartUs + (uint64_t)std::abs(target - from) * STEP_US; }
+  bool moving(uint64_t now) const { return now < arrivalUs(); }
+  int64_t hubTime(uint64_t now) const { return (int64_t)now + clockErrorUs; }
+
+  void move(int to, uint64_t now)
+  {
+    // A resend to a camera already there isn't a move
+    if (to == target && !moving(now))
+      return;
+    from = target;
+    target = to;
+    moveStartUs = now;
+    starts.push_back(now);
+    arrivals.push_back(arrivalUs());
+  }
+};
+
+struct Result
+{
+  uint32_t frames = 0;
+  double durationS = 0;
+  bool finished = true;
+};
+
+static Result run(Mode mode, const LinkModel &link, uint64_t seed, const std::vector<uint8_t> &code, Stats &timingMs,
+                  Stats &skewMs)
+{
+  Sim sim(seed);
+  Result r;
+  Cam cams[2];
+  cams[1].from = cams[1].target = 120;
+  for (Cam &c : cams)
+  {
+    c.clockErrorUs = (int64_t)sim.normal(0, 100);
+  }
+  int done = 0;
+  uint64_t endUs = 0;
+
+  // A frame from the hub to camera i, lost or delivered later
+  auto toCam = [&](int i, std::function<void(Cam &)> fn)
+  {
+    uint64_t delay;
+    if (link.deliver(sim, delay))
+    {
+      sim.after(delay, [&, i, fn]()
+                { fn(cams[i]); });
+    }
+  };
+  // And back, counted but the hub only sees it if it arrives
+  auto toHub = [&](std::function<void()> fn)
+  {
+    r.frames++;
+    uint64_t delay;
+    if (link.deliver(sim, delay))
+    {
+      sim.after(delay, fn);
+    }
+  };
+
+  // Hub-driven state
+  int step = 0;
+  int steps = LOOPS * 2;
+  bool arrived[2] = {};
+  uint16_t call = 0;
+  std::function<void(uint8_t)> sendMove;
+
+  auto onCompleted = [&](int i, uint16_t corrId)
+  {
+    if (corrId != call || arrived[i])
+      return;
+    arrived[i] = true;
+    if (arrived[0] && arrived[1])
+    {
+      if (++step == steps)
+      {
+        endUs = sim.now;
+        return;
+      }
+      arrived[0] = arrived[1] = false;
+      sim.after(PAUSE_US, [&]()
+                { sendMove(3); });
+    }
+  };
+
+  // One timed multicast frame for the cameras in mask
+  sendMove = [&](uint8_t mask)
+  {
+    call++;
+    r.frames++;
+    int pos = TARGETS[step % 2];
+    uint64_t at = sim.now + 20 * MS;
+    uint16_t id = call;
+    for (int i = 0; i < 2; i++)
+    {
+      if (!(mask & (1 << i)))
+        continue;
+      toCam(i, [&, i, pos, at, id](Cam &c)
+            {
+        c.movePending = true;
+        c.moveTarget = pos;
+        c.moveAtUs = at;
+        c.callPending = true;
+        c.call = id; });
+    }
+    // Expected travel plus slack, then resend to whoever hasn't answered
+    uint64_t travel = 0;
+    for (Cam &c : cams)
+    {
+      travel = std::max(travel, (uint64_t)std::abs(pos - c.target) * STEP_US);
+    }
+    int forStep = step;
+    sim.after(20 * MS + travel + 250 * MS, [&, id, forStep]()
+              {
+      if (id != call || forStep != step || endUs)
+        return;
+      uint8_t missing = (arrived[0] ? 0 : 1) | (arrived[1] ? 0 : 2);
+      // The resend is a new call, what already arrived counts for it
+      sendMove(missing);
+      for (int i = 0; i < 2; i++)
+      {
+        if (!(missing & (1 << i)))
+          arrived[i] = true;
+      } });
+  };
+
+  // Script state
+  bool accepted[2] = {};
+  uint64_t scriptStartUs = 100 * MS;
+  std::function<void()> sendScript = [&]()
+  {
+    uint8_t mask = (accepted[0] ? 0 : 1) | (accepted[1] ? 0 : 2);
+    if (mask == 0)
+      return;
+    r.frames++;
+    for (int i = 0; i < 2; i++)
+    {
+      if (!(mask & (1 << i)))
+        continue;
+      toCam(i, [&, i](Cam &c)
+            {
+        // Running it already means the accept got lost, the camera only
+        // accepts it again
+        if (c.script.isRunning() || c.script.load(code.data(), code.size(), (int64_t)scriptStartUs, (uint8_t)c.target))
+        {
+          toHub([&, i]()
+                { accepted[i] = true; });
+        } });
+    }
+    sim.after(30 * MS, sendScript);
+  };
+
+  std::function<void(int)> tick = [&](int i)
+  {
+    Cam &c = cams[i];
+    uint64_t now = sim.now;
+    if (c.movePending && c.hubTime(now) >= (int64_t)c.moveAtUs)
+    {
+      c.movePending = false;
+      c.move(c.moveTarget, now);
+    }
+    if (c.callPending && !c.movePending && !c.moving(now))
+    {
+      c.callPending = false;
+      uint16_t id = c.call;
+      toHub([&, i, id]()
+            { onCompleted(i, id); });
+    }
+
+    switch (c.script.update(c.hubTime(now), c.moving(now)))
+    {
+    case MotionScript::STEP_MOVE:
+      c.move(c.script.pos, now);
+      break;
+    case MotionScript::STEP_DONE:
+      // The scan is over when the last camera is, whether or not the hub
+      // hears about it
+      if (++done == 2)
+        endUs = now;
+      toHub([]() {});
+      break;
+    default:
+      break;
+    }
+    sim.after(MS + (uint64_t)sim.uniform(0, 200), [&, i]()
+              { tick(i); });
+  };
+
+  for (int i = 0; i < 2; i++)
+  {
+    sim.at((uint64_t)sim.uniform(0, MS), [&, i]()
+           { tick(i); });
+  }
+  if (mode == HUB_DRIVEN)
+  {
+    sim.at(0, [&]()
+           { sendMove(3); });
+  }
+  else
+  {
+    sim.at(0, sendScript);
+  }
+
+  uint64_t limit = 60000 * MS;
+  sim.runUntil(limit);
+  if (!endUs)
+  {
+    r.finished = false;
+    endUs = limit;
+  }
+  r.durationS = endUs / 1e6;
+
+  for (int k = 1; k < steps; k++)
+  {
+    for (Cam &c : cams)
+    {
+      if ((size_t)k >= c.starts.size())
+        continue;
+      double err;
+      if (mode == SCRIPT_SYNC)
+        err = (double)c.starts[k] - (double)(scriptStartUs + k * 2000 * MS);
+      else
+        err = (double)c.starts[k] - (double)(c.arrivals[k - 1] + PAUSE_US);
+      // The first pause on the camera that got there first waits for the
+      // other one when the hub drives, not counted
+      if (k > 1 || mode != HUB_DRIVEN)
+        timingMs.add(std::fabs(err) / 1000);
+    }
+    if ((size_t)k < cams[0].starts.size() && (size_t)k < cams[1].starts.size())
+    {
+      skewMs.add(std::fabs((double)cams[0].starts[k] - (double)cams[1].starts[k]) / 1000);
+    }
+  }
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  int runs = 200;
+  uint64_t seed = 1;
+  LinkModel link;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    std::string opt = argv[i];
+    if (opt == "--runs")
+      runs = atoi(argv[i + 1]);
+    else if (opt == "--seed")
+      seed = strtoull(argv[i + 1], nullptr, 10);
+    else if (opt == "--loss")
+      link.loss = atof(argv[i + 1]);
+  }
+
+  struct Variant
+  {
+    const char *name;
+    Mode mode;
+    const char *source;
+  };
+  const Variant variants[] = {
+      {"hub-driven", HUB_DRIVEN, ""},
+      {"script", SCRIPT, "loop 3; move 30; arrived; wait 500; move 150; arrived; wait 500; next"},
+      {"script+sync", SCRIPT_SYNC, "loop 3; move 30; sync 2000; move 150; sync 2000; next"},
+  };
+
+  printf("%d runs, %.0f%% loss\n", runs, link.loss * 100);
+  printf("%-12s %6s %10s %12s %12s %12s %12s %10s %6s\n", "variant", "bytes", "frames", "timing ms", "timing p99",
+         "skew ms", "skew p99", "scan s", "stuck");
+  for (const Variant &v : variants)
+  {
+    std::vector<uint8_t> code;
+    std::string error;
+    if (v.mode != HUB_DRIVEN && !assembleMotion(v.source, code, error))
+    {
+      fprintf(stderr, "%s: %s\n", v.name, error.c_str());
+      return 1;
+    }
+
+    Stats frames, timing, skew, duration;
+    int stuck = 0;
+    for (int i = 0; i < runs; i++)
+    {
+      Result r = run(v.mode, link, seed + i, code, timing, skew);
+      frames.add(r.frames);
+      duration.add(r.durationS);
+      stuck += !r.finished;
+    }
+    std::string bytes = v.mode == HUB_DRIVEN ? "-" : std::to_string(code.size());
+    printf("%-12s %6s %10.1f %12.2f %12.2f %12.2f %12.2f %10.2f %6d\n", v.name, bytes.c_str(), frames.mean(),
+           timing.mean(), timing.percentile(99), skew.mean(), skew.percentile(99), duration.mean(),
+           stuck);
+  }
+  return 0;
+}
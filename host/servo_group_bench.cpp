@@ -0,0 +1,218 @@
+// Cost of a control tick of the rear camera's ServoGroup for 1 to 4 axes,
+// and how well the axes stay together.
+//
+//   servo_group_bench [moves]
+//
+// Runs rear-camera-pio/src/servoGroup.cpp unchanged through the same random
+// moves for every axis count, with every call a due tick. As a baseline each
+// axis is also stepped on its own, one degree every 10 ms the way a single
+// CameraServo used to, which is as cheap but lets axes with less far to go
+// arrive early.
+//
+// finish skew is the largest gap between the first and the last axis of a
+// move taking its last step. path error is how far, in degrees, an axis
+// strays from the straight line between its start and its target.
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+#include "common/stats.h"
+#include "servoGroup.h"
+
+// The old CameraServo::update(), once per axis
+struct Stepper
+{
+  uint8_t pos;
+  uint8_t target;
+  uint32_t lastStepMs;
+
+  bool update(uint32_t nowMs)
+  {
+    if (pos == target || nowMs - lastStepMs < ServoGroup::MS_PER_DEGREE)
+    {
+      return false;
+    }
+    lastStepMs = nowMs;
+    pos += pos < target ? 1 : -1;
+    return true;
+  }
+};
+
+struct Move
+{
+  uint8_t targets[ServoGroup::MAX_AXES];
+};
+
+struct Result
+{
+  double nsPerTick;
+  uint32_t maxSkewMs;
+  double maxPathError;
+};
+
+static volatile uint32_t sink;
+
+static Result runGroup(size_t axes, const std::vector<Move> &moves, bool measureOnly)
+{
+  uint8_t start[ServoGroup::MAX_AXES] = {90, 90, 90, 90};
+  ServoGroup group;
+  group.init(axes, start);
+
+  Result r = {};
+  uint32_t now = 0;
+  uint64_t ticks = 0;
+  uint32_t changed = 0;
+  uint64_t t0 = nowUs();
+
+  for (const Move &m : moves)
+  {
+    uint8_t from[ServoGroup::MAX_AXES];
+    uint32_t arrivedMs[ServoGroup::MAX_AXES] = {};
+    for (size_t i = 0; i < axes; i++)
+    {
+      from[i] = group.position(i);
+    }
+
+    group.moveTo(m.targets, 0xf, now);
+    uint32_t startMs = now;
+    uint32_t duration = group.durationMs();
+
+    while (group.isMoving())
+    {
+      uint8_t stepped = group.tick(now);
+      changed += stepped;
+      ticks++;
+      if (!measureOnly)
+      {
+        for (size_t i = 0; i < axes; i++)
+        {
+          if (stepped & (1 << i))
+          {
+            arrivedMs[i] = now - startMs + 1;
+          }
+          // The straight line, one tick ahead as the group runs
+          double t = std::min(1.0, (double)(now - startMs + ServoGroup::TICK_MS) / duration);
+          double ideal = from[i] + (m.targets[i] - from[i]) * t;
+          r.maxPathError = std::max(r.maxPathError, std::fabs(group.position(i) - ideal));
+        }
+      }
+      now += ServoGroup::TICK_MS;
+    }
+
+    if (!measureOnly)
+    {
+      uint32_t first = UINT32_MAX, last = 0;
+      for (size_t i = 0; i < axes; i++)
+      {
+        if (arrivedMs[i])
+        {
+          first = std::min(first, arrivedMs[i]);
+          last = std::max(last, arrivedMs[i]);
+        }
+      }
+      if (last)
+      {
+        r.maxSkewMs = std::max(r.maxSkewMs, last - first);
+      }
+    }
+  }
+
+  sink = changed;
+  r.nsPerTick = ticks ? (nowUs() - t0) * 1000.0 / ticks : 0;
+  return r;
+}
+
+static Result runSteppers(size_t axes, const std::vector<Move> &moves, bool measureOnly)
+{
+  Stepper s[ServoGroup::MAX_AXES];
+  for (size_t i = 0; i < axes; i++)
+  {
+    s[i] = {90, 90, 0};
+  }
+
+  Result r = {};
+  uint32_t now = ServoGroup::MS_PER_DEGREE;
+  uint64_t ticks = 0;
+  uint32_t changed = 0;
+  uint64_t t0 = nowUs();
+
+  for (const Move &m : moves)
+  {
+    uint32_t arrivedMs[ServoGroup::MAX_AXES] = {};
+    for (size_t i = 0; i < axes; i++)
+    {
+      s[i].target = m.targets[i];
+    }
+    uint32_t startMs = now;
+
+    bool moving = true;
+    while (moving)
+    {
+      moving = false;
+      for (size_t i = 0; i < axes; i++)
+      {
+        bool stepped = s[i].update(now);
+        changed += stepped;
+        if (!measureOnly && stepped)
+        {
+          arrivedMs[i] = now - startMs + 1;
+        }
+        moving |= s[i].pos != s[i].target;
+      }
+      ticks++;
+      now += ServoGroup::MS_PER_DEGREE;
+    }
+
+    if (!measureOnly)
+    {
+      uint32_t first = UINT32_MAX, last = 0;
+      for (size_t i = 0; i < axes; i++)
+      {
+        if (arrivedMs[i])
+        {
+          first = std::min(first, arrivedMs[i]);
+          last = std::max(last, arrivedMs[i]);
+        }
+      }
+      if (last)
+      {
+        r.maxSkewMs = std::max(r.maxSkewMs, last - first);
+      }
+    }
+  }
+
+  sink = changed;
+  r.nsPerTick = ticks ? (nowUs() - t0) * 1000.0 / ticks : 0;
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000;
+
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> pos(0, 180);
+  std::vector<Move> moves(count);
+  for (Move &m : moves)
+  {
+    for (uint8_t &t : m.targets)
+    {
+      t = (uint8_t)pos(rng);
+    }
+  }
+
+  printf("%zu random moves per run, every call a due tick\n", count);
+  printf("%-6s %-16s %12s %16s %15s\n", "axes", "driver", "ns/tick", "finish skew ms", "path error deg");
+  for (size_t axes = 1; axes <= ServoGroup::MAX_AXES; axes++)
+  {
+    // Timed without the bookkeeping, checked with it
+    Result g = runGroup(axes, moves, true);
+    Result gc = runGroup(axes, moves, false);
+    Result s = runSteppers(axes, moves, true);
+    Result sc = runSteppers(axes, moves, false);
+    printf("%-6zu %-16s %12.1f %16u %15.2f\n", axes, "ServoGroup", g.nsPerTick, gc.maxSkewMs, gc.maxPathError);
+    printf("%-6zu %-16s %12.1f %16u %15s\n", axes, "steppers", s.nsPerTick, sc.maxSkewMs, "-");
+  }
+  return 0;
+}
@@ -0,0 +1,297 @@
+// Cost of the nodes' TimerWheel against scanning every deadline on every
+// tick, the way RpcClient::update() used to, for 10 to 10000 outstanding
+// timers.
+//
+//   timer_wheel_bench [seconds]
+//
+// Runs esp-now/controllers/src/timerWheel.cpp unchanged. Every timer stands
+// for a frame waiting for its ack: it is started for 20 to 500 ticks (ms on
+// the nodes) and started again when it fires. With acks, every tick 2% of
+// them are also cancelled and started again for the next frame. Both sides
+// see the same random sequence.
+//
+// Before timing, a check runs the same load across the 32 bit wrap with
+// delays up to 100 s and stalls of up to 5 s between advances, and fails
+// unless every timer fires exactly once, on its due tick, and no cancelled
+// one fires.
+
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include "common/stats.h"
+#include "timerWheel.h"
+
+static volatile uint32_t sink;
+
+// The scan it replaces: a deadline per slot, all of them looked at per tick
+struct Scan
+{
+  struct Slot
+  {
+    bool inUse;
+    uint32_t startTick;
+    uint32_t timeout;
+  };
+  std::vector<Slot> slots;
+  uint32_t fired = 0;
+
+  explicit Scan(size_t n) : slots(n) {}
+
+  void start(size_t i, uint32_t now, uint32_t timeout) { slots[i] = {true, now, timeout}; }
+  void cancel(size_t i) { slots[i].inUse = false; }
+
+  template <typename Fn>
+  void update(uint32_t now, Fn onFire)
+  {
+    for (size_t i = 0; i < slots.size(); i++)
+    {
+      Slot &s = slots[i];
+      if (!s.inUse || now - s.startTick < s.timeout)
+        continue;
+      s.inUse = false;
+      fired++;
+      onFire(i);
+    }
+  }
+};
+
+// Random delays and picks drawn up front, so the generator isn't timed
+struct Load
+{
+  static const size_t TABLE = 1 << 16;
+  std::vector<uint32_t> delays;
+  std::vector<uint32_t> picks;
+  size_t next = 0;
+  size_t churn;
+
+  Load(size_t n, bool acks) : delays(TABLE), picks(TABLE), churn(acks ? std::max<size_t>(1, n / 50) : 0)
+  {
+    std::mt19937 rng(7);
+    for (size_t i = 0; i < TABLE; i++)
+    {
+      delays[i] = 20 + rng() % 481;
+      picks[i] = rng() % n;
+    }
+  }
+
+  uint32_t delay() { return delays[next++ & (TABLE - 1)]; }
+  uint32_t pick() { return picks[next++ & (TABLE - 1)]; }
+};
+
+struct WheelSide
+{
+  TimerWheel wheel;
+  std::vector<uint32_t> ids;
+  Load *load;
+  uint32_t fired = 0;
+
+  WheelSide(TimerWheel::Node *pool, size_t n, uint32_t now, Load *load)
+      : wheel(pool, n, now), ids(n), load(load) {}
+
+  static void onFire(void *owner, uint32_t tag)
+  {
+    WheelSide &w = *(WheelSide *)owner;
+    w.fired++;
+    w.ids[tag] = w.wheel.start(w.load->delay(), onFire, owner, tag);
+  }
+};
+
+struct Result
+{
+  double wheelNsPerTick;
+  double scanNsPerTick;
+  double firesPerTick;
+  double cascadesPerFire;
+};
+
+static Result bench(size_t n, uint32_t ticks, bool acks)
+{
+  Result r = {};
+  uint32_t t0 = 1000;
+
+  std::vector<TimerWheel::Node> pool(n);
+  Load wl(n, acks);
+  WheelSide w(pool.data(), n, t0, &wl);
+  for (size_t i = 0; i < n; i++)
+  {
+    w.ids[i] = w.wheel.start(wl.delay(), WheelSide::onFire, &w, (uint32_t)i);
+  }
+  uint64_t start = nowUs();
+  for (uint32_t t = t0 + 1; t != t0 + 1 + ticks; t++)
+  {
+    w.wheel.advance(t);
+    for (size_t k = 0; k < wl.churn; k++)
+    {
+      uint32_t i = wl.pick();
+      w.wheel.cancel(w.ids[i]);
+      w.ids[i] = w.wheel.start(wl.delay(), WheelSide::onFire, &w, i);
+    }
+  }
+  r.wheelNsPerTick = (nowUs() - start) * 1000.0 / ticks;
+  r.firesPerTick = (double)w.fired / ticks;
+  r.cascadesPerFire = w.fired ? (double)w.wheel.cascaded / w.fired : 0;
+
+  Load sl(n, acks);
+  Scan s(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    s.start(i, t0, sl.delay());
+  }
+  start = nowUs();
+  for (uint32_t t = t0 + 1; t != t0 + 1 + ticks; t++)
+  {
+    s.update(t, [&](size_t i)
+             { s.start(i, t, sl.delay()); });
+    for (size_t k = 0; k < sl.churn; k++)
+    {
+      uint32_t i = sl.pick();
+      s.cancel(i);
+      s.start(i, t, sl.delay());
+    }
+  }
+  r.scanNsPerTick = (nowUs() - start) * 1000.0 / ticks;
+  sink = s.fired;
+  return r;
+}
+
+// Expected expiry of every timer, checked as it fires
+struct Checker
+{
+  TimerWheel *wheel;
+  std::vector<uint32_t> ids;
+  std::vector<uint32_t> due;
+  std::mt19937 rng{3};
+  uint32_t fired = 0;
+  uint32_t errors = 0;
+  bool draining = false;
+
+  uint32_t randomDelay()
+  {
+    // Mostly short, some reaching the upper levels
+    switch (rng() % 4)
+    {
+    case 0:
+      return 1 + rng() % 64;
+    case 1:
+      return 1 + rng() % 5000;
+    case 2:
+      return 1 + rng() % 300000;
+    default:
+      return 1 + rng() % 100000000;
+    }
+  }
+
+  void start(size_t i)
+  {
+    uint32_t d = randomDelay();
+    due[i] = wheel->now() + d;
+    ids[i] = wheel->start(d, onFire, this, (uint32_t)i);
+  }
+
+  static void onFire(void *owner, uint32_t tag)
+  {
+    Checker &c = *(Checker *)owner;
+    c.fired++;
+    if (c.wheel->now() != c.due[tag] || c.ids[tag] == TimerWheel::NONE)
+    {
+      c.errors++;
+    }
+    c.ids[tag] = TimerWheel::NONE;
+    // Some restart from inside the callback
+    if (!c.draining && c.rng() % 2)
+    {
+      c.start(tag);
+    }
+  }
+};
+
+static bool check(size_t n)
+{
+  std::vector<TimerWheel::Node> pool(n);
+  // Wraps a few seconds in
+  uint32_t now = UINT32_MAX - 3000;
+  TimerWheel wheel(pool.data(), n, now);
+  Checker c;
+  c.wheel = &wheel;
+  c.ids.assign(n, (uint32_t)TimerWheel::NONE);
+  c.due.assign(n, 0);
+  for (size_t i = 0; i < n; i++)
+  {
+    c.start(i);
+  }
+
+  uint64_t stallUs = 0;
+  uint32_t stalls = 0;
+  uint32_t cancelled = 0;
+  for (int step = 0; step < 400000; step++)
+  {
+    uint32_t r = c.rng() % 1000;
+    uint32_t dt = r == 0 ? 5000 : r < 20 ? 1 + c.rng() % 200 : 1;
+    uint64_t t = nowUs();
+    now += dt;
+    wheel.advance(now);
+    if (dt == 5000)
+    {
+      stallUs += nowUs() - t;
+      stalls++;
+    }
+
+    size_t i = c.rng() % n;
+    if (c.ids[i] == TimerWheel::NONE)
+    {
+      c.start(i);
+    }
+    else if (c.rng() % 4 == 0)
+    {
+      if (!wheel.cancel(c.ids[i]))
+        c.errors++;
+      c.ids[i] = TimerWheel::NONE;
+      cancelled++;
+    }
+  }
+  // Whatever is left runs out, delays are at most 100 s
+  c.draining = true;
+  now += 100000001;
+  wheel.advance(now);
+  for (size_t i = 0; i < n; i++)
+  {
+    if (c.ids[i] != TimerWheel::NONE)
+      c.errors++;
+  }
+  if (wheel.active() != 0)
+    c.errors++;
+
+  printf("check %5zu timers: %u fired, %u cancelled, %u wrong, 5 s stall %.1f us\n", n, c.fired, cancelled,
+         c.errors, stalls ? (double)stallUs / stalls : 0);
+  return c.errors == 0;
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = argc > 1 ? atof(argv[1]) : 10;
+  uint32_t ticks = (uint32_t)(seconds * 1000);
+
+  bool ok = true;
+  for (size_t n : {10, 1000})
+  {
+    ok &= check(n);
+  }
+  if (!ok)
+  {
+    fprintf(stderr, "timer wheel check failed\n");
+    return 1;
+  }
+
+  printf("\n%u ticks, cost per tick in ns\n", ticks);
+  printf("%7s %12s %12s %12s %12s %12s %14s\n", "timers", "wheel", "scan", "wheel acks", "scan acks",
+         "fires/tick", "cascades/fire");
+  for (size_t n : {10, 100, 1000, 10000})
+  {
+    Result idle = bench(n, ticks, false);
+    Result acks = bench(n, ticks, true);
+    printf("%7zu %12.1f %12.1f %12.1f %12.1f %12.2f %14.2f\n", n, idle.wheelNsPerTick, idle.scanNsPerTick,
+           acks.wheelNsPerTick, acks.scanNsPerTick, acks.firesPerTick, acks.cascadesPerFire);
+  }
+  return 0;
+}
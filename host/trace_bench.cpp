@@ -0,0 +1,177 @@
+// Cost of a trace event on the rear camera's TraceRing, alone and with
+// several tasks recording at once, and whether dumps taken while they do
+// are intact.
+//
+//   trace_bench [events per thread]
+//
+// Runs rear-camera-pio/src/traceRing.cpp unchanged. "record" is the ring
+// alone, "event" adds what trace.h's traceEvent() does around it: reading a
+// clock and looking up the task's id. Threads stand in for FreeRTOS tasks,
+// times are wall time over the events of all of them, so with more threads
+// than cores they include the preemptions. The device measures its own cost
+// at boot, see camera_trace_event_cycles.
+//
+// The dump check runs four writers flat out against a reader that dumps
+// the ring over and over, and fails unless every line parses and every
+// task's timestamps only go forward.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/stats.h"
+#include "traceRing.h"
+
+static TraceRing ring;
+
+static uint32_t clockUs()
+{
+  return (uint32_t)nowUs();
+}
+
+// What traceEvent() does on the device, with a thread's address for its
+// task handle
+static void traceEvent(TraceRing::Phase phase, const char *name)
+{
+  static thread_local char handle;
+  int id = ring.findTask(&handle);
+  ring.record(clockUs(), id >= 0 ? (uint8_t)id : ring.taskId(&handle, "thread"), phase, name);
+}
+
+// Wall time per event with threads threads recording at once, all of
+// their events counted
+static double run(int threads, uint32_t events, bool full)
+{
+  std::atomic<bool> go(false);
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; t++)
+  {
+    pool.emplace_back([&, t]()
+                      {
+      while (!go)
+      {
+        std::this_thread::yield();
+      }
+      for (uint32_t i = 0; i < events / 2; i++)
+      {
+        if (full)
+        {
+          traceEvent(TraceRing::BEGIN, "span");
+          traceEvent(TraceRing::END, "span");
+        }
+        else
+        {
+          ring.record(i, (uint8_t)t, TraceRing::BEGIN, "span");
+          ring.record(i, (uint8_t)t, TraceRing::END, "span");
+        }
+      } });
+  }
+  uint64_t start = nowUs();
+  go = true;
+  for (std::thread &t : pool)
+  {
+    t.join();
+  }
+  return (nowUs() - start) * 1000.0 / ((double)events * threads);
+}
+
+// Dumps the ring while writers run, counts lines that don't parse or step
+// back in time on their task
+static bool checkDumps()
+{
+  ring.clear();
+  std::atomic<bool> running(true);
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; t++)
+  {
+    writers.emplace_back([&]()
+                         {
+      for (uint32_t i = 0; running; i++)
+      {
+        traceEvent(i % 2 ? TraceRing::END : TraceRing::BEGIN, "span");
+      } });
+  }
+  while (ring.recorded() < TraceRing::EVENTS)
+  {
+    std::this_thread::yield();
+  }
+
+  uint32_t dumps = 0, lines = 0, bad = 0, skippedSlots = 0;
+  char buf[1024];
+  for (int d = 0; d < 2000; d++)
+  {
+    TraceRing::Cursor c = ring.snapshot();
+    uint32_t expected = c.end - c.next;
+    uint32_t got = 0;
+    uint32_t lastUs[TraceRing::MAX_TASKS] = {};
+    bool seen[TraceRing::MAX_TASKS] = {};
+    std::string carry;
+    size_t n;
+    while ((n = ring.read(c, buf, sizeof(buf))) > 0)
+    {
+      carry.append(buf, n);
+      size_t at;
+      while ((at = carry.find('\n')) != std::string::npos)
+      {
+        std::string line = carry.substr(0, at);
+        carry.erase(0, at + 1);
+        unsigned long us;
+        unsigned task;
+        char phase;
+        char name[32];
+        lines++;
+        if (line.compare(0, 5, "trace") == 0 || line.compare(0, 4, "task") == 0)
+          continue;
+        if (sscanf(line.c_str(), "%lu %u %c %31s", &us, &task, &phase, name) != 4 || task >= TraceRing::MAX_TASKS ||
+            (phase != 'B' && phase != 'E') || strcmp(name, "span") != 0)
+        {
+          bad++;
+          continue;
+        }
+        got++;
+        if (seen[task] && (int32_t)((uint32_t)us - lastUs[task]) < 0)
+          bad++;
+        seen[task] = true;
+        lastUs[task] = (uint32_t)us;
+      }
+    }
+    skippedSlots += expected - got;
+    dumps++;
+  }
+  running = false;
+  for (std::thread &w : writers)
+  {
+    w.join();
+  }
+
+  printf("dump check: %u dumps while 4 threads record, %u lines, %u bad, %.1f%% of slots overwritten before read\n",
+         dumps, lines, bad, lines ? 100.0 * skippedSlots / (skippedSlots + lines) : 0);
+  return bad == 0;
+}
+
+int main(int argc, char **argv)
+{
+  uint32_t events = argc > 1 ? (uint32_t)strtoul(argv[1], nullptr, 10) : 4000000;
+
+  printf("%u events per thread, ring of %zu, %u cores\n", events, TraceRing::EVENTS,
+         std::thread::hardware_concurrency());
+  printf("%8s %14s %14s\n", "threads", "record ns", "event ns");
+  for (int threads : {1, 2, 4})
+  {
+    double record = run(threads, events, false);
+    double event = run(threads, events, true);
+    printf("%8d %14.1f %14.1f\n", threads, record, event);
+  }
+  printf("\n");
+
+  if (!checkDumps())
+  {
+    fprintf(stderr, "trace dump check failed\n");
+    return 1;
+  }
+  return 0;
+}
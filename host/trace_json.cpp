@@ -0,0 +1,157 @@
+// Turns a trace dump from the rear camera into Chrome trace JSON, for
+// chrome://tracing or https://ui.perfetto.dev.
+//
+//   curl -s http://<camera>:8080/api/v1/trace | trace_json > trace.json
+//   trace_json dump.txt > trace.json
+//
+// The dump format is described in rear-camera-pio/src/traceRing.h; a serial
+// dump ('t' on the console) works too, lines that aren't part of it are
+// skipped. Timestamps are unwrapped from 32 bit micros() and start at 0.
+// Every task is a thread. Ends whose begin was overwritten in the ring are
+// dropped, and spans still open at the end of the dump are closed at its
+// last timestamp.
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+struct Event
+{
+  int64_t us;
+  unsigned task;
+  char phase;
+  std::string name;
+};
+
+static std::string escape(const std::string &s)
+{
+  std::string out;
+  for (char c : s)
+  {
+    if (c == '"' || c == '\\')
+    {
+      out += '\\';
+      out += c;
+    }
+    else if ((unsigned char)c < 0x20)
+    {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    }
+    else
+    {
+      out += c;
+    }
+  }
+  return out;
+}
+
+int main(int argc, char **argv)
+{
+  FILE *in = argc > 1 ? fopen(argv[1], "r") : stdin;
+  if (!in)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+
+  std::map<unsigned, std::string> tasks;
+  std::vector<Event> events;
+  bool haveLast = false;
+  uint32_t lastRaw = 0;
+  int64_t lastUs = 0;
+  int skipped = 0;
+  unsigned long first = 0;
+
+  char line[256];
+  while (fgets(line, sizeof(line), in))
+  {
+    line[strcspn(line, "\r\n")] = '\0';
+    unsigned long raw;
+    unsigned task;
+    char phase;
+    int at = 0;
+    if (sscanf(line, "trace 1 %lu", &first) == 1)
+    {
+      continue;
+    }
+    if (sscanf(line, "task %u %n", &task, &at) == 1 && at > 0)
+    {
+      tasks[task] = line + at;
+      continue;
+    }
+    if (sscanf(line, "%lu %u %c %n", &raw, &task, &phase, &at) == 3 && at > 0 &&
+        (phase == 'B' || phase == 'E' || phase == 'i'))
+    {
+      // Events are in the order they were recorded, a step back is a task
+      // that took its timestamp just before another one claimed a slot
+      int64_t us = haveLast ? lastUs + (int32_t)((uint32_t)raw - lastRaw) : 0;
+      haveLast = true;
+      lastRaw = (uint32_t)raw;
+      lastUs = us;
+      events.push_back({us, task, phase, line + at});
+      continue;
+    }
+    skipped++;
+  }
+  if (in != stdin)
+  {
+    fclose(in);
+  }
+
+  int64_t base = INT64_MAX, end = INT64_MIN;
+  for (const Event &e : events)
+  {
+    base = std::min(base, e.us);
+    end = std::max(end, e.us);
+  }
+
+  printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"rear camera\"}}");
+  for (const auto &t : tasks)
+  {
+    printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", t.first,
+           escape(t.second).c_str());
+  }
+
+  // Open spans per task, innermost last
+  std::map<unsigned, std::vector<std::string>> open;
+  int orphans = 0;
+  for (const Event &e : events)
+  {
+    std::vector<std::string> &stack = open[e.task];
+    if (e.phase == 'E')
+    {
+      if (stack.empty())
+      {
+        orphans++;
+        continue;
+      }
+      stack.pop_back();
+    }
+    else if (e.phase == 'B')
+    {
+      stack.push_back(e.name);
+    }
+    printf(",\n{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%" PRId64 ",\"pid\":1,\"tid\":%u}", escape(e.name).c_str(),
+           e.phase, e.phase == 'i' ? "\"s\":\"t\"," : "", e.us - base, e.task);
+  }
+  for (auto &t : open)
+  {
+    while (!t.second.empty())
+    {
+      printf(",\n{\"name\":\"%s\",\"ph\":\"E\",\"ts\":%" PRId64 ",\"pid\":1,\"tid\":%u}",
+             escape(t.second.back()).c_str(), end - base, t.first);
+      t.second.pop_back();
+    }
+  }
+  printf("\n]}\n");
+
+  fprintf(stderr, "%zu events from %zu tasks over %.3f s, first event %lu, %d orphaned ends, %d other lines\n",
+          events.size(), tasks.size(), events.empty() ? 0.0 : (end - base) / 1e6, first, orphans, skipped);
+  return 0;
+}
@@ -0,0 +1,296 @@
+// Simulates a burst of ESP-NOW sends from one node, straight into the WiFi
+// driver as the firmware used to, and through the radio's TxScheduler.
+//
+//   tx_sim [--frames n] [--rate n] [--peers n] [--loss p] [--driver-depth n] [--broadcast] [--seed n]
+//
+// Runs the firmware's TxScheduler unchanged, on its TimerWheel ticking in us
+// instead of ms, advanced on every pass. --frames frames of 248 bytes
+// are produced at --rate per second for --peers unicast peers in turn. The
+// driver holds --driver-depth frames and answers ESP_ERR_ESPNOW_NO_MEM when
+// full; it sends one frame at a time, and a frame goes unacknowledged with
+// probability --loss. Send callbacks reach loop() on its next pass, which
+// comes every 100-400 us with the odd 5 ms stall.
+//
+// --broadcast sends everything to the broadcast address, as radioSend()
+// does with every frame a node originates: one queue, no ACK on air, and
+// callbacks that report success whether or not the frame arrived.
+//
+// Producers either drop a frame the radio refuses or hold it and try again
+// on the next pass, like the serial host pacing itself on TX_STATUS.
+
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+
+#include "common/sim.h"
+#include "common/stats.h"
+#include "../esp-now/controllers/src/timerWheel.h"
+#include "../esp-now/controllers/src/txScheduler.h"
+
+static const size_t FRAME_LEN = 248;
+
+// 1 Mbps: DIFS, average backoff, long preamble, ESP-NOW framing, and for
+// unicast SIFS and the ACK
+static uint64_t airtimeUs(size_t len, bool broadcast)
+{
+  return 50 + 310 + 192 + (43 + len) * 8 + (broadcast ? 0 : 10 + 304);
+}
+
+struct Config
+{
+  int frames = 1000;
+  double rate = 2000;
+  int peers = 2;
+  double loss = 0.05;
+  size_t driverDepth = 4;
+  bool broadcast = false;
+  uint64_t seed = 1;
+};
+
+struct Result
+{
+  int delivered = 0;
+  int dropped = 0;
+  double seconds = 0;
+  uint32_t noMem = 0;
+  uint32_t retries = 0;
+  Stats latencyMs;
+};
+
+// window 0 sends straight to the driver
+static Result simulate(const Config &cfg, uint8_t window, bool hold)
+{
+  Sim sim(cfg.seed);
+  Result r;
+
+  TimerWheel::Node pool[TxScheduler::POOL];
+  TimerWheel timers(pool, TxScheduler::POOL, 0);
+  TxScheduler tx(timers, 1);
+  tx.window = window;
+
+  struct Driven
+  {
+    uint32_t id;
+    uint8_t mac[6];
+  };
+  std::deque<Driven> driver;
+  bool onAir = false;
+  std::deque<std::pair<Driven, bool>> callbacks;
+
+  std::vector<uint64_t> createdUs(cfg.frames);
+  std::vector<bool> finished(cfg.frames, false);
+  int produced = 0;
+  int finishedCount = 0;
+  uint64_t lastFinishUs = 0;
+
+  auto finish = [&](uint32_t id, bool ok)
+  {
+    if (finished[id])
+    {
+      return;
+    }
+    finished[id] = true;
+    finishedCount++;
+    lastFinishUs = sim.now;
+    if (ok)
+    {
+      r.delivered++;
+      r.latencyMs.add((sim.now - createdUs[id]) / 1000.0);
+    }
+    else
+    {
+      r.dropped++;
+    }
+  };
+
+  std::function<void()> startTx = [&]()
+  {
+    if (onAir || driver.empty())
+    {
+      return;
+    }
+    onAir = true;
+    uint64_t air = airtimeUs(FRAME_LEN, cfg.broadcast) + (uint64_t)sim.uniform(0, 300);
+    sim.after(air, [&]()
+              {
+      Driven d = driver.front();
+      driver.pop_front();
+      onAir = false;
+      bool lost = sim.chance(cfg.loss);
+      callbacks.push_back({d, cfg.broadcast || !lost});
+      startTx(); });
+  };
+
+  // esp_now_send()
+  auto driverSend = [&](const uint8_t *mac, const uint8_t *frame) -> bool
+  {
+    if (driver.size() >= cfg.driverDepth)
+    {
+      r.noMem++;
+      return false;
+    }
+    Driven d;
+    memcpy(&d.id, frame, sizeof(d.id));
+    memcpy(d.mac, mac, 6);
+    driver.push_back(d);
+    startTx();
+    return true;
+  };
+
+  // What the producer hands to radioSend(), or to esp_now_send() directly
+  auto submit = [&](uint32_t id) -> bool
+  {
+    uint8_t mac[6] = {0x24, 0x0a, 0xc4, 0, 0, (uint8_t)(id % cfg.peers)};
+    if (cfg.broadcast)
+    {
+      memset(mac, 0xff, sizeof(mac));
+    }
+    uint8_t frame[FRAME_LEN] = {};
+    memcpy(frame, &id, sizeof(id));
+    if (window == 0)
+    {
+      return driverSend(mac, frame);
+    }
+    return tx.enqueue(mac, frame, sizeof(frame));
+  };
+
+  std::function<void()> pass = [&]()
+  {
+    // service() advances the wheel before anything else
+    timers.advance((uint32_t)sim.now);
+
+    // Send callbacks queued since the last pass
+    while (!callbacks.empty())
+    {
+      auto c = callbacks.front();
+      callbacks.pop_front();
+      if (window == 0)
+      {
+        finish(c.first.id, c.second);
+      }
+      else if (tx.onSent(c.first.mac, c.second))
+      {
+        finish(c.first.id, c.second);
+      }
+    }
+
+    // Everything created by now
+    while (produced < cfg.frames && createdUs[produced] <= sim.now)
+    {
+      if (submit((uint32_t)produced))
+      {
+        produced++;
+        continue;
+      }
+      if (hold)
+      {
+        break;
+      }
+      finish((uint32_t)produced, false);
+      produced++;
+    }
+
+    // radioService()
+    if (window != 0)
+    {
+      uint8_t mac[6];
+      uint8_t frame[250];
+      size_t len;
+      while ((len = tx.next(mac, frame)) > 0)
+      {
+        bool accepted = driverSend(mac, frame);
+        tx.handedOff(accepted ? TxScheduler::ACCEPTED : TxScheduler::BUSY);
+        if (!accepted)
+        {
+          break;
+        }
+      }
+    }
+
+    if (finishedCount < cfg.frames)
+    {
+      uint64_t next = (uint64_t)sim.uniform(100, 400);
+      if (sim.chance(0.01))
+      {
+        next += 5000;
+      }
+      sim.after(next, pass);
+    }
+  };
+
+  for (int i = 0; i < cfg.frames; i++)
+  {
+    createdUs[i] = (uint64_t)(i * 1e6 / cfg.rate);
+  }
+  sim.at(0, pass);
+
+  uint64_t limit = 600ull * 1000000;
+  while (finishedCount < cfg.frames && sim.now < limit)
+  {
+    sim.runUntil(sim.now + 10000);
+  }
+
+  r.seconds = lastFinishUs / 1e6;
+  r.retries = tx.retries;
+  if (window != 0)
+  {
+    r.noMem = tx.busy;
+  }
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  Config cfg;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string opt = argv[i];
+    if (opt == "--broadcast")
+    {
+      cfg.broadcast = true;
+      continue;
+    }
+    if (i + 1 >= argc)
+      break;
+    if (opt == "--frames")
+      cfg.frames = atoi(argv[i + 1]);
+    else if (opt == "--rate")
+      cfg.rate = atof(argv[i + 1]);
+    else if (opt == "--peers")
+      cfg.peers = std::max(1, atoi(argv[i + 1]));
+    else if (opt == "--loss")
+      cfg.loss = atof(argv[i + 1]);
+    else if (opt == "--driver-depth")
+      cfg.driverDepth = strtoul(argv[i + 1], nullptr, 10);
+    else if (opt == "--seed")
+      cfg.seed = strtoull(argv[i + 1], nullptr, 10);
+    i++;
+  }
+  if (cfg.broadcast)
+  {
+    cfg.peers = 1;
+  }
+
+  std::string to = cfg.broadcast ? "broadcast" : "to " + std::to_string(cfg.peers) + " peers";
+  printf("%d frames of %zu bytes at %.0f/s %s, %.0f%% loss, driver holds %zu, air %.0f frames/s\n", cfg.frames,
+         FRAME_LEN, cfg.rate, to.c_str(), cfg.loss * 100, cfg.driverDepth,
+         1e6 / (airtimeUs(FRAME_LEN, cfg.broadcast) + 150));
+  printf("%-18s %-8s %9s %8s %9s %8s %8s %8s %8s\n", "sender", "producer", "delivered", "dropped", "frames/s",
+         "p50 ms", "p99 ms", "no_mem", "retries");
+
+  const uint8_t windows[] = {0, 1, 2, 4, 8};
+  for (bool hold : {false, true})
+  {
+    for (uint8_t w : windows)
+    {
+      Result r = simulate(cfg, w, hold);
+      std::string name = w == 0 ? "esp_now_send" : "scheduler window " + std::to_string(w);
+      printf("%-18s %-8s %9d %7.1f%% %9.0f %8.1f %8.1f %8u %8u\n", name.c_str(), hold ? "hold" : "drop",
+             r.delivered, 100.0 * r.dropped / cfg.frames, r.seconds > 0 ? r.delivered / r.seconds : 0.0,
+             r.latencyMs.count() ? r.latencyMs.percentile(50) : 0.0,
+             r.latencyMs.count() ? r.latencyMs.percentile(99) : 0.0, r.noMem, r.retries);
+    }
+  }
+  return 0;
+}
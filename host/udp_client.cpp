@@ -0,0 +1,296 @@
+// Talks to the rear camera's UDP control port and compares it to the HTTP API.
+//
+//   udp_client <host> move <pos> | stop | preset <slot> | query
+//   udp_client <host> bench [--count n] [--rate hz] [--http-port p]
+//
+// The benchmark sends move commands to the position the camera is already at,
+// so the servo and NVS stay out of the measurement. For each path it reports
+// round trip latency, how often the camera's loop() woke up, and camera CPU
+// time per command, from how much the idle task's share of the CPU drops
+// under load.
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <cstdlib>
+#include <poll.h>
+#include <string>
+#include <thread>
+
+#include "common/net.h"
+#include "common/stats.h"
+#include "../rear-camera-pio/src/udpProtocol.h"
+
+static int udpSocket(const char *host, uint16_t port)
+{
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo *res;
+  if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &res) != 0)
+  {
+    return -1;
+  }
+  int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+  if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0)
+  {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+// Sends a command and waits for the matching reply. Returns the round trip in
+// microseconds, or -1 on timeout.
+static long exchange(int fd, uint8_t op, uint8_t arg, uint16_t seq, UdpReply &reply, int timeoutMs = 500)
+{
+  UdpCommand cmd = {UDP_MAGIC, op, UDP_FLAG_ACK, arg, seq};
+  uint64_t start = nowUs();
+  if (send(fd, &cmd, sizeof(cmd), 0) != sizeof(cmd))
+  {
+    return -1;
+  }
+
+  while (true)
+  {
+    int remaining = timeoutMs - (int)((nowUs() - start) / 1000);
+    pollfd pfd = {fd, POLLIN, 0};
+    if (remaining <= 0 || poll(&pfd, 1, remaining) <= 0)
+    {
+      return -1;
+    }
+    if (recv(fd, &reply, sizeof(reply), 0) == sizeof(reply) && reply.magic == UDP_MAGIC && reply.seq == seq)
+    {
+      return (long)(nowUs() - start);
+    }
+  }
+}
+
+// One POST over a fresh connection, the way the main controller does it
+static long httpMove(const char *host, const char *port, int pos)
+{
+  uint64_t start = nowUs();
+  int fd = tcpConnect(host, port);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  char req[160];
+  int n = snprintf(req, sizeof(req),
+                   "POST /api/v1/move?pos=%d HTTP/1.1\r\nHost: %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+                   pos, host);
+  bool ok = sendAll(fd, req, n);
+  char buf[512];
+  while (ok && recv(fd, buf, sizeof(buf), 0) > 0)
+  {
+  }
+  close(fd);
+  return ok ? (long)(nowUs() - start) : -1;
+}
+
+static void printReply(const UdpReply &r)
+{
+  printf("status=%u pos=%u target=%u moving=%u handlerCycles=%u loopRate=%u idle=%.1f%%\n",
+         r.status, r.pos, r.target, r.moving, r.handlerCycles, r.loopRate, r.idlePermille / 10.0);
+}
+
+// Averages of the per second figures in replies
+struct Load
+{
+  double loopRate = 0;
+  double idlePermille = 0;
+  int samples = 0;
+
+  void add(const UdpReply &r)
+  {
+    loopRate += r.loopRate;
+    idlePermille += r.idlePermille;
+    samples++;
+  }
+  double rate() const { return samples ? loopRate / samples : 0; }
+  double idle() const { return samples ? idlePermille / samples : 0; }
+};
+
+// Idle load over a few seconds, sampled with cheap queries
+static Load sampleIdle(int fd, uint16_t &seq, int seconds)
+{
+  Load load;
+  for (int i = 0; i < seconds; i++)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    UdpReply r;
+    if (exchange(fd, UDP_QUERY, 0, ++seq, r) >= 0)
+    {
+      load.add(r);
+    }
+  }
+  return load;
+}
+
+// Camera CPU microseconds per command, the idle time each one took away
+// from every second
+static double costPerCommandUs(const Load &idle, const Load &loaded, double cmdRate)
+{
+  if (idle.samples == 0 || loaded.samples == 0 || cmdRate <= 0)
+  {
+    return 0;
+  }
+  return (idle.idle() - loaded.idle()) / 1000.0 * 1e6 / cmdRate;
+}
+
+static int bench(const char *host, int argc, char **argv)
+{
+  int count = 500;
+  double rate = 20;
+  const char *httpPort = "8080";
+  for (int i = 0; i + 1 < argc; i++)
+  {
+    std::string a = argv[i];
+    if (a == "--count")
+      count = atoi(argv[++i]);
+    else if (a == "--rate")
+      rate = atof(argv[++i]);
+    else if (a == "--http-port")
+      httpPort = argv[++i];
+  }
+
+  int fd = udpSocket(host, UDP_CONTROL_PORT);
+  uint16_t seq = (uint16_t)nowUs();
+  UdpReply r;
+  if (fd < 0 || exchange(fd, UDP_QUERY, 0, ++seq, r) < 0)
+  {
+    fprintf(stderr, "No answer from %s:%d\n", host, UDP_CONTROL_PORT);
+    return 1;
+  }
+  int pos = r.pos;
+  if (r.moving)
+  {
+    fprintf(stderr, "Camera is moving, wait for it to settle\n");
+    return 1;
+  }
+
+  printf("Measuring idle load...\n");
+  Load idle = sampleIdle(fd, seq, 3);
+
+  uint64_t periodUs = (uint64_t)(1e6 / rate);
+  Stats udpRtt, udpCycles, httpRtt;
+  int udpLost = 0, httpFailed = 0;
+  Load udpLoaded, httpLoaded;
+
+  // UDP path, load sampled from the replies while under load
+  uint64_t next = nowUs();
+  for (int i = 0; i < count; i++)
+  {
+    long us = exchange(fd, UDP_MOVE_TO, (uint8_t)pos, ++seq, r);
+    if (us < 0)
+    {
+      udpLost++;
+    }
+    else
+    {
+      udpRtt.add(us / 1000.0);
+      udpCycles.add(r.handlerCycles);
+      // Skip the first second, the figures still cover idle time. Replies
+      // within a second repeat the same figures, which weighs every second
+      // the same.
+      if (i > rate)
+      {
+        udpLoaded.add(r);
+      }
+    }
+    next += periodUs;
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(next)));
+  }
+
+  // HTTP path, the load is sampled over UDP from a second thread
+  std::atomic<bool> running(true);
+  std::thread sampler([&]()
+                      {
+                        int qfd = udpSocket(host, UDP_CONTROL_PORT);
+                        uint16_t qseq = 0;
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+                        while (running)
+                        {
+                          UdpReply qr;
+                          if (exchange(qfd, UDP_QUERY, 0, ++qseq, qr) >= 0)
+                          {
+                            httpLoaded.add(qr);
+                          }
+                          std::this_thread::sleep_for(std::chrono::seconds(1));
+                        }
+                        close(qfd); });
+
+  next = nowUs();
+  for (int i = 0; i < count; i++)
+  {
+    long us = httpMove(host, httpPort, pos);
+    if (us < 0)
+    {
+      httpFailed++;
+    }
+    else
+    {
+      httpRtt.add(us / 1000.0);
+    }
+    next += periodUs;
+    std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(next)));
+  }
+  running = false;
+  sampler.join();
+  close(fd);
+
+  printf("\n%d commands per path at %.0f Hz, idle loop wakeups %.0f/s, cpu idle %.1f%%\n", count, rate, idle.rate(),
+         idle.idle() / 10);
+  printf("udp  lost=%d loopRate=%.0f/s idle=%.1f%% cpu/cmd~%.0fus\n", udpLost, udpLoaded.rate(), udpLoaded.idle() / 10,
+         costPerCommandUs(idle, udpLoaded, rate));
+  udpRtt.print("udp rtt", "ms");
+  udpCycles.print("udp handler", "cycles");
+  printf("http failed=%d loopRate=%.0f/s idle=%.1f%% cpu/cmd~%.0fus\n", httpFailed, httpLoaded.rate(),
+         httpLoaded.idle() / 10, costPerCommandUs(idle, httpLoaded, rate));
+  httpRtt.print("http rtt", "ms");
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "usage: %s <host> move <pos> | stop | preset <slot> | query | bench [--count n] [--rate hz] [--http-port p]\n", argv[0]);
+    return 1;
+  }
+
+  const char *host = argv[1];
+  std::string verb = argv[2];
+  if (verb == "bench")
+  {
+    return bench(host, argc - 3, argv + 3);
+  }
+
+  uint8_t op;
+  uint8_t arg = argc > 3 ? (uint8_t)atoi(argv[3]) : 0;
+  if (verb == "move")
+    op = UDP_MOVE_TO;
+  else if (verb == "stop")
+    op = UDP_STOP;
+  else if (verb == "preset")
+    op = UDP_PRESET;
+  else if (verb == "query")
+    op = UDP_QUERY;
+  else
+  {
+    fprintf(stderr, "Unknown command %s\n", verb.c_str());
+    return 1;
+  }
+
+  int fd = udpSocket(host, UDP_CONTROL_PORT);
+  UdpReply r;
+  long us = fd < 0 ? -1 : exchange(fd, op, arg, (uint16_t)nowUs(), r);
+  if (us < 0)
+  {
+    fprintf(stderr, "No answer from %s:%d\n", host, UDP_CONTROL_PORT);
+    return 1;
+  }
+  printf("rtt=%.2fms ", us / 1000.0);
+  printReply(r);
+  return 0;
+}
@@ -0,0 +1,247 @@
+// Streams joystick style setpoints to the rear camera's /ws endpoint at a
+// fixed rate and measures how long they take to reach the servo.
+//
+//   ws_loadgen <host> [port] [--rate hz] [--seconds n] [--json]
+//
+// Two latencies are reported per acknowledged setpoint:
+//   rtt       send on the host -> position update carrying its seq received
+//   servo     setpoint arrival on the camera -> first servo write (device side)
+
+#include <cmath>
+#include <cstdlib>
+#include <poll.h>
+#include <string>
+
+#include "common/net.h"
+#include "common/stats.h"
+#include "../rear-camera-pio/src/wsProtocol.h"
+
+static bool wsHandshake(int fd, const char *host)
+{
+  char req[256];
+  int n = snprintf(req, sizeof(req),
+                   "GET /ws HTTP/1.1\r\n"
+                   "Host: %s\r\n"
+                   "Upgrade: websocket\r\n"
+                   "Connection: Upgrade\r\n"
+                   "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                   "Sec-WebSocket-Version: 13\r\n\r\n",
+                   host);
+  if (!sendAll(fd, req, n))
+  {
+    return false;
+  }
+
+  std::string resp;
+  char c;
+  while (resp.find("\r\n\r\n") == std::string::npos)
+  {
+    if (recv(fd, &c, 1, 0) != 1)
+    {
+      return false;
+    }
+    resp += c;
+  }
+  return resp.compare(0, 12, "HTTP/1.1 101") == 0;
+}
+
+// Client frames must be masked. The mask doesn't need to be random for a
+// load generator.
+static bool wsSend(int fd, uint8_t opcode, const void *payload, size_t len)
+{
+  uint8_t frame[2 + 4 + 125];
+  if (len > 125)
+  {
+    return false;
+  }
+  const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+  frame[0] = 0x80 | opcode;
+  frame[1] = 0x80 | (uint8_t)len;
+  memcpy(frame + 2, mask, 4);
+  for (size_t i = 0; i < len; i++)
+  {
+    frame[6 + i] = ((const uint8_t *)payload)[i] ^ mask[i % 4];
+  }
+  return sendAll(fd, frame, 6 + len);
+}
+
+static long jsonField(const std::string &s, const char *key)
+{
+  size_t at = s.find(key);
+  return at == std::string::npos ? -1 : strtol(s.c_str() + at + strlen(key), nullptr, 10);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s <host> [port] [--rate hz] [--seconds n] [--json]\n", argv[0]);
+    return 1;
+  }
+
+  const char *host = argv[1];
+  const char *port = "8080";
+  double rate = 50;
+  double seconds = 10;
+  bool json = false;
+  for (int i = 2; i < argc; i++)
+  {
+    std::string a = argv[i];
+    if (a == "--rate" && i + 1 < argc)
+      rate = atof(argv[++i]);
+    else if (a == "--seconds" && i + 1 < argc)
+      seconds = atof(argv[++i]);
+    else if (a == "--json")
+      json = true;
+    else
+      port = argv[i];
+  }
+
+  int fd = tcpConnect(host, port);
+  if (fd < 0 || !wsHandshake(fd, host))
+  {
+    fprintf(stderr, "WebSocket connect to %s:%s failed\n", host, port);
+    return 1;
+  }
+
+  static uint64_t sentAt[65536];
+  Stats rtt, servo, sendJitter;
+  uint16_t seq = 0;
+  uint16_t lastAck = 0;
+  bool haveAck = false;
+  size_t sent = 0, acked = 0, superseded = 0, rejected = 0;
+
+  uint64_t periodUs = (uint64_t)(1e6 / rate);
+  uint64_t start = nowUs();
+  uint64_t end = start + (uint64_t)(seconds * 1e6);
+  uint64_t nextSend = start;
+  uint64_t lastSend = 0;
+
+  std::string rx;
+  while (nowUs() < end)
+  {
+    uint64_t now = nowUs();
+    if (now >= nextSend)
+    {
+      // Sweep back and forth like someone working a joystick
+      double t = (now - start) / 1e6;
+      uint8_t pos = (uint8_t)(90 + 80 * sin(2 * M_PI * 0.5 * t));
+      seq++;
+      sentAt[seq] = now;
+      bool ok;
+      if (json)
+      {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), "{\"s\":%u,\"p\":%u}", seq, pos);
+        ok = wsSend(fd, 0x1, buf, n);
+      }
+      else
+      {
+        WsSetpoint sp = {WS_SETPOINT, seq, pos};
+        ok = wsSend(fd, 0x2, &sp, sizeof(sp));
+      }
+      if (!ok)
+      {
+        fprintf(stderr, "Send failed\n");
+        break;
+      }
+      if (lastSend)
+      {
+        sendJitter.add((double)(now - lastSend) - periodUs);
+      }
+      lastSend = now;
+      sent++;
+      nextSend += periodUs;
+      continue;
+    }
+
+    pollfd pfd = {fd, POLLIN, 0};
+    int timeoutMs = (int)((nextSend - now) / 1000);
+    if (poll(&pfd, 1, timeoutMs) <= 0)
+    {
+      continue;
+    }
+
+    char buf[1024];
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0)
+    {
+      fprintf(stderr, "Connection closed\n");
+      break;
+    }
+    uint64_t recvAt = nowUs();
+    rx.append(buf, n);
+
+    // Server frames are never masked
+    while (rx.size() >= 2)
+    {
+      uint8_t opcode = rx[0] & 0x0F;
+      size_t len = rx[1] & 0x7F;
+      size_t hdr = 2;
+      if (len == 126)
+      {
+        if (rx.size() < 4)
+          break;
+        len = ((uint8_t)rx[2] << 8) | (uint8_t)rx[3];
+        hdr = 4;
+      }
+      if (rx.size() < hdr + len)
+      {
+        break;
+      }
+      std::string payload = rx.substr(hdr, len);
+      rx.erase(0, hdr + len);
+
+      long ack = -1, latency = 0;
+      if (opcode == 0x2 && len == sizeof(WsPosition))
+      {
+        WsPosition p;
+        memcpy(&p, payload.data(), sizeof(p));
+        ack = p.ackSeq;
+        latency = p.latencyUs;
+      }
+      else if ((opcode == 0x2 && len == sizeof(WsError) && payload[0] == (char)WS_ERROR) ||
+               (opcode == 0x1 && payload.find("\"e\":") != std::string::npos))
+      {
+        // Dropped on a full motion queue
+        rejected++;
+      }
+      else if (opcode == 0x1)
+      {
+        ack = jsonField(payload, "\"s\":");
+        latency = jsonField(payload, "\"l\":");
+      }
+      else if (opcode == 0x9)
+      {
+        wsSend(fd, 0xA, payload.data(), payload.size());
+      }
+      else if (opcode == 0x8)
+      {
+        fprintf(stderr, "Server closed the connection\n");
+        end = 0;
+      }
+
+      if (ack < 0 || (haveAck && !wsSeqNewer((uint16_t)ack, lastAck)))
+      {
+        continue;
+      }
+      if (haveAck)
+      {
+        superseded += (uint16_t)((uint16_t)ack - lastAck - 1);
+      }
+      haveAck = true;
+      lastAck = (uint16_t)ack;
+      acked++;
+      rtt.add((recvAt - sentAt[(uint16_t)ack]) / 1000.0);
+      servo.add(latency / 1000.0);
+    }
+  }
+  close(fd);
+
+  printf("sent=%zu acked=%zu superseded=%zu rejected=%zu rate=%.0fHz mode=%s\n", sent, acked, superseded, rejected, rate,
+         json ? "json" : "binary");
+  rtt.print("rtt", "ms");
+  servo.print("setpoint->servo", "ms");
+  sendJitter.print("send jitter", "us");
+  return 0;
+}
@@ -94,12 +94,29 @@ def update_device(device_id):
 
             device.last_seen = time.time()
 
+        boot = request_data.get("boot")
+        if boot is not None and boot != device.boot:
+            device.boot = boot
+            device.reset_reason = request_data.get("reset-reason")
+            if request_data.get("reset-abnormal"):
+                logger.warning(f"Device {device_id} reset: {device.reset_reason}, boot {boot}")
+                # Not from here, the device waits for this response
+                threading.Thread(target=fetch_flight_log, args=(device_id, device.addr), daemon=True).start()
+
         return jsonify({"status": "success"}), 200
         
     except Exception as e:
         logger.error(f"Error updating device {device_id}: {str(e)}")
         return jsonify({"error": "Internal server error"}), 500
 
+def fetch_flight_log(device_id, addr):
+    """Logs the events a device recorded up to an unexpected reset"""
+    try:
+        response = requests.get(f"http://{addr}:8080/api/v1/flight", timeout=10)
+        logger.warning(f"Flight log of {device_id}:\n{response.text}")
+    except requests.exceptions.RequestException as e:
+        logger.error(f"Could not fetch flight log of {device_id}: {e}")
+
 @app.route('/api/v1/devices', methods=['GET'])
 def get_devices():
     try:
@@ -139,12 +156,16 @@ def internal_error(error):
     logger.error(f"Internal server error: {str(error)}")
     return jsonify({"error": "Internal server error"}), 500
 
+# Preset slots on the camera, which knows where up and down are for its mount
+PRESET_UP = 0
+PRESET_DOWN = 1
+
 def moveCameraUp():
     device = devices.get("rear-camera")
     if device is not None:
         headers = {'Content-Type': 'application/json'}
         try:
-            response = requests.post(f"http://{device.addr}:8080/api/v1/move?pos=0", headers=headers)
+            response = requests.post(f"http://{device.addr}:8080/api/v1/recall?slot={PRESET_UP}", headers=headers)
             logger.info(f"Camera up response: {str(response)}")
         except requests.exceptions.ConnectionError as e:
             logger.error(f"Connection error: {e}")
@@ -156,7 +177,7 @@ def moveCameraDown():
     if device is not None:
         headers = {'Content-Type': 'application/json'}
         try:
-            response = requests.post(f"http://{device.addr}:8080/api/v1/move?pos=90", headers=headers)
+            response = requests.post(f"http://{device.addr}:8080/api/v1/recall?slot={PRESET_DOWN}", headers=headers)
             logger.info(f"Camera down response: {str(response)}")
         except requests.exceptions.ConnectionError as e:
             logger.error(f"Connection error: {e}")
@@ -15,12 +15,17 @@ class Device:
         self.device_type = device_type
         self.addr = addr
         self.last_seen = time.time()
+        # Boot count and reset reason from the heartbeat, devices that send them
+        self.boot = None
+        self.reset_reason = None
 
     def __str__(self):
         return json.dumps({
             "device_type": self.device_type.value,  # Use .value to get the string
             "addr": self.addr,
-            "last_seen": str(self.last_seen)
+            "last_seen": str(self.last_seen),
+            "boot": self.boot,
+            "reset_reason": self.reset_reason
         })
 
 devices: Device = {}
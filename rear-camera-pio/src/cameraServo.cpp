@@ -1,64 +1,122 @@
 #include <cameraServo.h>
 #include <ESP32Servo.h>
 #include <Preferences.h>
+#include <trace.h>
+#include <flight.h>
+#include <allocStats.h>
 
 #define RW_MODE false
 #define RO_MODE true
 #define NVS_NAMESPACE "rearCamera"
 
-void CameraServo::init(int pin)
+void CameraServo::init(const int *pins, size_t axes)
 {
-  s.setPeriodHertz(50); // Standard 50 Hz servo frequency
-  s.attach(pin);
+  // Load the last saved positions from NVS
+  uint8_t positions[ServoGroup::MAX_AXES] = {};
+  loadPosition(positions, axes);
+  group.init(axes, positions);
 
-  // Load the last saved position from NVS
-  loadPosition();
+  for (size_t i = 0; i < group.axes(); i++)
+  {
+    s[i].setPeriodHertz(50); // Standard 50 Hz servo frequency
+    s[i].attach(pins[i]);
+    // Ensure we are at the correct position
+    s[i].write(group.position(i));
+  }
+}
 
-  // Ensure we are at the correct position
-  s.write(pos);
+void CameraServo::moveTo(const uint8_t *positions, uint8_t mask, uint32_t msPerDegree)
+{
+  group.moveTo(positions, mask, millis(), msPerDegree);
 }
 
-void CameraServo::moveSlowlyTo(int newPos)
+void CameraServo::stop()
 {
-  // Only save if the position actually changes
-  if (pos != newPos)
+  if (group.isMoving())
   {
-    while (pos != newPos)
+    group.stop(millis());
+    savePosition();
+  }
+}
+
+bool CameraServo::update()
+{
+  if (!group.isMoving())
+  {
+    return false;
+  }
+
+  uint8_t changed = group.tick(millis());
+  for (size_t i = 0; i < group.axes(); i++)
+  {
+    if (changed & (1 << i))
     {
-      if (pos < newPos)
-      {
-        pos += 1;
-      }
-      if (pos > newPos)
-      {
-        pos -= 1;
-      }
-      s.write(pos);
-      delay(10);
+      s[i].write(group.position(i));
     }
+  }
 
-    // Save the final position to NVS only once after movement is complete
+  // Save the final position to NVS only once after movement is complete
+  if (changed && !group.isMoving())
+  {
     savePosition();
   }
+
+  return changed != 0;
+}
+
+bool CameraServo::isMoving()
+{
+  return group.isMoving();
 }
 
 void CameraServo::savePosition()
 {
+  TRACE_SCOPE("nvs position");
+  AllocScope scope(allocNvs);
+  // Recorded first, a brownout during the write shows as the last event
+  flightEvent(FlightRecorder::NvsWrite, 0);
+  uint8_t positions[ServoGroup::MAX_AXES];
+  for (size_t i = 0; i < group.axes(); i++)
+  {
+    positions[i] = group.position(i);
+  }
+
   Preferences preferences;
   preferences.begin(NVS_NAMESPACE, RW_MODE);
-  preferences.putInt("servoPos", pos);
+  preferences.putBytes("servoPositions", positions, group.axes());
   preferences.end();
 }
 
-void CameraServo::loadPosition()
+void CameraServo::loadPosition(uint8_t *positions, size_t axes)
 {
+  AllocScope scope(allocNvs);
   Preferences preferences;
   preferences.begin(NVS_NAMESPACE, RO_MODE);
-  pos = preferences.getInt("servoPos", 0);
+  size_t saved = preferences.getBytesLength("servoPositions");
+  if (saved > 0)
+  {
+    // Axes added since the save start at 0
+    preferences.getBytes("servoPositions", positions, saved < axes ? saved : axes);
+  }
+  else
+  {
+    // Saved by the single servo firmware
+    positions[0] = constrain(preferences.getInt("servoPos", 0), 0, ServoGroup::MAX_POS);
+  }
   preferences.end();
 }
 
-int CameraServo::getCurrentPosition()
+size_t CameraServo::getAxes()
+{
+  return group.axes();
+}
+
+int CameraServo::getCurrentPosition(size_t axis)
 {
-  return pos;
-}
\ No newline at end of file
+  return group.position(axis);
+}
+
+int CameraServo::getTarget(size_t axis)
+{
+  return group.target(axis);
+}
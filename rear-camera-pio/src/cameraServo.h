@@ -2,19 +2,32 @@
 #define CAMERASERVO_H
 
 #include <ESP32Servo.h>
+#include <servoGroup.h>
 
+// Drives a group of servos, one per axis, from a ServoGroup. Axis 0 is the
+// original camera servo; single position commands and status move and
+// report that one.
 class CameraServo
 {
 private:
-    Servo s;
-    int pos;
+    Servo s[ServoGroup::MAX_AXES];
+    ServoGroup group;
     void savePosition();
-    void loadPosition();
+    void loadPosition(uint8_t *positions, size_t axes);
 
 public:
-    void init(int pin);
-    void moveSlowlyTo(int newPos);
-    int getCurrentPosition();
+    void init(const int *pins, size_t axes);
+    // Sets new targets for the axes in mask, update() moves every axis
+    // towards its target so they arrive together
+    void moveTo(const uint8_t *positions, uint8_t mask, uint32_t msPerDegree = ServoGroup::MS_PER_DEGREE);
+    // Holds the current position, abandoning the target
+    void stop();
+    // Runs a control tick if one is due, returns true if any servo was written
+    bool update();
+    bool isMoving();
+    size_t getAxes();
+    int getCurrentPosition(size_t axis = 0);
+    int getTarget(size_t axis = 0);
 };
 
-#endif // CAMERASERVO_H
\ No newline at end of file
+#endif // CAMERASERVO_H
@@ -0,0 +1,90 @@
+#include <eventStream.h>
+
+void EventStream::init(AsyncWebServer &server, CameraServo &cameraServo)
+{
+  servo = &cameraServo;
+
+  // New clients get a snapshot so they don't have to wait for the next change
+  events.onConnect([this](AsyncEventSourceClient *client)
+                   {
+                     char buf[96];
+                     snprintf(buf, sizeof(buf), "{\"pos\":%d,\"target\":%d,\"moving\":%d,\"wifi\":%d,\"heartbeat\":%d}",
+                              servo->getCurrentPosition(), servo->getTarget(), servo->isMoving() ? 1 : 0,
+                              wifiUp ? 1 : 0, heartbeatOk ? 1 : 0);
+                     client->send(buf, "state", nextId, 1000); });
+  server.addHandler(&events);
+}
+
+void EventStream::publish(const char *event, const char *data)
+{
+  events.send(data, event, nextId++);
+}
+
+void EventStream::setLink(bool wifi, bool heartbeat)
+{
+  if (wifi != wifiUp || heartbeat != heartbeatOk)
+  {
+    wifiUp = wifi;
+    heartbeatOk = heartbeat;
+    linkDirty = true;
+  }
+}
+
+void EventStream::moveComplete(int pos)
+{
+  completedPos[completed % MAX_COMPLETIONS] = pos;
+  completed++;
+}
+
+void EventStream::update()
+{
+  if (events.count() == 0)
+  {
+    // Nobody listening, just track state so the first client starts clean
+    lastPos = servo->getCurrentPosition();
+    lastTarget = servo->getTarget();
+    completedSent = completed;
+    linkDirty = false;
+    return;
+  }
+
+  char buf[64];
+  int pos = servo->getCurrentPosition();
+  int target = servo->getTarget();
+  bool moving = servo->isMoving();
+
+  if (target != lastTarget)
+  {
+    snprintf(buf, sizeof(buf), "{\"pos\":%d,\"target\":%d}", pos, target);
+    publish("target", buf);
+    lastTarget = target;
+  }
+
+  unsigned long now = millis();
+  if (pos != lastPos && moving && now - lastProgressMs >= PROGRESS_INTERVAL_MS &&
+      events.avgPacketsWaiting() < MAX_BACKLOG)
+  {
+    snprintf(buf, sizeof(buf), "{\"pos\":%d,\"target\":%d}", pos, target);
+    publish("position", buf);
+    lastPos = pos;
+    lastProgressMs = now;
+  }
+
+  if (completed - completedSent > MAX_COMPLETIONS)
+  {
+    completedSent = completed - MAX_COMPLETIONS;
+  }
+  for (; completedSent != completed; completedSent++)
+  {
+    snprintf(buf, sizeof(buf), "{\"pos\":%d}", completedPos[completedSent % MAX_COMPLETIONS]);
+    publish("complete", buf);
+    lastPos = pos;
+  }
+
+  if (linkDirty)
+  {
+    snprintf(buf, sizeof(buf), "{\"wifi\":%d,\"heartbeat\":%d}", wifiUp ? 1 : 0, heartbeatOk ? 1 : 0);
+    publish("link", buf);
+    linkDirty = false;
+  }
+}
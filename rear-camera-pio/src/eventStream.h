@@ -0,0 +1,62 @@
+#ifndef EVENTSTREAM_H
+#define EVENTSTREAM_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include <cameraServo.h>
+
+// Server-Sent Events on /api/v1/events so the main controller can follow a
+// move without polling.
+//
+// Events are produced by diffing state every 20 ms from loop(), so they coalesce
+// naturally: a client only ever sees the newest position. Position progress is
+// additionally rate limited and skipped while clients have a backlog, target,
+// motion-complete and link events are always sent.
+//
+// Completions are recorded by the motion task as they happen rather than
+// diffed, a move can start and finish between two polls, and each one gets
+// its own "complete" event.
+class EventStream
+{
+public:
+    // Minimum spacing of "position" events
+    static const unsigned long PROGRESS_INTERVAL_MS = 50;
+    // Skip "position" events while clients have this many packets queued
+    static const size_t MAX_BACKLOG = 2;
+
+    EventStream() : events("/api/v1/events") {}
+
+    void init(AsyncWebServer &server, CameraServo &servo);
+    // Called from loop(), publishes whatever changed since the last call
+    void update();
+    // WiFi / heartbeat state, published as a "link" event when it changes
+    void setLink(bool wifi, bool heartbeat);
+    // A move finished, was stopped or asked for where the servo already is.
+    // Called from the motion task, which shares loop() with update().
+    void moveComplete(int pos);
+
+    // Completions a poll can fall behind by before the oldest are dropped
+    static const size_t MAX_COMPLETIONS = 8;
+
+private:
+    AsyncEventSource events;
+    CameraServo *servo = nullptr;
+
+    uint32_t nextId = 1;
+    int lastPos = -1;
+    int lastTarget = -1;
+    unsigned long lastProgressMs = 0;
+
+    int completedPos[MAX_COMPLETIONS];
+    uint32_t completed = 0;
+    uint32_t completedSent = 0;
+
+    bool wifiUp = false;
+    bool heartbeatOk = false;
+    bool linkDirty = true;
+
+    void publish(const char *event, const char *data);
+};
+
+#endif // EVENTSTREAM_H
@@ -0,0 +1,151 @@
+#include <flight.h>
+#include <esp_attr.h>
+#include <motionQueue.h>
+
+// Left alone by the startup code, begin() decides whether it is still valid
+RTC_NOINIT_ATTR FlightRecorder::Log flightLog;
+
+FlightRecorder flightRecorder(flightLog);
+portMUX_TYPE flightMux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t flightEventCycles = 0;
+
+bool flightBegin()
+{
+  esp_reset_reason_t reason = esp_reset_reason();
+  bool kept = flightRecorder.begin();
+
+  uint32_t start = ESP.getCycleCount();
+  flightEvent(FlightRecorder::Boot, (uint8_t)reason, (uint16_t)flightRecorder.boot());
+  flightEventCycles = ESP.getCycleCount() - start;
+  return kept;
+}
+
+const char *resetReasonName(esp_reset_reason_t reason)
+{
+  switch (reason)
+  {
+  case ESP_RST_POWERON:
+    return "power-on";
+  case ESP_RST_EXT:
+    return "external";
+  case ESP_RST_SW:
+    return "software";
+  case ESP_RST_PANIC:
+    return "panic";
+  case ESP_RST_INT_WDT:
+    return "interrupt-watchdog";
+  case ESP_RST_TASK_WDT:
+    return "task-watchdog";
+  case ESP_RST_WDT:
+    return "watchdog";
+  case ESP_RST_DEEPSLEEP:
+    return "deep-sleep";
+  case ESP_RST_BROWNOUT:
+    return "brownout";
+  case ESP_RST_SDIO:
+    return "sdio";
+  default:
+    return "unknown";
+  }
+}
+
+bool resetWasAbnormal(esp_reset_reason_t reason)
+{
+  switch (reason)
+  {
+  case ESP_RST_POWERON:
+  case ESP_RST_EXT:
+  case ESP_RST_SW:
+  case ESP_RST_DEEPSLEEP:
+    return false;
+  default:
+    return true;
+  }
+}
+
+FlightCursor flightSnapshot()
+{
+  portENTER_CRITICAL(&flightMux);
+  uint32_t head = flightRecorder.head();
+  portEXIT_CRITICAL(&flightMux);
+
+  FlightCursor c;
+  c.end = head;
+  c.next = head > FlightRecorder::EVENTS - 1 ? head - (FlightRecorder::EVENTS - 1) : 0;
+  c.header = false;
+  return c;
+}
+
+static int formatEvent(char *line, size_t len, const FlightRecorder::Event &e)
+{
+  const char *type = FlightRecorder::typeName(e.type);
+  switch (e.type)
+  {
+  case FlightRecorder::Boot:
+    return snprintf(line, len, "%lu %s %s %u\n", (unsigned long)e.ms, type,
+                    resetReasonName((esp_reset_reason_t)e.arg), (unsigned)e.value);
+  case FlightRecorder::Command:
+  {
+    static const char *sources[] = {"http", "ws", "udp"};
+    const char *source = e.arg < 3 ? sources[e.arg] : "?";
+    if (e.value == FlightRecorder::STOP)
+    {
+      return snprintf(line, len, "%lu %s %s stop\n", (unsigned long)e.ms, type, source);
+    }
+    return snprintf(line, len, "%lu %s %s %u\n", (unsigned long)e.ms, type, source, (unsigned)e.value);
+  }
+  case FlightRecorder::Heartbeat:
+    return snprintf(line, len, "%lu %s %u %d\n", (unsigned long)e.ms, type, (unsigned)e.arg, (int)(int16_t)e.value);
+  case FlightRecorder::HeapLow:
+    return snprintf(line, len, "%lu %s %lu\n", (unsigned long)e.ms, type, (unsigned long)e.value * 16);
+  default:
+    return snprintf(line, len, "%lu %s %u %u\n", (unsigned long)e.ms, type, (unsigned)e.arg, (unsigned)e.value);
+  }
+}
+
+size_t flightRead(FlightCursor &cursor, char *buf, size_t len)
+{
+  size_t used = 0;
+  char line[64];
+
+  if (!cursor.header)
+  {
+    int n = snprintf(line, sizeof(line), "flight 1 %lu %s\n", (unsigned long)flightRecorder.boot(),
+                     resetReasonName(esp_reset_reason()));
+    if (used + n > len)
+    {
+      return used;
+    }
+    memcpy(buf + used, line, n);
+    used += n;
+    cursor.header = true;
+  }
+
+  while (cursor.next != cursor.end)
+  {
+    FlightRecorder::Event e;
+    portENTER_CRITICAL(&flightMux);
+    bool kept = flightRecorder.get(cursor.next, e);
+    portEXIT_CRITICAL(&flightMux);
+    if (!kept)
+    {
+      // Overwritten since the snapshot
+      cursor.next++;
+      continue;
+    }
+    int n = formatEvent(line, sizeof(line), e);
+    if (n < 0 || (size_t)n >= sizeof(line))
+    {
+      cursor.next++;
+      continue;
+    }
+    if (used + n > len)
+    {
+      return used;
+    }
+    memcpy(buf + used, line, n);
+    used += n;
+    cursor.next++;
+  }
+  return used;
+}
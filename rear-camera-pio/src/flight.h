@@ -0,0 +1,60 @@
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include <Arduino.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+
+#include <flightRecorder.h>
+
+// The camera's flight recorder, a FlightRecorder over a log in RTC slow
+// memory, which keeps its contents through every reset but a power-on. It is
+// always on and records what a reset in the field would otherwise take with
+// it: commands, finished moves, heartbeats, WiFi changes, new heap lows and
+// NVS writes.
+//
+// GET /api/v1/flight and 'f' on the serial console dump it as text:
+//   flight 1 <boot> <reset reason of this boot>
+//   <ms since its boot> <type> <arg> <value>
+// with the arg and value of boots, commands and heap lows spelled out.
+
+extern FlightRecorder flightRecorder;
+extern portMUX_TYPE flightMux;
+
+// Cycles the Boot event took to record, measured in flightBegin()
+extern uint32_t flightEventCycles;
+
+inline void flightEvent(FlightRecorder::Type type, uint8_t arg = 0, uint16_t value = 0)
+{
+    // The tick count is a load, millis() goes through esp_timer
+    uint32_t ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    portENTER_CRITICAL(&flightMux);
+    flightRecorder.record(ms, type, arg, value);
+    portEXIT_CRITICAL(&flightMux);
+}
+
+// Checks the log the previous boot left and records this boot, first thing
+// in setup(). Returns true if the old events were kept.
+bool flightBegin();
+
+const char *resetReasonName(esp_reset_reason_t reason);
+
+// True for resets nobody asked for: panics, watchdogs, brownouts
+bool resetWasAbnormal(esp_reset_reason_t reason);
+
+struct FlightCursor
+{
+    uint32_t next;
+    uint32_t end;
+    bool header;
+};
+
+// Starts a dump of the events kept now
+FlightCursor flightSnapshot();
+// Writes whole lines into buf, returns the length: 0 when the next line
+// doesn't fit as well as once the dump is complete. Safe while events are
+// being recorded.
+size_t flightRead(FlightCursor &cursor, char *buf, size_t len);
+inline bool flightDone(const FlightCursor &cursor) { return cursor.header && cursor.next == cursor.end; }
+
+#endif // FLIGHT_H
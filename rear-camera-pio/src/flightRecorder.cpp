@@ -0,0 +1,94 @@
+#include <flightRecorder.h>
+#include <atomic>
+#include <string.h>
+
+static_assert((FlightRecorder::EVENTS & (FlightRecorder::EVENTS - 1)) == 0, "FLIGHT_EVENTS must be a power of 2");
+
+uint32_t FlightRecorder::words(const Event &e)
+{
+  return e.ms + ((uint32_t)e.value | ((uint32_t)e.type << 16) | ((uint32_t)e.arg << 24));
+}
+
+uint32_t FlightRecorder::sumExcept(uint32_t head) const
+{
+  uint32_t sum = 0;
+  for (size_t i = 0; i < EVENTS; i++)
+  {
+    sum += words(log.events[i]);
+  }
+  return sum - words(log.events[head % EVENTS]);
+}
+
+bool FlightRecorder::begin()
+{
+  bool kept = log.magic == MAGIC && log.headerCheck == (MAGIC ^ ~log.boot);
+  if (kept && sumExcept(log.head) != log.sum)
+  {
+    // Reset after storing the sum but before the head
+    if (sumExcept(log.head + 1) == log.sum)
+    {
+      log.head++;
+    }
+    else
+    {
+      kept = false;
+    }
+  }
+  if (!kept)
+  {
+    memset(&log, 0, sizeof(log));
+    log.magic = MAGIC;
+  }
+  log.boot++;
+  log.headerCheck = MAGIC ^ ~log.boot;
+  return kept;
+}
+
+void FlightRecorder::record(uint32_t ms, Type type, uint8_t arg, uint16_t value)
+{
+  uint32_t h = log.head;
+  Event &e = log.events[h % EVENTS];
+  e.ms = ms;
+  e.value = value;
+  e.type = type;
+  e.arg = arg;
+  // A reset may come between any two stores, keep them in this order: the
+  // slot, then the sum it joins and the next slot leaves, then the head
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  log.sum += words(e) - words(log.events[(h + 1) % EVENTS]);
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  log.head = h + 1;
+}
+
+bool FlightRecorder::get(uint32_t index, Event &out) const
+{
+  uint32_t behind = log.head - index;
+  if (behind == 0 || behind > EVENTS - 1)
+  {
+    return false;
+  }
+  out = log.events[index % EVENTS];
+  return true;
+}
+
+const char *FlightRecorder::typeName(Type type)
+{
+  switch (type)
+  {
+  case Boot:
+    return "boot";
+  case Command:
+    return "command";
+  case MoveDone:
+    return "move-done";
+  case Heartbeat:
+    return "heartbeat";
+  case Wifi:
+    return "wifi";
+  case HeapLow:
+    return "heap-low";
+  case NvsWrite:
+    return "nvs-write";
+  }
+  return "?";
+}
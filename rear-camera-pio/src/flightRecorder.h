@@ -0,0 +1,98 @@
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Ring of the last few hundred significant events, small binary records
+// meant to live in memory that survives a reset (RTC slow memory on the
+// camera, see flight.h), so a brownout, watchdog or panic in the field
+// leaves behind what led up to it. Kept free of Arduino includes like
+// traceRing.h.
+//
+// The log carries a checksum of every slot except the one written next, so
+// writing a record doesn't touch it and committing one is a read of the next
+// slot, two adds and two stores. begin() recomputes it: a log that doesn't
+// add up, after a power-on or with a slot corrupted, is started afresh. A
+// reset between storing the checksum and the head is recognised and the
+// record kept.
+
+#ifndef FLIGHT_EVENTS
+#define FLIGHT_EVENTS 256
+#endif
+
+class FlightRecorder
+{
+public:
+    // One slot stays free for the record being written
+    static const size_t EVENTS = FLIGHT_EVENTS;
+
+    enum Type : uint8_t
+    {
+        // arg reset reason (esp_reset_reason_t), value boot count
+        Boot = 1,
+        // arg MotionSource, value target of axis 0, STOP for a stop
+        Command,
+        // value position of axis 0
+        MoveDone,
+        // arg 1 if it got an answer, value HTTP status or negative error
+        Heartbeat,
+        // arg 1 up, 0 down, value reconnects so far
+        Wifi,
+        // value lowest free heap since boot, in 16 byte units
+        HeapLow,
+        // Before writing NVS, arg 0 servo position, 1 presets
+        NvsWrite,
+    };
+
+    static const uint16_t STOP = 0xFFFF;
+
+    struct Event
+    {
+        uint32_t ms;
+        uint16_t value;
+        Type type;
+        uint8_t arg;
+    };
+
+    // Everything that survives a reset. The caller places it, begin() makes
+    // sense of whatever it holds.
+    struct Log
+    {
+        uint32_t magic;
+        uint32_t boot;
+        uint32_t headerCheck;
+        uint32_t head;
+        // Of every slot but head % EVENTS
+        uint32_t sum;
+        Event events[EVENTS];
+    };
+
+    explicit FlightRecorder(Log &log) : log(log) {}
+
+    // Checks the log left by the previous boot, starts an empty one if it
+    // isn't intact and counts the boot. Returns true if the old events were
+    // kept. Records nothing, the caller adds the Boot event.
+    bool begin();
+
+    // Not thread safe, the caller serialises
+    void record(uint32_t ms, Type type, uint8_t arg, uint16_t value);
+
+    uint32_t boot() const { return log.boot; }
+    // Number of the next event. Events before head() - (EVENTS - 1) are gone.
+    uint32_t head() const { return log.head; }
+    // The event numbered index, false if it isn't kept
+    bool get(uint32_t index, Event &out) const;
+
+    static const char *typeName(Type type);
+
+private:
+    static const uint32_t MAGIC = 0x464C5431; // "FLT1"
+
+    Log &log;
+
+    static uint32_t words(const Event &e);
+    uint32_t sumExcept(uint32_t head) const;
+};
+
+#endif // FLIGHTRECORDER_H
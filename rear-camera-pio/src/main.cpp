@@ -6,32 +6,173 @@
 #include <nvs_flash.h>
 
 #include <cameraServo.h>
+#include <motionQueue.h>
+#include <presetTable.h>
+#include <eventStream.h>
+#include <wsControl.h>
+#include <udpControl.h>
+#include <udpProtocol.h>
+#include <metrics.h>
+#include <scheduler.h>
+#include <trace.h>
+#include <flight.h>
+#include <allocStats.h>
 #include <secrets.h>
 
-unsigned long heartbeatLastSent = 0;
-const long HEARTBEAT_INTERVAL = 5000; // 5 seconds in milliseconds
+bool heartbeatOk = false;
+const uint32_t HEARTBEAT_INTERVAL_US = 5000000;
+
+// One servo per axis, add pins here for pan / tilt or a second camera
+const int SERVO_PINS[] = {9};
 
 CameraServo cameraServo;
+MotionQueue motionQueue;
+PresetTable presetTable;
+WsControl wsControl;
+EventStream eventStream;
+UdpControl udpControl;
+
+uint32_t clockUs() { return micros(); }
+
+// Allocations by what loop() and the request handlers are doing, see
+// allocStats.h. Stepping the servo must not allocate, the WebSocket
+// pushes it does on the way are counted as "ws".
+AllocRegion allocMotion("motion", true);
+AllocRegion allocEvents("events");
+AllocRegion allocHeartbeat("heartbeat");
+AllocRegion allocHttp("http");
+
+// Everything loop() does is a task here, loop() runs what is due and sleeps
+// until the next one or until a command arrives
+Scheduler scheduler(clockUs);
+int motionTask = -1;
+void handleMotion();
+void handleEvents();
+void handleWifi();
+void handleHeartbeat();
+void handlePresets();
+void handleConsole();
+void handleHealth();
+
+// loop() wakeups per second, servo ticks plus commands arriving between them
+uint32_t loopCount = 0;
+unsigned long loopRateStart = 0;
+bool wifiUp = true; // setup() restarts unless WiFi came up
+
+// Dumps requested on the serial console, 't' for the trace and 'f' for the
+// flight log, written out a little at a time so loop() never waits for the
+// UART
+TraceRing::Cursor serialTrace;
+bool serialTracing = false;
+FlightCursor serialFlight;
+bool serialFlightDump = false;
+
+// Lowest free heap written to the flight log so far
+uint32_t heapLowRecorded = UINT32_MAX;
+
+// Scrapes are rendered here and sent straight from it, one at a time
+char metricsBuf[12288];
+bool metricsBusy = false;
+unsigned long metricsBusySince = 0;
+const unsigned long METRICS_BUSY_TIMEOUT_MS = 5000;
+
+// Last command handed to the servo, kept until its first step for latency accounting
+MotionCommand appliedCmd;
+bool appliedPending = false;
 
 AsyncWebServer server(8080);
 
-class MoveHandler
+// pos=N moves axis 0, pos=N,M,... several axes at once. An empty entry
+// leaves that axis alone, pos=,45 only moves axis 1.
+bool parsePositions(const char *s, MotionCommand &cmd)
 {
-public:
-  static void handleRequest(AsyncWebServerRequest *request)
+  for (size_t axis = 0;; axis++)
   {
-    if (request->hasParam("who", true))
+    if (axis >= cameraServo.getAxes())
     {
-      String pos = request->getParam("pos", true)->value();
-      Serial.println(pos);
+      return false;
     }
-    request->send(200, "text/plain", "OK");
+    if (*s != ',' && *s != '\0')
+    {
+      char *end;
+      long pos = strtol(s, &end, 10);
+      if (end == s)
+      {
+        return false;
+      }
+      cmd.pos[axis] = constrain(pos, 0, 180);
+      cmd.mask |= 1 << axis;
+      s = end;
+    }
+    if (*s == '\0')
+    {
+      return cmd.mask != 0;
+    }
+    if (*s != ',')
+    {
+      return false;
+    }
+    s++;
   }
-};
+}
+
+// slot=N, false if missing or out of range
+bool parseSlot(AsyncWebServerRequest *request, size_t &slot)
+{
+  if (!request->hasParam("slot"))
+  {
+    return false;
+  }
+  const char *s = request->getParam("slot")->value().c_str();
+  char *end;
+  long v = strtol(s, &end, 10);
+  if (end == s || *end != '\0' || v < 0 || v >= (long)PresetTable::SLOTS)
+  {
+    return false;
+  }
+  slot = (size_t)v;
+  return true;
+}
+
+// JSON array of the slots that are set, axes left out of a preset are null
+size_t renderPresets(char *buf, size_t size)
+{
+  size_t len = snprintf(buf, size, "[");
+  bool first = true;
+  for (size_t slot = 0; slot < PresetTable::SLOTS && len < size; slot++)
+  {
+    PresetTable::Preset p;
+    if (!presetTable.get(slot, p))
+    {
+      continue;
+    }
+    len += snprintf(buf + len, size - len, "%s{\"slot\":%u,\"speed\":%u,\"pos\":[", first ? "" : ",", (unsigned)slot,
+                    p.msPerDegree ? p.msPerDegree : (unsigned)ServoGroup::MS_PER_DEGREE);
+    for (size_t axis = 0; axis < cameraServo.getAxes() && len < size; axis++)
+    {
+      if (p.mask & (1 << axis))
+        len += snprintf(buf + len, size - len, "%s%u", axis ? "," : "", p.pos[axis]);
+      else
+        len += snprintf(buf + len, size - len, "%snull", axis ? "," : "");
+    }
+    if (len < size)
+      len += snprintf(buf + len, size - len, "]}");
+    first = false;
+  }
+  if (len < size)
+    len += snprintf(buf + len, size - len, "]");
+  return len < size ? len : size - 1;
+}
 
 void setup()
 {
   Serial.begin(115200);
+  esp_reset_reason_t reason = esp_reset_reason();
+  bool kept = flightBegin();
+  Serial.printf("Reset reason: %s, boot %u, flight log %s\n", resetReasonName(reason),
+                (unsigned)flightRecorder.boot(), kept ? "kept" : "started");
+  traceMeasure();
+  Serial.printf("Tracing costs %u cycles per event\n", (unsigned)traceEventCycles);
 
   // Initialize NVS
   esp_err_t ret = nvs_flash_init();
@@ -49,7 +190,9 @@ void setup()
   ESP32PWM::allocateTimer(3);
 
   // Only initialize servo (and subsequently access nvs) after nvs has been initialized
-  cameraServo.init(9);
+  cameraServo.init(SERVO_PINS, sizeof(SERVO_PINS) / sizeof(SERVO_PINS[0]));
+  presetTable.init();
+  motionQueue.init(8);
 
   WiFi.mode(WIFI_STA);
   WiFi.begin(SECRET_SSID, SECRET_PASS);
@@ -71,59 +214,464 @@ void setup()
   server.on("/api/v1/move", HTTP_POST,
             [](AsyncWebServerRequest *request)
             {
+              TRACE_SCOPE("http move");
+              AllocScope scope(allocHttp);
               if (!request->hasParam("pos"))
               {
                 request->send(400, "text/plain", "pos param required");
                 return;
               }
 
-              String pos = request->getParam("pos")->value();
+              MotionCommand cmd = {};
+              cmd.source = MotionSource::Http;
+              cmd.op = MotionOp::MoveTo;
+              cmd.receivedUs = micros();
+              if (!parsePositions(request->getParam("pos")->value().c_str(), cmd))
+              {
+                request->send(400, "text/plain", "bad pos");
+                return;
+              }
+              if (!motionQueue.push(cmd))
+              {
+                request->send(503, "text/plain", "motion queue full");
+                return;
+              }
+
+              request->send(200, "text/plain", "OK");
+            });
+
+  server.on("/api/v1/recall", HTTP_POST,
+            [](AsyncWebServerRequest *request)
+            {
+              TRACE_SCOPE("http recall");
+              AllocScope scope(allocHttp);
+              size_t slot;
+              PresetTable::Preset preset;
+              if (!parseSlot(request, slot))
+              {
+                request->send(400, "text/plain", "bad slot");
+                return;
+              }
+              if (!presetTable.get(slot, preset))
+              {
+                request->send(404, "text/plain", "slot empty");
+                return;
+              }
+
+              MotionCommand cmd = {};
+              cmd.source = MotionSource::Http;
+              cmd.op = MotionOp::MoveTo;
+              cmd.receivedUs = micros();
+              memcpy(cmd.pos, preset.pos, sizeof(cmd.pos));
+              cmd.mask = preset.mask;
+              cmd.msPerDegree = preset.msPerDegree;
+              if (!motionQueue.push(cmd))
+              {
+                request->send(503, "text/plain", "motion queue full");
+                return;
+              }
 
-              cameraServo.moveSlowlyTo(pos.toInt());
+              request->send(200, "text/plain", "OK");
+            });
 
+  // pos as for /move, or where the axes are now if left out
+  server.on("/api/v1/preset", HTTP_PUT,
+            [](AsyncWebServerRequest *request)
+            {
+              TRACE_SCOPE("http preset");
+              AllocScope scope(allocHttp);
+              size_t slot;
+              if (!parseSlot(request, slot))
+              {
+                request->send(400, "text/plain", "bad slot");
+                return;
+              }
+
+              MotionCommand parsed = {};
+              PresetTable::Preset preset = {};
+              if (request->hasParam("pos"))
+              {
+                if (!parsePositions(request->getParam("pos")->value().c_str(), parsed))
+                {
+                  request->send(400, "text/plain", "bad pos");
+                  return;
+                }
+                memcpy(preset.pos, parsed.pos, sizeof(preset.pos));
+                preset.mask = parsed.mask;
+              }
+              else
+              {
+                for (size_t axis = 0; axis < cameraServo.getAxes(); axis++)
+                {
+                  preset.pos[axis] = cameraServo.getCurrentPosition(axis);
+                  preset.mask |= 1 << axis;
+                }
+              }
+              if (request->hasParam("speed"))
+              {
+                long speed = request->getParam("speed")->value().toInt();
+                preset.msPerDegree = (uint8_t)constrain(speed, 0, 255);
+              }
+              if (!presetTable.set(slot, preset))
+              {
+                request->send(400, "text/plain", "bad speed");
+                return;
+              }
+
+              request->send(200, "text/plain", "OK");
+            });
+
+  server.on("/api/v1/preset", HTTP_DELETE,
+            [](AsyncWebServerRequest *request)
+            {
+              TRACE_SCOPE("http preset");
+              AllocScope scope(allocHttp);
+              size_t slot;
+              if (!parseSlot(request, slot))
+              {
+                request->send(400, "text/plain", "bad slot");
+                return;
+              }
+              PresetTable::Preset empty = {};
+              presetTable.set(slot, empty);
               request->send(200, "text/plain", "OK");
             });
 
+  server.on("/api/v1/presets", HTTP_GET,
+            [](AsyncWebServerRequest *request)
+            {
+              // Rendered again on every call and sent from index, so no copy
+              // has to outlive the handler. It is one call unless the window
+              // is small.
+              request->send(request->beginChunkedResponse("application/json",
+                                                          [](uint8_t *out, size_t maxLen, size_t index) -> size_t
+                                                          {
+                                                            char buf[640];
+                                                            size_t len = renderPresets(buf, sizeof(buf));
+                                                            size_t n = index < len ? min(len - index, maxLen) : 0;
+                                                            memcpy(out, buf + index, n);
+                                                            return n;
+                                                          }));
+            });
+
+  server.on("/metrics", HTTP_GET,
+            [](AsyncWebServerRequest *request)
+            {
+              TRACE_SCOPE("http metrics");
+              AllocScope scope(allocHttp);
+              // The previous response may still be streaming out of the buffer
+              if (metricsBusy && millis() - metricsBusySince < METRICS_BUSY_TIMEOUT_MS)
+              {
+                request->send(503, "text/plain", "scrape in progress");
+                return;
+              }
+              metricsBusy = true;
+              metricsBusySince = millis();
+
+              size_t len = metrics.render(metricsBuf, sizeof(metricsBuf), motionQueue.depth(), cameraServo, scheduler);
+              request->onDisconnect([]()
+                                    { metricsBusy = false; });
+              request->send(200, "text/plain; version=0.0.4", (const uint8_t *)metricsBuf, len);
+            });
+
+  // Text dump of the flight log, see flight.h
+  server.on("/api/v1/flight", HTTP_GET,
+            [](AsyncWebServerRequest *request)
+            {
+              FlightCursor cursor = flightSnapshot();
+              request->send(request->beginChunkedResponse("text/plain",
+                                                          [cursor](uint8_t *buf, size_t maxLen, size_t index) mutable
+                                                          {
+                                                            // Only 0 at the end, as for the trace below
+                                                            size_t n = flightRead(cursor, (char *)buf, maxLen);
+                                                            return n == 0 && !flightDone(cursor) ? RESPONSE_TRY_AGAIN : n;
+                                                          }));
+            });
+
+  // Text dump of the trace ring, see traceRing.h. Every request reads the
+  // ring from its own cursor while tracing carries on.
+  server.on("/api/v1/trace", HTTP_GET,
+            [](AsyncWebServerRequest *request)
+            {
+              TraceRing::Cursor cursor = trace.snapshot();
+              request->send(request->beginChunkedResponse("text/plain",
+                                                          [cursor](uint8_t *buf, size_t maxLen, size_t index) mutable
+                                                          {
+                                                            // 0 ends the response, so a window too small for
+                                                            // the next line has to ask to be called again
+                                                            size_t n = trace.read(cursor, (char *)buf, maxLen);
+                                                            return n == 0 && !trace.done(cursor) ? RESPONSE_TRY_AGAIN : n;
+                                                          }));
+            });
+
+  wsControl.init(server, motionQueue, cameraServo.getAxes());
+  eventStream.init(server, cameraServo);
+  udpControl.init(UDP_CONTROL_PORT, motionQueue, cameraServo, presetTable);
+
   server.begin();
+
+  // When several are due the servo goes first. Tasks aren't preempted, a
+  // heartbeat stuck on the network still holds up the servo, which shows as
+  // motion overruns in /metrics.
+  motionQueue.setConsumer(xTaskGetCurrentTaskHandle());
+  motionTask = scheduler.every("motion", handleMotion, ServoGroup::TICK_MS * 1000, 3, 2000);
+  scheduler.every("events", handleEvents, 20000, 2);
+  scheduler.every("wifi", handleWifi, 1000000, 1);
+  scheduler.every("heartbeat", handleHeartbeat, HEARTBEAT_INTERVAL_US, 1);
+  scheduler.every("presets", handlePresets, 1000000, 0);
+  scheduler.every("console", handleConsole, 10000, 0);
+  scheduler.every("health", handleHealth, 1000000, 0);
 }
 
-// Sends a heartbeat to the api server periodically
+// Sends a heartbeat to the api server, a scheduler task
 void handleHeartbeat()
 {
-  unsigned long currentMillis = millis();
-  if (currentMillis - heartbeatLastSent >= HEARTBEAT_INTERVAL)
+  if (!wifiUp)
   {
-    heartbeatLastSent = currentMillis;
+    return;
+  }
+  TRACE_SCOPE("heartbeat");
+  AllocScope scope(allocHeartbeat);
+  uint32_t startUs = micros();
 
-    HTTPClient http;
-    http.begin("http://" + WiFi.gatewayIP().toString() + ":8080/api/v1/device/rear-camera");
-    http.addHeader("Content-Type", "application/json");
+  HTTPClient http;
+  http.begin("http://" + WiFi.gatewayIP().toString() + ":8080/api/v1/device/rear-camera");
+  // Runs on the scheduler, a dead controller mustn't hold up motion for long
+  http.setConnectTimeout(1000);
+  http.setTimeout(1000);
+  http.addHeader("Content-Type", "application/json");
 
-    String payload = "{\"device-type\":\"REAR_CAMERA\"}";
+  // The boot count and reset reason tell the controller about resets, it
+  // fetches the flight log after one it should know about
+  esp_reset_reason_t reason = esp_reset_reason();
+  String payload = String("{\"device-type\":\"REAR_CAMERA\",\"boot\":") + flightRecorder.boot() +
+                   ",\"reset-reason\":\"" + resetReasonName(reason) + "\",\"reset-abnormal\":" +
+                   (resetWasAbnormal(reason) ? "true" : "false") + "}";
 
-    int httpResponseCode = http.PUT(payload);
+  int httpResponseCode = http.PUT(payload);
 
-    if (httpResponseCode > 0)
+  heartbeatOk = httpResponseCode > 0;
+  flightEvent(FlightRecorder::Heartbeat, heartbeatOk, (uint16_t)(int16_t)httpResponseCode);
+  metrics.heartbeats.inc();
+  if (!heartbeatOk)
+  {
+    metrics.heartbeatFailures.inc();
+  }
+  if (heartbeatOk)
+  {
+    String payload = http.getString();
+  }
+  else
+  {
+    Serial.printf("Heartbeat Error code: %d\n", httpResponseCode);
+  }
+  http.end(); // Free resources
+  metrics.heartbeatDuration.observe(micros() - startUs);
+}
+
+// Hands queued commands to the servo and steps it. Later commands supersede
+// earlier ones, the servo only ever chases the newest target.
+void handleMotion()
+{
+  TRACE_SCOPE("motion");
+  AllocScope scope(allocMotion);
+  bool wasMoving = cameraServo.isMoving();
+  bool commanded = false;
+  MotionCommand cmd;
+  while (motionQueue.pop(cmd))
+  {
+    commanded = true;
+    TRACE_INSTANT("move applied");
+    flightEvent(FlightRecorder::Command, (uint8_t)cmd.source,
+                cmd.op == MotionOp::Stop ? FlightRecorder::STOP : cmd.pos[0]);
+    if (cmd.op == MotionOp::Stop)
     {
-      String payload = http.getString();
+      cameraServo.stop();
+      appliedPending = false;
+      continue;
     }
-    else
+    cameraServo.moveTo(cmd.pos, cmd.mask, cmd.msPerDegree);
+    switch (cmd.source)
     {
-      Serial.printf("Heartbeat Error code: %d\n", httpResponseCode);
+    case MotionSource::Http:
+      metrics.movesHttp.inc();
+      break;
+    case MotionSource::WebSocket:
+      metrics.movesWs.inc();
+      break;
+    case MotionSource::Udp:
+      metrics.movesUdp.inc();
+      break;
     }
-    http.end(); // Free resources
+    appliedCmd = cmd;
+    appliedPending = true;
+  }
+
+  bool stepped = cameraServo.update();
+  // A stop, a move that took a single step or one to where the servo
+  // already was never shows as moving between ticks, but completes all the same
+  if ((wasMoving || commanded) && !cameraServo.isMoving())
+  {
+    flightEvent(FlightRecorder::MoveDone, 0, (uint16_t)cameraServo.getCurrentPosition());
+    eventStream.moveComplete(cameraServo.getCurrentPosition());
   }
+
+  // A command counts as applied on the first servo write it causes, or right
+  // away if the servo was already there
+  if (appliedPending && (stepped || !cameraServo.isMoving()))
+  {
+    appliedPending = false;
+    if (appliedCmd.source == MotionSource::WebSocket)
+    {
+      wsControl.onApplied(appliedCmd, micros() - appliedCmd.receivedUs);
+    }
+  }
+
+  wsControl.update(cameraServo);
 }
 
-void loop()
+// Tracks the connection, the WiFi stack reconnects on its own
+void handleWifi()
 {
-  // Only continue this loop if we are connected to the wifi
-  if (WiFi.status() != WL_CONNECTED)
+  bool up = WiFi.status() == WL_CONNECTED;
+  if (up && !wifiUp)
+  {
+    metrics.wifiReconnects.inc();
+  }
+  else if (!up && wifiUp)
+  {
+    Serial.println("WiFi Disconnected, waiting for it to come back");
+  }
+  if (up != wifiUp)
+  {
+    flightEvent(FlightRecorder::Wifi, up, (uint16_t)metrics.wifiReconnects.get());
+  }
+  wifiUp = up;
+}
+
+void handleEvents()
+{
+  TRACE_SCOPE("events");
+  AllocScope scope(allocEvents);
+  eventStream.setLink(wifiUp, heartbeatOk);
+  eventStream.update();
+}
+
+void handlePresets()
+{
+  presetTable.persist();
+}
+
+// 't' starts a trace dump and 'f' a flight log dump, written out as the
+// UART's buffer drains
+void handleConsole()
+{
+  while (Serial.available())
+  {
+    int c = Serial.read();
+    if (c == 't' && !serialTracing)
+    {
+      serialTrace = trace.snapshot();
+      serialTracing = true;
+    }
+    else if (c == 'f' && !serialFlightDump)
+    {
+      serialFlight = flightSnapshot();
+      serialFlightDump = true;
+    }
+  }
+  if (!serialTracing && !serialFlightDump)
+  {
+    return;
+  }
+
+  char buf[128];
+  if (Serial.availableForWrite() < (int)sizeof(buf))
   {
-    Serial.println("WiFi Disconnected. Waiting 5 seconds before trying again...");
-    delay(5000);
     return;
   }
+  size_t n;
+  if (serialTracing)
+  {
+    n = trace.read(serialTrace, buf, sizeof(buf));
+    serialTracing = n > 0;
+  }
+  else
+  {
+    n = flightRead(serialFlight, buf, sizeof(buf));
+    serialFlightDump = n > 0;
+  }
+  if (n > 0)
+  {
+    Serial.write((const uint8_t *)buf, n);
+  }
+}
+
+// Notes new heap lows in the flight log. Only drops of 1 KB or more, so a
+// slow leak doesn't crowd out everything else.
+void handleHealth()
+{
+  uint32_t low = ESP.getMinFreeHeap();
+  if (low + 1024 <= heapLowRecorded)
+  {
+    flightEvent(FlightRecorder::HeapLow, 0, (uint16_t)(low / 16));
+    heapLowRecorded = low;
+  }
+}
+
+// Per mille of the run time since the last call that went to the idle
+// task, from FreeRTOS's run time stats. The C3 has the one idle task.
+uint16_t sampleIdle()
+{
+  static TaskStatus_t tasks[24];
+  static uint32_t lastIdle = 0;
+  static uint32_t lastTotal = 0;
+  static uint16_t permille = 0;
+
+  uint32_t total;
+  UBaseType_t n = uxTaskGetSystemState(tasks, sizeof(tasks) / sizeof(tasks[0]), &total);
+  TaskHandle_t idleTask = xTaskGetIdleTaskHandle();
+  for (UBaseType_t i = 0; i < n; i++)
+  {
+    if (tasks[i].xHandle == idleTask)
+    {
+      uint32_t idle = tasks[i].ulRunTimeCounter;
+      if (total != lastTotal)
+      {
+        permille = (uint16_t)((uint64_t)(idle - lastIdle) * 1000 / (total - lastTotal));
+      }
+      lastIdle = idle;
+      lastTotal = total;
+      break;
+    }
+  }
+  return permille;
+}
+
+void countLoopPass()
+{
+  loopCount++;
+  unsigned long now = millis();
+  if (now - loopRateStart >= 1000)
+  {
+    udpControl.setLoad(loopCount, sampleIdle());
+    loopCount = 0;
+    loopRateStart = now;
+  }
+}
 
-  handleHeartbeat();
+void loop()
+{
+  countLoopPass();
+  uint32_t startUs = micros();
+  scheduler.run();
+  metrics.loopPass.observe(micros() - startUs);
+
+  // A command arriving wakes us early and steps the servo right away, the
+  // tick after it stays where it was
+  uint32_t sleepMs = scheduler.untilNextUs() / 1000;
+  if (motionQueue.wait(sleepMs < 1000 ? sleepMs : 1000))
+  {
+    scheduler.trigger(motionTask);
+  }
 }
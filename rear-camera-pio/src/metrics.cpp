@@ -0,0 +1,199 @@
+#include <metrics.h>
+#include <trace.h>
+#include <flight.h>
+#include <allocStats.h>
+#include <WiFi.h>
+#include <stdarg.h>
+
+static const uint32_t LOOP_PASS_BOUNDS[] = {100, 500, 1000, 5000, 10000, 50000, 100000, 1000000};
+// Tasks whose stack headroom is exported, ours and the IDF's busiest
+static const char *const STACK_TASKS[] = {"loopTask", "async_tcp", "async_udp", "wifi",
+                                          "tiT", "esp_timer", "sys_evt", "IDLE"};
+static const uint32_t HEARTBEAT_BOUNDS[] = {10000, 50000, 100000, 250000, 500000, 1000000, 2000000, 5000000};
+
+Metrics metrics;
+
+Metrics::Metrics()
+    : loopPass(LOOP_PASS_BOUNDS, sizeof(LOOP_PASS_BOUNDS) / sizeof(LOOP_PASS_BOUNDS[0])),
+      heartbeatDuration(HEARTBEAT_BOUNDS, sizeof(HEARTBEAT_BOUNDS) / sizeof(HEARTBEAT_BOUNDS[0]))
+{
+}
+
+void Histogram::observe(uint32_t us)
+{
+  size_t i = 0;
+  while (i < count && us > bounds[i])
+  {
+    i++;
+  }
+  buckets[i].fetch_add(1, std::memory_order_relaxed);
+  observations.fetch_add(1, std::memory_order_relaxed);
+  sumUs.fetch_add(us, std::memory_order_relaxed);
+}
+
+// Appends to a fixed buffer, silently stops once it is full
+class Writer
+{
+public:
+  char *buf;
+  size_t cap;
+  size_t len = 0;
+
+  Writer(char *buf, size_t cap) : buf(buf), cap(cap) {}
+
+  void printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+  {
+    if (len + 1 >= cap)
+    {
+      return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + len, cap - len, fmt, args);
+    va_end(args);
+    len = (n < 0 || len + n >= cap) ? cap - 1 : len + n;
+  }
+
+  void header(const char *name, const char *type, const char *help)
+  {
+    printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  }
+
+  void counter(const char *name, const char *help, uint32_t value)
+  {
+    header(name, "counter", help);
+    printf("%s %lu\n", name, (unsigned long)value);
+  }
+
+  void gauge(const char *name, const char *help, long value)
+  {
+    header(name, "gauge", help);
+    printf("%s %ld\n", name, value);
+  }
+
+  // Microseconds printed as seconds without going through floats
+  void seconds(uint64_t us)
+  {
+    printf("%lu.%06lu", (unsigned long)(us / 1000000), (unsigned long)(us % 1000000));
+  }
+
+  void histogram(const char *name, const char *help, const Histogram &h)
+  {
+    header(name, "histogram", help);
+    uint32_t cumulative = 0;
+    for (size_t i = 0; i < h.count; i++)
+    {
+      cumulative += h.buckets[i].load(std::memory_order_relaxed);
+      printf("%s_bucket{le=\"", name);
+      seconds(h.bounds[i]);
+      printf("\"} %lu\n", (unsigned long)cumulative);
+    }
+    cumulative += h.buckets[h.count].load(std::memory_order_relaxed);
+    printf("%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)cumulative);
+    printf("%s_sum ", name);
+    seconds(h.sumUs.load(std::memory_order_relaxed));
+    printf("\n%s_count %lu\n", name, (unsigned long)h.observations.load(std::memory_order_relaxed));
+  }
+
+  // One line per scheduler task, field picks the counter
+  void tasks(const char *name, const char *type, const char *help, const Scheduler &s, uint32_t Scheduler::Task::*field,
+             bool inSeconds)
+  {
+    header(name, type, help);
+    for (size_t i = 0; i < s.count(); i++)
+    {
+      const Scheduler::Task &t = s.task(i);
+      printf("%s{task=\"%s\"} ", name, t.name);
+      if (inSeconds)
+        seconds(t.*field);
+      else
+        printf("%lu", (unsigned long)(t.*field));
+      printf("\n");
+    }
+  }
+};
+
+size_t Metrics::render(char *buf, size_t len, int queueDepth, CameraServo &servo, const Scheduler &scheduler)
+{
+  uint32_t start = micros();
+  Writer w(buf, len);
+
+  w.gauge("camera_uptime_seconds", "Seconds since boot", millis() / 1000);
+  w.gauge("camera_heap_free_bytes", "Free heap", ESP.getFreeHeap());
+  w.gauge("camera_heap_min_free_bytes", "Lowest free heap since boot", ESP.getMinFreeHeap());
+  w.gauge("camera_heap_max_alloc_bytes", "Largest allocatable heap block", ESP.getMaxAllocHeap());
+  w.header("camera_stack_free_bytes", "gauge", "Least free stack a task has had");
+  for (const char *task : STACK_TASKS)
+  {
+    int left = stackFree(task);
+    if (left >= 0)
+    {
+      w.printf("camera_stack_free_bytes{task=\"%s\"} %d\n", task, left);
+    }
+  }
+  w.header("camera_alloc_total", "counter", "Heap allocations by code region");
+  for (AllocRegion *r = AllocRegion::first; r; r = r->next)
+  {
+    w.printf("camera_alloc_total{region=\"%s\"} %lu\n", r->name,
+             (unsigned long)r->allocs.load(std::memory_order_relaxed));
+  }
+  w.header("camera_alloc_bytes_total", "counter", "Bytes allocated by code region, wraps");
+  for (AllocRegion *r = AllocRegion::first; r; r = r->next)
+  {
+    w.printf("camera_alloc_bytes_total{region=\"%s\"} %lu\n", r->name,
+             (unsigned long)r->bytes.load(std::memory_order_relaxed));
+  }
+  w.counter("camera_alloc_violations_total", "Allocations in regions that must not allocate",
+            allocViolations.load(std::memory_order_relaxed));
+  w.gauge("camera_wifi_rssi_dbm", "WiFi signal strength", WiFi.RSSI());
+  w.counter("camera_wifi_reconnects_total", "WiFi reconnections", wifiReconnects.get());
+
+  w.counter("camera_heartbeats_total", "Heartbeats sent to the main controller", heartbeats.get());
+  w.counter("camera_heartbeat_failures_total", "Heartbeats that failed", heartbeatFailures.get());
+  w.histogram("camera_heartbeat_duration_seconds", "Time loop() spent sending a heartbeat", heartbeatDuration);
+
+  w.header("camera_moves_total", "counter", "Move commands handed to the servo");
+  w.printf("camera_moves_total{source=\"http\"} %lu\n", (unsigned long)movesHttp.get());
+  w.printf("camera_moves_total{source=\"ws\"} %lu\n", (unsigned long)movesWs.get());
+  w.printf("camera_moves_total{source=\"udp\"} %lu\n", (unsigned long)movesUdp.get());
+  w.gauge("camera_motion_queue_depth", "Commands waiting on the motion queue", queueDepth);
+  w.counter("camera_motion_queue_full_total", "Commands dropped on a full motion queue", motionQueueFull.get());
+  w.header("camera_ws_setpoints_dropped_total", "counter", "WebSocket setpoints that never reached the servo");
+  w.printf("camera_ws_setpoints_dropped_total{reason=\"stale\"} %lu\n", (unsigned long)wsStaleDropped.get());
+  w.printf("camera_ws_setpoints_dropped_total{reason=\"overflow\"} %lu\n", (unsigned long)wsOverflowDropped.get());
+  w.header("camera_servo_position_degrees", "gauge", "Current servo position");
+  for (size_t i = 0; i < servo.getAxes(); i++)
+  {
+    w.printf("camera_servo_position_degrees{axis=\"%u\"} %d\n", (unsigned)i, servo.getCurrentPosition(i));
+  }
+  w.header("camera_servo_target_degrees", "gauge", "Servo target position");
+  for (size_t i = 0; i < servo.getAxes(); i++)
+  {
+    w.printf("camera_servo_target_degrees{axis=\"%u\"} %d\n", (unsigned)i, servo.getTarget(i));
+  }
+
+  w.histogram("camera_loop_pass_seconds", "Time loop() spent running tasks per wakeup", loopPass);
+  w.tasks("camera_task_runs_total", "counter", "Runs of a loop() task", scheduler, &Scheduler::Task::runs, false);
+  w.tasks("camera_task_overruns_total", "counter", "Runs that finished after their deadline", scheduler,
+          &Scheduler::Task::overruns, false);
+  w.tasks("camera_task_skipped_total", "counter", "Periodic releases missed entirely", scheduler,
+          &Scheduler::Task::skipped, false);
+  w.tasks("camera_task_late_seconds_total", "counter", "Time runs started after they were due, wraps", scheduler,
+          &Scheduler::Task::lateSumUs, true);
+  w.tasks("camera_task_late_max_seconds", "gauge", "Latest start since boot", scheduler, &Scheduler::Task::maxLateUs,
+          true);
+  w.tasks("camera_task_run_max_seconds", "gauge", "Longest run since boot", scheduler, &Scheduler::Task::maxRunUs,
+          true);
+
+  w.counter("camera_trace_events_total", "Events recorded into the trace ring", trace.recorded());
+  w.gauge("camera_trace_event_cycles", "CPU cycles per trace event, measured at boot", traceEventCycles);
+  w.counter("camera_boots_total", "Boots since the flight log was started", flightRecorder.boot());
+  w.gauge("camera_flight_event_cycles", "CPU cycles the boot's flight log event took", flightEventCycles);
+
+  w.gauge("camera_metrics_render_microseconds", "CPU time of the previous scrape", renderUs.get());
+  w.gauge("camera_metrics_render_bytes", "Size of the previous scrape", renderBytes.get());
+
+  renderUs.set(micros() - start);
+  renderBytes.set(w.len);
+  return w.len;
+}
@@ -0,0 +1,87 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#include <cameraServo.h>
+#include <scheduler.h>
+
+// Fixed set of counters, gauges and histograms, rendered in the Prometheus
+// text format on GET /metrics.
+//
+// Updates are single relaxed atomic operations so they can sit on hot paths
+// and be called from any task. Rendering writes into a caller supplied
+// buffer with snprintf and no floating point, so a scrape never touches the
+// heap.
+
+class Counter
+{
+private:
+    std::atomic<uint32_t> value{0};
+
+public:
+    void inc(uint32_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+class Gauge
+{
+private:
+    std::atomic<int32_t> value{0};
+
+public:
+    void set(int32_t v) { value.store(v, std::memory_order_relaxed); }
+    int32_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+// Durations in microseconds, exported in seconds
+class Histogram
+{
+public:
+    static const size_t MAX_BUCKETS = 8;
+
+    // bounds in microseconds, ascending, at most MAX_BUCKETS of them
+    Histogram(const uint32_t *bounds, size_t count) : bounds(bounds), count(count) {}
+    void observe(uint32_t us);
+
+    const uint32_t *bounds;
+    const size_t count;
+    std::atomic<uint32_t> buckets[MAX_BUCKETS + 1] = {};
+    std::atomic<uint32_t> observations{0};
+    // Wraps after about 71 minutes of observed time, which Prometheus takes
+    // as a counter reset. 64 bit atomics take a lock on the ESP32-C3.
+    std::atomic<uint32_t> sumUs{0};
+};
+
+struct Metrics
+{
+    Counter heartbeats;
+    Counter heartbeatFailures;
+    Counter wifiReconnects;
+
+    Counter movesHttp;
+    Counter movesWs;
+    Counter movesUdp;
+    Counter motionQueueFull;
+    Counter wsStaleDropped;
+    Counter wsOverflowDropped;
+
+    Histogram loopPass;
+    Histogram heartbeatDuration;
+
+    // Cost of the previous scrape
+    Gauge renderUs;
+    Gauge renderBytes;
+
+    Metrics();
+
+    // Renders everything into buf, returns the length written. Gauges sampled
+    // at scrape time (heap, queue depth, servo, loop() tasks) are passed in by
+    // the caller.
+    size_t render(char *buf, size_t len, int queueDepth, CameraServo &servo, const Scheduler &scheduler);
+};
+
+extern Metrics metrics;
+
+#endif // METRICS_H
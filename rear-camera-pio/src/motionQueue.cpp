@@ -0,0 +1,41 @@
+#include <motionQueue.h>
+#include <metrics.h>
+
+void MotionQueue::init(size_t depth)
+{
+  q = xQueueCreate(depth, sizeof(MotionCommand));
+}
+
+bool MotionQueue::push(const MotionCommand &cmd)
+{
+  if (xQueueSend(q, &cmd, 0) != pdTRUE)
+  {
+    metrics.motionQueueFull.inc();
+    return false;
+  }
+  wake();
+  return true;
+}
+
+bool MotionQueue::pop(MotionCommand &cmd)
+{
+  return xQueueReceive(q, &cmd, 0) == pdTRUE;
+}
+
+size_t MotionQueue::depth()
+{
+  return uxQueueMessagesWaiting(q);
+}
+
+void MotionQueue::wake()
+{
+  if (consumer)
+  {
+    xTaskNotifyGive(consumer);
+  }
+}
+
+bool MotionQueue::wait(uint32_t timeoutMs)
+{
+  return ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs)) != 0;
+}
@@ -0,0 +1,63 @@
+#ifndef MOTIONQUEUE_H
+#define MOTIONQUEUE_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#include <servoGroup.h>
+
+enum class MotionSource : uint8_t
+{
+    Http,
+    WebSocket,
+    Udp,
+};
+
+enum class MotionOp : uint8_t
+{
+    MoveTo,
+    Stop,
+};
+
+struct MotionCommand
+{
+    MotionSource source;
+    MotionOp op;
+    // Targets for the axes set in mask, the other axes keep theirs
+    uint8_t pos[ServoGroup::MAX_AXES];
+    uint8_t mask;
+    // Slew rate, 0 for the usual ServoGroup::MS_PER_DEGREE
+    uint8_t msPerDegree;
+    // Only meaningful for streamed setpoints, used to ack back to the sender
+    uint32_t clientId;
+    uint16_t seq;
+    // micros() when the command arrived, used for latency accounting
+    uint32_t receivedUs;
+};
+
+// Hands move commands from the network tasks (AsyncTCP) to loop(), which is
+// the only place the servo gets touched. loop() sleeps in wait() between
+// scheduled tasks and a push wakes it, so a command doesn't sit out the rest
+// of a servo tick.
+class MotionQueue
+{
+private:
+    QueueHandle_t q = nullptr;
+    TaskHandle_t consumer = nullptr;
+
+public:
+    void init(size_t depth);
+    // The task that pops, the one wake() notifies
+    void setConsumer(TaskHandle_t task) { consumer = task; }
+    // Safe to call from any task, returns false and drops the command if full
+    bool push(const MotionCommand &cmd);
+    bool pop(MotionCommand &cmd);
+    size_t depth();
+    // Wakes the consumer, for work it picks up some other way than pop()
+    void wake();
+    // Called by the consumer, sleeps up to timeoutMs, true if woken
+    bool wait(uint32_t timeoutMs);
+};
+
+#endif // MOTIONQUEUE_H
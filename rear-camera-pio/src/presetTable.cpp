@@ -0,0 +1,74 @@
+#include <presetTable.h>
+#include <Preferences.h>
+#include <trace.h>
+#include <flight.h>
+#include <allocStats.h>
+
+#define NVS_NAMESPACE "rearCamera"
+
+void PresetTable::init()
+{
+  AllocScope scope(allocNvs);
+  Preferences preferences;
+  preferences.begin(NVS_NAMESPACE, true);
+  if (preferences.getBytesLength("presets") == sizeof(presets))
+  {
+    preferences.getBytes("presets", presets, sizeof(presets));
+  }
+  else
+  {
+    // What the main controller's button used to send
+    presets[0].mask = 1;
+    presets[0].pos[0] = 0;
+    presets[1].mask = 1;
+    presets[1].pos[0] = 90;
+  }
+  preferences.end();
+}
+
+bool PresetTable::get(size_t slot, Preset &preset)
+{
+  if (slot >= SLOTS)
+  {
+    return false;
+  }
+  portENTER_CRITICAL(&mux);
+  preset = presets[slot];
+  portEXIT_CRITICAL(&mux);
+  return preset.mask != 0;
+}
+
+bool PresetTable::set(size_t slot, const Preset &preset)
+{
+  if (slot >= SLOTS || preset.msPerDegree > MAX_MS_PER_DEGREE)
+  {
+    return false;
+  }
+  portENTER_CRITICAL(&mux);
+  presets[slot] = preset;
+  dirty = true;
+  portEXIT_CRITICAL(&mux);
+  return true;
+}
+
+void PresetTable::persist()
+{
+  Preset copy[SLOTS];
+  portENTER_CRITICAL(&mux);
+  bool changed = dirty;
+  dirty = false;
+  memcpy(copy, presets, sizeof(copy));
+  portEXIT_CRITICAL(&mux);
+  if (!changed)
+  {
+    return;
+  }
+
+  TRACE_SCOPE("nvs presets");
+  AllocScope scope(allocNvs);
+  flightEvent(FlightRecorder::NvsWrite, 1);
+  Preferences preferences;
+  preferences.begin(NVS_NAMESPACE, false);
+  preferences.putBytes("presets", copy, sizeof(copy));
+  preferences.end();
+}
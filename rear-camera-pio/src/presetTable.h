@@ -0,0 +1,44 @@
+#ifndef PRESETTABLE_H
+#define PRESETTABLE_H
+
+#include <Arduino.h>
+
+#include <servoGroup.h>
+
+// Named positions kept on the camera, so callers move it by slot without
+// knowing where "up" is on this particular mount. Slots are set and read from
+// the network tasks, so every access copies under a lock; loop() writes
+// changes to NVS, keeping flash writes out of the request handlers.
+class PresetTable
+{
+public:
+    static const size_t SLOTS = 8;
+    // Slowest a preset may move, a full sweep in 9 s
+    static const uint8_t MAX_MS_PER_DEGREE = 50;
+
+    struct Preset
+    {
+        uint8_t pos[ServoGroup::MAX_AXES];
+        // Axes the preset moves, 0 for an empty slot
+        uint8_t mask;
+        // 0 for the usual rate
+        uint8_t msPerDegree;
+    };
+
+    // Loads the table from NVS, slot 0 at 0 degrees and slot 1 at 90 (camera
+    // up / down on the main controller) if nothing was saved
+    void init();
+    // False if the slot is out of range or empty
+    bool get(size_t slot, Preset &preset);
+    // False if the slot or speed is out of range. A mask of 0 clears the slot.
+    bool set(size_t slot, const Preset &preset);
+    // Writes the table to NVS if it changed, call from loop()
+    void persist();
+
+private:
+    Preset presets[SLOTS] = {};
+    bool dirty = false;
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif // PRESETTABLE_H
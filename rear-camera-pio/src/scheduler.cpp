@@ -0,0 +1,164 @@
+#include <scheduler.h>
+
+int Scheduler::add(const char *name, TaskFn fn, uint32_t periodUs, uint32_t firstUs, uint8_t priority,
+                   uint32_t deadlineUs)
+{
+  if (used == MAX_TASKS)
+  {
+    return -1;
+  }
+  Task &t = tasks[used];
+  t = {};
+  t.name = name;
+  t.fn = fn;
+  t.periodUs = periodUs;
+  t.deadlineUs = deadlineUs;
+  t.priority = priority;
+  t.active = true;
+  t.dueUs = firstUs;
+  return (int)used++;
+}
+
+int Scheduler::every(const char *name, TaskFn fn, uint32_t periodUs, uint8_t priority, uint32_t deadlineUs)
+{
+  return add(name, fn, periodUs, clock(), priority, deadlineUs ? deadlineUs : periodUs);
+}
+
+int Scheduler::once(const char *name, TaskFn fn, uint32_t delayUs, uint8_t priority, uint32_t deadlineUs)
+{
+  return add(name, fn, 0, clock() + delayUs, priority, deadlineUs);
+}
+
+void Scheduler::at(int id, uint32_t dueUs)
+{
+  if (id < 0 || (size_t)id >= used)
+  {
+    return;
+  }
+  tasks[id].dueUs = dueUs;
+  tasks[id].active = true;
+}
+
+void Scheduler::trigger(int id)
+{
+  if (id < 0 || (size_t)id >= used || tasks[id].triggered)
+  {
+    return;
+  }
+  tasks[id].triggered = true;
+  tasks[id].triggeredUs = clock();
+}
+
+void Scheduler::cancel(int id)
+{
+  if (id < 0 || (size_t)id >= used)
+  {
+    return;
+  }
+  tasks[id].active = false;
+  tasks[id].triggered = false;
+}
+
+uint32_t Scheduler::releaseUs(const Task &t) const
+{
+  if (t.triggered && (!t.active || (int32_t)(t.triggeredUs - t.dueUs) < 0))
+  {
+    return t.triggeredUs;
+  }
+  return t.dueUs;
+}
+
+void Scheduler::run()
+{
+  uint32_t ran = 0;
+  for (;;)
+  {
+    uint32_t now = clock();
+    Task *next = nullptr;
+    uint32_t nextRelease = 0;
+    for (size_t i = 0; i < used; i++)
+    {
+      Task &t = tasks[i];
+      if ((!t.active && !t.triggered) || (ran & (1 << i)))
+      {
+        continue;
+      }
+      uint32_t release = releaseUs(t);
+      if ((int32_t)(now - release) < 0)
+      {
+        continue;
+      }
+      if (!next || t.priority > next->priority ||
+          (t.priority == next->priority && (int32_t)(release - nextRelease) < 0))
+      {
+        next = &t;
+        nextRelease = release;
+      }
+    }
+    if (!next)
+    {
+      return;
+    }
+    ran |= 1 << (next - tasks);
+
+    // A trigger is consumed by the run, and so is a release that has come
+    Task &t = *next;
+    uint32_t late = now - nextRelease;
+    t.triggered = false;
+    if (t.active && (int32_t)(now - t.dueUs) >= 0)
+    {
+      if (t.periodUs == 0)
+      {
+        t.active = false;
+      }
+      else
+      {
+        uint32_t missed = (now - t.dueUs) / t.periodUs;
+        t.skipped += missed;
+        t.dueUs += (missed + 1) * t.periodUs;
+      }
+    }
+
+    t.fn();
+
+    uint32_t runUs = clock() - now;
+    t.runs++;
+    t.lateSumUs += late;
+    if (late > t.maxLateUs)
+    {
+      t.maxLateUs = late;
+    }
+    if (runUs > t.maxRunUs)
+    {
+      t.maxRunUs = runUs;
+    }
+    if (t.deadlineUs != 0 && late + runUs > t.deadlineUs)
+    {
+      t.overruns++;
+    }
+  }
+}
+
+uint32_t Scheduler::untilNextUs() const
+{
+  uint32_t now = clock();
+  uint32_t best = UINT32_MAX;
+  for (size_t i = 0; i < used; i++)
+  {
+    const Task &t = tasks[i];
+    if (!t.active && !t.triggered)
+    {
+      continue;
+    }
+    int32_t wait = (int32_t)(releaseUs(t) - now);
+    if (wait <= 0)
+    {
+      return 0;
+    }
+    if ((uint32_t)wait < best)
+    {
+      best = (uint32_t)wait;
+    }
+  }
+  return best;
+}
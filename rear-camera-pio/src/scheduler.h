@@ -0,0 +1,90 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+// Cooperative scheduler for loop(): periodic and one-shot tasks, run in
+// priority order when due, with the time to the next one so loop() can
+// sleep in between. Kept free of Arduino includes, the clock is passed in.
+//
+// Times are 32 bit microseconds and compared by difference, so micros()
+// wrapping every 71 minutes doesn't matter. Periodic tasks keep their phase:
+// the next release is a period after the last one was due, not after it
+// ran, and releases missed entirely are counted and skipped rather than run
+// back to back.
+//
+// Every task counts its runs, how late each started, how long the worst one
+// took and how often it finished after its deadline. The counters are single
+// 32 bit words, safe to read from another task for metrics.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Scheduler
+{
+public:
+    static const size_t MAX_TASKS = 8;
+
+    typedef void (*TaskFn)();
+    typedef uint32_t (*ClockFn)();
+
+    struct Task
+    {
+        const char *name;
+        TaskFn fn;
+        // 0 for a one-shot
+        uint32_t periodUs;
+        // From release to the end of the run, 0 for none
+        uint32_t deadlineUs;
+        // Higher runs first when several are due
+        uint8_t priority;
+        bool active;
+        // Run as soon as possible, see trigger()
+        bool triggered;
+        uint32_t dueUs;
+        uint32_t triggeredUs;
+
+        uint32_t runs;
+        // Finished after the deadline
+        uint32_t overruns;
+        // Releases that were missed because the previous one ran too late
+        uint32_t skipped;
+        uint32_t maxRunUs;
+        uint32_t maxLateUs;
+        // Wraps, a counter for rates
+        uint32_t lateSumUs;
+    };
+
+    explicit Scheduler(ClockFn clock) : clock(clock) {}
+
+    // A task due now and every periodUs after, deadline 0 for the period.
+    // Returns its id, -1 if the table is full.
+    int every(const char *name, TaskFn fn, uint32_t periodUs, uint8_t priority, uint32_t deadlineUs = 0);
+    // A task run once delayUs from now, and again if it is rearmed with at()
+    int once(const char *name, TaskFn fn, uint32_t delayUs, uint8_t priority, uint32_t deadlineUs = 0);
+    // Makes a task due at dueUs, reactivating a one-shot that already ran
+    void at(int id, uint32_t dueUs);
+    // Runs a task on the next run() without moving its periodic releases,
+    // e.g. when a command arrives for it. Safe from the loop task only.
+    void trigger(int id);
+    void cancel(int id);
+
+    // Runs every task that is due, highest priority first and each at most
+    // once, so a task that can't keep up doesn't starve the rest
+    void run();
+    // Microseconds until the next task is due, 0 if one is, UINT32_MAX if
+    // nothing is scheduled
+    uint32_t untilNextUs() const;
+
+    size_t count() const { return used; }
+    const Task &task(size_t i) const { return tasks[i]; }
+
+private:
+    ClockFn clock;
+    Task tasks[MAX_TASKS] = {};
+    size_t used = 0;
+
+    int add(const char *name, TaskFn fn, uint32_t periodUs, uint32_t firstUs, uint8_t priority, uint32_t deadlineUs);
+    // When a task should run, its trigger if that is earlier than its release
+    uint32_t releaseUs(const Task &t) const;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,112 @@
+#include <servoGroup.h>
+
+void ServoGroup::init(size_t axes, const uint8_t *positions)
+{
+  count = axes < MAX_AXES ? axes : MAX_AXES;
+  for (size_t i = 0; i < count; i++)
+  {
+    uint8_t p = positions[i] > MAX_POS ? MAX_POS : positions[i];
+    pos[i] = p;
+    start[i] = p;
+    targets[i] = p;
+  }
+  moving = false;
+}
+
+void ServoGroup::moveTo(const uint8_t *newTargets, uint8_t mask, uint32_t nowMs, uint32_t msPerDegree)
+{
+  msPerDeg = msPerDegree ? msPerDegree : MS_PER_DEGREE;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (mask & (1 << i))
+    {
+      targets[i] = newTargets[i] > MAX_POS ? MAX_POS : newTargets[i];
+    }
+  }
+  plan(nowMs);
+}
+
+void ServoGroup::stop(uint32_t nowMs)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    targets[i] = pos[i];
+  }
+  plan(nowMs);
+}
+
+void ServoGroup::plan(uint32_t nowMs)
+{
+  uint8_t furthest = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    start[i] = pos[i];
+    uint8_t dist = targets[i] > pos[i] ? targets[i] - pos[i] : pos[i] - targets[i];
+    furthest = dist > furthest ? dist : furthest;
+  }
+
+  moving = furthest != 0;
+  if (!moving)
+  {
+    return;
+  }
+
+  duration = furthest * msPerDeg;
+  for (size_t i = 0; i < count; i++)
+  {
+    uint32_t dist = targets[i] > start[i] ? targets[i] - start[i] : start[i] - targets[i];
+    // Rounded up, so the furthest axis makes its step on every tick
+    rateQ24[i] = ((dist << 24) + duration - 1) / duration;
+  }
+  startMs = nowMs;
+  nextTickMs = nowMs;
+}
+
+uint8_t ServoGroup::tick(uint32_t nowMs)
+{
+  if (!moving || (int32_t)(nowMs - nextTickMs) < 0)
+  {
+    return 0;
+  }
+  nextTickMs += TICK_MS;
+  if ((int32_t)(nowMs - nextTickMs) >= 0)
+  {
+    // Fell behind, don't try to catch up with a burst of ticks
+    nextTickMs = nowMs + TICK_MS;
+  }
+
+  // One tick ahead, so a move writes its first step on the tick that starts
+  // it rather than 10 ms later
+  uint32_t elapsed = nowMs - startMs + TICK_MS;
+  uint8_t changed = 0;
+
+  if (elapsed >= duration)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      if (pos[i] != targets[i])
+      {
+        pos[i] = targets[i];
+        changed |= 1 << i;
+      }
+    }
+    moving = false;
+    return changed;
+  }
+
+  for (size_t i = 0; i < count; i++)
+  {
+    // Rounded down, so every axis takes its last step at the end of the
+    // move rather than halfway through a short one. Fits in 32 bits, the
+    // product is at most the distance, 180 << 24, plus elapsed for the
+    // rounding up of the rate.
+    uint8_t offset = (uint8_t)((rateQ24[i] * elapsed) >> 24);
+    uint8_t p = targets[i] >= start[i] ? start[i] + offset : start[i] - offset;
+    if (p != pos[i])
+    {
+      pos[i] = p;
+      changed |= 1 << i;
+    }
+  }
+  return changed;
+}
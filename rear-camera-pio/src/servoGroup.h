@@ -0,0 +1,63 @@
+#ifndef SERVOGROUP_H
+#define SERVOGROUP_H
+
+// Motion planning for a group of servo axes, e.g. pan and tilt or two
+// cameras. Kept free of Arduino includes so the host tools can benchmark it.
+//
+// A move takes every axis from where it is to its target in straight lines
+// that start and finish together: the axis with the furthest to go runs at
+// the slew rate, the others are slowed down to match. Each tick computes
+// every axis from the time since the move started, so a late tick never
+// puts the axes out of step.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class ServoGroup
+{
+public:
+    // One per ESP32PWM timer
+    static const size_t MAX_AXES = 4;
+    static const uint8_t MAX_POS = 180;
+    // Usual slew rate of the fastest axis, one degree per this many ms
+    static const uint32_t MS_PER_DEGREE = 10;
+    // Control tick, every axis is updated on each
+    static const uint32_t TICK_MS = 10;
+
+    void init(size_t axes, const uint8_t *positions);
+
+    // New targets for the axes in mask, the rest keep theirs. Every axis
+    // starts over from where it is, so they still arrive together, the
+    // furthest at one degree per msPerDegree.
+    void moveTo(const uint8_t *targets, uint8_t mask, uint32_t nowMs, uint32_t msPerDegree = MS_PER_DEGREE);
+    // Holds every axis where it is
+    void stop(uint32_t nowMs);
+    // Runs a control tick if one is due, returns the axes whose position
+    // changed. Call as often as convenient.
+    uint8_t tick(uint32_t nowMs);
+
+    bool isMoving() const { return moving; }
+    size_t axes() const { return count; }
+    uint8_t position(size_t axis) const { return pos[axis]; }
+    uint8_t target(size_t axis) const { return targets[axis]; }
+    // Length of the current or last move
+    uint32_t durationMs() const { return duration; }
+
+private:
+    size_t count = 0;
+    uint8_t pos[MAX_AXES] = {};
+    uint8_t start[MAX_AXES] = {};
+    uint8_t targets[MAX_AXES] = {};
+    // Degrees per ms in 8.24 fixed point, towards the target
+    uint32_t rateQ24[MAX_AXES] = {};
+    uint32_t msPerDeg = MS_PER_DEGREE;
+
+    bool moving = false;
+    uint32_t startMs = 0;
+    uint32_t duration = 0;
+    uint32_t nextTickMs = 0;
+
+    void plan(uint32_t nowMs);
+};
+
+#endif // SERVOGROUP_H
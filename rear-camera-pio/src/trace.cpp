@@ -0,0 +1,16 @@
+#include <trace.h>
+
+TraceRing trace;
+uint32_t traceEventCycles = 0;
+
+void traceMeasure()
+{
+  const int SPANS = 500;
+  uint32_t start = ESP.getCycleCount();
+  for (int i = 0; i < SPANS; i++)
+  {
+    TraceSpan span("trace self test");
+  }
+  traceEventCycles = (ESP.getCycleCount() - start) / (2 * SPANS);
+  trace.clear();
+}
@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+#include <traceRing.h>
+
+// Span tracing for finding where a slow move spent its time, cheap enough to
+// leave on (see GET /api/v1/trace and host/trace_bench):
+//
+//   void handleHeartbeat()
+//   {
+//       TRACE_SCOPE("heartbeat");
+//       ...
+//   }
+//
+// TRACE_SCOPE records a begin event now and the matching end when the scope
+// is left, TRACE_INSTANT a single point. Names must be string literals. Build
+// with -D TRACE_ENABLED=0 and the macros compile to nothing.
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+extern TraceRing trace;
+
+// Cycles per event as measured at boot, see traceMeasure()
+extern uint32_t traceEventCycles;
+
+inline void traceEvent(TraceRing::Phase phase, const char *name)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    int id = trace.findTask(task);
+    trace.record(micros(), id >= 0 ? (uint8_t)id : trace.taskId(task, pcTaskGetName(task)), phase, name);
+}
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name) : name(name) { traceEvent(TraceRing::BEGIN, name); }
+    ~TraceSpan() { traceEvent(TraceRing::END, name); }
+
+private:
+    const char *name;
+};
+
+// Times a burst of events and clears the ring again, call from setup()
+// before anything else traces
+void traceMeasure();
+
+#if TRACE_ENABLED
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_INSTANT(name) traceEvent(TraceRing::INSTANT, name)
+#else
+#define TRACE_SCOPE(name) \
+    do                    \
+    {                     \
+    } while (0)
+#define TRACE_INSTANT(name) \
+    do                      \
+    {                       \
+    } while (0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,146 @@
+#include <traceRing.h>
+#include <stdio.h>
+#include <string.h>
+
+void TraceRing::record(uint32_t us, uint8_t task, Phase phase, const char *name)
+{
+  uint32_t index = head.fetch_add(1, std::memory_order_relaxed);
+  Event &e = events[index % EVENTS];
+  // Readers that catch the slot from here on see it as not written
+  e.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  e.r.us = us;
+  e.r.name = name;
+  e.r.phase = phase;
+  e.r.task = task;
+  e.seq.store(index + 1, std::memory_order_release);
+}
+
+int TraceRing::findTask(const void *handle) const
+{
+  for (size_t i = 0; i < MAX_TASKS; i++)
+  {
+    const void *h = taskHandles[i].load(std::memory_order_acquire);
+    if (h == handle)
+    {
+      return (int)i;
+    }
+    if (!h)
+    {
+      break;
+    }
+  }
+  return -1;
+}
+
+uint8_t TraceRing::taskId(const void *handle, const char *name)
+{
+  for (size_t i = 0; i < MAX_TASKS; i++)
+  {
+    const void *h = taskHandles[i].load(std::memory_order_acquire);
+    if (!h && taskHandles[i].compare_exchange_strong(h, handle, std::memory_order_acq_rel))
+    {
+      // A dump in between prints the task without its name
+      taskNames[i] = name;
+      return (uint8_t)i;
+    }
+    if (h == handle)
+    {
+      return (uint8_t)i;
+    }
+  }
+  return OTHER_TASK;
+}
+
+bool TraceRing::copy(uint32_t index, Record &out) const
+{
+  const Event &e = events[index % EVENTS];
+  if (e.seq.load(std::memory_order_acquire) != index + 1)
+  {
+    return false;
+  }
+  out = e.r;
+  // A writer that claimed the slot meanwhile has cleared seq
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return e.seq.load(std::memory_order_relaxed) == index + 1;
+}
+
+TraceRing::Cursor TraceRing::snapshot() const
+{
+  uint32_t end = head.load(std::memory_order_acquire);
+  Cursor c;
+  c.next = end > EVENTS ? end - EVENTS : 0;
+  c.end = end;
+  c.header = 0;
+  return c;
+}
+
+size_t TraceRing::read(Cursor &cursor, char *buf, size_t len) const
+{
+  size_t used = 0;
+  char line[80];
+
+  // Header, then every task registered so far
+  while (cursor.header <= MAX_TASKS)
+  {
+    int n;
+    if (cursor.header == 0)
+    {
+      n = snprintf(line, sizeof(line), "trace 1 %lu\n", (unsigned long)cursor.next);
+    }
+    else
+    {
+      size_t i = cursor.header - 1;
+      const void *h = taskHandles[i].load(std::memory_order_acquire);
+      if (!h)
+      {
+        cursor.header = MAX_TASKS + 1;
+        break;
+      }
+      const char *name = taskNames[i];
+      n = snprintf(line, sizeof(line), "task %u %s\n", (unsigned)i, name ? name : "?");
+    }
+    if (n < 0 || (size_t)n >= sizeof(line) || used + n > len)
+    {
+      return used;
+    }
+    memcpy(buf + used, line, n);
+    used += n;
+    cursor.header++;
+  }
+
+  // Events, skipping the ones overwritten since the snapshot
+  while ((int32_t)(cursor.end - cursor.next) > 0)
+  {
+    Record r;
+    if (!copy(cursor.next, r))
+    {
+      cursor.next++;
+      continue;
+    }
+    int n = snprintf(line, sizeof(line), "%lu %u %c %s\n", (unsigned long)r.us, (unsigned)r.task, (char)r.phase,
+                     r.name);
+    if (n < 0 || (size_t)n >= sizeof(line))
+    {
+      cursor.next++;
+      continue;
+    }
+    if (used + n > len)
+    {
+      return used;
+    }
+    memcpy(buf + used, line, n);
+    used += n;
+    cursor.next++;
+  }
+  return used;
+}
+
+void TraceRing::clear()
+{
+  for (size_t i = 0; i < EVENTS; i++)
+  {
+    events[i].seq.store(0, std::memory_order_relaxed);
+  }
+  head.store(0, std::memory_order_release);
+}
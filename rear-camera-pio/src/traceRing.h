@@ -0,0 +1,99 @@
+#ifndef TRACERING_H
+#define TRACERING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed ring of begin / end events for span tracing, written from any task
+// without a lock and read out as text while writers carry on. Kept free of
+// Arduino includes so the host can benchmark it, trace.h adds the clock,
+// the task ids and the macros.
+//
+// A writer claims the next slot with one atomic add and marks it with its
+// sequence number once the event is complete, so a reader skips slots that
+// are being written or were overwritten while it was reading. The oldest
+// events are overwritten once the ring is full.
+//
+// Dump format, one line each:
+//   trace 1 <number of the first event, the ones before were overwritten>
+//   task <id> <name>
+//   <us> <task id> <B|E|i> <name>
+// Timestamps are micros() and wrap, host/trace_json turns a dump into a
+// Chrome / Perfetto trace.
+
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS 2048
+#endif
+
+class TraceRing
+{
+public:
+    static const size_t EVENTS = TRACE_EVENTS;
+    static const size_t MAX_TASKS = 12;
+    // Task id of tasks beyond MAX_TASKS
+    static const uint8_t OTHER_TASK = 0xFF;
+
+    enum Phase : uint8_t
+    {
+        BEGIN = 'B',
+        END = 'E',
+        INSTANT = 'i',
+    };
+
+    struct Cursor
+    {
+        uint32_t next;
+        uint32_t end;
+        // Header lines written so far
+        uint8_t header;
+    };
+
+    // name must outlive the ring, a string literal
+    void record(uint32_t us, uint8_t task, Phase phase, const char *name);
+
+    // Small id of a task handle, registering it on first sight. name is only
+    // read then and must stay valid.
+    uint8_t taskId(const void *handle, const char *name);
+    // -1 if the handle isn't registered yet
+    int findTask(const void *handle) const;
+
+    // Starts a dump of what the ring holds now
+    Cursor snapshot() const;
+    // Writes whole lines from the cursor into buf, returns the length. Lines
+    // never span calls, so it is 0 when the next line doesn't fit as well
+    // as once the dump is complete.
+    size_t read(Cursor &cursor, char *buf, size_t len) const;
+    bool done(const Cursor &cursor) const { return cursor.header > MAX_TASKS && cursor.next == cursor.end; }
+
+    // Drops every event, only while nothing is recording
+    void clear();
+
+    uint32_t recorded() const { return head.load(std::memory_order_relaxed); }
+
+private:
+    struct Record
+    {
+        uint32_t us;
+        const char *name;
+        Phase phase;
+        uint8_t task;
+    };
+
+    struct Event
+    {
+        // Claim index + 1 once written, 0 while being written
+        std::atomic<uint32_t> seq;
+        Record r;
+    };
+
+    Event events[EVENTS] = {};
+    std::atomic<uint32_t> head{0};
+    std::atomic<const void *> taskHandles[MAX_TASKS] = {};
+    const char *taskNames[MAX_TASKS] = {};
+
+    // False if the event was overwritten or is being written
+    bool copy(uint32_t index, Record &out) const;
+};
+
+#endif // TRACERING_H
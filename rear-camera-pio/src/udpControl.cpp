@@ -0,0 +1,142 @@
+#include <udpControl.h>
+#include <udpProtocol.h>
+#include <trace.h>
+#include <allocStats.h>
+
+// Replies go out as lwIP buffers, which are allocated
+static AllocRegion allocUdp("udp");
+
+void UdpControl::init(uint16_t port, MotionQueue &motionQueue, CameraServo &cameraServo, PresetTable &presetTable)
+{
+  motion = &motionQueue;
+  servo = &cameraServo;
+  presets = &presetTable;
+
+  if (!udp.listen(port))
+  {
+    Serial.println("Failed to open UDP control port");
+    return;
+  }
+  udp.onPacket([this](AsyncUDPPacket &packet)
+               { onPacket(packet); });
+}
+
+// Runs on the AsyncUDP task
+void UdpControl::onPacket(AsyncUDPPacket &packet)
+{
+  TRACE_SCOPE("udp");
+  AllocScope scope(allocUdp);
+  uint32_t startCycles = ESP.getCycleCount();
+  uint32_t receivedUs = micros();
+
+  UdpMoveAxes frame;
+  UdpCommand &cmd = frame.cmd;
+  if (packet.length() != sizeof(UdpCommand) && packet.length() != sizeof(UdpMoveAxes))
+  {
+    return;
+  }
+  memcpy(&frame, packet.data(), packet.length());
+  if (cmd.magic != UDP_MAGIC || (packet.length() == sizeof(UdpMoveAxes)) != (cmd.op == UDP_MOVE_AXES))
+  {
+    return;
+  }
+
+  UdpStatus status = UDP_OK;
+  uint32_t sender = (uint32_t)packet.remoteIP() ^ ((uint32_t)packet.remotePort() << 16);
+
+  if (cmd.op != UDP_QUERY)
+  {
+    // Datagrams can arrive out of order, never let an old one win
+    if (hasSeq && sender == lastSender && (int16_t)(cmd.seq - lastSeq) <= 0)
+    {
+      status = UDP_STALE;
+    }
+    else
+    {
+      MotionCommand mc = {};
+      mc.source = MotionSource::Udp;
+      mc.seq = cmd.seq;
+      mc.receivedUs = receivedUs;
+
+      switch (cmd.op)
+      {
+      case UDP_MOVE_TO:
+        mc.op = MotionOp::MoveTo;
+        mc.pos[0] = cmd.arg;
+        mc.mask = 1;
+        status = cmd.arg <= 180 ? UDP_OK : UDP_BAD_ARG;
+        break;
+      case UDP_MOVE_AXES:
+        mc.op = MotionOp::MoveTo;
+        mc.mask = cmd.arg;
+        if (cmd.arg == 0 || cmd.arg >> servo->getAxes())
+        {
+          status = UDP_BAD_ARG;
+        }
+        for (size_t i = 0; i < servo->getAxes(); i++)
+        {
+          mc.pos[i] = frame.pos[i];
+          if ((cmd.arg & (1 << i)) && frame.pos[i] > 180)
+          {
+            status = UDP_BAD_ARG;
+          }
+        }
+        break;
+      case UDP_STOP:
+        mc.op = MotionOp::Stop;
+        break;
+      case UDP_PRESET:
+      {
+        mc.op = MotionOp::MoveTo;
+        PresetTable::Preset preset;
+        if (presets->get(cmd.arg, preset))
+        {
+          memcpy(mc.pos, preset.pos, sizeof(mc.pos));
+          mc.mask = preset.mask;
+          mc.msPerDegree = preset.msPerDegree;
+        }
+        else
+        {
+          status = UDP_BAD_ARG;
+        }
+        break;
+      }
+      default:
+        status = UDP_BAD_FRAME;
+        break;
+      }
+
+      if (status == UDP_OK)
+      {
+        if (motion->push(mc))
+        {
+          hasSeq = true;
+          lastSender = sender;
+          lastSeq = cmd.seq;
+        }
+        else
+        {
+          status = UDP_QUEUE_FULL;
+        }
+      }
+    }
+
+    if (!(cmd.flags & UDP_FLAG_ACK))
+    {
+      return;
+    }
+  }
+
+  UdpReply reply;
+  reply.magic = UDP_MAGIC;
+  reply.op = cmd.op;
+  reply.status = status;
+  reply.pos = servo->getCurrentPosition();
+  reply.seq = cmd.seq;
+  reply.target = servo->getTarget();
+  reply.moving = servo->isMoving() ? 1 : 0;
+  reply.loopRate = loopRate;
+  reply.idlePermille = idlePermille;
+  reply.handlerCycles = ESP.getCycleCount() - startCycles;
+  packet.write((uint8_t *)&reply, sizeof(reply));
+}
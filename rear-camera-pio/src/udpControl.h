@@ -0,0 +1,40 @@
+#ifndef UDPCONTROL_H
+#define UDPCONTROL_H
+
+#include <Arduino.h>
+#include <AsyncUDP.h>
+
+#include <cameraServo.h>
+#include <motionQueue.h>
+#include <presetTable.h>
+
+// Low latency control over UDP. Commands go on the same motion queue as the
+// HTTP API, with an optional ack datagram once they are queued.
+class UdpControl
+{
+public:
+    void init(uint16_t port, MotionQueue &motionQueue, CameraServo &servo, PresetTable &presetTable);
+    // loop() wakeups and idle time per second, reported in replies
+    void setLoad(uint32_t rate, uint16_t idle)
+    {
+        loopRate = rate;
+        idlePermille = idle;
+    }
+
+private:
+    AsyncUDP udp;
+    MotionQueue *motion = nullptr;
+    CameraServo *servo = nullptr;
+    PresetTable *presets = nullptr;
+    uint32_t loopRate = 0;
+    uint16_t idlePermille = 0;
+
+    // Last accepted sequence number and who sent it
+    uint32_t lastSender = 0;
+    uint16_t lastSeq = 0;
+    bool hasSeq = false;
+
+    void onPacket(AsyncUDPPacket &packet);
+};
+
+#endif // UDPCONTROL_H
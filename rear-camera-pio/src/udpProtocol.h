@@ -0,0 +1,77 @@
+#ifndef UDPPROTOCOL_H
+#define UDPPROTOCOL_H
+
+// Packed command frames for the UDP control port. Kept free of Arduino
+// includes so the host tools can share it. All fields are little endian.
+
+#include <stdint.h>
+
+#define UDP_CONTROL_PORT 8090
+#define UDP_MAGIC 0xCA
+// Axes a UdpMoveAxes frame carries, whether or not the camera has them all
+#define UDP_MAX_AXES 4
+
+enum UdpOp : uint8_t
+{
+    UDP_MOVE_TO = 1, // arg = position
+    UDP_STOP = 2,
+    UDP_PRESET = 3, // arg = preset slot
+    UDP_QUERY = 4,  // always answered
+    // UdpMoveAxes frame, arg = mask of the axes to move
+    UDP_MOVE_AXES = 5,
+};
+
+enum UdpFlags : uint8_t
+{
+    // Answer with a UdpReply once the command is queued
+    UDP_FLAG_ACK = 0x01,
+};
+
+enum UdpStatus : uint8_t
+{
+    UDP_OK = 0,
+    UDP_BAD_FRAME = 1,
+    UDP_BAD_ARG = 2,
+    UDP_QUEUE_FULL = 3,
+    // Sequence number older than one already accepted from this sender
+    UDP_STALE = 4,
+};
+
+struct __attribute__((packed)) UdpCommand
+{
+    uint8_t magic;
+    uint8_t op;
+    uint8_t flags;
+    uint8_t arg;
+    uint16_t seq;
+};
+
+// Moves several axes at once, they arrive together. Positions for axes
+// outside the mask are ignored.
+struct __attribute__((packed)) UdpMoveAxes
+{
+    UdpCommand cmd;
+    uint8_t pos[UDP_MAX_AXES];
+};
+
+// State of axis 0
+struct __attribute__((packed)) UdpReply
+{
+    uint8_t magic;
+    uint8_t op;
+    uint8_t status;
+    uint8_t pos;
+    uint16_t seq;
+    uint8_t target;
+    uint8_t moving;
+    // CPU cycles the camera spent handling this command
+    uint32_t handlerCycles;
+    // loop() wakeups in the last second: servo ticks, other loop() tasks and
+    // commands arriving in between
+    uint32_t loopRate;
+    // Per mille of the last second the CPU spent in the idle task, drops by
+    // what every task together spent on the commands, network stack included
+    uint16_t idlePermille;
+};
+
+#endif // UDPPROTOCOL_H
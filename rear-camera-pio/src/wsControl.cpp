@@ -0,0 +1,435 @@
+#include <wsControl.h>
+#include <wsProtocol.h>
+#include <metrics.h>
+#include <trace.h>
+#include <allocStats.h>
+
+static_assert(ServoGroup::MAX_AXES == WS_MAX_AXES, "WsAxesSetpoint must carry every axis");
+
+// Every message sent allocates its buffer in AsyncWebSocket
+static AllocRegion allocWs("ws");
+
+// Finds the value of a one letter key in a tiny JSON object, e.g. key 'p'
+// in {"s":12,"p":45}. Good enough for the frames we accept.
+static bool jsonFind(const uint8_t *data, size_t len, char key, size_t &at)
+{
+  for (size_t i = 0; i + 3 < len; i++)
+  {
+    if (data[i] != '"' || data[i + 1] != key || data[i + 2] != '"')
+    {
+      continue;
+    }
+
+    at = i + 3;
+    while (at < len && (data[at] == ' ' || data[at] == ':'))
+    {
+      at++;
+    }
+    return true;
+  }
+  return false;
+}
+
+// Parses an integer at data[j], leaves j after it
+static bool jsonParseInt(const uint8_t *data, size_t len, size_t &j, long &out)
+{
+  bool negative = false;
+  if (j < len && data[j] == '-')
+  {
+    negative = true;
+    j++;
+  }
+  if (j >= len || data[j] < '0' || data[j] > '9')
+  {
+    return false;
+  }
+
+  long value = 0;
+  while (j < len && data[j] >= '0' && data[j] <= '9')
+  {
+    value = value * 10 + (data[j] - '0');
+    j++;
+  }
+  out = negative ? -value : value;
+  return true;
+}
+
+static bool jsonInt(const uint8_t *data, size_t len, char key, long &out)
+{
+  size_t j;
+  return jsonFind(data, len, key, j) && jsonParseInt(data, len, j, out);
+}
+
+// An integer or an array of them, e.g. "p":[45,90]. Returns how many were
+// read, 0 if the value is malformed or has more than max.
+static size_t jsonInts(const uint8_t *data, size_t len, char key, long *out, size_t max)
+{
+  size_t j;
+  if (!jsonFind(data, len, key, j))
+  {
+    return 0;
+  }
+  if (j >= len || data[j] != '[')
+  {
+    return jsonParseInt(data, len, j, out[0]) ? 1 : 0;
+  }
+
+  size_t n = 0;
+  j++;
+  while (true)
+  {
+    while (j < len && data[j] == ' ')
+    {
+      j++;
+    }
+    if (n == max || !jsonParseInt(data, len, j, out[n]))
+    {
+      return 0;
+    }
+    n++;
+    while (j < len && data[j] == ' ')
+    {
+      j++;
+    }
+    if (j < len && data[j] == ']')
+    {
+      return n;
+    }
+    if (j >= len || data[j] != ',')
+    {
+      return 0;
+    }
+    j++;
+  }
+}
+
+void WsControl::init(AsyncWebServer &server, MotionQueue &motionQueue, size_t servoAxes)
+{
+  motion = &motionQueue;
+  axes = servoAxes;
+
+  ws.onEvent([this](AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
+             { onEvent(client, type, arg, data, len); });
+  server.addHandler(&ws);
+}
+
+WsControl::Client *WsControl::findClient(uint32_t id)
+{
+  for (size_t i = 0; i < MAX_CLIENTS; i++)
+  {
+    if (clients[i].inUse && clients[i].id == id)
+    {
+      return &clients[i];
+    }
+  }
+  return nullptr;
+}
+
+// Runs on the AsyncTCP task
+void WsControl::onEvent(AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len)
+{
+  switch (type)
+  {
+  case WS_EVT_CONNECT:
+  {
+    Client *slot = nullptr;
+    portENTER_CRITICAL(&mux);
+    for (size_t i = 0; i < MAX_CLIENTS; i++)
+    {
+      if (!clients[i].inUse)
+      {
+        slot = &clients[i];
+        *slot = {};
+        slot->id = client->id();
+        slot->lastPushedPos = -1;
+        slot->inUse = true;
+        break;
+      }
+    }
+    portEXIT_CRITICAL(&mux);
+
+    if (!slot)
+    {
+      Serial.println("WS client rejected, too many clients");
+      client->close(1013);
+      return;
+    }
+    Serial.printf("WS client %u connected\n", client->id());
+    break;
+  }
+  case WS_EVT_DISCONNECT:
+  {
+    portENTER_CRITICAL(&mux);
+    Client *c = findClient(client->id());
+    if (c)
+    {
+      c->inUse = false;
+    }
+    portEXIT_CRITICAL(&mux);
+    Serial.printf("WS client %u disconnected\n", client->id());
+    break;
+  }
+  case WS_EVT_DATA:
+    onData(client, (AwsFrameInfo *)arg, data, len);
+    break;
+  default:
+    break;
+  }
+}
+
+void WsControl::onData(AsyncWebSocketClient *client, AwsFrameInfo *info, uint8_t *data, size_t len)
+{
+  TRACE_SCOPE("ws setpoint");
+  AllocScope scope(allocWs);
+  uint32_t receivedUs = micros();
+
+  // Setpoints are tiny, anything fragmented isn't one of ours
+  if (!info->final || info->index != 0 || info->len != len)
+  {
+    return;
+  }
+
+  uint16_t seq;
+  uint8_t pos[ServoGroup::MAX_AXES] = {};
+  uint8_t mask;
+  bool json = info->opcode == WS_TEXT;
+  if (json)
+  {
+    long s;
+    long values[ServoGroup::MAX_AXES];
+    size_t n;
+    if (!jsonInt(data, len, 's', s) || (n = jsonInts(data, len, 'p', values, ServoGroup::MAX_AXES)) == 0)
+    {
+      return;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+      if (values[i] < 0 || values[i] > 180)
+      {
+        return;
+      }
+      pos[i] = (uint8_t)values[i];
+    }
+    seq = (uint16_t)s;
+    mask = (1 << n) - 1;
+  }
+  else if (len == sizeof(WsSetpoint) && data[0] == WS_SETPOINT)
+  {
+    WsSetpoint sp;
+    memcpy(&sp, data, sizeof(sp));
+    seq = sp.seq;
+    pos[0] = sp.pos;
+    mask = 1;
+  }
+  else if (len == sizeof(WsAxesSetpoint) && data[0] == WS_AXES_SETPOINT)
+  {
+    WsAxesSetpoint sp;
+    memcpy(&sp, data, sizeof(sp));
+    seq = sp.seq;
+    memcpy(pos, sp.pos, sizeof(pos));
+    mask = sp.mask;
+  }
+  else
+  {
+    return;
+  }
+
+  if (mask == 0 || mask >> axes)
+  {
+    return;
+  }
+  for (size_t i = 0; i < axes; i++)
+  {
+    if ((mask & (1 << i)) && pos[i] > 180)
+    {
+      return;
+    }
+  }
+
+  portENTER_CRITICAL(&mux);
+  Client *c = findClient(client->id());
+  if (c)
+  {
+    c->json = json;
+    enqueue(*c, seq, pos, mask, receivedUs);
+  }
+  portEXIT_CRITICAL(&mux);
+  if (c)
+  {
+    motion->wake();
+  }
+}
+
+// Must be called with the mux held
+void WsControl::enqueue(Client &c, uint16_t seq, const uint8_t *pos, uint8_t mask, uint32_t receivedUs)
+{
+  // Anything not newer than what we already have is stale
+  if (c.hasSeq && !wsSeqNewer(seq, c.lastSeq))
+  {
+    metrics.wsStaleDropped.inc();
+    return;
+  }
+  c.hasSeq = true;
+  c.lastSeq = seq;
+
+  // Full queue, the oldest setpoint is the least useful one
+  if (c.count == QUEUE_DEPTH)
+  {
+    c.head = (c.head + 1) % QUEUE_DEPTH;
+    c.count--;
+    metrics.wsOverflowDropped.inc();
+  }
+
+  Setpoint &sp = c.queue[(c.head + c.count) % QUEUE_DEPTH];
+  sp.seq = seq;
+  sp.mask = mask;
+  memcpy(sp.pos, pos, sizeof(sp.pos));
+  sp.receivedUs = receivedUs;
+  c.count++;
+}
+
+void WsControl::update(CameraServo &servo)
+{
+  AllocScope scope(allocWs);
+  uint32_t now = micros();
+
+  for (size_t i = 0; i < MAX_CLIENTS; i++)
+  {
+    Client &c = clients[i];
+    bool found = false;
+    uint32_t id = 0;
+    bool json = false;
+    Setpoint newest;
+
+    portENTER_CRITICAL(&mux);
+    if (c.inUse && c.count > 0)
+    {
+      // Only the newest setpoint matters, everything before it is stale
+      newest = c.queue[(c.head + c.count - 1) % QUEUE_DEPTH];
+      metrics.wsStaleDropped.inc(c.count - 1);
+      c.head = 0;
+      c.count = 0;
+      id = c.id;
+      json = c.json;
+      found = true;
+    }
+    portEXIT_CRITICAL(&mux);
+
+    if (found)
+    {
+      if (now - newest.receivedUs > MAX_SETPOINT_AGE_US)
+      {
+        metrics.wsStaleDropped.inc();
+      }
+      else
+      {
+        MotionCommand cmd = {};
+        cmd.source = MotionSource::WebSocket;
+        memcpy(cmd.pos, newest.pos, sizeof(cmd.pos));
+        cmd.mask = newest.mask;
+        cmd.clientId = id;
+        cmd.seq = newest.seq;
+        cmd.receivedUs = newest.receivedUs;
+        if (!motion->push(cmd))
+        {
+          reject(id, json, newest.seq, WS_ERR_BUSY);
+        }
+      }
+    }
+
+    push(c, servo);
+  }
+
+  ws.cleanupClients(MAX_CLIENTS);
+}
+
+void WsControl::onApplied(const MotionCommand &cmd, uint32_t latencyUs)
+{
+  portENTER_CRITICAL(&mux);
+  Client *c = findClient(cmd.clientId);
+  if (c)
+  {
+    c->ackSeq = cmd.seq;
+    c->latencyUs = latencyUs;
+    c->dirty = true;
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+void WsControl::push(Client &c, CameraServo &servo)
+{
+  // onEvent() may reset the slot on the AsyncTCP task, so work on a copy
+  portENTER_CRITICAL(&mux);
+  Client snap = c;
+  portEXIT_CRITICAL(&mux);
+  if (!snap.inUse)
+  {
+    return;
+  }
+
+  int pos = servo.getCurrentPosition();
+  if (!snap.dirty && pos == snap.lastPushedPos)
+  {
+    return;
+  }
+
+  unsigned long now = millis();
+  if (now - snap.lastPushMs < PUSH_INTERVAL_MS)
+  {
+    return;
+  }
+
+  // A client that can't keep up just misses updates, the next one carries
+  // the latest state anyway
+  if (!ws.availableForWrite(snap.id))
+  {
+    return;
+  }
+
+  if (snap.json)
+  {
+    char buf[80];
+    int n = snprintf(buf, sizeof(buf), "{\"s\":%u,\"p\":%d,\"t\":%d,\"m\":%d,\"l\":%lu}",
+                     snap.ackSeq, pos, servo.getTarget(), servo.isMoving() ? 1 : 0, (unsigned long)snap.latencyUs);
+    ws.text(snap.id, buf, n);
+  }
+  else
+  {
+    WsPosition msg;
+    msg.type = WS_POSITION;
+    msg.ackSeq = snap.ackSeq;
+    msg.pos = pos;
+    msg.target = servo.getTarget();
+    msg.moving = servo.isMoving() ? 1 : 0;
+    msg.latencyUs = snap.latencyUs;
+    ws.binary(snap.id, (uint8_t *)&msg, sizeof(msg));
+  }
+
+  portENTER_CRITICAL(&mux);
+  if (c.inUse && c.id == snap.id)
+  {
+    c.dirty = false;
+    c.lastPushedPos = pos;
+    c.lastPushMs = now;
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+// Tells a client its setpoint was dropped rather than leaving it unanswered
+void WsControl::reject(uint32_t id, bool json, uint16_t seq, uint8_t code)
+{
+  if (json)
+  {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "{\"s\":%u,\"e\":%u}", seq, code);
+    ws.text(id, buf, n);
+  }
+  else
+  {
+    WsError msg;
+    msg.type = WS_ERROR;
+    msg.seq = seq;
+    msg.code = code;
+    ws.binary(id, (uint8_t *)&msg, sizeof(msg));
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef WSCONTROL_H
+#define WSCONTROL_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include <cameraServo.h>
+#include <motionQueue.h>
+
+// Persistent /ws control channel for joystick style aiming. Clients stream
+// setpoints over one connection and get position updates pushed back.
+//
+// Every client has a small bounded queue. Setpoints are only ever superseded,
+// so loop() forwards the newest one and drops the rest as stale.
+class WsControl
+{
+public:
+    static const size_t MAX_CLIENTS = 4;
+    static const size_t QUEUE_DEPTH = 4;
+    // Setpoints older than this when loop() gets to them are dropped
+    static const uint32_t MAX_SETPOINT_AGE_US = 100000;
+    // Minimum spacing of position updates to a single client
+    static const unsigned long PUSH_INTERVAL_MS = 20;
+
+    WsControl() : ws("/ws") {}
+
+    void init(AsyncWebServer &server, MotionQueue &motionQueue, size_t servoAxes);
+    // Called from loop(), forwards setpoints and pushes position updates
+    void update(CameraServo &servo);
+    // Called from loop() once a streamed setpoint has reached the servo
+    void onApplied(const MotionCommand &cmd, uint32_t latencyUs);
+
+private:
+    struct Setpoint
+    {
+        uint16_t seq;
+        uint8_t mask;
+        uint8_t pos[ServoGroup::MAX_AXES];
+        uint32_t receivedUs;
+    };
+
+    struct Client
+    {
+        bool inUse;
+        bool json;
+        uint32_t id;
+
+        // Ring of setpoints waiting for loop()
+        Setpoint queue[QUEUE_DEPTH];
+        uint8_t head;
+        uint8_t count;
+        bool hasSeq;
+        uint16_t lastSeq;
+
+        // State for the next position update
+        bool dirty;
+        uint16_t ackSeq;
+        uint32_t latencyUs;
+        int lastPushedPos;
+        unsigned long lastPushMs;
+    };
+
+    AsyncWebSocket ws;
+    MotionQueue *motion = nullptr;
+    size_t axes = 1;
+    Client clients[MAX_CLIENTS] = {};
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+    void onEvent(AsyncWebSocketClient *client, AwsEventType type, void *arg, uint8_t *data, size_t len);
+    void onData(AsyncWebSocketClient *client, AwsFrameInfo *info, uint8_t *data, size_t len);
+    Client *findClient(uint32_t id);
+    void enqueue(Client &c, uint16_t seq, const uint8_t *pos, uint8_t mask, uint32_t receivedUs);
+    void push(Client &c, CameraServo &servo);
+    void reject(uint32_t id, bool json, uint16_t seq, uint8_t code);
+};
+
+#endif // WSCONTROL_H
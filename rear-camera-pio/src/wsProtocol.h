@@ -0,0 +1,80 @@
+#ifndef WSPROTOCOL_H
+#define WSPROTOCOL_H
+
+// Wire format for the /ws control channel. Kept free of Arduino includes so
+// the host tools can share it.
+//
+// Binary frames are little endian:
+//   setpoint (client -> camera): WsSetpoint, or WsAxesSetpoint for several
+//   axes at once
+//   position (camera -> client): WsPosition
+//   error (camera -> client): WsError, a setpoint that was dropped
+//
+// JSON clients send {"s":<seq>,"p":<pos>}, or {"s":<seq>,"p":[<pos>,...]}
+// for axes 0, 1, ..., and get back
+//   {"s":<ackSeq>,"p":<pos>,"t":<target>,"m":<moving>,"l":<latencyUs>}
+// or for a dropped setpoint
+//   {"s":<seq>,"e":<code>}
+
+#include <stdint.h>
+
+// Axes a WsAxesSetpoint carries, whether or not the camera has them all
+#define WS_MAX_AXES 4
+
+enum WsFrameType : uint8_t
+{
+    WS_SETPOINT = 0x01,
+    WS_AXES_SETPOINT = 0x02,
+    WS_POSITION = 0x81,
+    WS_ERROR = 0x82,
+};
+
+enum WsErrorCode : uint8_t
+{
+    // The motion queue was full, a later setpoint may get through
+    WS_ERR_BUSY = 1,
+};
+
+struct __attribute__((packed)) WsSetpoint
+{
+    uint8_t type; // WS_SETPOINT
+    uint16_t seq;
+    uint8_t pos;
+};
+
+struct __attribute__((packed)) WsAxesSetpoint
+{
+    uint8_t type; // WS_AXES_SETPOINT
+    uint16_t seq;
+    // Axes to move, positions of the others are ignored
+    uint8_t mask;
+    uint8_t pos[WS_MAX_AXES];
+};
+
+// State of axis 0
+struct __attribute__((packed)) WsPosition
+{
+    uint8_t type; // WS_POSITION
+    // Last setpoint from this client that reached the servo
+    uint16_t ackSeq;
+    uint8_t pos;
+    uint8_t target;
+    uint8_t moving;
+    // Setpoint arrival to first servo write for ackSeq, measured on device
+    uint32_t latencyUs;
+};
+
+struct __attribute__((packed)) WsError
+{
+    uint8_t type; // WS_ERROR
+    uint16_t seq;
+    uint8_t code; // WsErrorCode
+};
+
+// Sequence numbers wrap, so compare them the TCP way
+inline bool wsSeqNewer(uint16_t a, uint16_t b)
+{
+    return (int16_t)(a - b) > 0;
+}
+
+#endif // WSPROTOCOL_H
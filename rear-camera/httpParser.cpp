@@ -0,0 +1,153 @@
+#include "httpParser.h"
+#include <string.h>
+
+static const char CONTENT_LENGTH[] = "content-length";
+
+void HttpParser::reset() {
+  used = 0;
+  scan = 0;
+  lineStart = 0;
+  state = RequestLine;
+  error = 0;
+  methodAt = 0;
+  pathAt = 0;
+  bodyAt = 0;
+  bodyLength = 0;
+  buf[0] = '\0';
+}
+
+HttpParser::Result HttpParser::fail(int status) {
+  state = Error;
+  error = status;
+  return Failed;
+}
+
+HttpParser::Result HttpParser::commit(size_t n) {
+  used += n;
+
+  if (state == Done) {
+    return Complete;
+  }
+  if (state == Error) {
+    return Failed;
+  }
+
+  // Request line and headers, one line at a time. Only bytes that haven't
+  // been looked at yet are scanned.
+  while (state == RequestLine || state == Headers) {
+    char *nl = (char *)memchr(buf + scan, '\n', used - scan);
+    if (!nl) {
+      scan = used;
+      if (writeSpace() == 0) {
+        return fail(state == RequestLine ? 414 : 431);
+      }
+      return NeedMore;
+    }
+
+    size_t end = nl - buf;
+    scan = end + 1;
+    if (end > lineStart && buf[end - 1] == '\r') {
+      end--;
+    }
+    buf[end] = '\0';
+
+    if (state == RequestLine) {
+      if (!parseRequestLine(end)) {
+        return fail(400);
+      }
+      state = Headers;
+    } else if (end == lineStart) {
+      // Blank line, headers are done
+      if (bodyLength == 0) {
+        bodyAt = lineStart; // points at the terminator we just wrote
+        state = Done;
+        return Complete;
+      }
+      bodyAt = scan;
+      if (bodyAt + bodyLength > BUFFER_SIZE - 1) {
+        return fail(413);
+      }
+      state = Body;
+    } else {
+      if (!parseHeaderLine(end)) {
+        return fail(400);
+      }
+      // Known to be too big before any of the body has been read
+      if (bodyLength > (long)MAX_BODY) {
+        return fail(413);
+      }
+    }
+    lineStart = scan;
+  }
+
+  if (used - bodyAt < (size_t)bodyLength) {
+    return NeedMore;
+  }
+  buf[bodyAt + bodyLength] = '\0';
+  state = Done;
+  return Complete;
+}
+
+// "POST /api/v1/action/move HTTP/1.1", split in place
+bool HttpParser::parseRequestLine(size_t end) {
+  char *line = buf + lineStart;
+  char *sp1 = (char *)memchr(line, ' ', end - lineStart);
+  if (!sp1 || sp1 == line) {
+    return false;
+  }
+  char *sp2 = (char *)memchr(sp1 + 1, ' ', buf + end - (sp1 + 1));
+  if (!sp2 || sp2 == sp1 + 1 || strncmp(sp2 + 1, "HTTP/", 5) != 0) {
+    return false;
+  }
+
+  *sp1 = '\0';
+  *sp2 = '\0';
+  methodAt = lineStart;
+  pathAt = sp1 + 1 - buf;
+  return true;
+}
+
+// Only Content-Length matters to us, every other header is skipped
+bool HttpParser::parseHeaderLine(size_t end) {
+  char *line = buf + lineStart;
+  char *colon = (char *)memchr(line, ':', end - lineStart);
+  if (!colon) {
+    return false;
+  }
+
+  size_t nameLen = colon - line;
+  if (nameLen != sizeof(CONTENT_LENGTH) - 1) {
+    return true;
+  }
+  for (size_t i = 0; i < nameLen; i++) {
+    if ((line[i] | 0x20) != CONTENT_LENGTH[i]) {
+      return true;
+    }
+  }
+
+  char *p = colon + 1;
+  while (*p == ' ' || *p == '\t') {
+    p++;
+  }
+  if (*p < '0' || *p > '9') {
+    return false;
+  }
+
+  long value = 0;
+  while (*p >= '0' && *p <= '9') {
+    // Anything this long is oversized anyway, stop adding before it can overflow
+    if (value <= (long)BUFFER_SIZE) {
+      value = value * 10 + (*p - '0');
+    }
+    p++;
+  }
+  // Only whitespace may follow the digits (RFC 9110 8.6), "12abc" is not 12
+  while (*p == ' ' || *p == '\t') {
+    p++;
+  }
+  if (*p != '\0') {
+    return false;
+  }
+  bodyLength = value;
+  return true;
+}
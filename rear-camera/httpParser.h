@@ -0,0 +1,69 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Incremental HTTP/1.x request parser over a fixed buffer. No heap.
+//
+// The socket is read straight into the parser's buffer:
+//
+//   size_t n = client.read(parser.writePtr(), parser.writeSpace());
+//   HttpParser::Result r = parser.commit(n);
+//
+// Only the new bytes are scanned on every commit. Method, path and body point
+// into the buffer and stay valid until reset(). Requests that can't fit are
+// rejected as soon as that is known, without reading the rest.
+class HttpParser {
+public:
+  static const size_t BUFFER_SIZE = 1024;
+  static const size_t MAX_BODY = 256;
+
+  enum Result {
+    NeedMore,
+    Complete,
+    Failed,
+  };
+
+  void reset();
+
+  uint8_t *writePtr() { return (uint8_t *)buf + used; }
+  // Leaves room for the terminator written after the body
+  size_t writeSpace() { return BUFFER_SIZE - 1 - used; }
+  Result commit(size_t n);
+
+  const char *method() const { return buf + methodAt; }
+  const char *path() const { return buf + pathAt; }
+  long contentLength() const { return bodyLength; }
+  // Null terminated, empty if there was no body
+  const char *body() const { return buf + bodyAt; }
+  // HTTP status to answer with when commit() returned Failed
+  int errorStatus() const { return error; }
+
+private:
+  enum State {
+    RequestLine,
+    Headers,
+    Body,
+    Done,
+    Error,
+  };
+
+  char buf[BUFFER_SIZE];
+  size_t used;
+  size_t scan;
+  size_t lineStart;
+  State state;
+  int error;
+
+  size_t methodAt;
+  size_t pathAt;
+  size_t bodyAt;
+  long bodyLength;
+
+  Result fail(int status);
+  bool parseRequestLine(size_t end);
+  bool parseHeaderLine(size_t end);
+};
+
+#endif
@@ -1,16 +1,45 @@
 #include <WiFi.h>
-#include <HTTPClient.h>
 #include <Servo.h>
+#include <errno.h>
+#include <lwip/sockets.h>
 #include "secrets.h"
+#include "httpParser.h"
 
 unsigned long heartbeatLastSent = 0;
 const long heartbeatInterval = 5000; // 5 seconds in milliseconds
-const long timeoutTime = 2000;
+const long timeoutTime = 2000; // idle time before a client is dropped
+const unsigned long wifiRetryTime = 5000; // between reconnect attempts
+unsigned long wifiRetryAt = 0;
 WiFiServer server(8080);
 
+// The heartbeat PUT on a non-blocking socket, moved on a step per pass like
+// the client connections so a dead controller can't stall them
+enum HeartbeatState { HB_IDLE, HB_CONNECTING, HB_WAITING };
+struct Heartbeat {
+  HeartbeatState state;
+  int fd;
+  unsigned long deadline;
+};
+Heartbeat heartbeat = {HB_IDLE, -1, 0};
+const unsigned long heartbeatTimeout = 2000; // connect and response together
+
+// Open client connections, each with its own parser and idle deadline.
+// Clients beyond this wait in the listen backlog.
+const int MAX_CLIENTS = 8;
+struct Connection {
+  bool active;
+  WiFiClient client;
+  HttpParser parser;
+  unsigned long deadline;
+};
+Connection connections[MAX_CLIENTS];
+
 Servo myservo = Servo();
 int servoPin = 10; // D9
 int servoPos = 0;
+int servoTarget = 0;
+unsigned long servoLastStep = 0;
+const unsigned long servoStepTime = 10; // ms per degree
 const int MAX_SERVO_POS = 100;
 
 void setup() {
@@ -50,124 +79,245 @@ void setup() {
   server.begin();
 }
 
+void endHeartbeat() {
+  close(heartbeat.fd);
+  heartbeat.fd = -1;
+  heartbeat.state = HB_IDLE;
+}
+
+// Starts connecting, connect() returns before the handshake is done
+void startHeartbeat() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    Serial.printf("Heartbeat Error code: %d\n", errno);
+    return;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(8080);
+  addr.sin_addr.s_addr = (uint32_t)WiFi.gatewayIP();
+  heartbeat.fd = fd;
+  heartbeat.deadline = millis() + heartbeatTimeout;
+  heartbeat.state = HB_CONNECTING;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+    Serial.printf("Heartbeat Error code: %d\n", errno);
+    endHeartbeat();
+  }
+}
+
+// Sends the request once the connection is up
+void heartbeatConnecting() {
+  fd_set writable;
+  FD_ZERO(&writable);
+  FD_SET(heartbeat.fd, &writable);
+  struct timeval now = {0, 0};
+  if (select(heartbeat.fd + 1, NULL, &writable, NULL, &now) <= 0) {
+    return;
+  }
+
+  int err = 0;
+  socklen_t len = sizeof(err);
+  getsockopt(heartbeat.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+  if (err != 0) {
+    Serial.printf("Heartbeat Error code: %d\n", err);
+    endHeartbeat();
+    return;
+  }
+
+  const char *payload = "{\"device-type\":\"REAR_CAMERA\"}";
+  char request[256];
+  int n = snprintf(request, sizeof(request),
+                   "PUT /api/v1/device/rear-camera HTTP/1.1\r\n"
+                   "Host: %s:8080\r\n"
+                   "Content-Type: application/json\r\n"
+                   "Content-Length: %d\r\n"
+                   "Connection: close\r\n"
+                   "\r\n"
+                   "%s",
+                   WiFi.gatewayIP().toString().c_str(), (int)strlen(payload), payload);
+  // Far smaller than the socket's send buffer, so it goes in one call
+  if (send(heartbeat.fd, request, n, 0) != n) {
+    Serial.printf("Heartbeat Error code: %d\n", errno);
+    endHeartbeat();
+    return;
+  }
+  heartbeat.state = HB_WAITING;
+}
+
+// Any answer will do, the controller only counts that we called
+void heartbeatWaiting() {
+  char buf[64];
+  int n = recv(heartbeat.fd, buf, sizeof(buf), 0);
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return;
+  }
+  if (n <= 0) {
+    Serial.printf("Heartbeat Error code: %d\n", n < 0 ? errno : 0);
+  }
+  endHeartbeat();
+}
+
 // Sends a heartbeat to the api server periodically
 void handleHeartbeat() {
-  unsigned long currentMillis = millis();
-  if (currentMillis - heartbeatLastSent >= heartbeatInterval) {
-    heartbeatLastSent = currentMillis;
-    
-    HTTPClient http;
-    http.begin("http://"+WiFi.gatewayIP().toString() + ":8080/api/v1/device/rear-camera");
-    http.addHeader("Content-Type", "application/json");
-
-    String payload = "{\"device-type\":\"REAR_CAMERA\"}";
-
-    int httpResponseCode = http.PUT(payload); // Or http.POST() for POST requests
-
-    if (httpResponseCode > 0) {
-      // Serial.printf("HTTP Response code: %d\n", httpResponseCode);
-      String payload = http.getString();
-      // Serial.println(payload);
-    } else {
-      Serial.printf("Heartbeat Error code: %d\n", httpResponseCode);
-    }
-    http.end(); // Free resources
+  switch (heartbeat.state) {
+    case HB_IDLE:
+      if (millis() - heartbeatLastSent >= heartbeatInterval) {
+        heartbeatLastSent = millis();
+        startHeartbeat();
+      }
+      return;
+    case HB_CONNECTING:
+      heartbeatConnecting();
+      break;
+    case HB_WAITING:
+      heartbeatWaiting();
+      break;
+  }
+
+  if (heartbeat.state != HB_IDLE && (long)(millis() - heartbeat.deadline) >= 0) {
+    Serial.println("Heartbeat timed out.");
+    endHeartbeat();
   }
 }
 
-void moveServoSlowlyTo(int pos) {
-  while (servoPos != pos) {
-    if (servoPos < pos) {
-      servoPos += 1;
-    } if (servoPos > pos) {
-      servoPos -= 1;
+// Walks the servo one degree towards its target when a step is due
+void updateServo() {
+  if (servoPos == servoTarget || millis() - servoLastStep < servoStepTime) {
+    return;
+  }
+  servoLastStep = millis();
+  servoPos += (servoPos < servoTarget) ? 1 : -1;
+  myservo.write(servoPin, servoPos);
+}
+
+// Writes a complete response with a single client.write
+void sendResponse(WiFiClient &client, int status, const char *reason, const char *body) {
+  char response[192];
+  int n = snprintf(response, sizeof(response),
+                   "HTTP/1.1 %d %s\r\n"
+                   "Content-type:application/json\r\n"
+                   "Connection: close\r\n"
+                   "\r\n"
+                   "%s\n",
+                   status, reason, body);
+  client.write((const uint8_t *)response, min(n, (int)sizeof(response) - 1));
+}
+
+// Reason phrases for the statuses HttpParser fails with
+const char *errorReason(int status) {
+  switch (status) {
+    case 413:
+      return "Content Too Large";
+    case 414:
+      return "URI Too Long";
+    case 431:
+      return "Request Header Fields Too Large";
+    default:
+      return "Bad Request";
+  }
+}
+
+void routeRequest(Connection &conn) {
+  const char *method = conn.parser.method();
+  const char *path = conn.parser.path();
+  Serial.printf("%s %s\n", method, path);
+
+  if (strcmp(method, "POST") == 0 && strcmp(path, "/api/v1/action/move") == 0) {
+    // Naively convert the body to an int
+    int position = atoi(conn.parser.body());
+    if (position > MAX_SERVO_POS) {
+      char body[48];
+      snprintf(body, sizeof(body), "{\"status\": \"max servo position is %i\"}", MAX_SERVO_POS);
+      sendResponse(conn.client, 500, "Internal Server Error", body);
+      return;
     }
-    myservo.write(servoPin, servoPos);
-    delay(10);
+    // The servo gets there from loop(), the client doesn't wait for it
+    servoTarget = position;
   }
+
+  sendResponse(conn.client, 200, "OK", "{\"status\": \"ok\"}");
 }
 
-void handleHTTPRequests() {
-  WiFiClient client = server.available();
-  if (!client) {
+void closeConnection(Connection &conn) {
+  conn.client.stop();
+  conn.active = false;
+}
+
+// Takes at most one new client per pass, and only if there is a free slot
+void acceptClient() {
+  for (int i = 0; i < MAX_CLIENTS; i++) {
+    if (connections[i].active) {
+      continue;
+    }
+    WiFiClient client = server.available();
+    if (!client) {
+      return;
+    }
+    Connection &conn = connections[i];
+    conn.client = client;
+    conn.parser.reset();
+    conn.deadline = millis() + timeoutTime;
+    conn.active = true;
     return;
   }
+}
 
-  unsigned long currentTime = millis();
-  unsigned long startTime = currentTime;
-  Serial.println("New Client.");          // print a message out in the serial port
-  String currentLine = "";                // make a String to hold incoming data from the client
-  String header = "";
-
-  while (client.connected() && currentTime - startTime <= timeoutTime) {  // loop while the client's connected
-    currentTime = millis();
-    if (client.available()) {             // if there's bytes to read from the client,
-      char c = client.read();             // read a byte, then
-      Serial.write(c);                    // print it out the serial monitor
-      header += c;
-      if (c == '\n') {                    // if the byte is a newline character
-        // if the current line is blank, you got two newline characters in a row.
-        // that's the end of the client HTTP request, so send a response:
-        if (currentLine.length() == 0) {
-
-          // We are now past the headers and ready to read the body
-          String body = "";
-          while(client.available())
-          {
-            body += (char)client.read();
-          }
-
-          // Naively convert the body to an int
-          int position = atoi(body.c_str());
-
-          // Basic routing
-          if (header.indexOf("POST /api/v1/action/move") >= 0) {
-            if (position > MAX_SERVO_POS) {
-              client.println("HTTP/1.1 500 Internal Server Error");
-              client.println("Content-type:application/json");
-              client.println("Connection: close");
-              client.println();
-              client.printf("{\"status\": \"max servo position is %i\"}\n", MAX_SERVO_POS);
-              break;
-            }
-            moveServoSlowlyTo(position);
-          }
-
-          // HTTP headers always start with a response code (e.g. HTTP/1.1 200 OK)
-          // and a content-type so the client knows what's coming, then a blank line:
-          client.println("HTTP/1.1 200 OK");
-          client.println("Content-type:application/json");
-          client.println("Connection: close");
-          client.println();
-          client.println("{\"status\": \"ok\"}");
-          
-          break;
-        } else { // if you got a newline, then clear currentLine
-          currentLine = "";
-        }
-      } else if (c != '\r') {  // if you got anything else but a carriage return character,
-        currentLine += c;      // add it to the end of the currentLine
-      }
+// At most one read per connection per pass, so a chatty client can't hog the loop
+void serviceConnection(Connection &conn) {
+  int available = conn.client.available();
+  if (available <= 0) {
+    if (!conn.client.connected()) {
+      closeConnection(conn);
+    } else if ((long)(millis() - conn.deadline) >= 0) {
+      Serial.println("Client timed out.");
+      sendResponse(conn.client, 408, "Request Timeout", "{\"status\": \"timeout\"}");
+      closeConnection(conn);
     }
+    return;
   }
 
-  // Close the connection
-  client.stop();
-  Serial.println("Client disconnected.");
-  Serial.println("");
+  // Read straight into the parser's buffer, as much as fits
+  HttpParser &parser = conn.parser;
+  size_t n = conn.client.read(parser.writePtr(), min((size_t)available, parser.writeSpace()));
+  conn.deadline = millis() + timeoutTime;
+
+  HttpParser::Result result = parser.commit(n);
+  if (result == HttpParser::NeedMore) {
+    return;
+  }
+
+  if (result == HttpParser::Failed) {
+    Serial.printf("Rejected request with %d\n", parser.errorStatus());
+    sendResponse(conn.client, parser.errorStatus(), errorReason(parser.errorStatus()), "{\"status\": \"bad request\"}");
+  } else {
+    routeRequest(conn);
+  }
+  closeConnection(conn);
+}
+
+void handleHTTPRequests() {
+  acceptClient();
+  for (int i = 0; i < MAX_CLIENTS; i++) {
+    if (connections[i].active) {
+      serviceConnection(connections[i]);
+    }
+  }
 }
 
 void loop() {
-  // Only continue this loop if we are connected to the wifi
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("WiFi Disconnected. Attempting to reconnect...");
-    uint8_t status = WiFi.begin(SECRET_SSID, SECRET_PASS); // Attempt to reconnect
+  updateServo();
 
-    if (status != WL_CONNECTED) {
-      Serial.println("Unable to connect. Waiting 5 seconds before attempting to reconnect...");
-      delay(5000);
-      return;
+  // Only continue this loop if we are connected to the wifi. WiFi.begin()
+  // just starts connecting, later passes check whether it got there.
+  if (WiFi.status() != WL_CONNECTED) {
+    if ((long)(millis() - wifiRetryAt) >= 0) {
+      Serial.println("WiFi Disconnected. Attempting to reconnect...");
+      WiFi.begin(SECRET_SSID, SECRET_PASS);
+      wifiRetryAt = millis() + wifiRetryTime;
     }
+    return;
   }
 
   handleHeartbeat();
@@ -0,0 +1,106 @@
+#include "allocStats.h"
+#include <esp_rom_sys.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+AllocRegion *AllocRegion::first = nullptr;
+
+AllocRegion::AllocRegion(const char *name, bool noAlloc) : name(name), noAlloc(noAlloc), next(first)
+{
+  first = this;
+}
+
+AllocRegion allocOther("other");
+AllocRegion allocNvs("nvs");
+std::atomic<uint32_t> allocViolations{0};
+
+// Per task, in the task's own storage
+static thread_local AllocRegion *current = nullptr;
+
+AllocScope::AllocScope(AllocRegion &region) : previous(current)
+{
+  current = &region;
+}
+
+AllocScope::~AllocScope()
+{
+  current = previous;
+}
+
+static void count(size_t size)
+{
+  // Static constructors allocate before there are tasks to have regions
+  AllocRegion *region = &allocOther;
+  if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED && !xPortInIsrContext() && current)
+  {
+    region = current;
+  }
+  region->allocs.fetch_add(1, std::memory_order_relaxed);
+  region->bytes.fetch_add(size, std::memory_order_relaxed);
+  if (region->noAlloc)
+  {
+    allocViolations.fetch_add(1, std::memory_order_relaxed);
+#if ALLOC_STRICT
+    // The ROM printf, Serial could allocate again
+    esp_rom_printf("allocation of %u bytes in no-allocation region %s\n", (unsigned)size, region->name);
+    abort();
+#endif
+  }
+}
+
+extern "C"
+{
+  void *__real_malloc(size_t size);
+  void *__real_calloc(size_t n, size_t size);
+  void *__real_realloc(void *ptr, size_t size);
+
+  void *__wrap_malloc(size_t size)
+  {
+    count(size);
+    return __real_malloc(size);
+  }
+
+  void *__wrap_calloc(size_t n, size_t size)
+  {
+    count(n * size);
+    return __real_calloc(n, size);
+  }
+
+  // Every growth of a String is one, whether or not the block moves
+  void *__wrap_realloc(void *ptr, size_t size)
+  {
+    if (size > 0)
+    {
+      count(size);
+    }
+    return __real_realloc(ptr, size);
+  }
+}
+
+int stackFree(const char *task)
+{
+  TaskHandle_t handle = xTaskGetHandle(task);
+  // The IDF counts stacks in bytes
+  return handle ? (int)uxTaskGetStackHighWaterMark(handle) : -1;
+}
+
+void allocReport(Print &out, const char *const *tasks, size_t taskCount)
+{
+  // Print::printf allocates for lines over 64 bytes, these stay shorter
+  out.printf("heap free %u min %u largest %u\n", (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap(),
+             (unsigned)ESP.getMaxAllocHeap());
+  for (size_t i = 0; i < taskCount; i++)
+  {
+    int left = stackFree(tasks[i]);
+    if (left >= 0)
+    {
+      out.printf("stack %s free %d\n", tasks[i], left);
+    }
+  }
+  for (AllocRegion *r = AllocRegion::first; r; r = r->next)
+  {
+    out.printf("alloc %s %u %u%s\n", r->name, (unsigned)r->allocs.load(std::memory_order_relaxed),
+               (unsigned)r->bytes.load(std::memory_order_relaxed), r->noAlloc ? " no-alloc" : "");
+  }
+  out.printf("alloc violations %u\n", (unsigned)allocViolations.load(std::memory_order_relaxed));
+}
@@ -0,0 +1,66 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+// Heap allocations counted by the code region they come from, to see what
+// String, std::function and friends cost over days of uptime. Shared by the
+// ESP-NOW controllers and rear-camera-pio through lib_extra_dirs.
+//
+// malloc, calloc and realloc are wrapped at link time (-Wl,--wrap in
+// platformio.ini), so everything that goes through them is counted: new,
+// String, the Arduino core, IDF code calling malloc(). Allocations the IDF
+// makes with heap_caps_malloc() directly, the WiFi driver's for one, are not.
+//
+// AllocScope makes a region the task's current one until the scope ends.
+// Scopes nest and the innermost counts, allocations outside every scope go
+// to allocOther. A region made with noAlloc is a path that must not
+// allocate at all: an allocation there counts as a violation, and with
+// -D ALLOC_STRICT=1 aborts, so the panic's backtrace shows who did it.
+
+#include <Arduino.h>
+#include <atomic>
+
+#ifndef ALLOC_STRICT
+#define ALLOC_STRICT 0
+#endif
+
+class AllocRegion
+{
+public:
+  // Regions are globals, registered as they are constructed
+  AllocRegion(const char *name, bool noAlloc = false);
+
+  const char *const name;
+  const bool noAlloc;
+  std::atomic<uint32_t> allocs{0};
+  std::atomic<uint32_t> bytes{0};
+
+  // Every region, the last constructed first
+  static AllocRegion *first;
+  AllocRegion *const next;
+};
+
+class AllocScope
+{
+public:
+  explicit AllocScope(AllocRegion &region);
+  ~AllocScope();
+
+private:
+  AllocRegion *previous;
+};
+
+extern AllocRegion allocOther;
+// Preferences, opening NVS allocates
+extern AllocRegion allocNvs;
+// Allocations in noAlloc regions since boot
+extern std::atomic<uint32_t> allocViolations;
+
+// Least free stack the task has had, in bytes, -1 if there's no task of
+// that name
+int stackFree(const char *task);
+
+// Free, lowest and largest free block of the heap, the stacks of tasks and
+// every region, a line each. Doesn't allocate.
+void allocReport(Print &out, const char *const *tasks, size_t taskCount);
+
+#endif